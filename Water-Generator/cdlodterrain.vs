@@ -0,0 +1,65 @@
+#version 330 core
+// CDLOD terrain: one shared grid patch, instanced per selected quadtree node and displaced
+// from the height texture. Output matches noiseshader.vs so noiseshader.fs colours it.
+
+layout (location = 0) in vec2 aGrid;    // Patch vertex in grid units, 0..u_patchResolution
+layout (location = 1) in vec4 aNode;    // Per instance: world x/z of the node corner, size of a whole node at its level, level
+
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D u_heightmap;  // One texel per terrain vertex, R32F or normalised R16
+uniform float u_heightScale;    // height = texel * scale + offset
+uniform float u_heightOffset;
+uniform vec2 u_terrainOrigin;   // World x/z of texel (0, 0)
+uniform vec2 u_terrainSize;     // Vertices in x and z
+uniform float u_gridSpacing;    // World units between vertices (coarse previews use more than 1)
+uniform float u_patchResolution;
+uniform vec3 u_cameraPos;
+uniform float u_morphStart[16]; // Per level distance band where vertices slide to the coarser grid
+uniform float u_morphEnd[16];
+
+uniform float seaLevel;
+
+out vec3 position;
+out vec3 normal;
+
+float terrainHeight(vec2 xz)
+{
+    vec2 uv = ((xz - u_terrainOrigin) / u_gridSpacing + 0.5) / u_terrainSize;
+    return textureLod(u_heightmap, uv, 0.0).r * u_heightScale + u_heightOffset;
+}
+
+// Central differences over one texel
+vec3 terrainNormal(vec2 xz)
+{
+    float left = terrainHeight(xz - vec2(u_gridSpacing, 0.0));
+    float right = terrainHeight(xz + vec2(u_gridSpacing, 0.0));
+    float down = terrainHeight(xz - vec2(0.0, u_gridSpacing));
+    float up = terrainHeight(xz + vec2(0.0, u_gridSpacing));
+    return normalize(vec3(left - right, 2.0 * u_gridSpacing, down - up));
+}
+
+// Nodes can overhang the terrain edge; those vertices collapse onto it
+vec2 clampToTerrain(vec2 xz)
+{
+    return clamp(xz, u_terrainOrigin, u_terrainOrigin + (u_terrainSize - 1.0) * u_gridSpacing);
+}
+
+void main()
+{
+    int level = int(aNode.w);
+    float cellSize = aNode.z / u_patchResolution;
+    vec2 xz = clampToTerrain(aNode.xy + aGrid * cellSize);
+
+    float distanceToCamera = distance(u_cameraPos, vec3(xz.x, terrainHeight(xz), xz.y));
+    float morph = clamp((distanceToCamera - u_morphStart[level]) / max(u_morphEnd[level] - u_morphStart[level], 1e-3), 0.0, 1.0);
+
+    // Odd grid lines slide onto their even neighbour, turning the patch into the parent's grid
+    vec2 oddLines = fract(aGrid * 0.5) * 2.0;
+    xz = clampToTerrain(xz - oddLines * cellSize * morph);
+
+    position = vec3(xz.x, terrainHeight(xz), xz.y);
+    normal = terrainNormal(xz);
+    gl_Position = projection * view * vec4(position, 1.0);
+}
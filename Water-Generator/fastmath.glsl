@@ -0,0 +1,60 @@
+// GLSL twin of include/fast_math.h: exp(sin(x)) and cos(x) for the wave sum.
+// WAVE_MATH_TIER is injected per shader permutation:
+//   0 reference builtins, 1 precise (~1e-6), 2 balanced (~1e-4), 3 fast (~2e-2)
+#ifndef WAVE_MATH_TIER
+#define WAVE_MATH_TIER 0
+#endif
+
+#if WAVE_MATH_TIER == 0
+
+void waveExpSinCos(float x, out float expSin, out float cosine)
+{
+    expSin = exp(sin(x));
+    cosine = cos(x);
+}
+
+#else
+
+#if WAVE_MATH_TIER == 1
+float sinPoly(float r2) { return 9.999999968e-01 + r2 * (-1.666665022e-01 + r2 * (8.332016453e-03 + r2 * -1.950182201e-04)); }
+float cosPoly(float r2) { return 1.0 + r2 * (-4.999999962e-01 + r2 * (4.166661674e-02 + r2 * (-1.388661921e-03 + r2 * 2.437992938e-05))); }
+float expPoly(float s)
+{
+    return 9.999998808e-01 + s * (1.000001054e+00 + s * (5.000048572e-01 + s * (1.666582514e-01
+        + s * (4.163906772e-02 + s * (8.348694879e-03 + s * (1.436537383e-03 + s * 1.929712777e-04))))));
+}
+#elif WAVE_MATH_TIER == 2
+float sinPoly(float r2) { return 9.999984929e-01 + r2 * (-1.666238231e-01 + r2 * 8.150056554e-03); }
+float cosPoly(float r2) { return 9.999900350e-01 + r2 * (-4.997081404e-01 + r2 * 4.039853597e-02); }
+float expPoly(float s)
+{
+    return 1.000027568e+00 + s * (9.998369595e-01 + s * (4.993418549e-01 + s * (1.672742590e-01
+        + s * (4.364625879e-02 + s * 8.040507473e-03))));
+}
+#else
+float sinPoly(float r2) { return 9.995915742e-01 + r2 * -1.615350993e-01; }
+float cosPoly(float r2) { return 9.980784990e-01 + r2 * -4.748206018e-01; }
+float expPoly(float s) { return 9.965096228e-01 + s * (1.010803612e+00 + s * (5.388496161e-01 + s * 1.585170116e-01)); }
+#endif
+
+void waveExpSinCos(float x, out float expSin, out float cosine)
+{
+    // Reduce to r in [-pi/4, pi/4] around the nearest multiple of pi/2
+    float q = floor(x * 0.636619772 + 0.5);
+    float r = ((x - q * 1.5703125) - q * 4.837512969970703125e-4) - q * 7.54978995489188216e-8;
+    float quadrant = mod(q, 4.0);
+
+    float r2 = r * r;
+    float sinR = r * sinPoly(r2);
+    float cosR = cosPoly(r2);
+
+    // sin(x) = sinR, cosR, -sinR, -cosR and cos(x) = cosR, -sinR, -cosR, sinR by quadrant
+    bool odd = quadrant == 1.0 || quadrant == 3.0;
+    float s = (odd ? cosR : sinR) * (quadrant >= 2.0 ? -1.0 : 1.0);
+    float c = (odd ? sinR : cosR) * (quadrant == 1.0 || quadrant == 2.0 ? -1.0 : 1.0);
+
+    expSin = expPoly(s);
+    cosine = c;
+}
+
+#endif
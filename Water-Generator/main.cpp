@@ -16,7 +16,20 @@
 #include <math.h>
 #include <math.h>
 #include "noise.h"
+#include "water_sim.h"
+#include "sea_waves.h"
+#include "fast_math.h"
+#include "tiled_plane.h"
+#include "terrain_streaming.h"
+#include "tile_codec.h"
+#include "cdlod_terrain.h"
+#include "terrain_compute.h"
+#include "progressive_terrain.h"
+#include "vegetation_renderer.h"
+#include "sea_trim.h"
+#include "shore_map.h"
 #include <vector>
+#include <chrono>
 
 // Callback to resize the viewport
 void framebuffer_size_callback(GLFWwindow* window, int width, int length) {
@@ -110,6 +123,59 @@ void updateSeaLevel(std::vector<Vertex>& vertices, float seaLevel, GLuint VAO, G
     glBindVertexArray(0);
 }
 
+// Transform feedback target holding the displaced sea vertices for the current frame.
+// Its layout matches Vertex (position, normal), so the plane's index buffer can draw it directly.
+struct SeaCapture {
+    GLuint buffer;
+    GLuint VAO;
+    GLuint texture; // Buffer texture view of `buffer` for shaders that fetch vertices by index
+    GLsizei vertexCount;
+};
+
+SeaCapture createSeaCapture(GLuint planeVAO, GLsizei vertexCount) {
+    SeaCapture capture;
+    capture.vertexCount = vertexCount;
+
+    glGenBuffers(1, &capture.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, capture.buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), nullptr, GL_DYNAMIC_COPY);
+
+    // Reuse the plane's element buffer
+    GLint planeEBO;
+    glBindVertexArray(planeVAO);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &planeEBO);
+
+    glGenVertexArrays(1, &capture.VAO);
+    glBindVertexArray(capture.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, capture.buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, planeEBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+
+    glGenTextures(1, &capture.texture);
+    glBindTexture(GL_TEXTURE_BUFFER, capture.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, capture.buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return capture;
+}
+
+// Run the bound capture program over every plane vertex once, writing into the capture buffer
+void captureSeaVertices(const SeaCapture& capture, GLuint planeVAO) {
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, capture.buffer);
+    glBindVertexArray(planeVAO);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, capture.vertexCount);
+    glEndTransformFeedback();
+    glBindVertexArray(0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
 // Light source sphere generation
 struct LightSource {
     glm::vec3 position;
@@ -229,7 +295,8 @@ int scale = 50;
 float lengthScale = 10.0f;
 float lacunarity = 2.0f;
 float seaLevel = -10.0f;
-bool renderingMode = true;
+bool renderingMode = false; // Toggles the debug normals (u_showNormals)
+int normalStride = 4;
 float testVar = 0.5;
 glm::vec3 lightDir = glm::vec3(0.5, 0.5, testVar);
 
@@ -241,6 +308,399 @@ float waveSpeed = 1.0f;    // median value
 int waveCount = 4;
 float u_time;
 
+// Interactive ripple variables
+bool ripplesEnabled = true;
+float rippleStrength = 1.5f;
+float rippleRadius = 3.0f;
+WaterSimulation* waterSim = nullptr;
+
+// Transform feedback variables
+bool seaCaptureEnabled = false;
+bool validateSeaCaptureRequested = false;
+SeaWaveError lastSeaCaptureError;
+bool hasSeaCaptureError = false;
+
+// Wave math accuracy tier (shader permutation), see fast_math.h
+int waveMathTier = WAVE_MATH_REFERENCE;
+bool waveMathReportRequested = false;
+
+// Terrain noise benchmark, see perlin_batch.h
+bool noiseBenchmarkRequested = false;
+// Analytic noise derivative accuracy and timings, see perlin_batch.h
+bool noiseDerivativeReportRequested = false;
+// Smoothing kernel timings, see smoothing.h
+bool smoothingReportRequested = false;
+// Row-major vs tiled terrain layout timings, see tiled_plane.h
+bool tiledLayoutReportRequested = false;
+bool tiledLayoutReportLarge = false;    // Also 16384^2, which needs about 7.5 GB
+// Terrain tile compression ratio and decode speed, see tile_codec.h
+bool tileCodecReportRequested = false;
+// Hydrology timings and thread scaling at 4096^2, see hydrology.h
+bool hydrologyReportRequested = false;
+
+// Chunked terrain generated around the camera, see terrain_streaming.h
+bool infiniteTerrainEnabled = false;
+TerrainStreamer* terrainStreamer = nullptr;
+
+// Heightfield terrain drawn with quadtree LOD, see cdlod_terrain.h
+bool terrainVisible = true;
+bool terrainLighting = false;   // Diffuse scene light through the terrain normals; off draws the unlit colours
+bool terrainRegenerateRequested = false;
+int terrainResolution = 1025; // Vertices per side
+float terrainSeed = 1.0f;
+CdlodTerrain* cdlodTerrain = nullptr;
+Heightfield terrainHeightfield;
+
+// Height texture (CDLOD or every node at full detail) vs the per-vertex xyz buffer, see terrain_gpu.h
+enum TerrainPath { TERRAIN_PATH_CDLOD, TERRAIN_PATH_DISPLACED_GRID, TERRAIN_PATH_VERTEX_BUFFER };
+int terrainPath = TERRAIN_PATH_CDLOD;
+VertexBufferTerrain* vertexBufferTerrain = nullptr;
+bool terrainBrushRequested = false;
+bool terrainPathReportRequested = false;
+
+// Compute shader generation straight into the CDLOD height texture, see terrain_compute.h.
+// Needs a GL 4.3 context; otherwise (or for R16 heights) the CPU generator is used.
+TerrainComputeGenerator* terrainCompute = nullptr;
+bool gpuTerrainGeneration = true;
+bool lastTerrainOnGpu = false;
+double lastTerrainMilliseconds = 0.0;
+
+// CPU generation runs coarse-to-fine in the background, see progressive_terrain.h. The renderer
+// shows the finest level finished so far (terrainPreviewStep: 8, 4, 2 or 1).
+ProgressiveTerrainGenerator* progressiveTerrain = nullptr;
+int terrainPreviewStep = 0;
+
+// Late-stage settings; editing only these reuses the cached noise, see terrain_pipeline.h
+FalloffSettings terrainFalloff;
+SmoothingSettings terrainSmoothing;
+ErosionSettings terrainErosion; // CPU only, see erosion.h
+
+// Coastline for the falloff, see island_mask.h. Shapes other than the rectangle are CPU only.
+// The painted mask is copied on every stroke so a request in flight keeps its own snapshot.
+IslandMaskSettings terrainIsland;
+bool islandPaintRequested = false;
+bool islandPaintLand = true;
+float islandBrushRadius = 40.0f;
+bool islandPolygonPointRequested = false;
+
+// Depression filling, flow routing and river/lake carving, see hydrology.h. CPU only; the flow
+// map goes to the terrain shaders on texture unit 4 and is recomputed when the sea level moves.
+HydrologySettings terrainHydrology;
+HydrologyTexture* hydrologyTexture = nullptr;
+
+// Poisson-disk trees, bushes and rocks drawn instanced per chunk, see scatter.h. CPU only; scale
+// and draw distance apply straight away, everything else scatters again in the background.
+ScatterSettings terrainScatter;
+VegetationRenderer* vegetationRenderer = nullptr;
+bool vegetationVisible = true;
+
+// Terrain under the lowest wave and sea under land are not drawn, see sea_trim.h. The sea tiles
+// are classified again when terrainRevision (bumped on every terrain change) or the band moves.
+SeaTrimSettings seaTrim;
+SeaPlaneTiles seaTiles;
+unsigned int terrainRevision = 0;
+
+// Water depth, coast distance and coast direction over the sea plane for the sea shader's foam
+// and shallow tint, see shore_map.h. Rebuilt with the terrain; edits and sea level moves only
+// recompute the texels they can reach.
+ShoreMapSettings shoreSettings;
+ShoreMap* shoreMap = nullptr;
+bool shoreMapRebuildRequested = false;
+
+// Coasts are drawn where the waves are on average
+float shoreWaterLevel() {
+    SeaWaveParams waveParams = { seaFrequency, seaAmplitude, waveSpeed };
+    return seaLevel + seaWaveMeanHeight(waveParams);
+}
+
+void rebuildShoreMap() {
+    glm::vec2 halfExtent(width / 2.0f, length / 2.0f);
+    shoreMap->build(terrainHeightfield, shoreWaterLevel(), -halfExtent, halfExtent, 1.0f, shoreSettings.range);
+}
+
+void showTerrain(Heightfield heightfield, const std::vector<uint32_t>& hydrology = {}, const ScatterInstances& scatter = ScatterInstances()) {
+    terrainHeightfield = std::move(heightfield);
+    cdlodTerrain->build(terrainHeightfield);
+    hydrologyTexture->upload(hydrology, terrainHeightfield);
+    vegetationRenderer->upload(scatter, terrainHeightfield);
+    vertexBufferTerrain->release(); // Rebuilt when that path is next drawn
+    terrainRevision++;
+    rebuildShoreMap();
+}
+
+void regenerateTerrain() {
+    const SmoothingSettings& smoothing = terrainSmoothing;
+    lastTerrainOnGpu = gpuTerrainGeneration && terrainCompute->canGenerate(smoothing) && !terrainErosion.hydraulic && !terrainErosion.thermal
+        && terrainIsland.shape == ISLAND_RECTANGLE && !terrainHydrology.enabled && !terrainScatter.enabled
+        && cdlodTerrain->settings.heightFormat == HeightmapTexture::HEIGHTMAP_R32F;
+    if (!lastTerrainOnGpu) {
+        TerrainRequest request;
+        request.width = request.height = terrainResolution;
+        request.scale = (float)scale;
+        request.seed = terrainSeed;
+        request.octaves = octaves;
+        request.falloff = terrainFalloff;
+        request.island = terrainIsland;
+        request.smoothing = smoothing;
+        request.erosion = terrainErosion;
+        request.hydrology = terrainHydrology;
+        request.hydrology.seaLevel = seaLevel;
+        request.scatter = terrainScatter;
+        request.scatter.seaLevel = seaLevel;
+        request.biomeTable = std::make_shared<const BiomeTable>(activeBiomeTable());
+        progressiveTerrain->request(request);
+        return;
+    }
+
+    // The CPU copy is read back for the LOD bounds and edits; nothing is uploaded
+    auto start = std::chrono::high_resolution_clock::now();
+    progressiveTerrain->cancel();
+    terrainCompute->generate(terrainResolution, terrainResolution, (float)scale, terrainSeed, octaves, smoothing,
+        terrainFalloff, activeBiomeTable(), cdlodTerrain->heights());
+    terrainHeightfield = terrainCompute->download(cdlodTerrain->heights());
+    cdlodTerrain->buildOnHeightmap(terrainHeightfield);
+    vertexBufferTerrain->release();
+    hydrologyTexture->release();
+    vegetationRenderer->clear();
+    terrainRevision++;
+    rebuildShoreMap();
+    terrainPreviewStep = 1;
+    lastTerrainMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Raises a round bump of the terrain under the camera and re-uploads only the dirty rectangle
+void raiseTerrainAt(const glm::vec3& position, float radius, float amount) {
+    // In vertices of the current (possibly preview) grid
+    float spacing = terrainHeightfield.spacing();
+    radius /= spacing;
+    int centerX = (int)std::floor((position.x - terrainHeightfield.worldX(0)) / spacing + 0.5f);
+    int centerZ = (int)std::floor((position.z - terrainHeightfield.worldZ(0)) / spacing + 0.5f);
+    int x0 = std::max(centerX - (int)radius, 0), x1 = std::min(centerX + (int)radius, terrainHeightfield.width() - 1);
+    int z0 = std::max(centerZ - (int)radius, 0), z1 = std::min(centerZ + (int)radius, terrainHeightfield.height() - 1);
+    if (x0 > x1 || z0 > z1) return;
+
+    std::vector<float>& heights = terrainHeightfield.heightPlane();
+    for (int z = z0; z <= z1; z++)
+        for (int x = x0; x <= x1; x++) {
+            float distance = glm::length(glm::vec2((float)(x - centerX), (float)(z - centerZ))) / radius;
+            if (distance < 1.0f) heights[(size_t)z * terrainHeightfield.width() + x] += amount * (1.0f - distance * distance);
+        }
+    cdlodTerrain->updateRegion(terrainHeightfield, x0, z0, x1 - x0 + 1, z1 - z0 + 1);
+    vertexBufferTerrain->updateRegion(terrainHeightfield, x0, z0, x1 - x0 + 1, z1 - z0 + 1);
+    shoreMap->updateTerrain(terrainHeightfield, glm::vec2(terrainHeightfield.worldX(x0), terrainHeightfield.worldZ(z0)),
+        glm::vec2(terrainHeightfield.worldX(x1), terrainHeightfield.worldZ(z1)));
+    terrainRevision++;
+}
+
+// Camera position in map coordinates (0-1 over each axis of the terrain)
+glm::vec2 terrainMapPosition(const glm::vec3& position) {
+    float spacing = terrainHeightfield.spacing();
+    float extentX = std::max((terrainHeightfield.width() - 1) * spacing, 1.0f);
+    float extentZ = std::max((terrainHeightfield.height() - 1) * spacing, 1.0f);
+    return glm::vec2((position.x - terrainHeightfield.worldX(0)) / extentX, (position.z - terrainHeightfield.worldZ(0)) / extentZ);
+}
+
+// Paints land (or sea) into a copy of the island mask around the camera
+void paintIslandAt(const glm::vec3& position, float radius, bool land) {
+    const int resolution = 512;
+    std::shared_ptr<PaintedIslandMask> painted = terrainIsland.painted
+        ? std::make_shared<PaintedIslandMask>(*terrainIsland.painted) : std::make_shared<PaintedIslandMask>();
+    if (painted->width != resolution || painted->height != resolution) {
+        painted->width = painted->height = resolution;
+        painted->land.assign((size_t)resolution * resolution, 0);
+    }
+    glm::vec2 centre = terrainMapPosition(position) * (float)resolution;
+    float texelRadius = radius / std::max(terrainHeightfield.width() * terrainHeightfield.spacing(), 1.0f) * resolution;
+    for (int z = std::max((int)(centre.y - texelRadius), 0); z <= std::min((int)(centre.y + texelRadius), resolution - 1); z++)
+        for (int x = std::max((int)(centre.x - texelRadius), 0); x <= std::min((int)(centre.x + texelRadius), resolution - 1); x++)
+            if (glm::length(glm::vec2(x + 0.5f, z + 0.5f) - centre) <= texelRadius)
+                painted->land[(size_t)z * resolution + x] = land ? 1 : 0;
+    terrainIsland.painted = painted;
+    terrainIsland.paintedRevision++;
+}
+
+// Where the sea surface can be with the current waves; disabled when trimming is off
+SeaBand currentSeaBand() {
+    if (!seaTrim.enabled) return SeaBand();
+    SeaWaveParams waveParams = { seaFrequency, seaAmplitude, waveSpeed };
+    glm::vec2 halfExtent(width / 2.0f, length / 2.0f);
+    return SeaBand::fromWaves(-halfExtent, halfExtent, seaLevel, waveParams, ripplesEnabled ? seaTrim.rippleMargin : 0.0f);
+}
+
+void drawTerrain(TerrainPath path, const Shader& cdlodShader, const Shader& noiseshader, const glm::mat4& view,
+    const glm::mat4& projection, const glm::vec3& cameraPos) {
+    if (path == TERRAIN_PATH_VERTEX_BUFFER) {
+        if (!vertexBufferTerrain->ready()) vertexBufferTerrain->upload(terrainHeightfield);
+        noiseshader.use();
+        noiseshader.setMat4("model", glm::mat4(1.0f));
+        noiseshader.setMat4("view", view);
+        noiseshader.setMat4("projection", projection);
+        noiseshader.setFloat("seaLevel", seaLevel);
+        hydrologyTexture->bind(noiseshader, 4);
+        vertexBufferTerrain->draw(currentSeaBand(), cameraPos.y);
+        return;
+    }
+    cdlodTerrain->settings.fullResolution = path == TERRAIN_PATH_DISPLACED_GRID;
+    cdlodTerrain->setSeaBand(currentSeaBand());
+    cdlodTerrain->select(cameraPos, projection * view);
+    cdlodShader.use();
+    cdlodShader.setMat4("view", view);
+    cdlodShader.setMat4("projection", projection);
+    cdlodShader.setFloat("seaLevel", seaLevel);
+    hydrologyTexture->bind(cdlodShader, 4);
+    cdlodTerrain->draw(cdlodShader, cameraPos);
+}
+
+// GPU time and memory of each terrain path for the current view. The vertex buffer path is
+// skipped above 16M vertices, where its buffers alone would approach a gigabyte.
+void runTerrainPathReport(const Shader& cdlodShader, const Shader& noiseshader, const glm::mat4& view,
+    const glm::mat4& projection, const glm::vec3& cameraPos) {
+    const int repeats = 10;
+    const char* names[] = { "CDLOD", "Displaced grid", "Vertex buffer" };
+    int previousPath = terrainPath;
+
+    GLuint query;
+    glGenQueries(1, &query);
+    std::cout << "Terrain path report (" << glGetString(GL_RENDERER) << "), " << terrainHeightfield.width() << "x"
+        << terrainHeightfield.height() << " vertices, "
+        << (cdlodTerrain->heights().format() == HeightmapTexture::HEIGHTMAP_R16 ? "R16" : "R32F") << " heights" << std::endl;
+    for (int path = 0; path < 3; path++) {
+        if (path == TERRAIN_PATH_VERTEX_BUFFER && terrainHeightfield.vertexCount() > (1u << 24)) {
+            std::cout << "  " << names[path] << ": skipped" << std::endl;
+            continue;
+        }
+        drawTerrain((TerrainPath)path, cdlodShader, noiseshader, view, projection, cameraPos); // Warm up, uploads lazily
+        glFinish();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < repeats; i++)
+            drawTerrain((TerrainPath)path, cdlodShader, noiseshader, view, projection, cameraPos);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+
+        size_t bytes = path == TERRAIN_PATH_VERTEX_BUFFER ? vertexBufferTerrain->gpuBytes() : cdlodTerrain->getStats().gpuBytes;
+        int triangles = path == TERRAIN_PATH_VERTEX_BUFFER ? vertexBufferTerrain->triangleCount() - vertexBufferTerrain->trimmedTriangles()
+            : cdlodTerrain->getStats().triangles;
+        std::cout << "  " << names[path] << ": " << nanoseconds / 1e6 / repeats << " ms/frame, " << triangles << " triangles, "
+            << bytes / (1024.0 * 1024.0) << " MB on the GPU" << std::endl;
+    }
+    glDeleteQueries(1, &query);
+    cdlodTerrain->settings.fullResolution = previousPath == TERRAIN_PATH_DISPLACED_GRID;
+}
+
+// Uniforms read by seashadernogs.vs, shared by the direct draw and the capture pass
+void setSeaWaveUniforms(const Shader& shader) {
+    shader.setMat4("model", glm::mat4(1.0f));
+    shader.setFloat("u_time", u_time);
+    shader.setFloat("seaLevel", seaLevel);
+    shader.setFloat("sea_frequency", seaFrequency);
+    shader.setFloat("wave_speed", waveSpeed);
+    shader.setFloat("sea_amplitude", seaAmplitude);
+    shader.setFloat("wave_count", waveCount);
+
+    // Ripple height texture on unit 1 (unit 0 is the skybox)
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, waterSim->texture);
+    glActiveTexture(GL_TEXTURE0);
+    shader.setInt("u_rippleMap", 1);
+    shader.setBool("u_ripplesEnabled", ripplesEnabled);
+    shader.setVec2("u_rippleOrigin", waterSim->origin);
+    shader.setFloat("u_rippleExtent", waterSim->extent);
+}
+
+// Time the capture pass of every wave math permutation on the current GL driver and compare
+// its output with the CPU reference (ripples excluded)
+void runWaveMathGpuReport(const std::vector<Shader>& captureTiers, const SeaCapture& capture, GLuint planeVAO,
+    const std::vector<Vertex>& planeVertices) {
+    const int repeats = 20;
+    SeaWaveParams waveParams = { seaFrequency, seaAmplitude, waveSpeed };
+    std::vector<Vertex> captured(capture.vertexCount);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    std::cout << "Wave math GPU report (" << glGetString(GL_RENDERER) << "), " << capture.vertexCount << " vertices" << std::endl;
+    for (int tier = 0; tier < (int)captureTiers.size(); tier++) {
+        captureTiers[tier].use();
+        setSeaWaveUniforms(captureTiers[tier]);
+        captureTiers[tier].setBool("u_ripplesEnabled", false);
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < repeats; i++)
+            captureSeaVertices(capture, planeVAO);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+
+        glBindBuffer(GL_ARRAY_BUFFER, capture.buffer);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, captured.size() * sizeof(Vertex), captured.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        SeaWaveError error = compareSeaWaves(&captured[0].x, 6, &planeVertices[0].x, 6, captured.size(), u_time, waveParams);
+
+        std::cout << "  " << waveMathTierName(tier) << ": " << nanoseconds / 1e6 / repeats << " ms/pass, max position error "
+            << error.maxPositionError << ", max normal error " << error.maxNormalError << std::endl;
+    }
+    glDeleteQueries(1, &query);
+}
+
+// Set when the biome table is edited so the terrain can be regenerated
+bool biomeTableChanged = false;
+
+void renderBiomeTableWindow() {
+    BiomeTable& table = activeBiomeTable();
+    bool changed = false;
+
+    ImGui::Begin("Biome Table");
+    for (size_t i = 0; i < table.biomes.size(); i++) {
+        BiomeDefinition& biome = table.biomes[i];
+        ImGui::PushID((int)i);
+        if (ImGui::TreeNode(biome.name.c_str())) {
+            int type = biome.type;
+            if (ImGui::Combo("Biome Map Type", &type, "Plains\0Hills\0Mountains\0Desert\0")) {
+                biome.type = (BiomeType)type;
+                changed = true;
+            }
+            changed |= ImGui::SliderFloat("Classify Below", &biome.classifyBelow, 0.0f, 1.0f);
+            if (ImGui::DragFloat3("Start/Peak/End", &biome.start, 0.005f, 0.0f, 1.0f)) {
+                // Keep the triangle well formed so calculateMembership never divides by zero
+                biome.peak = std::max(biome.peak, biome.start + 0.001f);
+                biome.end = std::max(biome.end, biome.peak + 0.001f);
+                changed = true;
+            }
+            changed |= ImGui::SliderFloat("Height Scale", &biome.params.heightScale, 0.0f, 200.0f);
+            changed |= ImGui::SliderFloat("Frequency", &biome.params.frequency, 0.1f, 4.0f);
+            changed |= ImGui::SliderFloat("Persistence", &biome.params.persistence, 0.1f, 0.9f);
+            changed |= ImGui::SliderFloat("Lacunarity", &biome.params.lacunarity, 1.0f, 4.0f);
+            if (ImGui::Button("Remove")) {
+                table.biomes.erase(table.biomes.begin() + i);
+                changed = true;
+                ImGui::TreePop();
+                ImGui::PopID();
+                break;
+            }
+            ImGui::TreePop();
+        }
+        ImGui::PopID();
+    }
+
+    if (ImGui::Button("Add Biome")) {
+        table.biomes.push_back({ "Biome " + std::to_string(table.biomes.size() + 1), PLAINS, 1.0f, 0.4f, 0.5f, 0.6f, table.fallback });
+        changed = true;
+    }
+    if (ImGui::TreeNode("Fallback (no membership)")) {
+        changed |= ImGui::SliderFloat("Height Scale", &table.fallback.heightScale, 0.0f, 200.0f);
+        changed |= ImGui::SliderFloat("Frequency", &table.fallback.frequency, 0.1f, 4.0f);
+        changed |= ImGui::SliderFloat("Persistence", &table.fallback.persistence, 0.1f, 0.9f);
+        changed |= ImGui::SliderFloat("Lacunarity", &table.fallback.lacunarity, 1.0f, 4.0f);
+        ImGui::TreePop();
+    }
+    ImGui::End();
+
+    if (changed) {
+        table.compile();
+        biomeTableChanged = true;
+    }
+}
+
 void renderImGuiMenu() {
     if (!isGuiOpen) return;  // Don't render if menu is closed
 
@@ -262,15 +722,284 @@ void renderImGuiMenu() {
     ImGui::SliderFloat("Wave Speed", &waveSpeed, 0.0f, 10.0f);
     ImGui::SliderInt("Wave Count", &waveCount, 1, 10);
     ImGui::SliderFloat("Light Dir", &testVar, -1.0, 1.0);
-    ImGui::Checkbox("Rendering Mode", &renderingMode);
+    ImGui::Checkbox("Show Normals", &renderingMode);
+    ImGui::SliderInt("Normal Stride", &normalStride, 1, 32);
+
+    ImGui::Checkbox("Capture Sea Vertices", &seaCaptureEnabled);
+    if (ImGui::Button("Validate Capture")) validateSeaCaptureRequested = true;
+    if (hasSeaCaptureError) {
+        ImGui::Text("GPU vs CPU max error: pos %.2e, normal %.2e", lastSeaCaptureError.maxPositionError, lastSeaCaptureError.maxNormalError);
+    }
+    ImGui::Combo("Wave Math", &waveMathTier, "Reference\0Precise\0Balanced\0Fast\0");
+    if (ImGui::Button("Wave Math Report")) waveMathReportRequested = true;
+    if (ImGui::Button("Noise Benchmark")) noiseBenchmarkRequested = true;
+    ImGui::SameLine();
+    if (ImGui::Button("Noise Derivative Report")) noiseDerivativeReportRequested = true;
+    ImGui::SameLine();
+    ImGui::Text("Perlin backend: %s", perlinBackendName(activePerlinBackend()));
+    if (ImGui::Button("Smoothing Report")) smoothingReportRequested = true;
+    ImGui::SameLine();
+    if (ImGui::Button("Tiled Layout Report")) tiledLayoutReportRequested = true;
+    ImGui::SameLine();
+    ImGui::Checkbox("16384^2 (7.5 GB)", &tiledLayoutReportLarge);
+    ImGui::SameLine();
+    if (ImGui::Button("Tile Codec Report")) tileCodecReportRequested = true;
+
+    ImGui::Checkbox("Show Terrain", &terrainVisible);
+    ImGui::SameLine();
+    ImGui::Checkbox("Terrain Lighting", &terrainLighting);
+    if (terrainVisible && cdlodTerrain) {
+        int sizeIndex = 0;
+        const int sizes[] = { 257, 513, 1025, 2049, 4097 };
+        while (sizeIndex < 4 && sizes[sizeIndex] < terrainResolution) sizeIndex++;
+        if (ImGui::Combo("Terrain Size", &sizeIndex, "257\0" "513\0" "1025\0" "2049\0" "4097\0")) {
+            terrainResolution = sizes[sizeIndex];
+            terrainRegenerateRequested = true;
+        }
+        // Both generators are fast enough to follow the sliders (the CPU one through its previews)
+        terrainRegenerateRequested |= ImGui::SliderFloat("Terrain Seed", &terrainSeed, 0.0f, 100.0f);
+        terrainRegenerateRequested |= ImGui::SliderInt("Terrain Scale", &scale, 10, 200);
+        terrainRegenerateRequested |= ImGui::SliderInt("Octaves", &octaves, 1, 8);
+        terrainRegenerateRequested |= ImGui::SliderInt("Falloff Border", &terrainFalloff.border, 0, 200);
+        terrainRegenerateRequested |= ImGui::SliderFloat("Falloff Edge Height", &terrainFalloff.edgeHeight, 0.0f, 1.0f);
+        int smoothingKernel = terrainSmoothing.kernel;
+        if (ImGui::Combo("Smoothing Kernel", &smoothingKernel, "Box (exact)\0Box\0Gaussian\0Bilateral\0")) {
+            terrainSmoothing.kernel = (SmoothingKernel)smoothingKernel;
+            terrainRegenerateRequested = true;
+        }
+        terrainRegenerateRequested |= ImGui::SliderInt("Smoothing Passes", &terrainSmoothing.passes, 0, 8);
+        if (terrainSmoothing.kernel == SMOOTH_BOX)
+            terrainRegenerateRequested |= ImGui::SliderInt("Smoothing Radius", &terrainSmoothing.radius, 1, 8);
+        if (terrainSmoothing.kernel == SMOOTH_GAUSSIAN || terrainSmoothing.kernel == SMOOTH_BILATERAL)
+            terrainRegenerateRequested |= ImGui::SliderFloat("Smoothing Sigma", &terrainSmoothing.sigma, 0.5f, 8.0f);
+        if (terrainSmoothing.kernel == SMOOTH_BILATERAL)
+            terrainRegenerateRequested |= ImGui::SliderFloat("Smoothing Range Sigma", &terrainSmoothing.rangeSigma, 0.5f, 32.0f);
+        int islandShape = terrainIsland.shape;
+        if (ImGui::Combo("Island Shape", &islandShape, "Rectangle\0Polygon\0Noise threshold\0Painted\0")) {
+            terrainIsland.shape = (IslandShape)islandShape;
+            terrainRegenerateRequested = true;
+        }
+        if (terrainIsland.shape == ISLAND_POLYGON) {
+            ImGui::Text("Polygon: %d points", (int)terrainIsland.polygon.size());
+            if (ImGui::Button("Add Point Under Camera")) islandPolygonPointRequested = true;
+            ImGui::SameLine();
+            if (ImGui::Button("Clear Polygon")) {
+                terrainIsland.polygon.clear();
+                terrainRegenerateRequested = true;
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Reset Polygon")) {
+                terrainIsland.polygon = IslandMaskSettings().polygon;
+                terrainRegenerateRequested = true;
+            }
+        }
+        if (terrainIsland.shape == ISLAND_NOISE) {
+            terrainRegenerateRequested |= ImGui::SliderFloat("Island Noise Scale", &terrainIsland.noiseScale, 50.0f, 2000.0f);
+            terrainRegenerateRequested |= ImGui::SliderFloat("Island Threshold", &terrainIsland.threshold, -1.0f, 1.0f);
+            terrainRegenerateRequested |= ImGui::SliderFloat("Island Radial Bias", &terrainIsland.radialBias, 0.0f, 2.0f);
+            terrainRegenerateRequested |= ImGui::SliderFloat("Island Seed", &terrainIsland.noiseSeed, 0.0f, 100.0f);
+        }
+        if (terrainIsland.shape == ISLAND_PAINTED) {
+            ImGui::Checkbox("Paint Land (off: sea)", &islandPaintLand);
+            ImGui::SliderFloat("Island Brush Radius", &islandBrushRadius, 5.0f, 200.0f);
+            if (ImGui::Button("Paint Under Camera")) islandPaintRequested = true;
+        }
+        if (ImGui::TreeNode("Erosion")) {
+            bool changed = ImGui::Checkbox("Hydraulic", &terrainErosion.hydraulic);
+            ImGui::SameLine();
+            changed |= ImGui::Checkbox("Thermal", &terrainErosion.thermal);
+            int erosionSeed = (int)terrainErosion.seed;
+            if (ImGui::SliderInt("Erosion Seed", &erosionSeed, 1, 1000)) {
+                terrainErosion.seed = (uint32_t)erosionSeed;
+                changed = true;
+            }
+            changed |= ImGui::SliderFloat("Droplets Per Vertex", &terrainErosion.dropletsPerVertex, 0.01f, 2.0f);
+            changed |= ImGui::SliderInt("Droplet Lifetime", &terrainErosion.maxLifetime, 4, 64);
+            changed |= ImGui::SliderInt("Brush Radius", &terrainErosion.radius, 1, 6);
+            changed |= ImGui::SliderFloat("Inertia", &terrainErosion.inertia, 0.0f, 0.5f);
+            changed |= ImGui::SliderFloat("Sediment Capacity", &terrainErosion.sedimentCapacity, 0.5f, 8.0f);
+            changed |= ImGui::SliderFloat("Erode Speed", &terrainErosion.erodeSpeed, 0.0f, 1.0f);
+            changed |= ImGui::SliderFloat("Deposit Speed", &terrainErosion.depositSpeed, 0.0f, 1.0f);
+            changed |= ImGui::SliderFloat("Evaporate Speed", &terrainErosion.evaporateSpeed, 0.0f, 0.1f);
+            changed |= ImGui::SliderFloat("Gravity", &terrainErosion.gravity, 0.5f, 10.0f);
+            changed |= ImGui::SliderInt("Thermal Iterations", &terrainErosion.thermalIterations, 1, 200);
+            changed |= ImGui::SliderFloat("Talus", &terrainErosion.talus, 0.1f, 4.0f);
+            changed |= ImGui::SliderFloat("Thermal Rate", &terrainErosion.thermalRate, 0.05f, 1.0f);
+            terrainRegenerateRequested |= changed; // Disabled passes don't change the stage key
+            ImGui::TreePop();
+        }
+        if (ImGui::TreeNode("Hydrology")) {
+            bool changed = ImGui::Checkbox("Rivers And Lakes", &terrainHydrology.enabled);
+            int routing = terrainHydrology.routing;
+            if (ImGui::Combo("Flow Routing", &routing, "D8\0D-infinity\0")) {
+                terrainHydrology.routing = (FlowRouting)routing;
+                changed = true;
+            }
+            changed |= ImGui::SliderFloat("River Threshold (cells)", &terrainHydrology.riverThreshold, 20.0f, 5000.0f);
+            changed |= ImGui::SliderFloat("River Depth", &terrainHydrology.carveDepth, 0.0f, 5.0f);
+            changed |= ImGui::SliderFloat("Min Lake Depth", &terrainHydrology.minLakeDepth, 0.01f, 1.0f);
+            changed |= ImGui::SliderFloat("Flat Epsilon", &terrainHydrology.epsilon, 0.0f, 0.01f, "%.4f");
+            changed |= ImGui::Checkbox("Carve Rivers", &terrainHydrology.carveRivers);
+            ImGui::SameLine();
+            changed |= ImGui::Checkbox("Fill Lakes", &terrainHydrology.fillLakes);
+            terrainRegenerateRequested |= changed;
+            if (ImGui::Button("Hydrology Report")) hydrologyReportRequested = true;
+            if (terrainHydrology.enabled && !lastTerrainOnGpu) {
+                HydrologyStats stats = progressiveTerrain->hydrologyStats();
+                ImGui::Text("Fill %.1f ms (%.1f serial), directions %.1f ms, accumulation %.1f ms, output %.1f ms",
+                    stats.fillMilliseconds, stats.fillSerialMilliseconds, stats.directionMilliseconds, stats.accumulationMilliseconds, stats.outputMilliseconds);
+                ImGui::Text("%llu raised, %llu lake, %llu river, %llu sea cells; largest basin %.0f cells",
+                    (unsigned long long)stats.raisedCells, (unsigned long long)stats.lakeCells,
+                    (unsigned long long)stats.riverCells, (unsigned long long)stats.seaCells, stats.maxAccumulation);
+            }
+            ImGui::TreePop();
+        }
+        if (ImGui::TreeNode("Vegetation")) {
+            bool changed = ImGui::Checkbox("Scatter", &terrainScatter.enabled);
+            ImGui::SameLine();
+            ImGui::Checkbox("Show", &vegetationVisible);
+            int scatterSeed = (int)terrainScatter.seed;
+            if (ImGui::SliderInt("Scatter Seed", &scatterSeed, 1, 1000)) {
+                terrainScatter.seed = (uint32_t)scatterSeed;
+                changed = true;
+            }
+            changed |= ImGui::SliderInt("Chunk Size", &terrainScatter.chunkSize, 32, 512);
+            changed |= ImGui::SliderFloat("Shore Margin", &terrainScatter.shoreMargin, 0.0f, 10.0f);
+            for (int kind = 0; kind < SCATTER_KIND_COUNT; kind++) {
+                ScatterLayer& layer = terrainScatter.layers[kind];
+                if (!ImGui::TreeNode(scatterKindName((ScatterKind)kind))) continue;
+                changed |= ImGui::SliderFloat("Min Distance", &layer.minDistance, 0.5f, 20.0f);
+                changed |= ImGui::SliderFloat("Plains", &layer.biomeDensity[PLAINS], 0.0f, 1.0f);
+                changed |= ImGui::SliderFloat("Hills", &layer.biomeDensity[HILLS], 0.0f, 1.0f);
+                changed |= ImGui::SliderFloat("Mountains", &layer.biomeDensity[MOUNTAINS], 0.0f, 1.0f);
+                changed |= ImGui::SliderFloat("Desert", &layer.biomeDensity[DESERT], 0.0f, 1.0f);
+                changed |= ImGui::SliderFloat("Max Slope", &layer.maxSlope, 0.0f, 4.0f);
+                ImGui::SliderFloat("Min Scale", &layer.minScale, 0.1f, 4.0f);
+                ImGui::SliderFloat("Max Scale", &layer.maxScale, 0.1f, 4.0f);
+                ImGui::SliderFloat("Draw Distance", &layer.drawDistance, 50.0f, 3000.0f);
+                ImGui::TreePop();
+            }
+            terrainRegenerateRequested |= changed;
+            const ScatterStats& scatterStats = vegetationRenderer->scatterStats();
+            const VegetationStats& drawStats = vegetationRenderer->getStats();
+            ImGui::Text("%llu trees, %llu bushes, %llu rocks from %llu samples (%.1f + %.1f ms)",
+                (unsigned long long)scatterStats.instances[SCATTER_TREES], (unsigned long long)scatterStats.instances[SCATTER_BUSHES],
+                (unsigned long long)scatterStats.instances[SCATTER_ROCKS], (unsigned long long)scatterStats.samples,
+                scatterStats.sampleMilliseconds, scatterStats.packMilliseconds);
+            ImGui::Text("Drawn: %llu instances, %d draw calls, %d chunks (%d culled), %.1f MB on the GPU",
+                (unsigned long long)drawStats.instancesDrawn, drawStats.drawCalls, drawStats.chunksDrawn, drawStats.chunksCulled,
+                drawStats.gpuBytes / 1048576.0);
+            ImGui::TreePop();
+        }
+        if (ImGui::Button("Regenerate")) terrainRegenerateRequested = true;
+        if (terrainCompute && terrainCompute->supported()) {
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Generate On GPU", &gpuTerrainGeneration)) terrainRegenerateRequested = true;
+        }
+        if (lastTerrainOnGpu) {
+            ImGui::Text("Last generation: %.1f ms on the GPU", lastTerrainMilliseconds);
+        }
+        else {
+            ImGui::Text("Showing 1/%d resolution%s (levels: %.0f / %.0f / %.0f / %.0f ms)", terrainPreviewStep,
+                progressiveTerrain->refining() ? ", refining" : "", progressiveTerrain->levelSeconds(0) * 1e3,
+                progressiveTerrain->levelSeconds(1) * 1e3, progressiveTerrain->levelSeconds(2) * 1e3,
+                progressiveTerrain->levelSeconds(3) * 1e3);
+            if (ImGui::TreeNode("Pipeline Stages")) {
+                for (int stage = 0; stage < TERRAIN_STAGE_COUNT; stage++) {
+                    TerrainStageStats stats = progressiveTerrain->stageStats((TerrainStage)stage);
+                    ImGui::Text("%-13s %7.1f ms  %llu hits  %llu runs  %.1f MB", terrainStageName((TerrainStage)stage),
+                        stats.milliseconds, (unsigned long long)stats.hits, (unsigned long long)stats.misses, stats.bytes / 1048576.0);
+                }
+                ImGui::Text("Cached: %.1f MB", progressiveTerrain->pipelineBytes() / 1048576.0);
+                ImGui::TreePop();
+            }
+        }
+        CdlodSettings& lod = cdlodTerrain->settings;
+        ImGui::Combo("Terrain Path", &terrainPath, "CDLOD\0Displaced grid (full detail)\0Vertex buffer\0");
+        int heightFormat = lod.heightFormat;
+        if (ImGui::Combo("Height Texture Format", &heightFormat, "R16\0R32F\0")) {
+            lod.heightFormat = (HeightmapTexture::Format)heightFormat;
+            cdlodTerrain->build(terrainHeightfield);
+        }
+        if (ImGui::Button("Raise Terrain Under Camera")) terrainBrushRequested = true;
+        ImGui::SameLine();
+        if (ImGui::Button("Terrain Path Report")) terrainPathReportRequested = true;
+        ImGui::SliderFloat("LOD Distance", &lod.lodDistance, 16.0f, 512.0f);
+        ImGui::SliderFloat("LOD Error Tolerance", &lod.errorTolerance, 0.0f, 1.0f);
+        ImGui::SliderInt("Triangle Budget", &lod.triangleBudget, 50000, 4000000);
+        ImGui::Checkbox("Adapt LOD To Budget", &lod.adaptiveDistance);
+        const CdlodStats& stats = cdlodTerrain->getStats();
+        ImGui::Text("LOD: %d levels, %d nodes drawn, %d culled, %d triangles, distance %.0f", stats.levels, stats.selectedNodes,
+            stats.culledNodes, stats.triangles, stats.lodDistance);
+        ImGui::Text("GPU: height texture path %.1f MB, vertex buffer path %.1f MB", stats.gpuBytes / (1024.0 * 1024.0),
+            vertexBufferTerrain->gpuBytes() / (1024.0 * 1024.0));
+        ImGui::Checkbox("Trim Under Sea Level", &seaTrim.enabled);
+        if (seaTrim.enabled) {
+            ImGui::SameLine();
+            ImGui::SliderFloat("Ripple Margin", &seaTrim.rippleMargin, 0.0f, 10.0f);
+        }
+        ImGui::Text("Submerged: %d nodes, %d triangles (vertex buffer path: %d of %d triangles)", stats.submergedNodes,
+            stats.submergedTriangles, vertexBufferTerrain->trimmedTriangles(), vertexBufferTerrain->triangleCount());
+        ImGui::Text("Sea under land: %d of %d tiles, %d of %d triangles", seaTiles.hiddenTileCount(), seaTiles.tileCount(),
+            seaTiles.triangleCount() - seaTiles.drawnTriangles(), seaTiles.triangleCount());
+    }
+
+    ImGui::Checkbox("Infinite Terrain", &infiniteTerrainEnabled);
+    if (infiniteTerrainEnabled && terrainStreamer) {
+        TerrainStreamSettings& stream = terrainStreamer->settings;
+        int memoryBudgetMB = (int)(stream.memoryBudget >> 20);
+        int uploadBudgetKB = (int)(stream.uploadBudget >> 10);
+        ImGui::SliderInt("View Radius (chunks)", &stream.viewRadius, 1, 16);
+        if (ImGui::SliderInt("Memory Budget (MB)", &memoryBudgetMB, 16, 2048)) stream.memoryBudget = (size_t)memoryBudgetMB << 20;
+        if (ImGui::SliderInt("Upload Budget (KB/frame)", &uploadBudgetKB, 64, 16384)) stream.uploadBudget = (size_t)uploadBudgetKB << 10;
+        const TerrainStreamStats& stats = terrainStreamer->getStats();
+        ImGui::Text("Chunks: %d cached, %d uploaded, %d drawn", stats.cachedChunks, stats.uploadedChunks, stats.drawnChunks);
+        ImGui::Text("Queued %d, generating %d, uploads this frame %d", stats.queuedChunks, stats.generatingChunks, stats.uploadsLastFrame);
+        ImGui::Text("Memory: %.1f MB CPU, %.1f MB GPU", stats.cpuBytes / 1048576.0, stats.gpuBytes / 1048576.0);
+        ImGui::Text("Generated %llu, evicted %llu", (unsigned long long)stats.generatedTotal, (unsigned long long)stats.evictedTotal);
+        int cacheFormat = stream.cacheMaxError < 0.0f ? 0 : stream.cacheMaxError == 0.0f ? 1 : 2;
+        if (ImGui::Combo("Disk Cache Format", &cacheFormat, "Raw (mapped)\0Compressed lossless\0Compressed, 0.01 error\0")) {
+            const float formatErrors[] = { -1.0f, 0.0f, 0.01f };
+            stream.cacheMaxError = formatErrors[cacheFormat];
+            terrainStreamer->clear();
+        }
+        ImGui::Text("Disk cache: %llu hits, %llu misses, %llu written", (unsigned long long)stats.cacheHits,
+            (unsigned long long)stats.cacheMisses, (unsigned long long)stats.cacheWrites);
+    }
+
+    ImGui::Checkbox("Ripples", &ripplesEnabled);
+    ImGui::SliderFloat("Ripple Strength", &rippleStrength, 0.0f, 5.0f);
+    ImGui::SliderFloat("Ripple Radius", &rippleRadius, 0.5f, 10.0f);
+    if (waterSim) {
+        ImGui::SliderFloat("Ripple Damping", &waterSim->damping, 0.95f, 1.0f);
+        ImGui::Text("Awake ripple tiles: %d / %d", waterSim->awakeTileCount(), waterSim->tileCount());
+    }
+
+    if (ImGui::TreeNode("Shore")) {
+        ImGui::Checkbox("Foam And Shallow Tint", &shoreSettings.enabled);
+        if (ImGui::SliderFloat("Shore Range", &shoreSettings.range, 4.0f, 64.0f)) shoreMapRebuildRequested = true;
+        ImGui::SliderFloat("Foam Width", &shoreSettings.foamWidth, 0.0f, 16.0f);
+        ImGui::SliderFloat("Shallow Depth", &shoreSettings.shallowDepth, 0.5f, 30.0f);
+        ImGui::ColorEdit3("Shallow Color", &shoreSettings.shallowColor.x);
+        if (shoreMap) {
+            const ShoreMapStats& stats = shoreMap->getStats();
+            ImGui::Text("Last update: %d texels in %.2f ms (%d builds, %d partial updates), %.1f MB", stats.texelsUpdated,
+                stats.milliseconds, stats.fullBuilds, stats.partialUpdates, shoreMap->gpuBytes() / 1048576.0);
+        }
+        ImGui::TreePop();
+    }
 
     if (oldSeaLevel != seaLevel || oldSeaAmplitude != seaAmplitude || oldSeaFrequency != seaFrequency || oldWaveSpeed != waveSpeed
         || oldWaveCount != waveCount)
     {
         updateSea = true;
     }
+    // Sea cells are outlets of the flow routing, and nothing is scattered below the sea
+    if (oldSeaLevel != seaLevel && (terrainHydrology.enabled || terrainScatter.enabled)) terrainRegenerateRequested = true;
     ImGui::End();
 
+    renderBiomeTableWindow();
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -310,6 +1039,17 @@ void processInput(GLFWwindow* window) {
         eKeyPressed = false;
     }
 
+    // Left click disturbs the water where the view ray hits the sea plane
+    if (!isGuiOpen && ripplesEnabled && waterSim && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+        if (cameraFront.y < -0.01f) {
+            float t = (seaLevel - cameraPos.y) / cameraFront.y;
+            if (t > 0.0f) {
+                glm::vec3 hit = cameraPos + t * cameraFront;
+                waterSim->disturb(hit.x, hit.z, rippleRadius, rippleStrength * deltaTime * 10.0f);
+            }
+        }
+    }
+
     // Only process camera movement if GUI is closed
     if (!isGuiOpen) {
         float cameraSpeed = 40.0f * deltaTime;
@@ -367,13 +1107,18 @@ int main() {
         return -1;
     }
 
-    // Set OpenGL version to 3.3 Core Profile
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // Ask for 4.3 Core Profile (compute shaders for the GPU terrain generator), fall back to 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // Create a window
     GLFWwindow* window = glfwCreateWindow(800, 600, "Terrain Renderer", nullptr, nullptr);
+    if (!window) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(800, 600, "Terrain Renderer", nullptr, nullptr);
+    }
     if (!window) {
         std::cerr << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -400,8 +1145,20 @@ int main() {
     Shader skyshader("skyshader.vs", "skyshader.fs");
 //    Shader seashader("seashader.vs", "seashader.fs", "seashader.gs");
  //   Shader normalshader("normalshader.vs", "normalshader.fs", "normalshader.gs");
-  Shader seashader("seashadernogs.vs", "seashader.fs");
+    Shader seashaderCaptured("seashadercaptured.vs", "seashader.fs");
+
+    // Everything that evaluates the waves gets one permutation per wave math tier
+    std::vector<Shader> seaShaderTiers, seaCaptureShaderTiers, normalShaderTiers;
+    for (int tier = 0; tier < 4; tier++) {
+        std::string defines = "#define WAVE_MATH_TIER " + std::to_string(tier) + "\n";
+        seaShaderTiers.push_back(Shader("seashadernogs.vs", "seashader.fs", nullptr, defines));
+        seaCaptureShaderTiers.push_back(Shader("seashadernogs.vs", { "vFragPos", "FragNormal" }, defines));
+        normalShaderTiers.push_back(Shader("normalshader.vs", "normalshader.fs", nullptr, defines));
+    }
     Shader lightshader("lightshader.vs", "lightshader.fs");
+    Shader noiseshader("noiseshader.vs", "noiseshader.fs");
+    Shader cdlodShader("cdlodterrain.vs", "noiseshader.fs");
+    Shader vegetationShader("vegetation.vs", "vegetation.fs");
 
     // Cube vertices
     float skyboxVertices[] = {
@@ -482,6 +1239,34 @@ int main() {
     GLuint planeVBO;
 
     GLuint planeVAO = generatePlaneVAO(planeVertices, planeIndices, planeVBO);
+    seaTiles.build(planeVAO, planeIndices, (int)planeWidth, (int)planelength, glm::vec2(-planeWidth / 2.0f, -planelength / 2.0f), 1.0f);
+
+    // Ripple grid covering the sea plane
+    WaterSimulation rippleSimulation(256, glm::vec2(-planeWidth / 2.0f, -planelength / 2.0f), planeWidth);
+    rippleSimulation.createTexture();
+    waterSim = &rippleSimulation;
+
+    TerrainStreamSettings streamSettings;
+    streamSettings.scale = (float)scale;
+    streamSettings.octaves = octaves;
+    terrainStreamer = new TerrainStreamer(streamSettings);
+    cdlodTerrain = new CdlodTerrain();
+    vertexBufferTerrain = new VertexBufferTerrain();
+    hydrologyTexture = new HydrologyTexture();
+    shoreMap = new ShoreMap();
+    vegetationRenderer = new VegetationRenderer();
+    terrainCompute = new TerrainComputeGenerator();
+    progressiveTerrain = new ProgressiveTerrainGenerator();
+    if (!terrainCompute->init())
+        std::cout << "Compute shaders unavailable (GL " << glGetString(GL_VERSION) << "), terrain is generated on the CPU" << std::endl;
+    regenerateTerrain();
+
+    SeaCapture seaCapture = createSeaCapture(planeVAO, (GLsizei)planeVertices.size());
+
+    // The instanced normal lines generate their vertices from gl_VertexID/gl_InstanceID,
+    // but core profile still needs a VAO bound to draw
+    GLuint emptyVAO;
+    glGenVertexArrays(1, &emptyVAO);
 
     lightshader.use();
 
@@ -508,6 +1293,18 @@ int main() {
         // Process input (camera movement)
         processInput(window);
 
+        // The camera leaves a wake when skimming the water
+        static glm::vec3 lastCameraPos = cameraPos;
+        if (ripplesEnabled && std::abs(cameraPos.y - seaLevel) < 2.0f && glm::length(cameraPos - lastCameraPos) > 0.01f) {
+            waterSim->disturb(cameraPos.x, cameraPos.z, rippleRadius * 0.5f, rippleStrength * deltaTime * 5.0f);
+        }
+        lastCameraPos = cameraPos;
+
+        if (ripplesEnabled) {
+            rippleSimulation.update(deltaTime);
+            rippleSimulation.uploadTexture();
+        }
+
         // Clear the screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -540,52 +1337,217 @@ int main() {
         glBindVertexArray(light.VAO);
         glDrawArrays(GL_TRIANGLES, 0, light.vertices_count);
 
-        seashader.use();
-      //  seashader.setVec3("lightDir", glm::vec3(0.5,0.7,0.3)); // Light position
-        seashader.setVec3("lightColor", glm::vec3(1.0f, 0.87f, 0.52f)); // White light
-        seashader.setFloat("lightIntensity", 0.3f);
+        u_time = glfwGetTime();
+
+        if (biomeTableChanged) {
+            terrainStreamer->clear();
+            terrainRegenerateRequested = true;
+            biomeTableChanged = false;
+        }
+        if (islandPaintRequested) {
+            paintIslandAt(cameraPos, islandBrushRadius, islandPaintLand);
+            terrainRegenerateRequested = true;
+            islandPaintRequested = false;
+        }
+        if (islandPolygonPointRequested) {
+            terrainIsland.polygon.push_back(glm::clamp(terrainMapPosition(cameraPos), glm::vec2(0.0f), glm::vec2(1.0f)));
+            terrainRegenerateRequested = true;
+            islandPolygonPointRequested = false;
+        }
+        if (terrainRegenerateRequested) {
+            regenerateTerrain();
+            terrainRegenerateRequested = false;
+        }
+        if (shoreMapRebuildRequested) {
+            rebuildShoreMap();
+            shoreMapRebuildRequested = false;
+        }
+        Heightfield refinedTerrain;
+        std::vector<uint32_t> refinedHydrology;
+        ScatterInstances refinedScatter;
+        if (progressiveTerrain->poll(refinedTerrain, terrainPreviewStep, refinedHydrology, refinedScatter))
+            showTerrain(std::move(refinedTerrain), refinedHydrology, refinedScatter);
+        if (terrainBrushRequested) {
+            raiseTerrainAt(cameraPos, 24.0f, 8.0f);
+            terrainBrushRequested = false;
+        }
+        if (terrainPathReportRequested) {
+            runTerrainPathReport(cdlodShader, noiseshader, view, projection, cameraPos);
+            terrainPathReportRequested = false;
+        }
+        for (const Shader* terrainShader : { &noiseshader, &cdlodShader }) {
+            terrainShader->use();
+            terrainShader->setBool("u_terrainLighting", terrainLighting && !infiniteTerrainEnabled); // Chunks carry no normals
+            terrainShader->setVec3("lightPos", light.position);
+            terrainShader->setVec3("lightColor", light.color);
+            terrainShader->setFloat("lightIntensity", light.intensity);
+        }
+        if (terrainVisible && !infiniteTerrainEnabled)
+            drawTerrain((TerrainPath)terrainPath, cdlodShader, noiseshader, view, projection, cameraPos);
+        if (terrainVisible && !infiniteTerrainEnabled && vegetationVisible && vegetationRenderer->ready()) {
+            vegetationShader.use();
+            vegetationShader.setMat4("view", view);
+            vegetationShader.setMat4("projection", projection);
+            vegetationShader.setVec3("lightPos", light.position);
+            vegetationShader.setVec3("lightColor", light.color);
+            vegetationShader.setFloat("lightIntensity", light.intensity);
+            vegetationRenderer->draw(vegetationShader, cdlodTerrain->heights(), terrainScatter, projection * view, cameraPos, seaLevel);
+        }
+        if (infiniteTerrainEnabled) {
+            terrainStreamer->update(cameraPos, cameraFront);
+            noiseshader.use();
+            noiseshader.setMat4("model", glm::mat4(1.0f));
+            noiseshader.setMat4("view", view);
+            noiseshader.setMat4("projection", projection);
+            noiseshader.setFloat("seaLevel", seaLevel);
+            noiseshader.setBool("u_hydrologyEnabled", false);
+            terrainStreamer->draw(cameraPos);
+        }
 
-        seashader.setVec3("viewPos", cameraPos); // Pass camera position
-        seashader.setVec3("ViewDirection", cameraFront);
+        const Shader& seashader = seaShaderTiers[waveMathTier];
+        const Shader& seaCaptureShader = seaCaptureShaderTiers[waveMathTier];
+        const Shader& normalshader = normalShaderTiers[waveMathTier];
+
+        // Update sea level vertices
+        updateSeaLevel(planeVertices, seaLevel, planeVAO, planeVBO);
+
+        // Exact GPU readback of the wave sum, compared against the CPU evaluator (ripples excluded)
+        if (validateSeaCaptureRequested) {
+            seaCaptureShader.use();
+            setSeaWaveUniforms(seaCaptureShader);
+            seaCaptureShader.setBool("u_ripplesEnabled", false);
+            captureSeaVertices(seaCapture, planeVAO);
+
+            std::vector<Vertex> captured(seaCapture.vertexCount);
+            glBindBuffer(GL_ARRAY_BUFFER, seaCapture.buffer);
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, captured.size() * sizeof(Vertex), captured.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            SeaWaveParams waveParams = { seaFrequency, seaAmplitude, waveSpeed };
+            lastSeaCaptureError = compareSeaWaves(&captured[0].x, 6, &planeVertices[0].x, 6, captured.size(), u_time, waveParams);
+            hasSeaCaptureError = true;
+            std::cout << "Sea capture validation: max position error " << lastSeaCaptureError.maxPositionError
+                << " (vertex " << lastSeaCaptureError.worstVertex << "), max normal error "
+                << lastSeaCaptureError.maxNormalError << std::endl;
+            validateSeaCaptureRequested = false;
+        }
 
-        // Material properties
-        seashader.setVec3("objectColor", glm::vec3(0.5f, 0.737f, 0.87f)); // Water color
-        seashader.setFloat("ambientStrength", 0.3f);
-        seashader.setFloat("diffuseStrength", 0.4f);
-        seashader.setFloat("specularStrength", 0.75f);
-        seashader.setFloat("shininess", 64.0f);
+        if (waveMathReportRequested) {
+            runWaveMathReport();
+            runWaveMathGpuReport(seaCaptureShaderTiers, seaCapture, planeVAO, planeVertices);
+            waveMathReportRequested = false;
+        }
 
-        u_time = glfwGetTime();
-        seashader.setFloat("u_time", u_time);
-        seashader.setVec3("lightPos", light.position);
-        seashader.setVec3("lightColor", light.color);
-        seashader.setFloat("lightIntensity", light.intensity);
-        seashader.setMat4("viewPos", view);  // Use the camera's world-space position here
-        seashader.setFloat("Dir", testVar);
-        seashader.setInt("u_showNormals", renderingMode);
+        if (noiseBenchmarkRequested) {
+            benchmarkPerlinBatch();
+            noiseBenchmarkRequested = false;
+        }
+
+        if (noiseDerivativeReportRequested) {
+            benchmarkPerlinDerivatives();
+            noiseDerivativeReportRequested = false;
+        }
+
+        if (smoothingReportRequested) {
+            runSmoothingReport(smoothHeights);
+            smoothingReportRequested = false;
+        }
+
+        if (tiledLayoutReportRequested) {
+            if (tiledLayoutReportLarge) runTiledLayoutReport({ 4096, 16384 });
+            else runTiledLayoutReport();
+            tiledLayoutReportRequested = false;
+        }
+
+        if (tileCodecReportRequested) {
+            runTileCodecReport();
+            tileCodecReportRequested = false;
+        }
+
+        if (hydrologyReportRequested) {
+            runHydrologyReport(4096, seaLevel);
+            hydrologyReportRequested = false;
+        }
+
+        // In capture mode the wave sum runs once here and every pass below reads the buffer
+        if (seaCaptureEnabled) {
+            seaCaptureShader.use();
+            setSeaWaveUniforms(seaCaptureShader);
+            captureSeaVertices(seaCapture, planeVAO);
+        }
+        const Shader& seaDrawShader = seaCaptureEnabled ? seashaderCaptured : seashader;
+
+        seaDrawShader.use();
+      //  seaDrawShader.setVec3("lightDir", glm::vec3(0.5,0.7,0.3)); // Light position
+        seaDrawShader.setVec3("lightColor", glm::vec3(1.0f, 0.87f, 0.52f)); // White light
+        seaDrawShader.setFloat("lightIntensity", 0.3f);
+
+        seaDrawShader.setVec3("viewPos", cameraPos); // Pass camera position
+        seaDrawShader.setVec3("ViewDirection", cameraFront);
+
+        // Material properties
+        seaDrawShader.setVec3("objectColor", glm::vec3(0.5f, 0.737f, 0.87f)); // Water color
+        seaDrawShader.setFloat("ambientStrength", 0.3f);
+        seaDrawShader.setFloat("diffuseStrength", 0.4f);
+        seaDrawShader.setFloat("specularStrength", 0.75f);
+        seaDrawShader.setFloat("shininess", 64.0f);
+
+        seaDrawShader.setVec3("lightPos", light.position);
+        seaDrawShader.setVec3("lightColor", light.color);
+        seaDrawShader.setFloat("lightIntensity", light.intensity);
+        seaDrawShader.setMat4("viewPos", view);  // Use the camera's world-space position here
+        seaDrawShader.setFloat("Dir", testVar);
+        seaDrawShader.setInt("u_showNormals", renderingMode);
 
         glm::vec3 planeColor(0.2f, 0.6f, 0.9f);
-        seashader.setVec3("objectColor", planeColor);
+        seaDrawShader.setVec3("objectColor", planeColor);
 
         // Re-apply sea generation uniforms
-        seashader.setFloat("seaLevel", seaLevel);
-        seashader.setFloat("sea_frequency", seaFrequency);
-        seashader.setFloat("wave_speed", waveSpeed);
-        seashader.setFloat("sea_amplitude", seaAmplitude);
-        seashader.setFloat("wave_count", waveCount);
-
-            // Update sea level vertices
-            updateSeaLevel(planeVertices, seaLevel, planeVAO, planeVBO);
-
-        seashader.use();
-        // Bind the VAO and draw the plane
-        glBindVertexArray(planeVAO);
-        glDrawElements(GL_TRIANGLES, planeIndices.size(), GL_UNSIGNED_INT, 0);
+        if (!seaCaptureEnabled) setSeaWaveUniforms(seashader);
+
+        // Foam and shallow tint; the map only describes the generated terrain
+        shoreMap->updateWaterLevel(shoreWaterLevel());
+        ShoreMapSettings shore = shoreSettings;
+        shore.enabled = shore.enabled && terrainVisible && !infiniteTerrainEnabled;
+        seaDrawShader.use();
+        shoreMap->bind(seaDrawShader, 5, shore);
+        seaDrawShader.setFloat("u_time", u_time);
+
+        seaDrawShader.use();
+        seaDrawShader.setMat4("view", view);
+        seaDrawShader.setMat4("projection", projection);
+        // Bind the VAO and draw the plane, minus the tiles under land
+        seaTiles.classify(terrainVisible && !infiniteTerrainEnabled ? &terrainHeightfield : nullptr, terrainRevision, currentSeaBand());
+        glBindVertexArray(seaCaptureEnabled ? seaCapture.VAO : planeVAO);
+        seaTiles.draw();
         glBindVertexArray(0);
 
-        seashader.setMat4("model", model);
-        seashader.setMat4("view", view);
-        seashader.setMat4("projection", projection);
+        // Debug normals as instanced lines, one instance per sampled sea vertex
+        if (renderingMode) {
+            int gridColumns = (int)planeWidth + 1;
+            int gridRows = (int)planelength + 1;
+            int sampledColumns = (gridColumns - 1) / normalStride + 1;
+            int sampledRows = (gridRows - 1) / normalStride + 1;
+
+            normalshader.use();
+            setSeaWaveUniforms(normalshader);
+            normalshader.setMat4("view", view);
+            normalshader.setMat4("projection", projection);
+            normalshader.setFloat("normalLength", 0.5f);
+            normalshader.setVec2("u_gridOrigin", glm::vec2(-planeWidth / 2.0f, -planelength / 2.0f));
+            normalshader.setFloat("u_gridSpacing", 1.0f);
+            normalshader.setInt("u_gridColumns", gridColumns);
+            normalshader.setInt("u_normalStride", normalStride);
+            normalshader.setBool("u_useCapture", seaCaptureEnabled);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_BUFFER, seaCapture.texture);
+            glActiveTexture(GL_TEXTURE0);
+            normalshader.setInt("u_captureBuffer", 2);
+
+            glBindVertexArray(emptyVAO);
+            glDrawArraysInstanced(GL_LINES, 0, 2, sampledColumns * sampledRows);
+            glBindVertexArray(0);
+        }
 
         glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
         skyshader.use();
@@ -615,6 +1577,21 @@ int main() {
         glfwPollEvents();
     }
 
+    // Streamed chunks own GL objects, so release them while the context is alive
+    delete terrainStreamer;
+    terrainStreamer = nullptr;
+    delete cdlodTerrain;
+    cdlodTerrain = nullptr;
+    delete vertexBufferTerrain;
+    delete hydrologyTexture;
+    delete shoreMap;
+    delete vegetationRenderer;
+    vertexBufferTerrain = nullptr;
+    delete terrainCompute;
+    terrainCompute = nullptr;
+    delete progressiveTerrain;
+    progressiveTerrain = nullptr;
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -2,8 +2,22 @@
 
 out vec4 FragColor;
 in vec3 position;
+in vec3 normal;
 uniform float seaLevel;
 
+// Diffuse light from the scene light through the vertex normal; off leaves the colours unlit
+uniform bool u_terrainLighting;
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform float lightIntensity;
+
+// Rivers and lakes, see hydrology.h: r flow, g river strength, b lake depth, a land
+uniform bool u_hydrologyEnabled;
+uniform sampler2D u_hydrologyMap;
+uniform vec2 u_hydrologyOrigin;     // World x/z of texel (0, 0)
+uniform vec2 u_hydrologySize;       // Texels in x and z
+uniform float u_hydrologySpacing;
+
 // Improved hash function
 vec2 hash2(vec2 p) {
     p = vec2(dot(p, vec2(127.1, 311.7)),
@@ -11,13 +25,14 @@ vec2 hash2(vec2 p) {
     return -1.0 + 2.0 * fract(sin(p) * 43758.5453123);
 }
 
-// Gradient noise (Perlin-like)
-float gradientNoise(vec2 p) {
+// Gradient noise (Perlin-like) with its analytic derivative: x = value, yz = d/dp
+vec3 gradientNoiseD(vec2 p) {
     vec2 i = floor(p);
     vec2 f = fract(p);
     
-    // Smoothing
+    // Smoothing and its derivative
     vec2 u = f * f * (3.0 - 2.0 * f);
+    vec2 du = 6.0 * f * (1.0 - f);
     
     // Gradients
     vec2 ga = hash2(i + vec2(0.0, 0.0));
@@ -31,9 +46,13 @@ float gradientNoise(vec2 p) {
     float vc = dot(gc, f - vec2(0.0, 1.0));
     float vd = dot(gd, f - vec2(1.0, 1.0));
     
-    // Interpolation
-    return mix(mix(va, vb, u.x),
-              mix(vc, vd, u.x), u.y);
+    // Interpolation; the derivative blends the gradients the same way and adds what the fade
+    // curves contribute
+    float value = mix(mix(va, vb, u.x),
+                      mix(vc, vd, u.x), u.y);
+    vec2 derivative = mix(mix(ga, gb, u.x), mix(gc, gd, u.x), u.y)
+                    + du * vec2(mix(vb - va, vd - vc, u.y), mix(vc - va, vd - vb, u.x));
+    return vec3(value, derivative);
 }
 
 // Function to create smooth color transitions
@@ -42,15 +61,16 @@ vec4 smoothColor(float height, vec4 colorA, vec4 colorB, float threshold, float
     return mix(colorA, colorB, t);
 }
 
-// FBM (Fractal Brownian Motion) for more natural variation
-float fbm(vec2 p) {
-    float value = 0.0;
+// FBM (Fractal Brownian Motion) for more natural variation, with its derivative like gradientNoiseD
+vec3 fbmD(vec2 p) {
+    vec3 value = vec3(0.0);
     float amplitude = 0.5;
     float frequency = 1.0;
     
-    // Add multiple layers of noise
+    // Add multiple layers of noise; each octave's slope scales with its frequency
     for(int i = 0; i < 4; i++) {
-        value += amplitude * gradientNoise(p * frequency);
+        vec3 octave = gradientNoiseD(p * frequency);
+        value += amplitude * vec3(octave.x, octave.yz * frequency);
         amplitude *= 0.5;
         frequency *= 2.0;
     }
@@ -61,7 +81,7 @@ float fbm(vec2 p) {
 void main()
 {
     // Use FBM for more natural height variation
-    float noiseValue = fbm(position.xz * 3.0) * 0.3;
+    float noiseValue = fbmD(position.xz * 3.0).x * 0.3;
     float adjustedHeight = position.y + noiseValue;
     
     // Define colors with slightly adjusted alpha for better blending
@@ -74,7 +94,7 @@ void main()
     vec4 snowColor = vec4(0.9, 0.9, 0.95, 1.0);
 
     // Add subtle variation based on additional noise layers
-    float detailNoise = gradientNoise(position.xz * 10.0) * 0.1;
+    float detailNoise = gradientNoiseD(position.xz * 10.0).x * 0.1;
     
     if (adjustedHeight < seaLevel + 3) {
         FragColor = smoothColor(adjustedHeight, grassLight, grassDark, 0.3, 0.1);
@@ -89,8 +109,22 @@ void main()
         FragColor = smoothColor(adjustedHeight, mountainColor, snowColor, 1.4, 0.3);
     }
 
+    if (u_hydrologyEnabled) {
+        vec2 uv = ((position.xz - u_hydrologyOrigin) / u_hydrologySpacing + 0.5) / u_hydrologySize;
+        vec4 water = texture(u_hydrologyMap, uv);
+        vec4 lakeColor = mix(waterShallow, waterDeep, clamp(water.b * 2.0, 0.0, 1.0));
+        FragColor = mix(FragColor, lakeColor, smoothstep(0.0, 0.02, water.b) * water.a);
+        FragColor = mix(FragColor, waterShallow, smoothstep(0.0, 0.25, water.g) * water.a);
+    }
+
     // Add subtle detail variation
     FragColor.rgb += vec3(detailNoise);
+
+    if (u_terrainLighting) {
+        vec3 lightDir = normalize(lightPos - position);
+        float diffuse = max(dot(normalize(normal), lightDir), 0.0);
+        FragColor.rgb *= 0.45 + diffuse * lightColor * lightIntensity;
+    }
     
     // Ensure colors stay in valid range
     FragColor = clamp(FragColor, 0.0, 1.0);
@@ -1,5 +1,6 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aNormal;  // Packed 2_10_10_10, w unused
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
@@ -7,8 +8,10 @@ uniform mat4 projection;
 uniform float seaLevel;
 
 out vec3 position;
+out vec3 normal;
 void main()
 {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
     position = aPos;
+    normal = aNormal.xyz;
 }
\ No newline at end of file
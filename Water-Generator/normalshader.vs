@@ -1,14 +1,46 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+// Debug normals drawn as instanced lines: instance = one sampled grid vertex,
+// gl_VertexID 0/1 = start/end of its normal. No geometry shader and no vertex buffer.
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform float normalLength;
 
-out vec3 FragPos;
+// Sea grid layout and the subsampling stride (every n-th vertex in x and z)
+uniform vec2 u_gridOrigin;
+uniform float u_gridSpacing;
+uniform int u_gridColumns;
+uniform int u_normalStride;
+uniform float seaLevel;
+
+// When the sea was captured with transform feedback, read its normals instead of re-evaluating
+uniform bool u_useCapture;
+uniform samplerBuffer u_captureBuffer; // 6 floats per vertex: position, normal
+
+#include "seawaves.glsl"
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0)); // Store world position
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    int sampledColumns = (u_gridColumns - 1) / u_normalStride + 1;
+    int column = (gl_InstanceID % sampledColumns) * u_normalStride;
+    int row = (gl_InstanceID / sampledColumns) * u_normalStride;
+
+    vec3 position;
+    vec3 normal;
+    if (u_useCapture) {
+        int base = (row * u_gridColumns + column) * 6;
+        position = vec3(texelFetch(u_captureBuffer, base).r, texelFetch(u_captureBuffer, base + 1).r, texelFetch(u_captureBuffer, base + 2).r);
+        normal = vec3(texelFetch(u_captureBuffer, base + 3).r, texelFetch(u_captureBuffer, base + 4).r, texelFetch(u_captureBuffer, base + 5).r);
+    }
+    else {
+        vec2 xz = u_gridOrigin + vec2(column, row) * u_gridSpacing;
+        vec2 slope;
+        float height = seaSurface(xz, slope);
+        position = vec3(xz.x, seaLevel + height, xz.y);
+        normal = normalize(vec3(-slope.x, 1.0, -slope.y));
+    }
+
+    // Vertex 0 is the surface point, vertex 1 the normal endpoint
+    position += normal * normalLength * float(gl_VertexID);
+    gl_Position = projection * view * vec4(position, 1.0);
 }
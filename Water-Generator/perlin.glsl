@@ -0,0 +1,76 @@
+// GLSL twin of glm::perlin(vec3) (Gustavson's classic Perlin noise, glm/gtc/noise.inl), in the
+// same operation order so the GPU terrain matches include/noise.h to float rounding.
+
+vec4 perlinMod289(vec4 x) { return x - floor(x * (1.0 / 289.0)) * 289.0; }
+vec3 perlinMod289(vec3 x) { return x - floor(x * (1.0 / 289.0)) * 289.0; }
+vec4 perlinPermute(vec4 x) { return perlinMod289((x * 34.0 + 1.0) * x); }
+vec4 perlinTaylorInvSqrt(vec4 r) { return 1.79284291400159 - 0.85373472095314 * r; }
+vec3 perlinFade(vec3 t) { return (t * t * t) * (t * (t * 6.0 - 15.0) + 10.0); }
+
+float perlin(vec3 position)
+{
+    vec3 Pi0 = floor(position);
+    vec3 Pi1 = Pi0 + 1.0;
+    Pi0 = perlinMod289(Pi0);
+    Pi1 = perlinMod289(Pi1);
+    vec3 Pf0 = fract(position);
+    vec3 Pf1 = Pf0 - 1.0;
+    vec4 ix = vec4(Pi0.x, Pi1.x, Pi0.x, Pi1.x);
+    vec4 iy = vec4(Pi0.yy, Pi1.yy);
+    vec4 iz0 = Pi0.zzzz;
+    vec4 iz1 = Pi1.zzzz;
+
+    vec4 ixy = perlinPermute(perlinPermute(ix) + iy);
+    vec4 ixy0 = perlinPermute(ixy + iz0);
+    vec4 ixy1 = perlinPermute(ixy + iz1);
+
+    vec4 gx0 = ixy0 * (1.0 / 7.0);
+    vec4 gy0 = fract(floor(gx0) * (1.0 / 7.0)) - 0.5;
+    gx0 = fract(gx0);
+    vec4 gz0 = vec4(0.5) - abs(gx0) - abs(gy0);
+    vec4 sz0 = step(gz0, vec4(0.0));
+    gx0 -= sz0 * (step(0.0, gx0) - 0.5);
+    gy0 -= sz0 * (step(0.0, gy0) - 0.5);
+
+    vec4 gx1 = ixy1 * (1.0 / 7.0);
+    vec4 gy1 = fract(floor(gx1) * (1.0 / 7.0)) - 0.5;
+    gx1 = fract(gx1);
+    vec4 gz1 = vec4(0.5) - abs(gx1) - abs(gy1);
+    vec4 sz1 = step(gz1, vec4(0.0));
+    gx1 -= sz1 * (step(0.0, gx1) - 0.5);
+    gy1 -= sz1 * (step(0.0, gy1) - 0.5);
+
+    vec3 g000 = vec3(gx0.x, gy0.x, gz0.x);
+    vec3 g100 = vec3(gx0.y, gy0.y, gz0.y);
+    vec3 g010 = vec3(gx0.z, gy0.z, gz0.z);
+    vec3 g110 = vec3(gx0.w, gy0.w, gz0.w);
+    vec3 g001 = vec3(gx1.x, gy1.x, gz1.x);
+    vec3 g101 = vec3(gx1.y, gy1.y, gz1.y);
+    vec3 g011 = vec3(gx1.z, gy1.z, gz1.z);
+    vec3 g111 = vec3(gx1.w, gy1.w, gz1.w);
+
+    vec4 norm0 = perlinTaylorInvSqrt(vec4(dot(g000, g000), dot(g010, g010), dot(g100, g100), dot(g110, g110)));
+    g000 *= norm0.x;
+    g010 *= norm0.y;
+    g100 *= norm0.z;
+    g110 *= norm0.w;
+    vec4 norm1 = perlinTaylorInvSqrt(vec4(dot(g001, g001), dot(g011, g011), dot(g101, g101), dot(g111, g111)));
+    g001 *= norm1.x;
+    g011 *= norm1.y;
+    g101 *= norm1.z;
+    g111 *= norm1.w;
+
+    float n000 = dot(g000, Pf0);
+    float n100 = dot(g100, vec3(Pf1.x, Pf0.y, Pf0.z));
+    float n010 = dot(g010, vec3(Pf0.x, Pf1.y, Pf0.z));
+    float n110 = dot(g110, vec3(Pf1.x, Pf1.y, Pf0.z));
+    float n001 = dot(g001, vec3(Pf0.x, Pf0.y, Pf1.z));
+    float n101 = dot(g101, vec3(Pf1.x, Pf0.y, Pf1.z));
+    float n011 = dot(g011, vec3(Pf0.x, Pf1.y, Pf1.z));
+    float n111 = dot(g111, Pf1);
+
+    vec3 fadeXyz = perlinFade(Pf0);
+    vec4 nZ = mix(vec4(n000, n100, n010, n110), vec4(n001, n101, n011, n111), fadeXyz.z);
+    vec2 nYz = mix(nZ.xy, nZ.zw, fadeXyz.y);
+    return 2.2 * mix(nYz.x, nYz.y, fadeXyz.x);
+}
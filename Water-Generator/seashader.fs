@@ -18,6 +18,18 @@ uniform float diffuseStrength;  // Light reflection intensity
 uniform float specularStrength; // Shiny reflections
 uniform float shininess;        // Sharpness of specular highlight
 
+// Coast data, see shore_map.h: r depth, g distance to land, ba direction to it
+uniform bool u_shoreEnabled;
+uniform sampler2D u_shoreMap;
+uniform vec2 u_shoreOrigin;         // World x/z of texel (0, 0)
+uniform vec2 u_shoreSize;           // Texels in x and z
+uniform float u_shoreSpacing;
+uniform float u_shoreReferenceLevel; // Water level the depths are stored against
+uniform float u_foamWidth;
+uniform float u_shallowDepth;
+uniform vec3 u_shallowColor;
+uniform float u_time;
+
 void main()
 {
     vec3 lightDir = normalize(lightPos - vFragPos);
@@ -36,8 +48,25 @@ void main()
     float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
     vec3 specular = specularStrength * spec * lightColor;
 
+    // Shallow water takes the shallow colour; surf rolls in towards the coast inside the foam band
+    vec3 waterColor = objectColor;
+    float foam = 0.0;
+    if (u_shoreEnabled) {
+        vec2 uv = ((vFragPos.xz - u_shoreOrigin) / u_shoreSpacing + 0.5) / u_shoreSize;
+        vec4 shore = texture(u_shoreMap, uv);
+        // Below the displaced surface: the waves only ever lift it above the rest level
+        float depth = vFragPos.y - (u_shoreReferenceLevel - shore.r);
+        waterColor = mix(u_shallowColor, objectColor, smoothstep(0.0, u_shallowDepth, depth));
+        // Wavefronts parallel to the coast, wobbling along it so they don't look drawn with a ruler
+        float along = dot(vFragPos.xz, vec2(-shore.a, shore.b));
+        float wavefront = 0.5 + 0.5 * sin(shore.g * 2.0 + u_time * 1.5 + 1.5 * sin(along * 0.3));
+        foam = (1.0 - smoothstep(0.0, u_foamWidth, shore.g)) * smoothstep(0.6, 0.9, wavefront);
+        foam = max(foam, 1.0 - smoothstep(0.0, 0.4, depth)); // Wet edge right at the waterline
+    }
+
     // Combine lighting components
-    vec3 result = (ambient + diffuse + specular) * objectColor * lightIntensity;
+    vec3 result = (ambient + diffuse + specular) * waterColor * lightIntensity;
+    result = mix(result, (ambient + diffuse + vec3(0.5)) * lightIntensity, foam);
 
     // Output final color
     FragColor = vec4(result, 1.0);
@@ -0,0 +1,17 @@
+#version 330 core
+// Draws sea vertices that were already displaced by seashadernogs.vs and captured with
+// transform feedback, so the wave sum is only evaluated once per frame.
+layout (location = 0) in vec3 aPos;    // World-space displaced position
+layout (location = 1) in vec3 aNormal; // World-space normal
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 FragNormal;
+out vec3 vFragPos;
+void main()
+{
+    FragNormal = aNormal;
+    vFragPos = aPos;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
@@ -0,0 +1,51 @@
+// Sea surface shared by every program that needs the waves (sea draw, capture, debug normals).
+// The analytic part is mirrored on the CPU in include/sea_waves.h; keep them in sync.
+
+#include "fastmath.glsl"
+
+uniform float u_time;
+uniform float sea_frequency;
+uniform float sea_amplitude;
+uniform float wave_speed;
+
+// Interactive ripple layer, added on top of the analytic waves
+uniform sampler2D u_rippleMap;
+uniform vec2 u_rippleOrigin;
+uniform float u_rippleExtent;
+uniform bool u_ripplesEnabled;
+
+// Adds amplitude * exp(sin(dot(k, xz) + omegaT)) and its gradient
+void addWave(inout float height, inout vec2 slope, vec2 xz, float amplitude, vec2 k, float omegaT)
+{
+    float e, c;
+    waveExpSinCos(dot(k, xz) + omegaT, e, c);
+    height += amplitude * e;
+    slope += amplitude * e * c * k;
+}
+
+// Height offset of the sea at rest position xz; slope receives (dH/dx, dH/dz)
+float seaSurface(vec2 xz, out vec2 slope)
+{
+    float t = u_time;
+    float height = 0.0;
+    slope = vec2(0.0);
+
+    addWave(height, slope, xz, sea_amplitude,        vec2(0.3, sea_frequency + 0.1), t); // Ignores wave_speed
+    addWave(height, slope, xz, sea_amplitude * 0.8,  vec2(sea_frequency + 0.15, 0.0), t * wave_speed);
+    addWave(height, slope, xz, sea_amplitude * 0.9,  vec2(0.0, sea_frequency + 0.2), t * wave_speed);
+    addWave(height, slope, xz, sea_amplitude * 0.6,  vec2(sea_frequency + 0.05, 0.0), t * wave_speed);
+    addWave(height, slope, xz, sea_amplitude * 0.7,  vec2(sea_frequency + 0.08), t * wave_speed * 1.2);
+    addWave(height, slope, xz, sea_amplitude * 0.5,  vec2(1.0, -1.0) * (sea_frequency + 0.12), t * wave_speed * 0.8);
+    addWave(height, slope, xz, sea_amplitude * 0.4,  vec2(0.5 * (sea_frequency + 0.18)), t * wave_speed * 1.5);
+
+    // Simulated ripple height and its slope (central differences in the height texture)
+    if (u_ripplesEnabled) {
+        vec2 rippleUV = (xz - u_rippleOrigin) / u_rippleExtent;
+        vec2 texel = 1.0 / vec2(textureSize(u_rippleMap, 0));
+        float cellSize = u_rippleExtent * texel.x;
+        height += texture(u_rippleMap, rippleUV).r;
+        slope.x += (texture(u_rippleMap, rippleUV + vec2(texel.x, 0.0)).r - texture(u_rippleMap, rippleUV - vec2(texel.x, 0.0)).r) / (2.0 * cellSize);
+        slope.y += (texture(u_rippleMap, rippleUV + vec2(0.0, texel.y)).r - texture(u_rippleMap, rippleUV - vec2(0.0, texel.y)).r) / (2.0 * cellSize);
+    }
+    return height;
+}
@@ -0,0 +1,98 @@
+#version 430 core
+// GPU twin of generateHeightfield (include/noise.h), see include/terrain_compute.h.
+// TERRAIN_PASS is injected per program:
+//   0 biome noise, blended parameters, fBm and falloff into u_heights / u_biomes
+//   1 one pass of the clipped 3x3 (or (2r+1)^2) box from u_source into u_heights
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+uniform ivec2 u_size;           // Vertices in x and z
+layout (r32f, binding = 0) uniform image2D u_heights;
+
+#if TERRAIN_PASS == 0
+
+#include "perlin.glsl"
+
+layout (r8ui, binding = 1) uniform writeonly uimage2D u_biomes;
+
+// BiomeTable's compiled LUT: heightScale, frequency, persistence, lacunarity
+layout (std430, binding = 0) readonly buffer BiomeLut { vec4 biomeLut[]; };
+
+uniform vec2 u_origin;          // World x/z of vertex (0, 0)
+uniform float u_scale;
+uniform float u_seed;
+uniform int u_octaves;
+uniform bool u_applyFalloff;
+uniform int u_falloffBorder;    // FalloffSettings
+uniform float u_falloffEdge;
+uniform int u_bandCount;        // BiomeTable classification bands, sorted
+uniform float u_bandBelow[16];
+uniform int u_bandType[16];
+
+vec4 evaluateBiome(float noiseValue)
+{
+    float t = clamp(noiseValue, 0.0, 1.0) * float(biomeLut.length() - 2);
+    int i = int(t);
+    return mix(biomeLut[i], biomeLut[i + 1], t - float(i));
+}
+
+uint classifyBiome(float noiseValue)
+{
+    for (int i = 0; i < u_bandCount; i++)
+        if (noiseValue < u_bandBelow[i]) return uint(u_bandType[i]);
+    return u_bandCount == 0 ? 0u : uint(u_bandType[u_bandCount - 1]);
+}
+
+float falloff(ivec2 cell)
+{
+    int distanceToEdge = min(min(cell.x, u_size.x - 1 - cell.x), min(cell.y, u_size.y - 1 - cell.y));
+    if (distanceToEdge >= u_falloffBorder || u_falloffBorder <= 0) return 1.0;
+    return mix(u_falloffEdge, 1.0, float(distanceToEdge) / float(u_falloffBorder));
+}
+
+void main()
+{
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(cell, u_size))) return;
+    vec2 world = u_origin + vec2(cell);
+
+    float biomeNoise = (perlin(vec3(world.x / (u_scale * 4.0), u_seed * 0.1, world.y / (u_scale * 4.0))) + 1.0) * 0.5;
+    vec4 params = evaluateBiome(biomeNoise);
+
+    // Same octave sum as fbm3_batch
+    float height = 0.0, amplitude = 1.0, maxValue = 0.0, lacunarityPower = 1.0;
+    for (int o = 0; o < u_octaves; o++) {
+        float frequency = params.y * lacunarityPower;
+        height += perlin(vec3(world.x / u_scale * frequency, u_seed * 0.5 * frequency, world.y / u_scale * frequency)) * amplitude;
+        maxValue += amplitude;
+        amplitude *= params.z;
+        lacunarityPower *= params.w;
+    }
+    height = height / maxValue * params.x;
+    if (u_applyFalloff) height *= falloff(cell);
+
+    imageStore(u_heights, cell, vec4(height));
+    imageStore(u_biomes, cell, uvec4(classifyBiome(biomeNoise)));
+}
+
+#else
+
+layout (r32f, binding = 1) uniform readonly image2D u_source;
+uniform int u_radius;
+
+void main()
+{
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(cell, u_size))) return;
+
+    // Row by row like smoothHeights, renormalised over the cells inside the plane
+    ivec2 lo = max(cell - u_radius, ivec2(0));
+    ivec2 hi = min(cell + u_radius, u_size - 1);
+    float sum = 0.0;
+    for (int z = lo.y; z <= hi.y; z++)
+        for (int x = lo.x; x <= hi.x; x++)
+            sum += imageLoad(u_source, ivec2(x, z)).r;
+    imageStore(u_heights, cell, vec4(sum / float((hi.x - lo.x + 1) * (hi.y - lo.y + 1))));
+}
+
+#endif
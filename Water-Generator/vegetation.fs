@@ -0,0 +1,17 @@
+#version 330 core
+
+out vec4 FragColor;
+in vec3 position;
+in vec3 normal;
+in vec3 colour;
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform float lightIntensity;
+
+void main()
+{
+    vec3 lightDir = normalize(lightPos - position);
+    float diffuse = max(dot(normalize(normal), lightDir), 0.0);
+    FragColor = vec4(colour * (0.45 + diffuse * lightColor * lightIntensity), 1.0);
+}
@@ -0,0 +1,64 @@
+#version 330 core
+// Scattered trees, bushes and rocks (scatter.h): one mesh per kind, instanced per terrain chunk.
+// Instances only carry their place in the chunk and some variation; the ground height comes from
+// the terrain's height texture, like cdlodterrain.vs.
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec3 aColor;
+layout (location = 3) in vec2 aOffset;      // Per instance: position in the chunk, 0-1
+layout (location = 4) in vec4 aVariation;   // Per instance: rotation, scale, tint, biome, 0-1
+
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D u_heightmap;  // One texel per terrain vertex, R32F or normalised R16
+uniform float u_heightScale;    // height = texel * scale + offset
+uniform float u_heightOffset;
+uniform vec2 u_terrainOrigin;   // World x/z of texel (0, 0)
+uniform vec2 u_terrainSize;     // Vertices in x and z
+uniform float u_gridSpacing;
+
+uniform vec2 u_chunkOrigin;     // World x/z of the chunk corner
+uniform float u_chunkSize;      // World units
+uniform vec2 u_scaleRange;
+uniform float u_drawDistance;
+uniform vec3 u_cameraPos;
+uniform float seaLevel;
+uniform float u_shoreMargin;
+
+out vec3 position;
+out vec3 normal;
+out vec3 colour;
+
+// BiomeType: plains, hills, mountains, desert
+const vec3 biomeTint[4] = vec3[4](vec3(1.05, 1.05, 0.9), vec3(0.9, 1.0, 0.9), vec3(0.85, 0.9, 0.95), vec3(1.1, 1.0, 0.75));
+
+float terrainHeight(vec2 xz)
+{
+    vec2 uv = ((xz - u_terrainOrigin) / u_gridSpacing + 0.5) / u_terrainSize;
+    return textureLod(u_heightmap, uv, 0.0).r * u_heightScale + u_heightOffset;
+}
+
+void main()
+{
+    vec2 xz = u_chunkOrigin + aOffset * u_chunkSize;
+    float ground = terrainHeight(xz);
+
+    // Shrinks away over the last 15% of the draw distance instead of popping, and under a sea
+    // that has risen since the scatter
+    float scale = mix(u_scaleRange.x, u_scaleRange.y, aVariation.y);
+    scale *= clamp((u_drawDistance - distance(u_cameraPos, vec3(xz.x, ground, xz.y))) / (0.15 * u_drawDistance), 0.0, 1.0);
+    scale *= step(seaLevel + u_shoreMargin, ground);
+
+    float angle = aVariation.x * 6.2831853;
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    vec3 local = aPos * scale;
+    local.xz = rotation * local.xz;
+
+    position = vec3(xz.x, ground, xz.y) + local;
+    normal = vec3(0.0, aNormal.y, 0.0);
+    normal.xz = rotation * aNormal.xz;
+    colour = aColor * (0.8 + 0.4 * aVariation.z) * biomeTint[int(aVariation.w * 255.0 + 0.5) & 3];
+    gl_Position = projection * view * vec4(position, 1.0);
+}
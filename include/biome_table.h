@@ -0,0 +1,142 @@
+#ifndef BIOME_TABLE_H
+#define BIOME_TABLE_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+// Struct to hold biome-specific parameters
+struct BiomeParameters {
+    float heightScale;
+    float frequency;
+    float persistence;
+    float lacunarity;
+};
+
+// Define different biome types
+enum BiomeType {
+    PLAINS,
+    HILLS,
+    MOUNTAINS,
+    DESERT
+};
+
+// Fuzzy logic membership function
+float calculateMembership(float value, float start, float peak, float end) {
+    if (value < start || value > end) return 0.0f;
+    if (value < peak) {
+        return (value - start) / (peak - start);
+    }
+    return (end - value) / (end - peak);
+}
+
+// One row of the biome table. Over the 0-1 biome noise every biome contributes its parameters
+// with a triangular membership weight; biomeMap takes the first band (sorted by classifyBelow)
+// that contains the noise value.
+struct BiomeDefinition {
+    std::string name;
+    BiomeType type;           // Value written to biomeMap
+    float classifyBelow;      // Upper end of this biome's biomeMap band
+    float start, peak, end;   // Membership curve
+    BiomeParameters params;
+};
+
+// Data-driven replacement for the hard-coded fuzzy blend. compile() bakes the blended
+// parameters into a LUT over the biome noise, so evaluating a vertex is one indexed load and
+// a lerp. Recompile after every edit.
+class BiomeTable
+{
+public:
+    static const int LUT_SIZE = 4096;
+
+    std::vector<BiomeDefinition> biomes;
+    BiomeParameters fallback;     // Used where no membership curve is non-zero
+
+    // The original three-biome setup (mountains are classified as desert in biomeMap)
+    BiomeTable()
+    {
+        fallback = { 50.0f, 1.0f, 0.5f, 2.0f };
+        biomes.push_back({ "Plains", PLAINS, 0.3f, 0.0f, 0.25f, 0.5f, { 30.0f, 0.8f, 0.4f, 1.5f } });
+        biomes.push_back({ "Hills", HILLS, 0.55f, 0.5f, 0.625f, 0.75f, { 60.0f, 1.2f, 0.5f, 2.0f } });
+        biomes.push_back({ "Mountains", DESERT, 1.0f, 0.75f, 0.875f, 1.0f, { 100.0f, 1.5f, 0.6f, 2.5f } });
+        compile();
+    }
+
+    // Exact blend at one noise value; what the LUT samples
+    BiomeParameters blend(float noiseValue) const
+    {
+        BiomeParameters sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float totalMembership = 0.0f;
+        for (const BiomeDefinition& biome : biomes) {
+            float membership = calculateMembership(noiseValue, biome.start, biome.peak, biome.end);
+            sum.heightScale += membership * biome.params.heightScale;
+            sum.frequency += membership * biome.params.frequency;
+            sum.persistence += membership * biome.params.persistence;
+            sum.lacunarity += membership * biome.params.lacunarity;
+            totalMembership += membership;
+        }
+        if (totalMembership <= 0.0f)
+            return fallback;
+        return { sum.heightScale / totalMembership, sum.frequency / totalMembership,
+            sum.persistence / totalMembership, sum.lacunarity / totalMembership };
+    }
+
+    void compile()
+    {
+        // One extra entry so evaluate() can always read index + 1
+        lut.resize(LUT_SIZE + 1);
+        for (int i = 0; i < LUT_SIZE; i++)
+            lut[i] = blend((float)i / (LUT_SIZE - 1));
+        lut[LUT_SIZE] = lut[LUT_SIZE - 1];
+
+        bands.clear();
+        for (const BiomeDefinition& biome : biomes)
+            bands.push_back({ biome.classifyBelow, biome.type });
+        std::stable_sort(bands.begin(), bands.end(), [](const Band& a, const Band& b) { return a.below < b.below; });
+        version++;
+    }
+
+    BiomeParameters evaluate(float noiseValue) const
+    {
+        float t = std::min(std::max(noiseValue, 0.0f), 1.0f) * (LUT_SIZE - 1);
+        int i = (int)t;
+        float f = t - (float)i;
+        const BiomeParameters& a = lut[i];
+        const BiomeParameters& b = lut[i + 1];
+        return { a.heightScale + (b.heightScale - a.heightScale) * f, a.frequency + (b.frequency - a.frequency) * f,
+            a.persistence + (b.persistence - a.persistence) * f, a.lacunarity + (b.lacunarity - a.lacunarity) * f };
+    }
+
+    BiomeType classify(float noiseValue) const
+    {
+        for (const Band& band : bands)
+            if (noiseValue < band.below) return band.type;
+        return bands.empty() ? PLAINS : bands.back().type;
+    }
+
+    // Bumped by every compile(), so cached terrain can tell the table changed
+    uint32_t getVersion() const { return version; }
+
+    struct Band {
+        float below;
+        BiomeType type;
+    };
+
+    // Compiled state, for evaluating the table elsewhere (the GPU terrain generator)
+    const std::vector<BiomeParameters>& compiledLut() const { return lut; }
+    const std::vector<Band>& compiledBands() const { return bands; }
+
+private:
+    std::vector<BiomeParameters> lut;
+    std::vector<Band> bands;
+    uint32_t version = 0;
+};
+
+// Table used by getBiomeParameters()/classifyBiome() and edited from the ImGui menu
+BiomeTable& activeBiomeTable() {
+    static BiomeTable table;
+    return table;
+}
+
+#endif
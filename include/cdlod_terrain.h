@@ -0,0 +1,490 @@
+#ifndef CDLOD_TERRAIN_H
+#define CDLOD_TERRAIN_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <shader_m.h>
+#include "heightfield.h"
+#include "terrain_gpu.h"
+#include "sea_trim.h"
+#include "thread_pool.h"
+
+// View frustum as six inward-facing planes (xyz normal, w distance), extracted from a
+// projection * view matrix
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0]; // Left
+        frustum.planes[1] = rows[3] - rows[0]; // Right
+        frustum.planes[2] = rows[3] + rows[1]; // Bottom
+        frustum.planes[3] = rows[3] - rows[1]; // Top
+        frustum.planes[4] = rows[3] + rows[2]; // Near
+        frustum.planes[5] = rows[3] - rows[2]; // Far
+        for (glm::vec4& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // False only when the box is entirely outside one plane
+    bool intersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        for (const glm::vec4& plane : planes) {
+            // The box corner furthest along the plane normal
+            glm::vec3 corner(plane.x >= 0.0f ? boxMax.x : boxMin.x, plane.y >= 0.0f ? boxMax.y : boxMin.y,
+                plane.z >= 0.0f ? boxMax.z : boxMin.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return false;
+        }
+        return true;
+    }
+};
+
+struct CdlodSettings {
+    int patchResolution = 32;       // Quads per side of the shared grid patch (= cells per leaf node); a multiple of 4
+    float lodDistance = 64.0f;      // Range of the finest level; every coarser level doubles it (at least 2 leaf nodes)
+    float morphStart = 0.7f;        // Fraction of a level's distance band where morphing starts
+    float errorTolerance = 0.05f;   // Nodes whose geometric error is below this are never split
+    int triangleBudget = 500000;
+    bool adaptiveDistance = true;   // Shrink/grow lodDistance to stay within the triangle budget
+    bool fullResolution = false;    // Every visible leaf node, no LOD: a plain displaced grid
+    HeightmapTexture::Format heightFormat = HeightmapTexture::HEIGHTMAP_R32F;   // Applied by build()
+};
+
+struct CdlodStats {
+    int levels = 0;
+    int selectedNodes = 0;
+    int culledNodes = 0;
+    int submergedNodes = 0;         // In view but always under the sea, see sea_trim.h
+    int submergedTriangles = 0;     // What those nodes would have drawn at the level they were skipped
+    int triangles = 0;
+    float lodDistance = 0.0f;       // After budget adaptation
+    size_t gpuBytes = 0;
+};
+
+// Continuous distance-dependent LOD (Strugar's CDLOD) over a Heightfield. A quadtree stores the
+// min/max height and geometric error of every node; each frame the nodes inside their level's
+// distance band and the view frustum are selected and drawn as instances of one grid patch,
+// displaced from a height texture. Vertices morph towards the next coarser grid across the
+// outer part of each band, so levels meet without cracks or popping. The number of nodes drawn
+// depends on the distance bands, not on the terrain size.
+class CdlodTerrain
+{
+public:
+    static const int MAX_LEVELS = 16;
+
+    CdlodSettings settings;
+
+    CdlodTerrain() {}
+    ~CdlodTerrain() { release(); }
+    CdlodTerrain(const CdlodTerrain&) = delete;
+    CdlodTerrain& operator=(const CdlodTerrain&) = delete;
+
+    bool ready() const { return heightmap.id() != 0; }
+    const CdlodStats& getStats() const { return stats; }
+
+    // Nodes the sea hides are skipped with their whole subtree; a disabled band draws everything
+    void setSeaBand(const SeaBand& band) { seaBand = band; }
+
+    // Builds the quadtree and uploads the height texture and patch; needs the GL context current
+    void build(const Heightfield& heightfield, ThreadPool& pool = globalThreadPool())
+    {
+        release();
+        buildTree(heightfield, pool);
+        heightmap.upload(heightfield, settings.heightFormat);
+        buildPatch();
+    }
+
+    // Same as build() when heights() already holds the heightfield, e.g. written there by the
+    // GPU generator: skips the texture upload
+    void buildOnHeightmap(const Heightfield& heightfield, ThreadPool& pool = globalThreadPool())
+    {
+        releasePatch();
+        buildTree(heightfield, pool);
+        buildPatch();
+    }
+
+    // Picks the nodes to draw this frame
+    void select(const glm::vec3& cameraPos, const glm::mat4& viewProjection)
+    {
+        instances.clear();
+        quarterInstances.clear();
+        stats.culledNodes = stats.submergedNodes = stats.submergedTriangles = 0;
+        if (!ready()) return;
+
+        updateRanges();
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        if (settings.fullResolution) {
+            // No LOD: every leaf in the frustum at full detail, never morphing
+            morphStart[0] = morphEnd[0] = 1e9f;
+            for (int z = 0; z < nodeCountZ(0); z++)
+                for (int x = 0; x < nodeCountX(0); x++) {
+                    glm::vec3 boxMin, boxMax;
+                    nodeBox(0, x, z, boxMin, boxMax);
+                    if (!frustum.intersectsBox(boxMin, boxMax)) stats.culledNodes++;
+                    else if (seaBand.hides(boxMin, boxMax, cameraPos.y)) countSubmerged();
+                    else addInstance(instances, 0, x * nodeSize(0), z * nodeSize(0));
+                }
+            countSelected();
+            return;
+        }
+        int top = levelCount - 1;
+        int rootsX = nodeCountX(top), rootsZ = nodeCountZ(top);
+        for (int z = 0; z < rootsZ; z++)
+            for (int x = 0; x < rootsX; x++)
+                selectNode(top, x, z, cameraPos, frustum);
+
+        countSelected();
+        stats.lodDistance = currentLodDistance;
+
+        // Keep the next frame near the triangle budget
+        if (settings.adaptiveDistance) {
+            if (stats.triangles > settings.triangleBudget)
+                currentLodDistance = std::max(currentLodDistance * 0.95f, minimumLodDistance());
+            else if (stats.triangles < settings.triangleBudget * 0.8f)
+                currentLodDistance = std::min(currentLodDistance * 1.02f, settings.lodDistance);
+        }
+        else {
+            currentLodDistance = settings.lodDistance;
+        }
+    }
+
+    // Draws the selected nodes. The shader is cdlodterrain.vs; view, projection and any
+    // fragment uniforms are set by the caller.
+    void draw(const Shader& shader, const glm::vec3& cameraPos)
+    {
+        if (!ready() || (instances.empty() && quarterInstances.empty())) return;
+
+        shader.use();
+        heightmap.bind(shader, 3);
+        shader.setFloat("u_patchResolution", (float)settings.patchResolution);
+        shader.setVec3("u_cameraPos", cameraPos);
+        glUniform1fv(glGetUniformLocation(shader.ID, "u_morphStart"), levelCount, morphStart);
+        glUniform1fv(glGetUniformLocation(shader.ID, "u_morphEnd"), levelCount, morphEnd);
+
+        // Whole nodes, then the quarter nodes from the same buffer with the instance attribute
+        // moved past them
+        size_t wholeBytes = instances.size() * sizeof(float), quarterBytes = quarterInstances.size() * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, wholeBytes + quarterBytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, wholeBytes, instances.data());
+        glBufferSubData(GL_ARRAY_BUFFER, wholeBytes, quarterBytes, quarterInstances.data());
+        glBindVertexArray(patchVAO);
+        if (!instances.empty())
+            glDrawElementsInstanced(GL_TRIANGLES, patchIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)(instances.size() / 4));
+        if (!quarterInstances.empty()) {
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)wholeBytes);
+            glDrawElementsInstanced(GL_TRIANGLES, quarterIndexCount, GL_UNSIGNED_INT, (void*)(patchIndexCount * sizeof(unsigned int)),
+                (GLsizei)(quarterInstances.size() / 4));
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        }
+        glBindVertexArray(0);
+    }
+
+    // After an edit of vertices [x, x + width) x [z, z + height): re-uploads that rectangle of
+    // the height texture and refreshes the bounds and error of the nodes over it
+    void updateRegion(const Heightfield& heightfield, int x, int z, int width, int height)
+    {
+        if (!ready()) return;
+        heightmap.updateRegion(heightfield, x, z, width, height);
+        auto heightAt = [&](int hx, int hz) { return heightfield.heightAt(std::min(hx, terrainWidth - 1), std::min(hz, terrainHeight - 1)); };
+        for (int level = 0; level < levelCount; level++) {
+            // Nodes include their far edge, so an edit on a boundary touches both neighbours
+            int size = nodeSize(level);
+            int x0 = std::max(0, (x - 1) / size), x1 = std::min(nodeCountX(level) - 1, (x + width) / size);
+            int z0 = std::max(0, (z - 1) / size), z1 = std::min(nodeCountZ(level) - 1, (z + height) / size);
+            for (int nz = z0; nz <= z1; nz++)
+                for (int nx = x0; nx <= x1; nx++)
+                    computeNode(level, nx, nz, heightAt);
+        }
+    }
+
+    HeightmapTexture& heights() { return heightmap; }
+
+    // Geometric error of one node: the largest height difference between the terrain and the
+    // node's patch at its own resolution
+    float nodeError(int level, int x, int z) const { return levels[level].error[(size_t)z * nodeCountX(level) + x]; }
+
+private:
+    // Min/max heights and error of every quadtree node
+    void buildTree(const Heightfield& heightfield, ThreadPool& pool)
+    {
+        terrainWidth = heightfield.width();
+        terrainHeight = heightfield.height();
+        originX = heightfield.worldX(0);
+        originZ = heightfield.worldZ(0);
+        spacing = heightfield.spacing();
+        std::vector<float> heights = heightfield.decodeHeights();
+        auto heightAt = [&](int x, int z) {
+            return heights[(size_t)std::min(z, terrainHeight - 1) * terrainWidth + std::min(x, terrainWidth - 1)];
+        };
+
+        int cells = std::max(terrainWidth, terrainHeight) - 1;
+        levelCount = 1;
+        while ((settings.patchResolution << (levelCount - 1)) < cells && levelCount < MAX_LEVELS)
+            levelCount++;
+        levels.assign(levelCount, Level());
+        for (int level = 0; level < levelCount; level++) {
+            size_t count = (size_t)nodeCountX(level) * nodeCountZ(level);
+            levels[level].minHeight.assign(count, 0.0f);
+            levels[level].maxHeight.assign(count, 0.0f);
+            levels[level].error.assign(count, 0.0f);
+            pool.parallelFor(nodeCountZ(level), 1, [&](int zBegin, int zEnd) {
+                for (int z = zBegin; z < zEnd; z++)
+                    for (int x = 0; x < nodeCountX(level); x++)
+                        computeNode(level, x, z, heightAt);
+            });
+        }
+        currentLodDistance = settings.lodDistance;
+        stats.levels = levelCount;
+    }
+
+    struct Level {
+        std::vector<float> minHeight, maxHeight, error;
+    };
+
+    int nodeSize(int level) const { return settings.patchResolution << level; }
+    int nodeCountX(int level) const { return ((terrainWidth - 1) + nodeSize(level) - 1) / nodeSize(level); }
+    int nodeCountZ(int level) const { return ((terrainHeight - 1) + nodeSize(level) - 1) / nodeSize(level); }
+
+    // Leaves take min/max straight from the heights; every coarser node combines its children.
+    // A node's error is bounded by its children's error plus how far its own bilinear patch is
+    // from the heights at the children's grid points (the difference of two bilinear surfaces
+    // peaks at the finer grid's vertices). heightAt clamps to the terrain.
+    template<typename HeightFunction>
+    void computeNode(int level, int nx, int nz, const HeightFunction& heightAt)
+    {
+        int size = nodeSize(level);
+        int x0 = nx * size, z0 = nz * size;
+        float lo = 1e30f, hi = -1e30f, childError = 0.0f;
+        if (level == 0) {
+            for (int z = z0; z <= std::min(z0 + size, terrainHeight - 1); z++)
+                for (int x = x0; x <= std::min(x0 + size, terrainWidth - 1); x++) {
+                    lo = std::min(lo, heightAt(x, z));
+                    hi = std::max(hi, heightAt(x, z));
+                }
+        }
+        else {
+            const Level& children = levels[level - 1];
+            int childCountX = nodeCountX(level - 1), childCountZ = nodeCountZ(level - 1);
+            for (int cz = nz * 2; cz < std::min(nz * 2 + 2, childCountZ); cz++)
+                for (int cx = nx * 2; cx < std::min(nx * 2 + 2, childCountX); cx++) {
+                    size_t child = (size_t)cz * childCountX + cx;
+                    lo = std::min(lo, children.minHeight[child]);
+                    hi = std::max(hi, children.maxHeight[child]);
+                    childError = std::max(childError, children.error[child]);
+                }
+        }
+
+        // This node's patch samples every `step` cells; compare it to the finer grid
+        int step = size / settings.patchResolution;
+        float ownError = 0.0f;
+        if (step > 1) {
+            int fine = level == 0 ? 1 : step / 2;
+            for (int z = z0; z <= z0 + size && z < terrainHeight; z += fine) {
+                int gz = z0 + (z - z0) / step * step;
+                float tz = (float)(z - gz) / step;
+                for (int x = x0; x <= x0 + size && x < terrainWidth; x += fine) {
+                    int gx = x0 + (x - x0) / step * step;
+                    float tx = (float)(x - gx) / step;
+                    float top = heightAt(gx, gz) + (heightAt(gx + step, gz) - heightAt(gx, gz)) * tx;
+                    float bottom = heightAt(gx, gz + step) + (heightAt(gx + step, gz + step) - heightAt(gx, gz + step)) * tx;
+                    ownError = std::max(ownError, std::fabs(heightAt(x, z) - (top + (bottom - top) * tz)));
+                }
+            }
+        }
+        size_t index = (size_t)nz * nodeCountX(level) + nx;
+        levels[level].minHeight[index] = lo;
+        levels[level].maxHeight[index] = hi;
+        levels[level].error[index] = ownError + childError;
+    }
+
+    // Closer than about one and a half node sizes, a node can border one two levels coarser,
+    // which no morph closes
+    float minimumLodDistance() const { return 2.0f * settings.patchResolution; }
+
+    // Distances are in world units; the nodes of a coarser grid are `spacing` times larger
+    void updateRanges()
+    {
+        float distance = std::max(currentLodDistance, minimumLodDistance());
+        float previous = 0.0f;
+        for (int level = 0; level < levelCount; level++) {
+            ranges[level] = level == levelCount - 1 ? 1e9f : distance * spacing * (float)(1 << level);
+            morphEnd[level] = ranges[level];
+            morphStart[level] = previous + (ranges[level] - previous) * settings.morphStart;
+            previous = ranges[level];
+        }
+    }
+
+    void nodeBox(int level, int x, int z, glm::vec3& boxMin, glm::vec3& boxMax) const
+    {
+        const Level& current = levels[level];
+        size_t index = (size_t)z * nodeCountX(level) + x;
+        int size = nodeSize(level);
+        boxMin = glm::vec3(originX + x * size * spacing, current.minHeight[index], originZ + z * size * spacing);
+        boxMax = glm::vec3(originX + std::min((x + 1) * size, terrainWidth - 1) * spacing, current.maxHeight[index],
+            originZ + std::min((z + 1) * size, terrainHeight - 1) * spacing);
+    }
+
+    static bool boxInRange(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& point, float range)
+    {
+        glm::vec3 closest = glm::clamp(point, boxMin, boxMax);
+        glm::vec3 offset = closest - point;
+        return glm::dot(offset, offset) <= range * range;
+    }
+
+    // Returns false when the node is outside its level's range, so the parent covers its area
+    bool selectNode(int level, int x, int z, const glm::vec3& cameraPos, const Frustum& frustum)
+    {
+        glm::vec3 boxMin, boxMax;
+        nodeBox(level, x, z, boxMin, boxMax);
+        // Before the range test: a submerged child must not come back as a quarter of its parent
+        if (seaBand.hides(boxMin, boxMax, cameraPos.y)) {
+            if (frustum.intersectsBox(boxMin, boxMax)) countSubmerged();
+            return true;
+        }
+        if (!boxInRange(boxMin, boxMax, cameraPos, ranges[level])) return false;
+        if (!frustum.intersectsBox(boxMin, boxMax)) {
+            stats.culledNodes++;
+            return true;
+        }
+
+        bool flat = nodeError(level, x, z) <= settings.errorTolerance;
+        if (level == 0 || flat || !boxInRange(boxMin, boxMax, cameraPos, ranges[level - 1])) {
+            addInstance(instances, level, x * nodeSize(level), z * nodeSize(level));
+            return true;
+        }
+
+        // Children outside the finer range are drawn as quarter nodes at this level: the corner
+        // of the patch at this level's grid density, so they morph and meet their neighbours
+        // exactly like a whole node of this level would
+        int childCountX = nodeCountX(level - 1), childCountZ = nodeCountZ(level - 1);
+        for (int cz = z * 2; cz < std::min(z * 2 + 2, childCountZ); cz++)
+            for (int cx = x * 2; cx < std::min(x * 2 + 2, childCountX); cx++)
+                if (!selectNode(level - 1, cx, cz, cameraPos, frustum))
+                    addInstance(quarterInstances, level, cx * nodeSize(level - 1), cz * nodeSize(level - 1));
+        return true;
+    }
+
+    void countSubmerged()
+    {
+        stats.submergedNodes++;
+        stats.submergedTriangles += settings.patchResolution * settings.patchResolution * 2;
+    }
+
+    // The size is always a whole node's at this level: the shader derives the grid spacing from it
+    void addInstance(std::vector<float>& list, int level, int cellX, int cellZ)
+    {
+        list.push_back(originX + cellX * spacing);
+        list.push_back(originZ + cellZ * spacing);
+        list.push_back(nodeSize(level) * spacing);
+        list.push_back((float)level);
+    }
+
+    void countSelected()
+    {
+        int n = settings.patchResolution;
+        int wholeNodes = (int)instances.size() / 4, quarterNodes = (int)quarterInstances.size() / 4;
+        stats.selectedNodes = wholeNodes + quarterNodes;
+        stats.triangles = wholeNodes * n * n * 2 + quarterNodes * (n / 2) * (n / 2) * 2;
+    }
+
+    // One (n + 1)^2 grid in patch units, shared by every node; per-node origin, size and level
+    // come from the instance buffer (attribute 1). The element buffer holds the whole patch and
+    // then its (n / 2)^2 corner for quarter nodes, whose odd grid lines line up with the whole
+    // patch's as long as n / 2 is even.
+    void buildPatch()
+    {
+        int n = settings.patchResolution;
+        std::vector<float> grid;
+        grid.reserve((size_t)(n + 1) * (n + 1) * 2);
+        for (int z = 0; z <= n; z++)
+            for (int x = 0; x <= n; x++) {
+                grid.push_back((float)x);
+                grid.push_back((float)z);
+            }
+        std::vector<unsigned int> indices;
+        indices.reserve((size_t)n * n * 6 + (size_t)(n / 2) * (n / 2) * 6);
+        for (int z = 0; z < n; z++)
+            for (int x = 0; x < n; x++) {
+                unsigned int topLeft = z * (n + 1) + x;
+                unsigned int topRight = topLeft + 1;
+                unsigned int bottomLeft = (z + 1) * (n + 1) + x;
+                unsigned int bottomRight = bottomLeft + 1;
+                indices.insert(indices.end(), { topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight });
+            }
+        patchIndexCount = (GLsizei)indices.size();
+        for (int z = 0; z < n / 2; z++)
+            for (int x = 0; x < n / 2; x++) {
+                unsigned int topLeft = z * (n + 1) + x;
+                unsigned int topRight = topLeft + 1;
+                unsigned int bottomLeft = (z + 1) * (n + 1) + x;
+                unsigned int bottomRight = bottomLeft + 1;
+                indices.insert(indices.end(), { topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight });
+            }
+        quarterIndexCount = (GLsizei)indices.size() - patchIndexCount;
+
+        glGenVertexArrays(1, &patchVAO);
+        glGenBuffers(1, &patchVBO);
+        glGenBuffers(1, &patchEBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(patchVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, patchVBO);
+        glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(float), grid.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patchEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+        stats.gpuBytes = heightmap.gpuBytes() + grid.size() * sizeof(float) + indices.size() * sizeof(unsigned int);
+    }
+
+    void release()
+    {
+        heightmap.release();
+        releasePatch();
+    }
+
+    void releasePatch()
+    {
+        if (patchVAO) glDeleteVertexArrays(1, &patchVAO);
+        GLuint buffers[] = { patchVBO, patchEBO, instanceVBO };
+        for (GLuint buffer : buffers)
+            if (buffer) glDeleteBuffers(1, &buffer);
+        patchVAO = patchVBO = patchEBO = instanceVBO = 0;
+        instances.clear();
+        quarterInstances.clear();
+    }
+
+    int terrainWidth = 0, terrainHeight = 0;
+    float originX = 0.0f, originZ = 0.0f;
+    float spacing = 1.0f;           // World units per vertex
+    int levelCount = 0;
+    std::vector<Level> levels;
+    float ranges[MAX_LEVELS], morphStart[MAX_LEVELS], morphEnd[MAX_LEVELS];
+    float currentLodDistance = 0.0f;
+
+    std::vector<float> instances;   // originX, originZ, size, level per selected node
+    std::vector<float> quarterInstances;    // Same layout; size is still the whole node's
+    CdlodStats stats;
+    SeaBand seaBand;
+
+    HeightmapTexture heightmap;
+    GLuint patchVAO = 0, patchVBO = 0, patchEBO = 0, instanceVBO = 0;
+    GLsizei patchIndexCount = 0, quarterIndexCount = 0;
+};
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef EROSION_H
+#define EROSION_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include "thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EROSION_SSE2 1
+#endif
+
+// Erosion passes over a row-major height plane (Heightfield::heightPlane()).
+//
+// Hydraulic: water droplets roll downhill, picking up sediment where they speed up and dropping
+// it where they slow down (the particle model popularised by Hans Beyer's thesis). Droplets are
+// grouped by the tile they start in, and each droplet is confined to its tile plus a margin,
+// so tiles of one colour in a 2x2 colouring never touch the same cell and run in parallel.
+// Every tile draws its droplets from its own stream seeded by (seed, round, tile), and the
+// colours run in a fixed order, so the result depends on the seed only, never on the thread
+// count. The tile grid shifts between rounds so no seam stays put.
+//
+// Thermal: material slides from a cell to any of its 8 neighbours that is lower by more than
+// the talus height. The exchange between two cells depends only on their two heights, so each
+// cell gathers its own change from its neighbours into a second buffer: no write conflicts,
+// mass is conserved (to float rounding), and the result is deterministic.
+
+struct ErosionSettings {
+    bool hydraulic = false;
+    float dropletsPerVertex = 0.25f;
+    int rounds = 4;                 // Droplets are spread over this many tile-shifted rounds
+    int maxLifetime = 30;           // Steps, one cell each
+    int radius = 3;                 // Erosion brush radius in cells
+    float inertia = 0.05f;          // 0: follow the slope, 1: keep going straight
+    float sedimentCapacity = 2.0f;
+    float minCapacity = 0.01f;
+    float erodeSpeed = 0.2f;
+    float depositSpeed = 0.2f;
+    float evaporateSpeed = 0.01f;
+    float gravity = 4.0f;
+    uint32_t seed = 1;
+
+    bool thermal = false;
+    int thermalIterations = 50;
+    float talus = 1.0f;             // Height difference per cell that stays put
+    float thermalRate = 0.5f;       // Share of the excess moved per iteration
+};
+
+struct ErosionStats {
+    double hydraulicMilliseconds = 0.0;
+    double thermalMilliseconds = 0.0;
+    uint64_t droplets = 0;
+    uint64_t dropletSteps = 0;
+    bool cancelled = false;     // The heights are half-eroded
+};
+
+// splitmix64; one stream per tile and round
+class ErosionRandom
+{
+public:
+    explicit ErosionRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // [0, 1)
+    float nextFloat() { return (float)(next() >> 40) * (1.0f / 16777216.0f); }
+
+private:
+    uint64_t state;
+};
+
+namespace erosion_detail {
+
+    struct HeightAndGradient {
+        float height, gradientX, gradientZ;
+    };
+
+    // Bilinear height and gradient at (x, z); the cell and its +1 neighbours must be in range
+    inline HeightAndGradient sample(const float* heights, int width, float x, float z)
+    {
+        int cellX = (int)x, cellZ = (int)z;
+        float u = x - cellX, v = z - cellZ;
+        const float* p = heights + (size_t)cellZ * width + cellX;
+        float nw = p[0], ne = p[1], sw = p[width], se = p[width + 1];
+        HeightAndGradient result;
+        result.gradientX = (ne - nw) * (1.0f - v) + (se - sw) * v;
+        result.gradientZ = (sw - nw) * (1.0f - u) + (se - ne) * u;
+        result.height = nw * (1.0f - u) * (1.0f - v) + ne * u * (1.0f - v) + sw * (1.0f - u) * v + se * u * v;
+        return result;
+    }
+
+    struct BrushOffset {
+        int dx, dz;
+        float weight;
+    };
+
+    // Cells within `radius` weighted by (radius - distance), normalised
+    inline std::vector<BrushOffset> makeBrush(int radius)
+    {
+        std::vector<BrushOffset> brush;
+        float sum = 0.0f;
+        for (int dz = -radius; dz <= radius; dz++)
+            for (int dx = -radius; dx <= radius; dx++) {
+                float distance = std::sqrt((float)(dx * dx + dz * dz));
+                if (distance < radius) {
+                    brush.push_back({ dx, dz, radius - distance });
+                    sum += radius - distance;
+                }
+            }
+        for (BrushOffset& offset : brush) offset.weight /= sum;
+        return brush;
+    }
+
+    // Droplets of one tile; the droplet dies when its brush would leave [x0, x1) x [z0, z1)
+    inline uint64_t runTileDroplets(float* heights, int width, int x0, int z0, int x1, int z1, int spawnX0, int spawnZ0,
+        int spawnX1, int spawnZ1, int droplets, const ErosionSettings& settings, const std::vector<BrushOffset>& brush,
+        ErosionRandom& random)
+    {
+        int radius = settings.radius;
+        // Cell range whose brush and +1 corner stay inside the tile region
+        float minX = (float)(x0 + radius), minZ = (float)(z0 + radius);
+        float maxX = (float)(x1 - radius - 1), maxZ = (float)(z1 - radius - 1);
+        if (maxX <= minX || maxZ <= minZ) return 0;
+
+        uint64_t steps = 0;
+        for (int droplet = 0; droplet < droplets; droplet++) {
+            float x = spawnX0 + random.nextFloat() * (spawnX1 - spawnX0);
+            float z = spawnZ0 + random.nextFloat() * (spawnZ1 - spawnZ0);
+            x = std::min(std::max(x, minX), std::nextafter(maxX, minX));
+            z = std::min(std::max(z, minZ), std::nextafter(maxZ, minZ));
+            float directionX = 0.0f, directionZ = 0.0f;
+            float speed = 1.0f, water = 1.0f, sediment = 0.0f;
+
+            for (int lifetime = 0; lifetime < settings.maxLifetime; lifetime++) {
+                int cellX = (int)x, cellZ = (int)z;
+                float u = x - cellX, v = z - cellZ;
+                HeightAndGradient here = sample(heights, width, x, z);
+
+                directionX = directionX * settings.inertia - here.gradientX * (1.0f - settings.inertia);
+                directionZ = directionZ * settings.inertia - here.gradientZ * (1.0f - settings.inertia);
+                float length = std::sqrt(directionX * directionX + directionZ * directionZ);
+                if (length < 1e-6f) break;
+                directionX /= length;
+                directionZ /= length;
+                x += directionX;
+                z += directionZ;
+                steps++;
+                if (x < minX || x >= maxX || z < minZ || z >= maxZ) break;
+
+                float deltaHeight = sample(heights, width, x, z).height - here.height;
+                float capacity = std::max(-deltaHeight * speed * water * settings.sedimentCapacity, settings.minCapacity);
+
+                if (deltaHeight > 0.0f) {
+                    // Uphill: fill the pit behind, at most up to the new position
+                    float amount = std::min(deltaHeight, sediment);
+                    sediment -= amount;
+                    float* p = heights + (size_t)cellZ * width + cellX;
+                    p[0] += amount * (1.0f - u) * (1.0f - v);
+                    p[1] += amount * u * (1.0f - v);
+                    p[width] += amount * (1.0f - u) * v;
+                    p[width + 1] += amount * u * v;
+                }
+                else if (sediment > capacity) {
+                    // Spread over the brush like erosion; single-cell deposits pile up into spikes
+                    float amount = (sediment - capacity) * settings.depositSpeed;
+                    sediment -= amount;
+                    float* centre = heights + (size_t)cellZ * width + cellX;
+                    for (const BrushOffset& offset : brush)
+                        centre[offset.dz * width + offset.dx] += amount * offset.weight;
+                }
+                else {
+                    // Never dig deeper than the drop, or the droplet carves its own pit
+                    float amount = std::min((capacity - sediment) * settings.erodeSpeed, -deltaHeight);
+                    float* centre = heights + (size_t)cellZ * width + cellX;
+                    for (const BrushOffset& offset : brush)
+                        centre[offset.dz * width + offset.dx] -= amount * offset.weight;
+                    sediment += amount;
+                }
+
+                speed = std::sqrt(std::max(0.0f, speed * speed - deltaHeight * settings.gravity));
+                water *= 1.0f - settings.evaporateSpeed;
+            }
+        }
+        return steps;
+    }
+}
+
+// Hydraulic erosion in place. Returns the number of droplet steps taken. cancelled() is checked
+// between colour passes.
+uint64_t erodeHydraulic(std::vector<float>& heights, int width, int height, const ErosionSettings& settings,
+    ThreadPool& pool = globalThreadPool(), const std::function<bool()>& cancelled = nullptr) {
+    using namespace erosion_detail;
+    // A droplet can travel maxLifetime cells plus its brush from where it spawned, so with
+    // tiles twice that wide it rarely hits the edge of its region
+    int margin = settings.maxLifetime + settings.radius + 2;
+    int tileSize = std::max(2 * margin, 16);
+    std::vector<BrushOffset> brush = makeBrush(std::max(settings.radius, 1));
+    int rounds = std::max(settings.rounds, 1);
+    double totalDroplets = (double)settings.dropletsPerVertex * width * height;
+
+    uint64_t steps = 0;
+    for (int round = 0; round < rounds; round++) {
+        // Shift the tile grid every round so tile seams move around
+        ErosionRandom roundRandom(((uint64_t)settings.seed << 32) ^ (uint64_t)round * 0x632be59bd9b4e019ull);
+        int shiftX = (int)(roundRandom.next() % (uint64_t)tileSize);
+        int shiftZ = (int)(roundRandom.next() % (uint64_t)tileSize);
+        int tilesX = (width + shiftX + tileSize - 1) / tileSize;
+        int tilesZ = (height + shiftZ + tileSize - 1) / tileSize;
+
+        for (int colour = 0; colour < 4; colour++) {
+            if (cancelled && cancelled()) return steps;
+            int colourX = colour & 1, colourZ = colour >> 1;
+            int columns = (tilesX - colourX + 1) / 2;
+            int rows = (tilesZ - colourZ + 1) / 2;
+            if (columns <= 0 || rows <= 0) continue;
+            std::vector<uint64_t> tileSteps((size_t)columns * rows, 0);
+
+            pool.parallelFor(columns * rows, 1, [&](int begin, int end) {
+                for (int task = begin; task < end; task++) {
+                    int tileX = (task % columns) * 2 + colourX;
+                    int tileZ = (task / columns) * 2 + colourZ;
+                    int spawnX0 = std::max(tileX * tileSize - shiftX, 0);
+                    int spawnZ0 = std::max(tileZ * tileSize - shiftZ, 0);
+                    int spawnX1 = std::min((tileX + 1) * tileSize - shiftX, width);
+                    int spawnZ1 = std::min((tileZ + 1) * tileSize - shiftZ, height);
+                    // The region reaches halfway into the neighbouring (other colour) tiles
+                    int x0 = std::max(spawnX0 - tileSize / 2, 0), x1 = std::min(spawnX1 + tileSize / 2, width);
+                    int z0 = std::max(spawnZ0 - tileSize / 2, 0), z1 = std::min(spawnZ1 + tileSize / 2, height);
+
+                    uint64_t tileId = (uint64_t)tileZ * tilesX + tileX;
+                    ErosionRandom random(((uint64_t)settings.seed << 32) ^ (tileId * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)round << 20));
+                    double share = (double)(spawnX1 - spawnX0) * (spawnZ1 - spawnZ0) / ((double)width * height);
+                    int droplets = (int)(totalDroplets * share / rounds + 0.5);
+                    tileSteps[task] = runTileDroplets(heights.data(), width, x0, z0, x1, z1, spawnX0, spawnZ0, spawnX1, spawnZ1,
+                        droplets, settings, brush, random);
+                }
+            });
+            for (uint64_t count : tileSteps) steps += count;
+        }
+    }
+    return steps;
+}
+
+// Thermal erosion in place, `thermalIterations` gather passes; cancelled() is checked between them
+void erodeThermal(std::vector<float>& heights, int width, int height, const ErosionSettings& settings,
+    ThreadPool& pool = globalThreadPool(), const std::function<bool()>& cancelled = nullptr) {
+    // Each of the 8 exchanges moves at most rate / 16 of the excess, so a cell can't overshoot
+    const float exchange = std::min(std::max(settings.thermalRate, 0.0f), 1.0f) / 16.0f;
+    const float talus = settings.talus, talusDiagonal = settings.talus * 1.41421356f;
+    std::vector<float> next(heights.size());
+
+    // Excess over the talus in either direction; antisymmetric in the two cells, so whatever
+    // one loses the other gains
+    auto flow = [](float difference, float limit) {
+        return std::max(difference - limit, 0.0f) + std::min(difference + limit, 0.0f);
+    };
+    // Border cells, with their neighbour set clipped to the grid
+    auto clippedCell = [&](const float* source, int x, int z) {
+        float centre = source[(size_t)z * width + x];
+        float change = 0.0f;
+        for (int dz = -1; dz <= 1; dz++)
+            for (int dx = -1; dx <= 1; dx++) {
+                int nx = x + dx, nz = z + dz;
+                if ((dx == 0 && dz == 0) || nx < 0 || nx >= width || nz < 0 || nz >= height) continue;
+                change += flow(source[(size_t)nz * width + nx] - centre, (dx != 0 && dz != 0) ? talusDiagonal : talus);
+            }
+        return centre + exchange * change;
+    };
+
+    for (int iteration = 0; iteration < settings.thermalIterations; iteration++) {
+        if (cancelled && cancelled()) return;
+        const float* source = heights.data();
+        float* target = next.data();
+        pool.parallelFor(height, 32, [&](int zBegin, int zEnd) {
+            for (int z = zBegin; z < zEnd; z++) {
+                float* out = target + (size_t)z * width;
+                if (z == 0 || z == height - 1 || width < 3) {
+                    for (int x = 0; x < width; x++) out[x] = clippedCell(source, x, z);
+                    continue;
+                }
+                const float* above = source + (size_t)(z - 1) * width;
+                const float* row = source + (size_t)z * width;
+                const float* below = source + (size_t)(z + 1) * width;
+                out[0] = clippedCell(source, 0, z);
+                int x = 1;
+#ifdef EROSION_SSE2
+                // Four cells at a time, same summation order as the scalar loop
+                const __m128 zero = _mm_setzero_ps(), exchange4 = _mm_set1_ps(exchange);
+                const __m128 talus4 = _mm_set1_ps(talus), talusDiagonal4 = _mm_set1_ps(talusDiagonal);
+                auto flow4 = [&](const float* neighbour, __m128 centre, __m128 limit) {
+                    __m128 difference = _mm_sub_ps(_mm_loadu_ps(neighbour), centre);
+                    return _mm_add_ps(_mm_max_ps(_mm_sub_ps(difference, limit), zero), _mm_min_ps(_mm_add_ps(difference, limit), zero));
+                };
+                for (; x + 4 <= width - 1; x += 4) {
+                    __m128 centre = _mm_loadu_ps(row + x);
+                    __m128 straight = _mm_add_ps(_mm_add_ps(_mm_add_ps(flow4(row + x - 1, centre, talus4), flow4(row + x + 1, centre, talus4)),
+                        flow4(above + x, centre, talus4)), flow4(below + x, centre, talus4));
+                    __m128 diagonal = _mm_add_ps(_mm_add_ps(_mm_add_ps(flow4(above + x - 1, centre, talusDiagonal4),
+                        flow4(above + x + 1, centre, talusDiagonal4)), flow4(below + x - 1, centre, talusDiagonal4)),
+                        flow4(below + x + 1, centre, talusDiagonal4));
+                    _mm_storeu_ps(out + x, _mm_add_ps(centre, _mm_mul_ps(exchange4, _mm_add_ps(straight, diagonal))));
+                }
+#endif
+                for (; x < width - 1; x++) {
+                    float centre = row[x];
+                    float straight = flow(row[x - 1] - centre, talus) + flow(row[x + 1] - centre, talus)
+                        + flow(above[x] - centre, talus) + flow(below[x] - centre, talus);
+                    float diagonal = flow(above[x - 1] - centre, talusDiagonal) + flow(above[x + 1] - centre, talusDiagonal)
+                        + flow(below[x - 1] - centre, talusDiagonal) + flow(below[x + 1] - centre, talusDiagonal);
+                    out[x] = centre + exchange * (straight + diagonal);
+                }
+                out[width - 1] = clippedCell(source, width - 1, z);
+            }
+        });
+        heights.swap(next);
+    }
+}
+
+// Hydraulic then thermal, whichever are enabled
+ErosionStats erodeHeightPlane(std::vector<float>& heights, int width, int height, const ErosionSettings& settings,
+    ThreadPool& pool = globalThreadPool(), const std::function<bool()>& cancelled = nullptr) {
+    ErosionStats stats;
+    if (settings.hydraulic) {
+        auto start = std::chrono::high_resolution_clock::now();
+        stats.dropletSteps = erodeHydraulic(heights, width, height, settings, pool, cancelled);
+        stats.droplets = (uint64_t)((double)settings.dropletsPerVertex * width * height);
+        stats.hydraulicMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    if (settings.thermal) {
+        auto start = std::chrono::high_resolution_clock::now();
+        erodeThermal(heights, width, height, settings, pool, cancelled);
+        stats.thermalMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    stats.cancelled = cancelled && cancelled();
+    return stats;
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FAST_MATH_SSE2 1
+#endif
+
+// Polynomial approximations of the two functions the sea waves need per term:
+// exp(sin(x)) and cos(x). fastmath.glsl holds the same kernels for the shaders.
+//
+// The phase is reduced to r in [-pi/4, pi/4] around the nearest multiple of pi/2
+// (three-constant Cody-Waite), sin(r)/cos(r) are minimax polynomials in r^2 and exp(s)
+// is a minimax polynomial on s in [-1, 1]. Max error of the fitted polynomials:
+//
+//   tier               sin (rel)   cos (abs)   exp (rel)   exp(sin(x)) (abs)
+//   0 Reference        libm / GLSL builtins
+//   1 Precise  7/8/7   3.2e-9      4.7e-11     1.9e-7      9e-7 (float rounding dominates)
+//   2 Balanced 5/4/5   1.5e-6      1.0e-5      4.2e-5      1.4e-4
+//   3 Fast     3/2/3   4.1e-4      1.9e-3      5.0e-3      1.9e-2
+//
+// Range reduction adds roughly |x| * 6e-8 on top, the same order as the builtins.
+
+#define WAVE_MATH_REFERENCE 0
+#define WAVE_MATH_PRECISE 1
+#define WAVE_MATH_BALANCED 2
+#define WAVE_MATH_FAST 3
+
+struct WaveMathCoefficients {
+    int sinTerms; float sinC[4]; // sin(r) = r * P(r^2)
+    int cosTerms; float cosC[5]; // cos(r) = Q(r^2)
+    int expTerms; float expC[8]; // exp(s) = E(s)
+};
+
+static const WaveMathCoefficients waveMathCoefficients[4] = {
+    { 0, {}, 0, {}, 0, {} }, // Reference, unused
+    { 4, { 9.999999968e-01f, -1.666665022e-01f, 8.332016453e-03f, -1.950182201e-04f },
+      5, { 1.000000000e+00f, -4.999999962e-01f, 4.166661674e-02f, -1.388661921e-03f, 2.437992938e-05f },
+      8, { 9.999998808e-01f, 1.000001054e+00f, 5.000048572e-01f, 1.666582514e-01f,
+           4.163906772e-02f, 8.348694879e-03f, 1.436537383e-03f, 1.929712777e-04f } },
+    { 3, { 9.999984929e-01f, -1.666238231e-01f, 8.150056554e-03f },
+      3, { 9.999900350e-01f, -4.997081404e-01f, 4.039853597e-02f },
+      6, { 1.000027568e+00f, 9.998369595e-01f, 4.993418549e-01f, 1.672742590e-01f, 4.364625879e-02f, 8.040507473e-03f } },
+    { 2, { 9.995915742e-01f, -1.615350993e-01f },
+      2, { 9.980784990e-01f, -4.748206018e-01f },
+      4, { 9.965096228e-01f, 1.010803612e+00f, 5.388496161e-01f, 1.585170116e-01f } },
+};
+
+const char* waveMathTierName(int tier) {
+    static const char* names[] = { "Reference", "Precise", "Balanced", "Fast" };
+    return names[std::min(std::max(tier, 0), 3)];
+}
+
+// pi/2 split in three (Cephes DP1..DP3 doubled) so q * PIO2_HI and q * PIO2_MID are exact
+const float WAVE_TWO_OVER_PI = 0.636619772f;
+const float WAVE_PIO2_HI = 1.5703125f;
+const float WAVE_PIO2_MID = 4.837512969970703125e-4f;
+const float WAVE_PIO2_LO = 7.54978995489188216e-8f;
+
+float wavePolynomial(const float* c, int terms, float x) {
+    float result = c[terms - 1];
+    for (int i = terms - 2; i >= 0; i--)
+        result = result * x + c[i];
+    return result;
+}
+
+// expSin = exp(sin(x)), cosine = cos(x)
+template<int Tier>
+void waveExpSinCos(float x, float& expSin, float& cosine) {
+    if (Tier == WAVE_MATH_REFERENCE) {
+        expSin = std::exp(std::sin(x));
+        cosine = std::cos(x);
+        return;
+    }
+    const WaveMathCoefficients& k = waveMathCoefficients[Tier];
+
+    float q = std::floor(x * WAVE_TWO_OVER_PI + 0.5f);
+    float r = ((x - q * WAVE_PIO2_HI) - q * WAVE_PIO2_MID) - q * WAVE_PIO2_LO;
+    int quadrant = (int)q & 3;
+
+    float r2 = r * r;
+    float sinR = r * wavePolynomial(k.sinC, k.sinTerms, r2);
+    float cosR = wavePolynomial(k.cosC, k.cosTerms, r2);
+
+    // Rotate by the quadrant: sin(x) = sinR, cosR, -sinR, -cosR and cos(x) = cosR, -sinR, -cosR, sinR
+    float s = (quadrant & 1) ? cosR : sinR;
+    float c = (quadrant & 1) ? sinR : cosR;
+    if (quadrant & 2) s = -s;
+    if ((quadrant + 1) & 2) c = -c;
+
+    expSin = wavePolynomial(k.expC, k.expTerms, s);
+    cosine = c;
+}
+
+#ifdef FAST_MATH_SSE2
+__m128 wavePolynomial4(const float* c, int terms, __m128 x) {
+    __m128 result = _mm_set1_ps(c[terms - 1]);
+    for (int i = terms - 2; i >= 0; i--)
+        result = _mm_add_ps(_mm_mul_ps(result, x), _mm_set1_ps(c[i]));
+    return result;
+}
+
+// Four lanes of waveExpSinCos
+template<int Tier>
+void waveExpSinCos4(__m128 x, __m128& expSin, __m128& cosine) {
+    if (Tier == WAVE_MATH_REFERENCE) {
+        float in[4], e[4], c[4];
+        _mm_storeu_ps(in, x);
+        for (int i = 0; i < 4; i++)
+            waveExpSinCos<WAVE_MATH_REFERENCE>(in[i], e[i], c[i]);
+        expSin = _mm_loadu_ps(e);
+        cosine = _mm_loadu_ps(c);
+        return;
+    }
+    const WaveMathCoefficients& k = waveMathCoefficients[Tier];
+
+    // Round to nearest quadrant (default MXCSR rounding)
+    __m128i qi = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(WAVE_TWO_OVER_PI)));
+    __m128 q = _mm_cvtepi32_ps(qi);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(WAVE_PIO2_HI)));
+    r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(WAVE_PIO2_MID)));
+    r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(WAVE_PIO2_LO)));
+
+    __m128 r2 = _mm_mul_ps(r, r);
+    __m128 sinR = _mm_mul_ps(r, wavePolynomial4(k.sinC, k.sinTerms, r2));
+    __m128 cosR = wavePolynomial4(k.cosC, k.cosTerms, r2);
+
+    const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qi, one), one));
+    __m128 s = _mm_or_ps(_mm_and_ps(swap, cosR), _mm_andnot_ps(swap, sinR));
+    __m128 c = _mm_or_ps(_mm_and_ps(swap, sinR), _mm_andnot_ps(swap, cosR));
+    // Bit 1 of the quadrant moves into the float sign bit
+    s = _mm_xor_ps(s, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(qi, two), 30)));
+    c = _mm_xor_ps(c, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qi, one), two), 30)));
+
+    expSin = wavePolynomial4(k.expC, k.expTerms, s);
+    cosine = c;
+}
+#endif
+
+// Batch form used by the report and by CPU-side wave evaluation
+template<int Tier>
+void waveExpSinCosBatch(const float* x, float* expSin, float* cosine, size_t count) {
+    size_t i = 0;
+#ifdef FAST_MATH_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 e, c;
+        waveExpSinCos4<Tier>(_mm_loadu_ps(x + i), e, c);
+        _mm_storeu_ps(expSin + i, e);
+        _mm_storeu_ps(cosine + i, c);
+    }
+#endif
+    for (; i < count; i++)
+        waveExpSinCos<Tier>(x[i], expSin[i], cosine[i]);
+}
+
+void waveExpSinCosBatch(int tier, const float* x, float* expSin, float* cosine, size_t count) {
+    switch (tier) {
+    case WAVE_MATH_PRECISE: waveExpSinCosBatch<WAVE_MATH_PRECISE>(x, expSin, cosine, count); break;
+    case WAVE_MATH_BALANCED: waveExpSinCosBatch<WAVE_MATH_BALANCED>(x, expSin, cosine, count); break;
+    case WAVE_MATH_FAST: waveExpSinCosBatch<WAVE_MATH_FAST>(x, expSin, cosine, count); break;
+    default: waveExpSinCosBatch<WAVE_MATH_REFERENCE>(x, expSin, cosine, count); break;
+    }
+}
+
+// Prints max error against double precision and throughput for every tier
+void runWaveMathReport(float maxPhase = 200.0f, size_t sampleCount = 1 << 20) {
+    std::vector<float> phases(sampleCount), e(sampleCount), c(sampleCount);
+    for (size_t i = 0; i < sampleCount; i++)
+        phases[i] = -maxPhase + 2.0f * maxPhase * (float)i / (float)(sampleCount - 1);
+
+    std::ios format(nullptr);
+    format.copyfmt(std::cout);
+    std::cout << "Wave math report, phases in [" << -maxPhase << ", " << maxPhase << "], " << sampleCount << " samples" << std::endl;
+    std::cout << std::setw(10) << "tier" << std::setw(16) << "exp(sin) err" << std::setw(14) << "cos err" << std::setw(16) << "Msamples/s" << std::endl;
+    for (int tier = 0; tier < 4; tier++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        const int repeats = 8;
+        for (int r = 0; r < repeats; r++)
+            waveExpSinCosBatch(tier, phases.data(), e.data(), c.data(), sampleCount);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        double maxExpError = 0.0, maxCosError = 0.0;
+        for (size_t i = 0; i < sampleCount; i++) {
+            double x = phases[i];
+            maxExpError = std::max(maxExpError, std::fabs(e[i] - std::exp(std::sin(x))));
+            maxCosError = std::max(maxCosError, std::fabs(c[i] - std::cos(x)));
+        }
+        std::cout << std::setw(10) << waveMathTierName(tier) << std::setw(16) << std::scientific << std::setprecision(2) << maxExpError
+            << std::setw(14) << maxCosError << std::setw(16) << std::fixed << std::setprecision(1)
+            << repeats * sampleCount / seconds * 1e-6 << std::endl;
+    }
+    std::cout.copyfmt(format);
+}
+
+#endif
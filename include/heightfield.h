@@ -0,0 +1,216 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "thread_pool.h"
+
+// Compact terrain: one height per grid vertex plus a packed biome plane. x and z are implied
+// by the grid (1 unit spacing unless set otherwise, centred on the origin like generateTerrain)
+// and the triangle list is implied by the dimensions, so both are only built when a renderer
+// asks for them.
+//
+// Per vertex: 4 bytes of float height (2 when quantised) + 1 byte of biome (+ 4 of packed normal
+// when the generator kept one), against 12 bytes of xyz + 4 bytes of BiomeType + ~24 bytes of
+// indices in TerrainData.
+class Heightfield
+{
+public:
+    enum Format {
+        HEIGHT_FLOAT,
+        HEIGHT_UINT16   // height = quantised * quantScale + quantOffset
+    };
+
+    Heightfield() {}
+
+    Heightfield(int width, int height, Format format = HEIGHT_FLOAT)
+        : w(width), h(height), storage(format)
+    {
+        biomes.assign(vertexCount(), 0);
+        if (format == HEIGHT_FLOAT) heights.assign(vertexCount(), 0.0f);
+        else quantised.assign(vertexCount(), 0);
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    size_t vertexCount() const { return (size_t)w * h; }
+    Format format() const { return storage; }
+
+    // A grid with spacing s covers the same area as the (w - 1) * s + 1 grid it was sampled from
+    float worldX(int x) const { return (float)x * gridSpacing - ((w - 1) * gridSpacing + 1.0f) / 2.0f; }
+    float worldZ(int z) const { return (float)z * gridSpacing - ((h - 1) * gridSpacing + 1.0f) / 2.0f; }
+
+    // World units between neighbouring vertices; coarse previews use more than 1
+    float spacing() const { return gridSpacing; }
+    void setSpacing(float spacing) { gridSpacing = spacing; releaseMesh(); }
+
+    float heightAt(int x, int z) const
+    {
+        size_t i = (size_t)z * w + x;
+        return format() == HEIGHT_FLOAT ? heights[i] : quantised[i] * quantScale + quantOffset;
+    }
+
+    // Stored as uint8 BiomeType values
+    uint8_t biomeAt(int x, int z) const { return biomes[(size_t)z * w + x]; }
+
+    // Float plane for in-place passes (smoothing, erosion). Quantised heightfields are decoded
+    // first. Any cached mesh and the normals are dropped since the caller may change heights.
+    std::vector<float>& heightPlane()
+    {
+        if (format() == HEIGHT_UINT16) dequantise();
+        releaseMesh();
+        std::vector<uint32_t>().swap(normals);
+        return heights;
+    }
+    const std::vector<float>& heightPlane() const { return heights; } // Empty when quantised
+
+    std::vector<uint8_t>& biomePlane() { return biomes; }
+    const std::vector<uint8_t>& biomePlane() const { return biomes; }
+
+    // Vertex normals packed with packTerrainNormal, row-major. Empty unless the generator kept
+    // them; set them after the heights, since heightPlane() drops them.
+    std::vector<uint32_t>& normalPlane() { return normals; }
+    const std::vector<uint32_t>& normalPlane() const { return normals; }
+
+    // Heights as floats regardless of the storage format
+    std::vector<float> decodeHeights() const
+    {
+        if (format() == HEIGHT_FLOAT) return heights;
+        std::vector<float> decoded(quantised.size());
+        for (size_t i = 0; i < quantised.size(); i++)
+            decoded[i] = quantised[i] * quantScale + quantOffset;
+        return decoded;
+    }
+
+    // Switch to 16-bit storage over the current height range (error <= range / 131070)
+    void quantise()
+    {
+        if (format() == HEIGHT_UINT16) return;
+        if (!heights.empty()) {
+            auto range = std::minmax_element(heights.begin(), heights.end());
+            quantOffset = *range.first;
+            quantScale = (*range.second - *range.first) / 65535.0f;
+        }
+        float inverse = quantScale > 0.0f ? 1.0f / quantScale : 0.0f;
+
+        quantised.resize(heights.size());
+        for (size_t i = 0; i < heights.size(); i++)
+            quantised[i] = (uint16_t)std::min(65535.0f, (heights[i] - quantOffset) * inverse + 0.5f);
+        std::vector<float>().swap(heights);
+        storage = HEIGHT_UINT16;
+    }
+
+    void dequantise()
+    {
+        if (format() == HEIGHT_FLOAT) return;
+        heights = decodeHeights();
+        std::vector<uint16_t>().swap(quantised);
+        storage = HEIGHT_FLOAT;
+    }
+
+    float quantisationScale() const { return quantScale; }
+    float quantisationOffset() const { return quantOffset; }
+
+    // Interleaved xyz positions, built on first use
+    const std::vector<float>& meshVertices(ThreadPool& pool = globalThreadPool()) const
+    {
+        if (meshVertexCache.empty() && vertexCount() > 0) {
+            meshVertexCache.resize(vertexCount() * 3);
+            pool.parallelFor(h, 64, [&](int zBegin, int zEnd) {
+                for (int z = zBegin; z < zEnd; z++) {
+                    for (int x = 0; x < w; x++) {
+                        float* out = &meshVertexCache[((size_t)z * w + x) * 3];
+                        out[0] = worldX(x);
+                        out[1] = heightAt(x, z);
+                        out[2] = worldZ(z);
+                    }
+                }
+            });
+        }
+        return meshVertexCache;
+    }
+
+    // Two triangles per grid cell, in generateTerrain's winding, built on first use
+    const std::vector<unsigned int>& meshIndices(ThreadPool& pool = globalThreadPool()) const
+    {
+        if (meshIndexCache.empty() && w > 1 && h > 1) {
+            meshIndexCache.resize((size_t)(w - 1) * (h - 1) * 6);
+            pool.parallelFor(h - 1, 64, [&](int zBegin, int zEnd) {
+                for (int z = zBegin; z < zEnd; z++) {
+                    unsigned int* out = &meshIndexCache[(size_t)z * (w - 1) * 6];
+                    for (int x = 0; x < w - 1; x++) {
+                        unsigned int topLeft = z * w + x;
+                        unsigned int topRight = topLeft + 1;
+                        unsigned int bottomLeft = (z + 1) * w + x;
+                        unsigned int bottomRight = bottomLeft + 1;
+
+                        *out++ = topLeft;
+                        *out++ = bottomLeft;
+                        *out++ = topRight;
+                        *out++ = topRight;
+                        *out++ = bottomLeft;
+                        *out++ = bottomRight;
+                    }
+                }
+            });
+        }
+        return meshIndexCache;
+    }
+
+    // Free the mesh once it has been uploaded
+    void releaseMesh() const
+    {
+        std::vector<float>().swap(meshVertexCache);
+        std::vector<unsigned int>().swap(meshIndexCache);
+    }
+
+    // Bytes held by the height, biome and normal planes (and any cached mesh)
+    size_t memoryBytes() const
+    {
+        return heights.capacity() * sizeof(float) + quantised.capacity() * sizeof(uint16_t) + biomes.capacity()
+            + normals.capacity() * sizeof(uint32_t) + meshVertexCache.capacity() * sizeof(float)
+            + meshIndexCache.capacity() * sizeof(unsigned int);
+    }
+
+private:
+    int w = 0, h = 0;
+    Format storage = HEIGHT_FLOAT;
+    std::vector<float> heights;
+    std::vector<uint16_t> quantised;
+    float quantScale = 1.0f, quantOffset = 0.0f;
+    std::vector<uint8_t> biomes;
+    std::vector<uint32_t> normals;
+    float gridSpacing = 1.0f;
+
+    mutable std::vector<float> meshVertexCache;
+    mutable std::vector<unsigned int> meshIndexCache;
+};
+
+// Normal packed as GL_INT_2_10_10_10_REV (x, y, z signed 10-bit, w unused)
+uint32_t packTerrainNormal(const glm::vec3& normal) {
+    auto pack = [](float v) { return (uint32_t)((int)std::floor(glm::clamp(v, -1.0f, 1.0f) * 511.0f + 0.5f) & 0x3ff); };
+    return pack(normal.x) | (pack(normal.y) << 10) | (pack(normal.z) << 20);
+}
+
+glm::vec3 unpackTerrainNormal(uint32_t packed) {
+    auto unpack = [](uint32_t v) { return (float)((int)(v << 22) >> 22) / 511.0f; };
+    return glm::vec3(unpack(packed), unpack(packed >> 10), unpack(packed >> 20));
+}
+
+// Packed normal of vertex (x, z) from heightAt(x, z) of a width x height grid: central
+// differences, one-sided at the border, over `spacing` world units between vertices
+template<typename HeightAt>
+uint32_t packedGridNormal(const HeightAt& heightAt, int x, int z, int width, int height, float spacing) {
+    int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, width - 1);
+    int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, height - 1);
+    float dx = x1 > x0 ? (heightAt(x1, z) - heightAt(x0, z)) / ((x1 - x0) * spacing) : 0.0f;
+    float dz = z1 > z0 ? (heightAt(x, z1) - heightAt(x, z0)) / ((z1 - z0) * spacing) : 0.0f;
+    float inverseLength = 1.0f / std::sqrt(dx * dx + 1.0f + dz * dz);
+    return packTerrainNormal(glm::vec3(-dx, 1.0f, -dz) * inverseLength);
+}
+
+#endif
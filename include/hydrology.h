@@ -0,0 +1,826 @@
+#ifndef HYDROLOGY_H
+#define HYDROLOGY_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <limits>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+#include <queue>
+#include <iostream>
+#include "thread_pool.h"
+#include "noise.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Drainage over a row-major height plane (Heightfield::heightPlane()): rivers where a lot of
+// terrain drains through a cell, lakes where water would pool. Cells at or below the sea level
+// are sea and take any water that reaches them; water reaching the map edge leaves the map.
+//
+// Depressions are filled with Barnes, Lehman & Mulla's Priority-Flood + epsilon: the surface is
+// flooded inwards from the outlets in order of height. A cell reached from a higher one is raised
+// just above it, so every filled cell has a strictly lower neighbour and water reaches an outlet
+// from anywhere. Keys never go below the last one popped, so the open set is a radix heap (a
+// bucketed monotone queue) instead of a binary heap, and cells whose fill is already settled
+// skip it through a plain FIFO. The flood runs per tile in parallel, and a small graph of the
+// spills between tiles then gives every tile the level it drains at; only the epsilon over the
+// flats left behind is serial.
+//
+// Flow directions come from the filled surface:
+// - D8 sends everything to the steepest of the 8 neighbours.
+// - D-infinity (Tarboton) takes the steepest of the 8 triangular facets around the cell and
+//   splits the flow between its two corners by angle.
+// Receivers are always strictly lower, so the flow graph is a DAG. Accumulation walks it from
+// its sources in parallel. A cell's upstream area is summed by pulling from its donors in a
+// fixed order once the last of them finishes (an atomic count of unfinished donors). The sums
+// therefore don't depend on which thread finished last, and the result is deterministic.
+
+enum FlowRouting {
+    FLOW_D8,
+    FLOW_DINF
+};
+
+struct HydrologySettings {
+    bool enabled = false;
+    FlowRouting routing = FLOW_D8;
+    float seaLevel = -10.0f;        // Set from the scene; cells at or below it are sea
+    float epsilon = 0.0f;           // Rise across filled flats; 0 is the next float up
+    float riverThreshold = 250.0f;  // Upstream area (cells) where a river starts
+    float carveDepth = 1.5f;        // Channel depth of the largest rivers, in world units
+    float minLakeDepth = 0.05f;     // Filled depth below which a pit is not a lake
+    bool carveRivers = true;
+    bool fillLakes = true;          // Flatten lakes to their surface instead of leaving the bed
+};
+
+struct HydrologyStats {
+    double fillMilliseconds = 0.0;
+    double fillSerialMilliseconds = 0.0;    // Part of the fill on one thread: spill graph and epsilon
+    double directionMilliseconds = 0.0;
+    double accumulationMilliseconds = 0.0;
+    double outputMilliseconds = 0.0;    // Masks, carving and texels
+    uint64_t raisedCells = 0;           // Filled above the terrain
+    uint64_t seaCells = 0;
+    uint64_t lakeCells = 0;
+    uint64_t riverCells = 0;
+    float maxAccumulation = 0.0f;
+};
+
+// One texel per vertex, RGBA8 packed little-endian (R in the low byte):
+//   R  log2 of the upstream area over 24 (so 16M cells is 1)
+//   G  river strength, 0 off the rivers
+//   B  lake depth over 4 world units, 0 off the lakes
+//   A  0 on the sea, 1 on land
+struct HydrologyMaps {
+    int width = 0, height = 0;
+    std::vector<float> filled;          // Priority-Flood surface, before carving
+    std::vector<float> accumulation;    // Upstream area in cells, the cell included
+    std::vector<uint32_t> texels;
+    HydrologyStats stats;
+
+    size_t memoryBytes() const
+    {
+        return filled.capacity() * sizeof(float) + accumulation.capacity() * sizeof(float) + texels.capacity() * sizeof(uint32_t);
+    }
+};
+
+namespace hydrology_detail {
+
+// Neighbour d lies at angle d * 45 degrees: even codes are edge neighbours, odd are diagonal
+const int offsetX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int offsetZ[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+const uint8_t NO_RECEIVER = 8;
+
+inline int opposite(int direction) { return (direction + 4) & 7; }
+
+// Where a cell sends its water: `share` / 65535 of it to `first`, the rest to `second`
+struct FlowReceivers {
+    uint8_t first = NO_RECEIVER;
+    uint8_t second = NO_RECEIVER;
+    uint16_t share = 65535;
+};
+
+// 64-bit scans only exist on 64-bit MSVC targets; 32-bit x86 scans the two halves instead
+inline int highestBit(uint64_t value) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanReverse(&index, (unsigned long)(value >> 32))) return (int)index + 32;
+    _BitScanReverse(&index, (unsigned long)value);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+inline int lowestBit(uint64_t value) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, (unsigned long)value)) return (int)index;
+    _BitScanForward(&index, (unsigned long)(value >> 32));
+    return (int)index + 32;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// Radix heap: a bucketed priority queue for keys that only ever increase past the last one
+// popped. Bucket b holds the keys whose highest bit differing from the last popped key is b.
+// Popping takes the minimum of the lowest non-empty bucket and redistributes the rest of that
+// bucket around it; keys only ever move to lower buckets, so every operation is amortised
+// O(1) appends to 64 vectors.
+//
+// The key is the height's bits in sortable order above the cell index, so keys are unique,
+// equal heights pop in index order and the fill is deterministic.
+class RadixQueue
+{
+public:
+    bool empty() const { return occupied == 0; }
+
+    void push(float height, uint32_t index)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &height, sizeof(bits));
+        bits ^= (bits >> 31) ? 0xffffffffu : 0x80000000u;
+        insert(((uint64_t)bits << 32) | index);
+    }
+
+    uint32_t pop(float& height)
+    {
+        int bucket = lowestBit(occupied);
+        std::vector<uint64_t>& split = buckets[bucket];
+        auto lowest = std::min_element(split.begin(), split.end());
+        last = *lowest;
+        *lowest = split.back();
+        split.pop_back();
+        occupied &= ~(1ull << bucket);
+        for (uint64_t key : split) insert(key);
+        split.clear();
+
+        uint32_t bits = (uint32_t)(last >> 32);
+        bits ^= (bits >> 31) ? 0x80000000u : 0xffffffffu;
+        std::memcpy(&height, &bits, sizeof(height));
+        return (uint32_t)last;
+    }
+
+private:
+    void insert(uint64_t key)
+    {
+        int bucket = highestBit(key ^ last);
+        buckets[bucket].push_back(key);
+        occupied |= 1ull << bucket;
+    }
+
+    std::vector<uint64_t> buckets[64];
+    uint64_t occupied = 0;  // Bit b set when bucket b is not empty
+    uint64_t last = 0;
+};
+
+// The fill runs in three steps so that most of it is parallel (after Barnes' tiled
+// Priority-Flood). First every tile is flooded on its own, without epsilon, from its border
+// cells and the outlets inside it; each border cell starts its own watershed label and the
+// outlets share OCEAN_LABEL. The lowest spill between every pair of labels that touch, inside a
+// tile or across a tile edge, makes a small graph. Second, the graph is flooded from the ocean,
+// which gives every label the level it drains at, and a cell's level without epsilon is the
+// larger of its tile fill and its label's spill. Third, the epsilon: only the cells left with
+// no strictly lower neighbour (filled pits and flats) are flooded again, serially, from the
+// cells around them that do drain.
+const int FLOOD_TILE = 256;
+const uint32_t OCEAN_LABEL = 1;     // 0: sea, or not reached yet
+
+// Lowest level water crosses between two labels at; the smaller label in the high half
+struct SpillEdge {
+    uint64_t labels;
+    float level;
+};
+
+inline uint64_t spillKey(uint32_t a, uint32_t b) {
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+// Land cells on the map edge or next to the sea
+inline bool isOutlet(const std::vector<float>& heights, int width, int height, float seaLevel, int x, int z) {
+    if (x == 0 || z == 0 || x == width - 1 || z == height - 1) return true;
+    const float* centre = &heights[(size_t)z * width + x];
+    for (int d = 0; d < 8; d++)
+        if (centre[(ptrdiff_t)offsetZ[d] * width + offsetX[d]] <= seaLevel) return true;
+    return false;
+}
+
+// Priority-Flood without epsilon over the tile [x0, x1) x [z0, z1), writing its part of
+// `filled` and `labels`. Border cells are labelled firstLabel onwards in row order. Works on a
+// copy of the tile padded with a closed ring; the spills between labels found inside the tile
+// are appended to `edges`, one per pair.
+void floodTile(const std::vector<float>& heights, int width, int height, float seaLevel, int x0, int z0, int x1, int z1,
+    uint32_t firstLabel, std::vector<float>& filled, std::vector<uint32_t>& labels, std::vector<SpillEdge>& edges) {
+    const float infinity = std::numeric_limits<float>::infinity();
+    int tileWidth = x1 - x0, tileHeight = z1 - z0;
+    int stride = tileWidth + 2;
+    size_t paddedCount = (size_t)stride * (tileHeight + 2);
+    std::vector<float> open(paddedCount, -infinity), level(paddedCount);
+    std::vector<uint32_t> label(paddedCount, 0);
+    ptrdiff_t offsets[8];
+    for (int d = 0; d < 8; d++) offsets[d] = (ptrdiff_t)offsetZ[d] * stride + offsetX[d];
+    auto local = [&](int x, int z) { return (size_t)(z - z0 + 1) * stride + (x - x0 + 1); };
+
+    RadixQueue queue;
+    uint32_t nextLabel = firstLabel;
+    for (int z = z0; z < z1; z++)
+        for (int x = x0; x < x1; x++) {
+            float h = heights[(size_t)z * width + x];
+            if (h <= seaLevel) continue;
+            size_t p = local(x, z);
+            bool border = x == x0 || z == z0 || x == x1 - 1 || z == z1 - 1;
+            bool outlet = isOutlet(heights, width, height, seaLevel, x, z);
+            if (!border && !outlet) {
+                open[p] = h;
+                continue;
+            }
+            label[p] = outlet ? OCEAN_LABEL : nextLabel;
+            nextLabel += !outlet;
+            level[p] = h;
+            queue.push(h, (uint32_t)p);
+        }
+
+    struct Settled { uint32_t cell; float level; };
+    std::vector<Settled> settled;
+    size_t settledHead = 0;
+    std::vector<SpillEdge> found;
+    for (;;) {
+        uint32_t cell;
+        float spill;
+        if (settledHead < settled.size()) {
+            cell = settled[settledHead].cell;
+            spill = settled[settledHead++].level;
+        }
+        else {
+            settled.clear();
+            settledHead = 0;
+            if (queue.empty()) break;
+            cell = queue.pop(spill);
+        }
+        uint32_t own = label[cell];
+        for (int d = 0; d < 8; d++) {
+            size_t neighbour = cell + offsets[d];
+            float next = open[neighbour];
+            if (next == -infinity) {
+                uint32_t other = label[neighbour];
+                if (other && other != own) found.push_back({ spillKey(own, other), std::max(spill, level[neighbour]) });
+                continue;
+            }
+            open[neighbour] = -infinity;
+            label[neighbour] = own;
+            if (next <= spill) {
+                level[neighbour] = spill;
+                settled.push_back({ (uint32_t)neighbour, spill });
+                continue;
+            }
+            level[neighbour] = next;
+            bool lowerOpen = false;
+            for (int e = 0; e < 8; e++) {
+                float beyond = open[neighbour + offsets[e]];
+                lowerOpen |= beyond > -infinity && beyond <= next;
+            }
+            if (lowerOpen) queue.push(next, (uint32_t)neighbour);
+            else settled.push_back({ (uint32_t)neighbour, next });
+        }
+    }
+
+    for (int z = z0; z < z1; z++)
+        for (int x = x0; x < x1; x++) {
+            size_t i = (size_t)z * width + x, p = local(x, z);
+            filled[i] = label[p] ? level[p] : heights[i];
+            labels[i] = label[p];
+        }
+
+    // One edge per pair, at its lowest spill
+    std::sort(found.begin(), found.end(), [](const SpillEdge& a, const SpillEdge& b) {
+        return a.labels != b.labels ? a.labels < b.labels : a.level < b.level;
+    });
+    for (size_t i = 0; i < found.size(); i++)
+        if (i == 0 || found[i].labels != found[i - 1].labels) edges.push_back(found[i]);
+}
+
+// Priority-Flood + epsilon into `filled`; returns the cells raised above the terrain. Sea cells
+// keep their height; land cells on the map edge or next to the sea are the outlets. The tiles
+// depend only on the map size, so the result is the same for any thread count. The time spent in
+// the serial parts goes to `serialMilliseconds`.
+uint64_t priorityFlood(const std::vector<float>& heights, int width, int height, float seaLevel, float epsilon,
+    std::vector<float>& filled, double& serialMilliseconds, ThreadPool& pool) {
+    using Clock = std::chrono::high_resolution_clock;
+    const float infinity = std::numeric_limits<float>::infinity();
+    auto raise = [&](float level) { return std::max(std::nextafter(level, infinity), level + epsilon); };
+    size_t count = (size_t)width * height;
+    int tilesX = (width + FLOOD_TILE - 1) / FLOOD_TILE, tilesZ = (height + FLOOD_TILE - 1) / FLOOD_TILE;
+    int tileWidth = (width + tilesX - 1) / tilesX, tileHeight = (height + tilesZ - 1) / tilesZ;
+    int tileCount = tilesX * tilesZ;
+    uint32_t labelsPerTile = 2 * (tileWidth + tileHeight);
+    auto tileX0 = [&](int t) { return (t % tilesX) * tileWidth; };
+    auto tileZ0 = [&](int t) { return (t / tilesX) * tileHeight; };
+    auto tileX1 = [&](int t) { return std::min(width, tileX0(t) + tileWidth); };
+    auto tileZ1 = [&](int t) { return std::min(height, tileZ0(t) + tileHeight); };
+
+    // Tiles, and the spills across each tile's right and bottom edges (border cells keep their
+    // height, so those spills are the higher of the two heights)
+    filled.resize(count);
+    std::vector<uint32_t> labels(count);
+    std::vector<std::vector<SpillEdge>> tileEdges(tileCount);
+    pool.parallelFor(tileCount, 1, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            int x0 = tileX0(t), z0 = tileZ0(t), x1 = tileX1(t), z1 = tileZ1(t);
+            floodTile(heights, width, height, seaLevel, x0, z0, x1, z1, 2 + (uint32_t)t * labelsPerTile, filled, labels, tileEdges[t]);
+        }
+    });
+    pool.parallelFor(tileCount, 1, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            int x0 = tileX0(t), z0 = tileZ0(t), x1 = tileX1(t), z1 = tileZ1(t);
+            auto link = [&](int x, int z, int nx, int nz) {
+                if (nx < 0 || nz < 0 || nx >= width || nz >= height) return;
+                uint32_t a = labels[(size_t)z * width + x], b = labels[(size_t)nz * width + nx];
+                if (a && b && a != b)
+                    tileEdges[t].push_back({ spillKey(a, b), std::max(heights[(size_t)z * width + x], heights[(size_t)nz * width + nx]) });
+            };
+            for (int z = z0; z < z1; z++)
+                for (int dz = -1; dz <= 1; dz++) link(x1 - 1, z, x1, z + dz);
+            for (int x = x0; x < x1; x++)
+                for (int dx = -1; dx <= 1; dx++) link(x, z1 - 1, x + dx, z1);
+        }
+    });
+
+    // Spill level of every label: the graph flooded from the ocean
+    auto serialStart = Clock::now();
+    uint32_t labelCount = 2 + (uint32_t)tileCount * labelsPerTile;
+    std::vector<uint32_t> firstEdge(labelCount + 1, 0);
+    for (const std::vector<SpillEdge>& edges : tileEdges)
+        for (const SpillEdge& edge : edges) {
+            firstEdge[edge.labels >> 32]++;
+            firstEdge[(uint32_t)edge.labels]++;
+        }
+    uint32_t total = 0;
+    for (uint32_t& entry : firstEdge) {
+        uint32_t edgesHere = entry;
+        entry = total;
+        total += edgesHere;
+    }
+    std::vector<std::pair<uint32_t, float>> adjacent(total);
+    std::vector<uint32_t> fillPosition(firstEdge.begin(), firstEdge.end() - 1);
+    for (const std::vector<SpillEdge>& edges : tileEdges)
+        for (const SpillEdge& edge : edges) {
+            uint32_t a = (uint32_t)(edge.labels >> 32), b = (uint32_t)edge.labels;
+            adjacent[fillPosition[a]++] = { b, edge.level };
+            adjacent[fillPosition[b]++] = { a, edge.level };
+        }
+    std::vector<std::vector<SpillEdge>>().swap(tileEdges);
+
+    // A binary heap rather than a RadixQueue: a spill equal to the one popped can reach a lower
+    // label, whose key would then sort below the last one popped
+    std::vector<float> labelSpill(labelCount, infinity);
+    {
+        typedef std::pair<float, uint32_t> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> graph;
+        labelSpill[OCEAN_LABEL] = -infinity;
+        graph.push({ -infinity, OCEAN_LABEL });
+        while (!graph.empty()) {
+            float spill = graph.top().first;
+            uint32_t label = graph.top().second;
+            graph.pop();
+            if (spill != labelSpill[label]) continue;
+            for (uint32_t e = firstEdge[label]; e < firstEdge[label + 1]; e++) {
+                float through = std::max(spill, adjacent[e].second);
+                if (through < labelSpill[adjacent[e].first]) {
+                    labelSpill[adjacent[e].first] = through;
+                    graph.push({ through, adjacent[e].first });
+                }
+            }
+        }
+    }
+    serialMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - serialStart).count();
+
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        for (size_t i = (size_t)zBegin * width; i < (size_t)zEnd * width; i++)
+            if (labels[i]) filled[i] = std::max(filled[i], labelSpill[labels[i]]);
+    });
+    std::vector<uint32_t>().swap(labels);
+
+    // Epsilon: flats are the land cells that are not outlets and have no strictly lower
+    // neighbour; they are flooded from the cells around them that do drain. `closed` starts
+    // with the sea and the outlets, which are never raised.
+    std::vector<uint8_t> closed(count);
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++)
+            for (int x = 0; x < width; x++)
+                closed[(size_t)z * width + x] = heights[(size_t)z * width + x] <= seaLevel || isOutlet(heights, width, height, seaLevel, x, z);
+    });
+    auto drains = [&](size_t i) {
+        if (closed[i]) return true;
+        for (int d = 0; d < 8; d++)
+            if (filled[i + (ptrdiff_t)offsetZ[d] * width + offsetX[d]] < filled[i]) return true;
+        return false;
+    };
+    // A land cell that drains next to a flat at its own level starts the flood into it
+    std::vector<std::vector<uint32_t>> bandSeeds((height + 15) / 16);
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        std::vector<uint32_t>& seeds = bandSeeds[zBegin / 16];
+        for (int z = zBegin; z < zEnd; z++)
+            for (int x = 0; x < width; x++) {
+                size_t i = (size_t)z * width + x;
+                if (heights[i] <= seaLevel || !drains(i)) continue;
+                for (int d = 0; d < 8; d++) {
+                    int nx = x + offsetX[d], nz = z + offsetZ[d];
+                    if (nx < 0 || nz < 0 || nx >= width || nz >= height) continue;
+                    size_t neighbour = (size_t)nz * width + nx;
+                    if (filled[neighbour] == filled[i] && !drains(neighbour)) {
+                        seeds.push_back((uint32_t)i);
+                        break;
+                    }
+                }
+            }
+    });
+
+    serialStart = Clock::now();
+    RadixQueue queue;
+    for (const std::vector<uint32_t>& seeds : bandSeeds)
+        for (uint32_t seed : seeds) queue.push(filled[seed], seed);
+    std::vector<std::vector<uint32_t>>().swap(bandSeeds);
+
+    // As in the tiles, but only cells at or above the level last taken from the queue can be
+    // raised: anything lower already drains another way
+    ptrdiff_t offsets[8];
+    for (int d = 0; d < 8; d++) offsets[d] = (ptrdiff_t)offsetZ[d] * width + offsetX[d];
+    struct Settled { uint32_t cell; float level; };
+    std::vector<Settled> settled;
+    size_t settledHead = 0;
+    float floor = -infinity;
+    for (;;) {
+        uint32_t cell;
+        float level;
+        if (settledHead < settled.size()) {
+            cell = settled[settledHead].cell;
+            level = settled[settledHead++].level;
+        }
+        else {
+            settled.clear();
+            settledHead = 0;
+            if (queue.empty()) break;
+            cell = queue.pop(level);
+            if (filled[cell] != level) continue;    // Raised since it was queued, and flooded from there
+            floor = level;
+            closed[cell] = 1;
+        }
+        // Seeds can be outlets on the map edge; raised cells never are
+        int x = (int)(cell % width), z = (int)(cell / width);
+        bool inside = x > 0 && z > 0 && x < width - 1 && z < height - 1;
+        for (int d = 0; d < 8; d++) {
+            if (!inside) {
+                int nx = x + offsetX[d], nz = z + offsetZ[d];
+                if (nx < 0 || nz < 0 || nx >= width || nz >= height) continue;
+            }
+            size_t neighbour = cell + offsets[d];
+            if (closed[neighbour]) continue;
+            float own = filled[neighbour];
+            if (own < floor || own > level) continue;
+            float raised = raise(level);
+            filled[neighbour] = raised;
+            closed[neighbour] = 1;
+            settled.push_back({ (uint32_t)neighbour, raised });
+        }
+    }
+    serialMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - serialStart).count();
+
+    std::atomic<uint64_t> raised(0);
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        uint64_t band = 0;
+        for (size_t i = (size_t)zBegin * width; i < (size_t)zEnd * width; i++) band += filled[i] > heights[i];
+        raised += band;
+    });
+    return raised;
+}
+
+// Off-map neighbours read as +infinity, so they are never downhill
+inline FlowReceivers steepestD8(float centre, const float* neighbours) {
+    const float diagonal = 0.70710678f;
+    FlowReceivers out;
+    float steepest = 0.0f;
+    for (int d = 0; d < 8; d++) {
+        float slope = (centre - neighbours[d]) * ((d & 1) ? diagonal : 1.0f);
+        if (slope > steepest) {
+            steepest = slope;
+            out.first = (uint8_t)d;
+        }
+    }
+    return out;
+}
+
+// Facet f spans the edge neighbour e and the diagonal neighbour g beside it; the flow angle
+// runs from e (0) to g (pi / 4). Facets are compared by squared slope without trigonometry;
+// only the steepest one needs its angle.
+inline FlowReceivers steepestDInfinity(float centre, const float* neighbours) {
+    const float diagonal = 0.70710678f;
+    const float quarter = 0.78539816f;
+    const float infinity = std::numeric_limits<float>::infinity();
+    float steepest = 0.0f, bestS1 = 0.0f, bestS2 = 0.0f;   // Squared slope
+    int bestEdge = -1, bestDiagonal = -1, bestKind = 0;
+    for (int f = 0; f < 8; f++) {
+        int e = f & ~1, g = (f & 1) ? (e + 1) & 7 : (e + 7) & 7;
+        if (neighbours[e] == infinity || neighbours[g] == infinity) continue;
+        float s1 = centre - neighbours[e], s2 = neighbours[e] - neighbours[g];
+        float slope, squared;
+        int kind;
+        if (s2 <= 0.0f) {
+            slope = s1;                 // Angle clamps to the edge
+            kind = 0;
+        }
+        else if (s2 >= s1) {
+            slope = (centre - neighbours[g]) * diagonal;    // Clamps to the diagonal
+            kind = 2;
+        }
+        else {
+            slope = s1;                 // Inside the facet; both s1 and s2 are positive
+            kind = 1;
+        }
+        if (slope <= 0.0f) continue;
+        squared = kind == 1 ? s1 * s1 + s2 * s2 : slope * slope;
+        if (squared > steepest) {
+            steepest = squared;
+            bestEdge = e;
+            bestDiagonal = g;
+            bestKind = kind;
+            bestS1 = s1;
+            bestS2 = s2;
+        }
+    }
+    // Facets with a corner off the map can hide the only way down on the border
+    if (bestEdge < 0) return steepestD8(centre, neighbours);
+
+    FlowReceivers out;
+    uint16_t share = bestKind == 0 ? 65535 : bestKind == 2 ? 0
+        : (uint16_t)std::floor((1.0f - std::atan(bestS2 / bestS1) / quarter) * 65535.0f + 0.5f);
+    if (share == 0) {
+        out.first = (uint8_t)bestDiagonal;
+    }
+    else {
+        out.first = (uint8_t)bestEdge;
+        out.share = share;
+        if (share != 65535) out.second = (uint8_t)bestDiagonal;
+    }
+    return out;
+}
+
+// Receivers of every land cell on the filled surface; sea cells and pits on the map edge keep none
+void flowDirections(const std::vector<float>& filled, const std::vector<float>& heights, int width, int height,
+    float seaLevel, FlowRouting routing, std::vector<FlowReceivers>& receivers, ThreadPool& pool) {
+    const float infinity = std::numeric_limits<float>::infinity();
+    ptrdiff_t offsets[8];
+    for (int d = 0; d < 8; d++) offsets[d] = (ptrdiff_t)offsetZ[d] * width + offsetX[d];
+    receivers.assign((size_t)width * height, FlowReceivers());
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        float neighbours[8];
+        for (int z = zBegin; z < zEnd; z++)
+            for (int x = 0; x < width; x++) {
+                size_t i = (size_t)z * width + x;
+                if (heights[i] <= seaLevel) continue;
+                if (x > 0 && z > 0 && x < width - 1 && z < height - 1) {
+                    for (int d = 0; d < 8; d++) neighbours[d] = filled[i + offsets[d]];
+                }
+                else {
+                    for (int d = 0; d < 8; d++) {
+                        int nx = x + offsetX[d], nz = z + offsetZ[d];
+                        bool inside = nx >= 0 && nz >= 0 && nx < width && nz < height;
+                        neighbours[d] = inside ? filled[i + offsets[d]] : infinity;
+                    }
+                }
+                receivers[i] = routing == FLOW_D8 ? steepestD8(filled[i], neighbours) : steepestDInfinity(filled[i], neighbours);
+            }
+    });
+}
+
+// Upstream area of every cell over the receiver DAG, in cells
+void flowAccumulation(const std::vector<FlowReceivers>& receivers, int width, int height, std::vector<float>& accumulation,
+    ThreadPool& pool) {
+    size_t count = (size_t)width * height;
+    ptrdiff_t offsets[8];
+    for (int d = 0; d < 8; d++) offsets[d] = (ptrdiff_t)offsetZ[d] * width + offsetX[d];
+    accumulation.assign(count, 0.0f);
+
+    // Bit d: the neighbour in direction d drains into the cell
+    std::vector<uint8_t> donors(count);
+    std::unique_ptr<std::atomic<uint8_t>[]> unfinished(new std::atomic<uint8_t>[count]);
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++)
+            for (int x = 0; x < width; x++) {
+                size_t i = (size_t)z * width + x;
+                bool interior = x > 0 && z > 0 && x < width - 1 && z < height - 1;
+                uint32_t mask = 0;
+                for (int d = 0; d < 8; d++) {
+                    int nx = x + offsetX[d], nz = z + offsetZ[d];
+                    if (!interior && (nx < 0 || nz < 0 || nx >= width || nz >= height)) continue;
+                    const FlowReceivers& donor = receivers[i + offsets[d]];
+                    int back = opposite(d);
+                    mask |= (uint32_t)((donor.first == back) | (donor.second == back)) << d;
+                }
+                uint8_t total = 0;
+                for (uint32_t bits = mask; bits; bits &= bits - 1) total++;
+                donors[i] = (uint8_t)mask;
+                unfinished[i].store(total, std::memory_order_relaxed);
+            }
+    });
+
+    // Every source starts a walk downstream; a walk carries on into a receiver only when it
+    // finished that receiver's last donor
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        std::vector<uint32_t> stack;
+        for (size_t source = (size_t)zBegin * width; source < (size_t)zEnd * width; source++) {
+            if (donors[source]) continue;
+            stack.push_back((uint32_t)source);
+            while (!stack.empty()) {
+                uint32_t cell = stack.back();
+                stack.pop_back();
+                float area = 1.0f;
+                for (uint32_t mask = donors[cell]; mask; mask &= mask - 1) {
+                    int d = lowestBit(mask);
+                    size_t donor = cell + offsets[d];
+                    const FlowReceivers& out = receivers[donor];
+                    uint32_t share = out.first == opposite(d) ? out.share : 65535u - out.share;
+                    area += share == 65535u ? accumulation[donor] : accumulation[donor] * (float)share / 65535.0f;
+                }
+                accumulation[cell] = area;
+
+                const FlowReceivers& out = receivers[cell];
+                for (uint8_t d : { out.first, out.second }) {
+                    if (d == NO_RECEIVER) continue;
+                    size_t receiver = cell + offsets[d];
+                    if (unfinished[receiver].fetch_sub(1, std::memory_order_acq_rel) == 1) stack.push_back((uint32_t)receiver);
+                }
+            }
+        }
+    });
+}
+
+// log2 from the float's exponent plus its mantissa as a straight line (within 0.09)
+inline float approximateLog2(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (float)((int)(bits >> 23) - 127) + (float)(bits & 0x7fffff) * (1.0f / 8388608.0f);
+}
+
+}  // namespace hydrology_detail
+
+// Fills, routes and accumulates over `heights`, then carves rivers into it and flattens lakes
+// (per the settings). `maps` gets the filled surface, the accumulation and the texels.
+void applyHydrology(std::vector<float>& heights, int width, int height, const HydrologySettings& settings,
+    HydrologyMaps& maps, ThreadPool& pool = globalThreadPool()) {
+    using namespace hydrology_detail;
+    using Clock = std::chrono::high_resolution_clock;
+    auto milliseconds = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+    maps.width = width;
+    maps.height = height;
+    maps.stats = HydrologyStats();
+    HydrologyStats& stats = maps.stats;
+    size_t count = (size_t)width * height;
+
+    auto start = Clock::now();
+    stats.raisedCells = priorityFlood(heights, width, height, settings.seaLevel, settings.epsilon, maps.filled,
+        stats.fillSerialMilliseconds, pool);
+    stats.fillMilliseconds = milliseconds(start);
+
+    start = Clock::now();
+    std::vector<FlowReceivers> receivers;
+    flowDirections(maps.filled, heights, width, height, settings.seaLevel, settings.routing, receivers, pool);
+    stats.directionMilliseconds = milliseconds(start);
+
+    start = Clock::now();
+    flowAccumulation(receivers, width, height, maps.accumulation, pool);
+    std::vector<FlowReceivers>().swap(receivers);
+    stats.accumulationMilliseconds = milliseconds(start);
+
+    // Texels, and the channel depth of every river cell
+    start = Clock::now();
+    const float lakeTexelDepth = 4.0f;
+    std::vector<float> channelDepth(count, 0.0f);
+    maps.texels.resize(count);
+    std::mutex statsMutex;
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        uint64_t sea = 0, lakes = 0, rivers = 0;
+        float maxAccumulation = 0.0f;
+        for (size_t i = (size_t)zBegin * width; i < (size_t)zEnd * width; i++) {
+            float area = maps.accumulation[i];
+            maxAccumulation = std::max(maxAccumulation, area);
+            uint32_t flow = (uint32_t)std::min(255.0f, approximateLog2(area) * (255.0f / 24.0f) + 0.5f);
+            if (heights[i] <= settings.seaLevel) {
+                maps.texels[i] = flow;
+                sea++;
+                continue;
+            }
+            uint32_t river = 0, lake = 0;
+            float lakeDepth = maps.filled[i] - heights[i];
+            if (lakeDepth >= settings.minLakeDepth) {
+                lake = (uint32_t)std::min(255.0f, std::max(1.0f, lakeDepth / lakeTexelDepth * 255.0f + 0.5f));
+                lakes++;
+            }
+            else if (area >= settings.riverThreshold) {
+                float strength = std::min(1.0f, 0.25f + std::log2(area / settings.riverThreshold) / 8.0f);
+                river = (uint32_t)(strength * 255.0f + 0.5f);
+                channelDepth[i] = settings.carveDepth * strength;
+                rivers++;
+            }
+            maps.texels[i] = flow | (river << 8) | (lake << 16) | (255u << 24);
+        }
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.seaCells += sea;
+        stats.lakeCells += lakes;
+        stats.riverCells += rivers;
+        stats.maxAccumulation = std::max(stats.maxAccumulation, maxAccumulation);
+    });
+
+    // A river cell sinks channelDepth below the filled surface and its banks slope back up
+    // over the neighbouring cells, so a river is about three cells wide. Only the cell itself
+    // is written, so this runs in place.
+    if (settings.carveRivers || settings.fillLakes) {
+        const float diagonal = std::sqrt(2.0f);
+        pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+            for (int z = zBegin; z < zEnd; z++)
+                for (int x = 0; x < width; x++) {
+                    size_t i = (size_t)z * width + x;
+                    uint32_t texel = maps.texels[i];
+                    if (!(texel >> 24)) continue;
+                    if ((texel >> 16) & 0xff) {
+                        if (settings.fillLakes) heights[i] = maps.filled[i];
+                        continue;
+                    }
+                    if (!settings.carveRivers) continue;
+                    float lowest = heights[i];
+                    if (channelDepth[i] > 0.0f) lowest = std::min(lowest, maps.filled[i] - channelDepth[i]);
+                    for (int d = 0; d < 8; d++) {
+                        int nx = x + offsetX[d], nz = z + offsetZ[d];
+                        if (nx < 0 || nz < 0 || nx >= width || nz >= height) continue;
+                        size_t n = (size_t)nz * width + nx;
+                        if (channelDepth[n] <= 0.0f) continue;
+                        float bank = maps.filled[n] - channelDepth[n] * (1.0f - 0.5f * ((d & 1) ? diagonal : 1.0f));
+                        lowest = std::min(lowest, bank);
+                    }
+                    heights[i] = lowest;
+                }
+        });
+    }
+    stats.outputMilliseconds = milliseconds(start);
+}
+
+// Hydrology timings on a size x size terrain for 1, 2, 4... threads up to the shared pool's
+// size. The serial part of the fill bounds its speed-up (Amdahl); the projection for the pool
+// assumes the rest scales perfectly. The goal is the whole pass well under a second at 4096^2.
+void runHydrologyReport(int size = 4096, float seaLevel = -10.0f) {
+    Heightfield terrain = generateHeightfield(size, size, 50.0f, 1.0f, 4);
+    const std::vector<float>& plane = terrain.heightPlane();
+    unsigned int poolSize = globalThreadPool().size();
+    std::cout << "Hydrology report, " << size << "x" << size << " terrain, pool of " << poolSize << " threads" << std::endl;
+
+    HydrologySettings settings;
+    settings.enabled = true;
+    settings.seaLevel = seaLevel;
+    std::vector<float> reference;
+    double oneThreadFill = 0.0, oneThreadSerial = 0.0, poolTotal = 0.0;
+    for (unsigned int threads = 1;; threads = std::min(threads * 2, poolSize)) {
+        ThreadPool pool(threads);
+        std::vector<float> heights = plane;
+        HydrologyMaps maps;
+        applyHydrology(heights, size, size, settings, maps, pool);
+        const HydrologyStats& stats = maps.stats;
+        double total = stats.fillMilliseconds + stats.directionMilliseconds + stats.accumulationMilliseconds + stats.outputMilliseconds;
+        if (threads == 1) {
+            oneThreadFill = stats.fillMilliseconds;
+            oneThreadSerial = stats.fillSerialMilliseconds;
+            reference = maps.filled;
+        }
+        poolTotal = total;
+        std::cout << "  " << threads << " threads: fill " << stats.fillMilliseconds << " ms (x"
+            << oneThreadFill / stats.fillMilliseconds << ", serial " << stats.fillSerialMilliseconds << " ms), directions "
+            << stats.directionMilliseconds << " ms, accumulation " << stats.accumulationMilliseconds << " ms, output "
+            << stats.outputMilliseconds << " ms, total " << total << " ms"
+            << (maps.filled == reference ? "" : ", FILL DIFFERS FROM 1 THREAD") << std::endl;
+        if (threads == poolSize) break;
+    }
+
+    double projected = oneThreadSerial + (oneThreadFill - oneThreadSerial) / poolSize;
+    std::cout << "  fill at " << poolSize << " threads if all but the serial part scaled: " << projected
+        << " ms (limit x" << oneThreadFill / oneThreadSerial << " on any number of threads)" << std::endl;
+    if (poolTotal < 1000.0)
+        std::cout << "  under 1 s at " << poolSize << " threads" << std::endl;
+    else
+        std::cout << "  NOT under 1 s at " << poolSize << " threads (" << poolTotal
+            << " ms); see the scaling above for the thread count it would need" << std::endl;
+}
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef ISLAND_MASK_H
+#define ISLAND_MASK_H
+
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "thread_pool.h"
+#include "perlin_batch.h"
+#include "noise.h"
+
+// Coastline shapes for the edge falloff. A shape is rasterised into a land/sea mask on the
+// terrain grid, turned into a signed distance field (negative on land, in vertices) with an
+// exact Euclidean distance transform, and the falloff ramps from edgeHeight at the coast to full
+// height `border` vertices inland. Everything outside the grid counts as sea, so land never
+// runs off the edge of the map.
+//
+// The transform is exact and separable: a two-way scan down every column gives the vertical
+// distance to the nearest seed, then Felzenszwalb & Huttenlocher's lower envelope of parabolas
+// along every row adds the horizontal part. Both are O(n) per line, so the whole field is O(N)
+// for any shape. Column strips and rows run in parallel on the pool.
+
+enum IslandShape {
+    ISLAND_RECTANGLE,   // calculateFalloff's border around the whole map (no distance field)
+    ISLAND_POLYGON,
+    ISLAND_NOISE,
+    ISLAND_PAINTED
+};
+
+const char* islandShapeName(IslandShape shape) {
+    static const char* names[] = { "Rectangle", "Polygon", "Noise threshold", "Painted" };
+    return names[shape];
+}
+
+// Land/sea bitmap painted by the user, sampled over the whole map by normalised position
+struct PaintedIslandMask {
+    int width = 0, height = 0;
+    std::vector<uint8_t> land;      // Row-major, non-zero is land
+};
+
+struct IslandMaskSettings {
+    IslandShape shape = ISLAND_RECTANGLE;
+
+    // ISLAND_POLYGON: outline in map coordinates (0-1 over each axis), even-odd filled
+    std::vector<glm::vec2> polygon = {
+        { 0.22f, 0.30f }, { 0.40f, 0.16f }, { 0.62f, 0.20f }, { 0.80f, 0.14f }, { 0.86f, 0.38f },
+        { 0.74f, 0.56f }, { 0.84f, 0.78f }, { 0.60f, 0.86f }, { 0.42f, 0.74f }, { 0.20f, 0.82f },
+        { 0.14f, 0.58f }, { 0.28f, 0.48f }
+    };
+
+    // ISLAND_NOISE: land where two octaves of Perlin noise, minus radialBias * r^2 (r is 1 at
+    // the middle of each edge), exceed threshold
+    float noiseScale = 300.0f;      // World units per noise period
+    float threshold = -0.1f;
+    float radialBias = 0.6f;
+    float noiseSeed = 3.0f;
+
+    // ISLAND_PAINTED; revision must change whenever the bitmap does (it keys the cache)
+    std::shared_ptr<const PaintedIslandMask> painted;
+    uint64_t paintedRevision = 0;
+};
+
+namespace island_detail {
+
+    const float EDT_INFINITY = 1e20f;
+
+    // Squared distance to the nearest zero of f (0 at seeds, EDT_INFINITY elsewhere) along one
+    // line: Felzenszwalb & Huttenlocher's lower envelope. v and z need n and n + 1 entries.
+    inline void distanceTransform1D(const float* f, int n, float* d, int* v, float* z)
+    {
+        int k = 0;
+        v[0] = 0;
+        z[0] = -EDT_INFINITY;
+        z[1] = EDT_INFINITY;
+        for (int q = 1; q < n; q++) {
+            // Where parabola q overtakes the envelope; z[0] is far enough out that k stays >= 0
+            float s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * (q - v[k]));
+            while (s <= z[k]) {
+                k--;
+                s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * (q - v[k]));
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = EDT_INFINITY;
+        }
+        k = 0;
+        for (int q = 0; q < n; q++) {
+            while (z[k + 1] < (float)q) k++;
+            float offset = (float)(q - v[k]);
+            d[q] = offset * offset + f[v[k]];
+        }
+    }
+
+    // In place over a row-major width x height grid of 0 / EDT_INFINITY: squared distance to
+    // the nearest 0
+    inline void distanceTransform2D(std::vector<float>& grid, int width, int height, ThreadPool& pool)
+    {
+        // Columns: with binary input the 1D transform is just the distance to the nearest seed
+        // above or below, found with one scan down and one up. Strips of columns keep every
+        // access a contiguous run along a row.
+        const int strip = 256;
+        pool.parallelFor((width + strip - 1) / strip, 1, [&](int stripBegin, int stripEnd) {
+            for (int s = stripBegin; s < stripEnd; s++) {
+                int x0 = s * strip, x1 = std::min(x0 + strip, width);
+                for (int y = 1; y < height; y++) {
+                    const float* previous = &grid[(size_t)(y - 1) * width];
+                    float* row = &grid[(size_t)y * width];
+                    for (int x = x0; x < x1; x++) row[x] = std::min(row[x], previous[x] + 1.0f);
+                }
+                for (int y = height - 2; y >= 0; y--) {
+                    const float* next = &grid[(size_t)(y + 1) * width];
+                    float* row = &grid[(size_t)y * width];
+                    for (int x = x0; x < x1; x++) row[x] = std::min(row[x], next[x] + 1.0f);
+                }
+                // Squared, leaving columns without a seed at EDT_INFINITY (squaring would overflow)
+                for (int y = 0; y < height; y++) {
+                    float* row = &grid[(size_t)y * width];
+                    for (int x = x0; x < x1; x++) row[x] = row[x] < (float)height ? row[x] * row[x] : EDT_INFINITY;
+                }
+            }
+        });
+        // Rows: lower envelope of the column distances
+        pool.parallelFor(height, 16, [&](int yBegin, int yEnd) {
+            std::vector<float> f(width), z(width + 1);
+            std::vector<int> v(width);
+            for (int y = yBegin; y < yEnd; y++) {
+                float* row = &grid[(size_t)y * width];
+                std::copy(row, row + width, f.begin());
+                distanceTransform1D(f.data(), width, row, v.data(), z.data());
+            }
+        });
+    }
+
+    // Even-odd fill of the polygon sampled at vertex centres; mask is width x height
+    inline void rasterisePolygon(const std::vector<glm::vec2>& polygon, int width, int height, std::vector<uint8_t>& mask,
+        ThreadPool& pool)
+    {
+        if (polygon.size() < 3) return;
+        pool.parallelFor(height, 32, [&](int zBegin, int zEnd) {
+            std::vector<float> crossings;
+            for (int z = zBegin; z < zEnd; z++) {
+                float v = height > 1 ? (float)z / (height - 1) : 0.5f;
+                crossings.clear();
+                for (size_t i = 0; i < polygon.size(); i++) {
+                    glm::vec2 a = polygon[i], b = polygon[(i + 1) % polygon.size()];
+                    if ((a.y <= v) == (b.y <= v)) continue;
+                    crossings.push_back(a.x + (v - a.y) / (b.y - a.y) * (b.x - a.x));
+                }
+                std::sort(crossings.begin(), crossings.end());
+                for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+                    int xBegin = std::max(0, (int)std::ceil(crossings[i] * (width - 1)));
+                    int xEnd = std::min(width - 1, (int)std::floor(crossings[i + 1] * (width - 1)));
+                    for (int x = xBegin; x <= xEnd; x++) mask[(size_t)z * width + x] = 1;
+                }
+            }
+        });
+    }
+}
+
+// Land (1) / sea (0) for every `step`-th vertex of a fullWidth x fullHeight map
+std::vector<uint8_t> rasteriseIslandMask(const IslandMaskSettings& settings, int fullWidth, int fullHeight, int step = 1,
+    ThreadPool& pool = globalThreadPool()) {
+    int width = (fullWidth - 1) / step + 1;
+    int height = (fullHeight - 1) / step + 1;
+    std::vector<uint8_t> mask((size_t)width * height, 0);
+    auto mapU = [&](int x) { return fullWidth > 1 ? (float)(x * step) / (fullWidth - 1) : 0.5f; };
+    auto mapV = [&](int z) { return fullHeight > 1 ? (float)(z * step) / (fullHeight - 1) : 0.5f; };
+
+    switch (settings.shape) {
+    case ISLAND_RECTANGLE:
+        std::fill(mask.begin(), mask.end(), 1);
+        break;
+
+    case ISLAND_POLYGON:
+        island_detail::rasterisePolygon(settings.polygon, width, height, mask, pool);
+        break;
+
+    case ISLAND_NOISE:
+        pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+            std::vector<float> xs(width), ys(width), zs(width), octave1(width), octave2(width);
+            for (int z = zBegin; z < zEnd; z++) {
+                // In world units so the coastline doesn't move when the map is resized
+                float worldZ = (float)(z * step) - fullHeight / 2.0f;
+                for (int x = 0; x < width; x++) {
+                    float worldX = (float)(x * step) - fullWidth / 2.0f;
+                    xs[x] = worldX / settings.noiseScale;
+                    zs[x] = worldZ / settings.noiseScale;
+                    ys[x] = settings.noiseSeed;
+                }
+                perlin3_batch(xs.data(), ys.data(), zs.data(), octave1.data(), width);
+                for (int x = 0; x < width; x++) {
+                    xs[x] *= 2.0f;
+                    zs[x] *= 2.0f;
+                    ys[x] = settings.noiseSeed + 17.0f;
+                }
+                perlin3_batch(xs.data(), ys.data(), zs.data(), octave2.data(), width);
+                for (int x = 0; x < width; x++) {
+                    float u = mapU(x) * 2.0f - 1.0f, v = mapV(z) * 2.0f - 1.0f;
+                    float value = octave1[x] + 0.5f * octave2[x] - settings.radialBias * (u * u + v * v);
+                    mask[(size_t)z * width + x] = value > settings.threshold ? 1 : 0;
+                }
+            }
+        });
+        break;
+
+    case ISLAND_PAINTED:
+        if (settings.painted && settings.painted->width > 0 && settings.painted->height > 0) {
+            const PaintedIslandMask& painted = *settings.painted;
+            pool.parallelFor(height, 32, [&](int zBegin, int zEnd) {
+                for (int z = zBegin; z < zEnd; z++) {
+                    int paintedZ = std::min((int)(mapV(z) * painted.height), painted.height - 1);
+                    for (int x = 0; x < width; x++) {
+                        int paintedX = std::min((int)(mapU(x) * painted.width), painted.width - 1);
+                        mask[(size_t)z * width + x] = painted.land[(size_t)paintedZ * painted.width + paintedX] ? 1 : 0;
+                    }
+                }
+            });
+        }
+        break;
+    }
+    return mask;
+}
+
+// Signed Euclidean distance to the coast for a width x height land mask, in grid cells scaled
+// by `spacing`: negative on land, positive at sea, +-0.5 on either side of the coast. The ring
+// outside the grid is sea.
+std::vector<float> signedDistanceField(const std::vector<uint8_t>& mask, int width, int height, float spacing = 1.0f,
+    ThreadPool& pool = globalThreadPool()) {
+    using island_detail::EDT_INFINITY;
+    // One cell of sea padding on every side
+    int paddedWidth = width + 2, paddedHeight = height + 2;
+    std::vector<float> toLand((size_t)paddedWidth * paddedHeight, EDT_INFINITY);
+    std::vector<float> toSea((size_t)paddedWidth * paddedHeight, 0.0f);
+    pool.parallelFor(height, 64, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++)
+            for (int x = 0; x < width; x++) {
+                bool land = mask[(size_t)z * width + x] != 0;
+                size_t padded = (size_t)(z + 1) * paddedWidth + x + 1;
+                toLand[padded] = land ? 0.0f : EDT_INFINITY;
+                toSea[padded] = land ? EDT_INFINITY : 0.0f;
+            }
+    });
+    island_detail::distanceTransform2D(toLand, paddedWidth, paddedHeight, pool);
+    island_detail::distanceTransform2D(toSea, paddedWidth, paddedHeight, pool);
+
+    std::vector<float> distance((size_t)width * height);
+    pool.parallelFor(height, 64, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++)
+            for (int x = 0; x < width; x++) {
+                size_t padded = (size_t)(z + 1) * paddedWidth + x + 1;
+                bool land = mask[(size_t)z * width + x] != 0;
+                // With no land at all toLand stays infinite; clamp so the falloff stays finite
+                float cells = land ? -(std::sqrt(toSea[padded]) - 0.5f)
+                                   : std::min(std::sqrt(toLand[padded]), (float)(paddedWidth + paddedHeight)) - 0.5f;
+                distance[(size_t)z * width + x] = cells * spacing;
+            }
+    });
+    return distance;
+}
+
+// Coast distance for every `step`-th vertex of the map, in full-resolution vertices. Empty for
+// ISLAND_RECTANGLE, which keeps using calculateFalloff.
+std::vector<float> islandDistanceField(const IslandMaskSettings& settings, int fullWidth, int fullHeight, int step = 1,
+    ThreadPool& pool = globalThreadPool()) {
+    if (settings.shape == ISLAND_RECTANGLE) return std::vector<float>();
+    int width = (fullWidth - 1) / step + 1;
+    int height = (fullHeight - 1) / step + 1;
+    return signedDistanceField(rasteriseIslandMask(settings, fullWidth, fullHeight, step, pool), width, height, (float)step, pool);
+}
+
+// Falloff factor at a signed coast distance: edgeHeight at and beyond the coast, ramping to 1
+// over `border` vertices inland
+float islandFalloff(float signedDistance, const FalloffSettings& falloff) {
+    if (signedDistance >= 0.0f) return falloff.edgeHeight;
+    if (falloff.border <= 0) return 1.0f;
+    float inland = std::min(-signedDistance / falloff.border, 1.0f);
+    return glm::mix(falloff.edgeHeight, 1.0f, inland);
+}
+
+#endif
@@ -4,22 +4,11 @@
 #include <glm/gtc/noise.hpp>
 #include <vector>
 #include <algorithm>
-
-// Struct to hold biome-specific parameters
-struct BiomeParameters {
-    float heightScale;
-    float frequency;
-    float persistence;
-    float lacunarity;
-};
-
-// Define different biome types
-enum BiomeType {
-    PLAINS,
-    HILLS,
-    MOUNTAINS,
-    DESERT
-};
+#include "thread_pool.h"
+#include "biome_table.h"
+#include "perlin_batch.h"
+#include "smoothing.h"
+#include "heightfield.h"
 
 void smoothHeights(std::vector<float>& vertices, int width, int height, int smoothingPasses = 1) {
     std::vector<float> smoothedHeights(vertices.size() / 3, 0.0f); // Only store Y-values
@@ -60,8 +49,15 @@ void smoothHeights(std::vector<float>& vertices, int width, int height, int smoo
 }
 
 
-float calculateFalloff(int x, int z, int width, int height, float seaLevel) {
-    int borderThreshold = 50; // Distance from the border to start falloff
+// Edge falloff of a finite map: full height from `border` vertices in, pulled down to
+// `edgeHeight` times the height at the edge
+struct FalloffSettings {
+    int border = 50;
+    float edgeHeight = 0.0f;
+};
+
+float calculateFalloff(int x, int z, int width, int height, float seaLevel, int borderThreshold = 50) {
+    // borderThreshold: distance from the border to start falloff
     int left = x;
     int right = width - 1 - x;
     int top = z;
@@ -69,7 +65,7 @@ float calculateFalloff(int x, int z, int width, int height, float seaLevel) {
 
     int distanceToEdge = std::min({ left, right, top, bottom });
 
-    if (distanceToEdge >= borderThreshold) {
+    if (distanceToEdge >= borderThreshold || borderThreshold <= 0) {
         return 1.0f; // No falloff
     }
 
@@ -86,66 +82,43 @@ struct TerrainData {
     std::vector<BiomeType> biomeMap; // Store biome type for each vertex
 };
 
-// Fuzzy logic membership function
-float calculateMembership(float value, float start, float peak, float end) {
-    if (value < start || value > end) return 0.0f;
-    if (value < peak) {
-        return (value - start) / (peak - start);
-    }
-    return (end - value) / (end - peak);
-}
-
-// Get biome parameters based on fuzzy membership
+// Blended parameters for a biome noise value, from the active biome table
 BiomeParameters getBiomeParameters(float noiseValue) {
-    BiomeParameters params;
-
-    // Default parameters
-    params.heightScale = 50.0f;
-    params.frequency = 1.0f;
-    params.persistence = 0.5f;
-    params.lacunarity = 2.0f;
-
-    // Plains membership (0.0 - 0.5)
-    float plainsMembership = calculateMembership(noiseValue, 0.0f, 0.25f, 0.5f);
-
-    // Hills membership (0.5 - 0.75)
-    float hillsMembership = calculateMembership(noiseValue, 0.5f, 0.625f, 0.75f);
-
-    // Mountains membership (0.75 - 1.0)
-    float mountainsMembership = calculateMembership(noiseValue, 0.75f, 0.875f, 1.0f);
-
-
-    // Blend parameters based on membership values
-    BiomeParameters finalParams;
-    float totalMembership = plainsMembership + hillsMembership + mountainsMembership;
-
-    if (totalMembership > 0.0f) {
-        finalParams.heightScale =
-            (plainsMembership * 30.0f +
-                hillsMembership * 60.0f +
-                mountainsMembership * 100.0f) / totalMembership;
-
-        finalParams.frequency =
-            (plainsMembership * 0.8f +
-                hillsMembership * 1.2f +
-                mountainsMembership * 1.5f) / totalMembership;
-
-        finalParams.persistence =
-            (plainsMembership * 0.4f +
-                hillsMembership * 0.5f +
-                mountainsMembership * 0.6f) / totalMembership;
+    return activeBiomeTable().evaluate(noiseValue);
+}
 
-        finalParams.lacunarity =
-            (plainsMembership * 1.5f +
-                hillsMembership * 2.0f +
-                mountainsMembership * 2.5f) / totalMembership;
-    }
+// Biome selector noise at a grid vertex, normalised to 0-1
+float sampleBiomeNoise(float worldX, float worldZ, float scale, float seed) {
+    // Generate biome noise using different frequency and seed
+    float biomeX = (worldX / (scale * 4.0f)); // Larger scale for smoother biome transitions
+    float biomeZ = (worldZ / (scale * 4.0f));
+    float biomeValue = glm::perlin(glm::vec3(biomeX, seed * 0.1f, biomeZ));
+    return (biomeValue + 1.0f) * 0.5f; // Normalize to 0-1
+}
 
-    else {
-        return params; // Return default if no membership
+// fBm height (before falloff) using the biome parameters
+float sampleTerrainHeight(float worldX, float worldZ, float scale, float seed, int octaves, const BiomeParameters& biomeParams) {
+    float heightValue = 0.0f;
+    float amplitude = 1.0f;
+    float maxValue = 0.0f;
+
+    for (int o = 0; o < octaves; o++) {
+        float currentFreq = biomeParams.frequency * pow(biomeParams.lacunarity, o);
+        float sampleX = (worldX / scale) * currentFreq;
+        float sampleZ = (worldZ / scale) * currentFreq;
+        float sampleY = seed * 0.5f * currentFreq;
+
+        float noiseValue = glm::perlin(glm::vec3(sampleX, sampleY, sampleZ));
+        heightValue += noiseValue * amplitude;
+        maxValue += amplitude;
+        amplitude *= biomeParams.persistence;
     }
+    return heightValue / maxValue;
+}
 
-    return finalParams;
+// Biome type stored in TerrainData, from the active biome table
+BiomeType classifyBiome(float biomeNoise) {
+    return activeBiomeTable().classify(biomeNoise);
 }
 
 TerrainData generateTerrain(int width, int height, float scale, float seed, int octaves) {
@@ -161,12 +134,7 @@ TerrainData generateTerrain(int width, int height, float scale, float seed, int
         float worldZ = (float)z - (height / 2.0f);
         for (int x = 0; x < width; x++) {
             float worldX = (float)x - (width / 2.0f);
-
-            // Generate biome noise using different frequency and seed
-            float biomeX = (worldX / (scale * 4.0f)); // Larger scale for smoother biome transitions
-            float biomeZ = (worldZ / (scale * 4.0f));
-            float biomeValue = glm::perlin(glm::vec3(biomeX, seed * 0.1f, biomeZ));
-            biomeNoise.push_back((biomeValue + 1.0f) * 0.5f); // Normalize to 0-1
+            biomeNoise.push_back(sampleBiomeNoise(worldX, worldZ, scale, seed));
         }
     }
 
@@ -181,35 +149,18 @@ TerrainData generateTerrain(int width, int height, float scale, float seed, int
             BiomeParameters biomeParams = getBiomeParameters(biomeNoise[index]);
 
             // Generate height using biome parameters
-            float heightValue = 0.0f;
-            float amplitude = 1.0f;
-            float maxValue = 0.0f;
-
-            for (int o = 0; o < octaves; o++) {
-                float currentFreq = biomeParams.frequency * pow(biomeParams.lacunarity, o);
-                float sampleX = (worldX / scale) * currentFreq;
-                float sampleZ = (worldZ / scale) * currentFreq;
-                float sampleY = seed * 0.5f * currentFreq;
-
-                float noiseValue = glm::perlin(glm::vec3(sampleX, sampleY, sampleZ));
-                heightValue += noiseValue * amplitude;
-                maxValue += amplitude;
-                amplitude *= biomeParams.persistence;
-            }
+            float heightValue = sampleTerrainHeight(worldX, worldZ, scale, seed, octaves, biomeParams);
 
             // Normalize and scale height based on biome
             float falloffFactor = calculateFalloff(x, z, width, height, 0.0f); // Replace 0.0f with the desired sea level height
-            heightValue = (heightValue / maxValue) * biomeParams.heightScale * falloffFactor;
+            heightValue = heightValue * biomeParams.heightScale * falloffFactor;
 
             // Store vertex data
             terrain.vertices.push_back(worldX);
             terrain.vertices.push_back(heightValue);
             terrain.vertices.push_back(worldZ);
 
-            // Store biome type excluding Mountains
-            if (biomeNoise[index] < 0.3f) terrain.biomeMap.push_back(PLAINS);
-            else if (biomeNoise[index] < 0.55f) terrain.biomeMap.push_back(HILLS);
-            else terrain.biomeMap.push_back(DESERT);  // Replace Mountain range
+            terrain.biomeMap.push_back(classifyBiome(biomeNoise[index]));
         }
     }
 
@@ -233,4 +184,98 @@ TerrainData generateTerrain(int width, int height, float scale, float seed, int
 
     return terrain;
 }
-#endif
\ No newline at end of file
+
+// Same result as smoothHeights, run on a contiguous height plane across the pool
+void smoothHeightsParallel(std::vector<float>& vertices, int width, int height, int smoothingPasses = 1,
+    ThreadPool& pool = globalThreadPool()) {
+    std::vector<float> heights(vertices.size() / 3);
+    for (size_t i = 0; i < heights.size(); i++)
+        heights[i] = vertices[i * 3 + 1];
+
+    SmoothingSettings settings;
+    settings.kernel = SMOOTH_BOX_EXACT;
+    settings.passes = smoothingPasses;
+    smoothHeightPlane(heights, width, height, settings, pool);
+
+    for (size_t i = 0; i < heights.size(); i++)
+        vertices[i * 3 + 1] = heights[i];
+}
+
+// Biome noise, blended parameters and fBm height for a width x height block of vertices,
+// `spacing` units apart, whose first vertex sits at world (originX, originZ). Rows go through the
+// batch noise kernels in parallel. With applyFalloff the block is treated as a whole finite
+// map and its edges are pulled down like generateTerrain does.
+void sampleTerrainBlock(float originX, float originZ, int width, int height, float scale, float seed, int octaves,
+    const BiomeTable& biomeTable, bool applyFalloff, float* heightPlane, uint8_t* biomePlane, ThreadPool& pool,
+    float spacing = 1.0f) {
+    const int rowsPerTask = 8;
+    pool.parallelFor(height, rowsPerTask, [&](int zBegin, int zEnd) {
+        std::vector<float> biomeXs(width), biomeYs(width, seed * 0.1f), biomeZs(width), biomeNoise(width);
+        std::vector<float> sampleXs(width), sampleZs(width), frequency(width), lacunarity(width), persistence(width), heights(width);
+        std::vector<BiomeParameters> biomeParams(width);
+        for (int x = 0; x < width; x++) {
+            float worldX = originX + (float)x * spacing;
+            biomeXs[x] = worldX / (scale * 4.0f);
+            sampleXs[x] = worldX / scale;
+        }
+
+        for (int z = zBegin; z < zEnd; z++) {
+            float worldZ = originZ + (float)z * spacing;
+            std::fill(biomeZs.begin(), biomeZs.end(), worldZ / (scale * 4.0f));
+            std::fill(sampleZs.begin(), sampleZs.end(), worldZ / scale);
+            perlin3_batch(biomeXs.data(), biomeYs.data(), biomeZs.data(), biomeNoise.data(), width);
+
+            for (int x = 0; x < width; x++) {
+                biomeNoise[x] = (biomeNoise[x] + 1.0f) * 0.5f;
+                biomeParams[x] = biomeTable.evaluate(biomeNoise[x]);
+                frequency[x] = biomeParams[x].frequency;
+                lacunarity[x] = biomeParams[x].lacunarity;
+                persistence[x] = biomeParams[x].persistence;
+            }
+            FbmBatchInput fbmInput = { sampleXs.data(), sampleZs.data(), frequency.data(), lacunarity.data(), persistence.data(), seed * 0.5f };
+            fbm3_batch(fbmInput, octaves, heights.data(), width);
+
+            for (int x = 0; x < width; x++) {
+                size_t index = (size_t)z * width + x;
+                float falloffFactor = applyFalloff ? calculateFalloff(x, z, width, height, 0.0f) : 1.0f;
+                heightPlane[index] = heights[x] * biomeParams[x].heightScale * falloffFactor;
+                biomePlane[index] = (uint8_t)biomeTable.classify(biomeNoise[x]);
+            }
+        }
+    });
+}
+
+// Multithreaded terrain generation into the compact Heightfield. Rows are split into tiles on
+// the pool and every output is written in place, so heights and biomes are bit-identical to
+// generateTerrain for any thread count (with the default smoothing settings).
+Heightfield generateHeightfield(int width, int height, float scale, float seed, int octaves,
+    ThreadPool& pool = globalThreadPool(), const SmoothingSettings& smoothing = SmoothingSettings(),
+    const BiomeTable& biomeTable = activeBiomeTable()) {
+    Heightfield terrain(width, height);
+    std::vector<float>& heightPlane = terrain.heightPlane();
+    sampleTerrainBlock(terrain.worldX(0), terrain.worldZ(0), width, height, scale, seed, octaves, biomeTable, true,
+        heightPlane.data(), terrain.biomePlane().data(), pool);
+    smoothHeightPlane(heightPlane, width, height, smoothing, pool);
+    return terrain;
+}
+
+// Expand a Heightfield into the interleaved TerrainData layout
+TerrainData toTerrainData(const Heightfield& heightfield, ThreadPool& pool = globalThreadPool()) {
+    TerrainData terrain;
+    terrain.vertices = heightfield.meshVertices(pool);
+    terrain.indices = heightfield.meshIndices(pool);
+    heightfield.releaseMesh();
+
+    const std::vector<uint8_t>& biomes = heightfield.biomePlane();
+    terrain.biomeMap.resize(biomes.size());
+    for (size_t i = 0; i < biomes.size(); i++)
+        terrain.biomeMap[i] = (BiomeType)biomes[i];
+    return terrain;
+}
+
+// Multithreaded generateTerrain, same output (see generateHeightfield)
+TerrainData generateTerrainParallel(int width, int height, float scale, float seed, int octaves,
+    ThreadPool& pool = globalThreadPool(), const SmoothingSettings& smoothing = SmoothingSettings()) {
+    return toTerrainData(generateHeightfield(width, height, scale, seed, octaves, pool, smoothing), pool);
+}
+#endif
@@ -0,0 +1,671 @@
+#ifndef PERLIN_BATCH_H
+#define PERLIN_BATCH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/noise.hpp>
+#include <cmath>
+#include <cstddef>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PERLIN_BATCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Batch version of glm::perlin(glm::vec3) for the terrain generator.
+//
+// The kernel is a lane-wise port of glm's classic 3D noise (mod289 permutation, computed
+// gradients, taylorInvSqrt normalisation) that keeps every operation in the same order,
+// so each backend returns the same bits as glm::perlin as long as the compiler does not
+// contract mul+add into FMA (the AVX2 backend deliberately does not enable FMA).
+// Backends: AVX2 (8 lanes), SSE4.1 (4 lanes), scalar; chosen at runtime from CPUID.
+//
+// The *d variants also return the analytic partial derivatives in x and z (y is the seed axis
+// and held fixed), so a height and its surface normal come from one evaluation instead of
+// four more samples for central differences.
+
+enum PerlinBackend {
+    PERLIN_SCALAR,
+    PERLIN_SSE4,
+    PERLIN_AVX2
+};
+
+// Scalar "vector" so the same kernel source serves every backend
+struct PerlinLaneScalar {
+    float v;
+    PerlinLaneScalar() {}
+    PerlinLaneScalar(float f) : v(f) {}
+    static PerlinLaneScalar load(const float* p) { return PerlinLaneScalar(*p); }
+    void store(float* p) const { *p = v; }
+    friend PerlinLaneScalar operator+(PerlinLaneScalar a, PerlinLaneScalar b) { return a.v + b.v; }
+    friend PerlinLaneScalar operator-(PerlinLaneScalar a, PerlinLaneScalar b) { return a.v - b.v; }
+    friend PerlinLaneScalar operator*(PerlinLaneScalar a, PerlinLaneScalar b) { return a.v * b.v; }
+    friend PerlinLaneScalar floorLane(PerlinLaneScalar a) { return std::floor(a.v); }
+    friend PerlinLaneScalar absLane(PerlinLaneScalar a) { return std::fabs(a.v); }
+    // glm::step(edge, x): x < edge ? 0 : 1
+    friend PerlinLaneScalar stepLane(PerlinLaneScalar edge, PerlinLaneScalar x) { return x.v < edge.v ? 0.0f : 1.0f; }
+};
+
+template<class V>
+V perlinMod289(V x) {
+    return x - floorLane(x * V(1.0f / 289.0f)) * V(289.0f);
+}
+
+template<class V>
+V perlinPermute(V x) {
+    return perlinMod289(((x * V(34.0f)) + V(1.0f)) * x);
+}
+
+template<class V>
+V perlinFract(V x) {
+    return x - floorLane(x);
+}
+
+// Normalised gradient of one lattice corner from its hash
+template<class V>
+void perlinGradient(V hash, V& gx, V& gy, V& gz) {
+    gx = hash * V(static_cast<float>(1.0 / 7.0));
+    gy = perlinFract(floorLane(gx) * V(static_cast<float>(1.0 / 7.0))) - V(0.5f);
+    gx = perlinFract(gx);
+    gz = V(0.5f) - absLane(gx) - absLane(gy);
+    V sz = stepLane(gz, V(0.0f));
+    gx = gx - sz * (stepLane(V(0.0f), gx) - V(0.5f));
+    gy = gy - sz * (stepLane(V(0.0f), gy) - V(0.5f));
+
+    V norm = V(static_cast<float>(1.79284291400159)) - V(static_cast<float>(0.85373472095314)) * (gx * gx + gy * gy + gz * gz);
+    gx = gx * norm;
+    gy = gy * norm;
+    gz = gz * norm;
+}
+
+template<class V>
+V perlinCorner(V hash, V fx, V fy, V fz) {
+    V gx, gy, gz;
+    perlinGradient(hash, gx, gy, gz);
+    return gx * fx + gy * fy + gz * fz;
+}
+
+template<class V>
+V perlinMix(V x, V y, V a) {
+    return x * (V(1.0f) - a) + y * a;
+}
+
+template<class V>
+V perlinFade(V t) {
+    return (t * t * t) * (t * (t * V(6.0f) - V(15.0f)) + V(10.0f));
+}
+
+template<class V>
+V perlin3Kernel(V px, V py, V pz) {
+    V pi0x = floorLane(px), pi0y = floorLane(py), pi0z = floorLane(pz);
+    V pi1x = pi0x + V(1.0f), pi1y = pi0y + V(1.0f), pi1z = pi0z + V(1.0f);
+    V pf0x = perlinFract(px), pf0y = perlinFract(py), pf0z = perlinFract(pz);
+    V pf1x = pf0x - V(1.0f), pf1y = pf0y - V(1.0f), pf1z = pf0z - V(1.0f);
+    pi0x = perlinMod289(pi0x); pi0y = perlinMod289(pi0y); pi0z = perlinMod289(pi0z);
+    pi1x = perlinMod289(pi1x); pi1y = perlinMod289(pi1y); pi1z = perlinMod289(pi1z);
+
+    // Corner hashes in glm's order: (x0,y0), (x1,y0), (x0,y1), (x1,y1), then z0 / z1
+    V permX0 = perlinPermute(pi0x), permX1 = perlinPermute(pi1x);
+    V ixy00 = perlinPermute(permX0 + pi0y);
+    V ixy10 = perlinPermute(permX1 + pi0y);
+    V ixy01 = perlinPermute(permX0 + pi1y);
+    V ixy11 = perlinPermute(permX1 + pi1y);
+
+    V n000 = perlinCorner(perlinPermute(ixy00 + pi0z), pf0x, pf0y, pf0z);
+    V n100 = perlinCorner(perlinPermute(ixy10 + pi0z), pf1x, pf0y, pf0z);
+    V n010 = perlinCorner(perlinPermute(ixy01 + pi0z), pf0x, pf1y, pf0z);
+    V n110 = perlinCorner(perlinPermute(ixy11 + pi0z), pf1x, pf1y, pf0z);
+    V n001 = perlinCorner(perlinPermute(ixy00 + pi1z), pf0x, pf0y, pf1z);
+    V n101 = perlinCorner(perlinPermute(ixy10 + pi1z), pf1x, pf0y, pf1z);
+    V n011 = perlinCorner(perlinPermute(ixy01 + pi1z), pf0x, pf1y, pf1z);
+    V n111 = perlinCorner(perlinPermute(ixy11 + pi1z), pf1x, pf1y, pf1z);
+
+    V fadeX = perlinFade(pf0x), fadeY = perlinFade(pf0y), fadeZ = perlinFade(pf0z);
+    V nz00 = perlinMix(n000, n001, fadeZ);
+    V nz10 = perlinMix(n100, n101, fadeZ);
+    V nz01 = perlinMix(n010, n011, fadeZ);
+    V nz11 = perlinMix(n110, n111, fadeZ);
+    V ny0 = perlinMix(nz00, nz01, fadeY);
+    V ny1 = perlinMix(nz10, nz11, fadeY);
+    return V(static_cast<float>(2.2)) * perlinMix(ny0, ny1, fadeX);
+}
+
+// d/dt of perlinFade: 30t^2(t - 1)^2
+template<class V>
+V perlinFadeDerivative(V t) {
+    return V(30.0f) * (t * t) * (t * (t - V(2.0f)) + V(1.0f));
+}
+
+// perlinCorner that also hands back the gradient's x and z: the corner's own partial derivatives
+template<class V>
+V perlinCornerDerivative(V hash, V fx, V fy, V fz, V& gx, V& gz) {
+    V gy;
+    perlinGradient(hash, gx, gy, gz);
+    return gx * fx + gy * fy + gz * fz;
+}
+
+// perlin3Kernel plus d/dx and d/dz. The value goes through exactly the same operations, so it
+// is still bit-identical to glm::perlin. The derivatives follow the interpolation back out:
+// each mix contributes the blended corner gradients, and the axis it fades along adds
+// (far - near) * fade'(t).
+template<class V>
+void perlin3DerivativeKernel(V px, V py, V pz, V& value, V& dx, V& dz) {
+    V pi0x = floorLane(px), pi0y = floorLane(py), pi0z = floorLane(pz);
+    V pi1x = pi0x + V(1.0f), pi1y = pi0y + V(1.0f), pi1z = pi0z + V(1.0f);
+    V pf0x = perlinFract(px), pf0y = perlinFract(py), pf0z = perlinFract(pz);
+    V pf1x = pf0x - V(1.0f), pf1y = pf0y - V(1.0f), pf1z = pf0z - V(1.0f);
+    pi0x = perlinMod289(pi0x); pi0y = perlinMod289(pi0y); pi0z = perlinMod289(pi0z);
+    pi1x = perlinMod289(pi1x); pi1y = perlinMod289(pi1y); pi1z = perlinMod289(pi1z);
+
+    V permX0 = perlinPermute(pi0x), permX1 = perlinPermute(pi1x);
+    V ixy00 = perlinPermute(permX0 + pi0y);
+    V ixy10 = perlinPermute(permX1 + pi0y);
+    V ixy01 = perlinPermute(permX0 + pi1y);
+    V ixy11 = perlinPermute(permX1 + pi1y);
+
+    V gx000, gz000, gx100, gz100, gx010, gz010, gx110, gz110;
+    V gx001, gz001, gx101, gz101, gx011, gz011, gx111, gz111;
+    V n000 = perlinCornerDerivative(perlinPermute(ixy00 + pi0z), pf0x, pf0y, pf0z, gx000, gz000);
+    V n100 = perlinCornerDerivative(perlinPermute(ixy10 + pi0z), pf1x, pf0y, pf0z, gx100, gz100);
+    V n010 = perlinCornerDerivative(perlinPermute(ixy01 + pi0z), pf0x, pf1y, pf0z, gx010, gz010);
+    V n110 = perlinCornerDerivative(perlinPermute(ixy11 + pi0z), pf1x, pf1y, pf0z, gx110, gz110);
+    V n001 = perlinCornerDerivative(perlinPermute(ixy00 + pi1z), pf0x, pf0y, pf1z, gx001, gz001);
+    V n101 = perlinCornerDerivative(perlinPermute(ixy10 + pi1z), pf1x, pf0y, pf1z, gx101, gz101);
+    V n011 = perlinCornerDerivative(perlinPermute(ixy01 + pi1z), pf0x, pf1y, pf1z, gx011, gz011);
+    V n111 = perlinCornerDerivative(perlinPermute(ixy11 + pi1z), pf1x, pf1y, pf1z, gx111, gz111);
+
+    V fadeX = perlinFade(pf0x), fadeY = perlinFade(pf0y), fadeZ = perlinFade(pf0z);
+    V slopeZ = perlinFadeDerivative(pf0z), slopeX = perlinFadeDerivative(pf0x);
+
+    // Along z
+    V nz00 = perlinMix(n000, n001, fadeZ);
+    V nz10 = perlinMix(n100, n101, fadeZ);
+    V nz01 = perlinMix(n010, n011, fadeZ);
+    V nz11 = perlinMix(n110, n111, fadeZ);
+    V xz00 = perlinMix(gx000, gx001, fadeZ), xz10 = perlinMix(gx100, gx101, fadeZ);
+    V xz01 = perlinMix(gx010, gx011, fadeZ), xz11 = perlinMix(gx110, gx111, fadeZ);
+    V zz00 = perlinMix(gz000, gz001, fadeZ) + (n001 - n000) * slopeZ;
+    V zz10 = perlinMix(gz100, gz101, fadeZ) + (n101 - n100) * slopeZ;
+    V zz01 = perlinMix(gz010, gz011, fadeZ) + (n011 - n010) * slopeZ;
+    V zz11 = perlinMix(gz110, gz111, fadeZ) + (n111 - n110) * slopeZ;
+
+    // Along y, which is not differentiated
+    V ny0 = perlinMix(nz00, nz01, fadeY);
+    V ny1 = perlinMix(nz10, nz11, fadeY);
+    V xy0 = perlinMix(xz00, xz01, fadeY), xy1 = perlinMix(xz10, xz11, fadeY);
+    V zy0 = perlinMix(zz00, zz01, fadeY), zy1 = perlinMix(zz10, zz11, fadeY);
+
+    // Along x
+    V scale = V(static_cast<float>(2.2));
+    value = scale * perlinMix(ny0, ny1, fadeX);
+    dx = scale * (perlinMix(xy0, xy1, fadeX) + (ny1 - ny0) * slopeX);
+    dz = scale * perlinMix(zy0, zy1, fadeX);
+}
+
+template<class V, int Lanes>
+void perlin3BatchLanes(const float* x, const float* y, const float* z, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + Lanes <= n; i += Lanes)
+        perlin3Kernel(V::load(x + i), V::load(y + i), V::load(z + i)).store(out + i);
+    for (; i < n; i++)
+        out[i] = perlin3Kernel(PerlinLaneScalar(x[i]), PerlinLaneScalar(y[i]), PerlinLaneScalar(z[i])).v;
+}
+
+void perlin3BatchScalar(const float* x, const float* y, const float* z, float* out, size_t n) {
+    perlin3BatchLanes<PerlinLaneScalar, 1>(x, y, z, out, n);
+}
+
+template<class V, int Lanes>
+void perlin3dBatchLanes(const float* x, const float* y, const float* z, float* out, float* outDx, float* outDz, size_t n) {
+    size_t i = 0;
+    for (; i + Lanes <= n; i += Lanes) {
+        V value, dx, dz;
+        perlin3DerivativeKernel(V::load(x + i), V::load(y + i), V::load(z + i), value, dx, dz);
+        value.store(out + i);
+        dx.store(outDx + i);
+        dz.store(outDz + i);
+    }
+    for (; i < n; i++) {
+        PerlinLaneScalar value, dx, dz;
+        perlin3DerivativeKernel(PerlinLaneScalar(x[i]), PerlinLaneScalar(y[i]), PerlinLaneScalar(z[i]), value, dx, dz);
+        out[i] = value.v;
+        outDx[i] = dx.v;
+        outDz[i] = dz.v;
+    }
+}
+
+void perlin3dBatchScalar(const float* x, const float* y, const float* z, float* out, float* outDx, float* outDz, size_t n) {
+    perlin3dBatchLanes<PerlinLaneScalar, 1>(x, y, z, out, outDx, outDz, n);
+}
+
+#ifdef PERLIN_BATCH_X86
+
+// GCC/Clang only emit SSE4.1/AVX2 instructions inside functions compiled for those targets.
+// The batch entry points are flattened so the generic kernel is inlined into them and
+// compiled for the wider ISA as well.
+#if defined(__GNUC__)
+#define PERLIN_TARGET(isa) __attribute__((target(isa)))
+#define PERLIN_FLATTEN(isa) __attribute__((target(isa), flatten))
+#else
+#define PERLIN_TARGET(isa)
+#define PERLIN_FLATTEN(isa)
+#endif
+
+struct PerlinLaneSSE4 {
+    __m128 v;
+    PERLIN_TARGET("sse4.1") PerlinLaneSSE4() {}
+    PERLIN_TARGET("sse4.1") PerlinLaneSSE4(__m128 m) : v(m) {}
+    PERLIN_TARGET("sse4.1") PerlinLaneSSE4(float f) : v(_mm_set1_ps(f)) {}
+    PERLIN_TARGET("sse4.1") static PerlinLaneSSE4 load(const float* p) { return _mm_loadu_ps(p); }
+    PERLIN_TARGET("sse4.1") void store(float* p) const { _mm_storeu_ps(p, v); }
+    PERLIN_TARGET("sse4.1") friend PerlinLaneSSE4 operator+(PerlinLaneSSE4 a, PerlinLaneSSE4 b) { return _mm_add_ps(a.v, b.v); }
+    PERLIN_TARGET("sse4.1") friend PerlinLaneSSE4 operator-(PerlinLaneSSE4 a, PerlinLaneSSE4 b) { return _mm_sub_ps(a.v, b.v); }
+    PERLIN_TARGET("sse4.1") friend PerlinLaneSSE4 operator*(PerlinLaneSSE4 a, PerlinLaneSSE4 b) { return _mm_mul_ps(a.v, b.v); }
+    PERLIN_TARGET("sse4.1") friend PerlinLaneSSE4 floorLane(PerlinLaneSSE4 a) { return _mm_floor_ps(a.v); }
+    PERLIN_TARGET("sse4.1") friend PerlinLaneSSE4 absLane(PerlinLaneSSE4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    PERLIN_TARGET("sse4.1") friend PerlinLaneSSE4 stepLane(PerlinLaneSSE4 edge, PerlinLaneSSE4 x) {
+        return _mm_andnot_ps(_mm_cmplt_ps(x.v, edge.v), _mm_set1_ps(1.0f));
+    }
+};
+
+PERLIN_FLATTEN("sse4.1") void perlin3BatchSSE4(const float* x, const float* y, const float* z, float* out, size_t n) {
+    perlin3BatchLanes<PerlinLaneSSE4, 4>(x, y, z, out, n);
+}
+
+PERLIN_FLATTEN("sse4.1") void perlin3dBatchSSE4(const float* x, const float* y, const float* z, float* out, float* outDx,
+    float* outDz, size_t n) {
+    perlin3dBatchLanes<PerlinLaneSSE4, 4>(x, y, z, out, outDx, outDz, n);
+}
+
+struct PerlinLaneAVX2 {
+    __m256 v;
+    PERLIN_TARGET("avx2") PerlinLaneAVX2() {}
+    PERLIN_TARGET("avx2") PerlinLaneAVX2(__m256 m) : v(m) {}
+    PERLIN_TARGET("avx2") PerlinLaneAVX2(float f) : v(_mm256_set1_ps(f)) {}
+    PERLIN_TARGET("avx2") static PerlinLaneAVX2 load(const float* p) { return _mm256_loadu_ps(p); }
+    PERLIN_TARGET("avx2") void store(float* p) const { _mm256_storeu_ps(p, v); }
+    PERLIN_TARGET("avx2") friend PerlinLaneAVX2 operator+(PerlinLaneAVX2 a, PerlinLaneAVX2 b) { return _mm256_add_ps(a.v, b.v); }
+    PERLIN_TARGET("avx2") friend PerlinLaneAVX2 operator-(PerlinLaneAVX2 a, PerlinLaneAVX2 b) { return _mm256_sub_ps(a.v, b.v); }
+    PERLIN_TARGET("avx2") friend PerlinLaneAVX2 operator*(PerlinLaneAVX2 a, PerlinLaneAVX2 b) { return _mm256_mul_ps(a.v, b.v); }
+    PERLIN_TARGET("avx2") friend PerlinLaneAVX2 floorLane(PerlinLaneAVX2 a) { return _mm256_floor_ps(a.v); }
+    PERLIN_TARGET("avx2") friend PerlinLaneAVX2 absLane(PerlinLaneAVX2 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+    PERLIN_TARGET("avx2") friend PerlinLaneAVX2 stepLane(PerlinLaneAVX2 edge, PerlinLaneAVX2 x) {
+        return _mm256_andnot_ps(_mm256_cmp_ps(x.v, edge.v, _CMP_LT_OQ), _mm256_set1_ps(1.0f));
+    }
+};
+
+PERLIN_FLATTEN("avx2") void perlin3BatchAVX2(const float* x, const float* y, const float* z, float* out, size_t n) {
+    perlin3BatchLanes<PerlinLaneAVX2, 8>(x, y, z, out, n);
+}
+
+PERLIN_FLATTEN("avx2") void perlin3dBatchAVX2(const float* x, const float* y, const float* z, float* out, float* outDx,
+    float* outDz, size_t n) {
+    perlin3dBatchLanes<PerlinLaneAVX2, 8>(x, y, z, out, outDx, outDz, n);
+}
+
+PerlinBackend detectPerlinBackend() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) return PERLIN_AVX2;
+    if (sse41) return PERLIN_SSE4;
+    return PERLIN_SCALAR;
+}
+
+#else
+
+PerlinBackend detectPerlinBackend() {
+    return PERLIN_SCALAR;
+}
+
+#endif
+
+const char* perlinBackendName(PerlinBackend backend) {
+    switch (backend) {
+    case PERLIN_AVX2: return "AVX2";
+    case PERLIN_SSE4: return "SSE4.1";
+    default: return "scalar";
+    }
+}
+
+typedef void (*Perlin3BatchFunction)(const float*, const float*, const float*, float*, size_t);
+
+Perlin3BatchFunction perlin3BatchFunction(PerlinBackend backend) {
+#ifdef PERLIN_BATCH_X86
+    if (backend == PERLIN_AVX2) return perlin3BatchAVX2;
+    if (backend == PERLIN_SSE4) return perlin3BatchSSE4;
+#endif
+    return perlin3BatchScalar;
+}
+
+typedef void (*Perlin3dBatchFunction)(const float*, const float*, const float*, float*, float*, float*, size_t);
+
+Perlin3dBatchFunction perlin3dBatchFunction(PerlinBackend backend) {
+#ifdef PERLIN_BATCH_X86
+    if (backend == PERLIN_AVX2) return perlin3dBatchAVX2;
+    if (backend == PERLIN_SSE4) return perlin3dBatchSSE4;
+#endif
+    return perlin3dBatchScalar;
+}
+
+// Best backend for this CPU, detected once
+PerlinBackend activePerlinBackend() {
+    static PerlinBackend backend = detectPerlinBackend();
+    return backend;
+}
+
+// out[i] = glm::perlin(glm::vec3(x[i], y[i], z[i]))
+void perlin3_batch(const float* x, const float* y, const float* z, float* out, size_t n) {
+    static Perlin3BatchFunction function = perlin3BatchFunction(activePerlinBackend());
+    function(x, y, z, out, n);
+}
+
+// perlin3_batch plus the partial derivatives: outDx[i] = d/dx, outDz[i] = d/dz at the same point
+void perlin3d_batch(const float* x, const float* y, const float* z, float* out, float* outDx, float* outDz, size_t n) {
+    static Perlin3dBatchFunction function = perlin3dBatchFunction(activePerlinBackend());
+    function(x, y, z, out, outDx, outDz, n);
+}
+
+// Per-sample fBm parameters, structure-of-arrays
+struct FbmBatchInput {
+    const float* x;           // worldX / scale
+    const float* z;           // worldZ / scale
+    const float* frequency;
+    const float* lacunarity;
+    const float* persistence;
+    float y;                  // seed * 0.5, scaled by the octave frequency like x and z
+};
+
+// fBm with the octave count fixed at compile time so the octave loop fully unrolls
+// (Octaves == 0 takes the count from `octaves` at runtime).
+// Matches sampleTerrainHeight() in noise.h: sum of perlin(p * frequency * lacunarity^o) * persistence^o,
+// divided by the summed amplitudes. lacunarity^o is built up incrementally in double precision
+// instead of calling pow() for every octave.
+template<int Octaves>
+void fbm3_batch(const FbmBatchInput& in, float* out, size_t n, int octaves = Octaves) {
+    const size_t BLOCK = 256;
+    float sx[BLOCK], sy[BLOCK], sz[BLOCK], noise[BLOCK];
+    float height[BLOCK], amplitude[BLOCK], maxValue[BLOCK];
+    double lacunarityPower[BLOCK];
+
+    for (size_t begin = 0; begin < n; begin += BLOCK) {
+        size_t count = std::min(BLOCK, n - begin);
+        for (size_t i = 0; i < count; i++) {
+            height[i] = 0.0f;
+            amplitude[i] = 1.0f;
+            maxValue[i] = 0.0f;
+            lacunarityPower[i] = 1.0;
+        }
+
+        for (int o = 0; o < (Octaves > 0 ? Octaves : octaves); o++) {
+            for (size_t i = 0; i < count; i++) {
+                float currentFreq = (float)(in.frequency[begin + i] * lacunarityPower[i]);
+                sx[i] = in.x[begin + i] * currentFreq;
+                sy[i] = in.y * currentFreq;
+                sz[i] = in.z[begin + i] * currentFreq;
+                lacunarityPower[i] *= in.lacunarity[begin + i];
+            }
+            perlin3_batch(sx, sy, sz, noise, count);
+            for (size_t i = 0; i < count; i++) {
+                height[i] += noise[i] * amplitude[i];
+                maxValue[i] += amplitude[i];
+                amplitude[i] *= in.persistence[begin + i];
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+            out[begin + i] = height[i] / maxValue[i];
+    }
+}
+
+// Runtime octave count -> compiled specialisation for 1-8 octaves
+void fbm3_batch(const FbmBatchInput& in, int octaves, float* out, size_t n) {
+    switch (octaves) {
+    case 1: fbm3_batch<1>(in, out, n); break;
+    case 2: fbm3_batch<2>(in, out, n); break;
+    case 3: fbm3_batch<3>(in, out, n); break;
+    case 4: fbm3_batch<4>(in, out, n); break;
+    case 5: fbm3_batch<5>(in, out, n); break;
+    case 6: fbm3_batch<6>(in, out, n); break;
+    case 7: fbm3_batch<7>(in, out, n); break;
+    case 8: fbm3_batch<8>(in, out, n); break;
+    default: fbm3_batch<0>(in, out, n, octaves); break;
+    }
+}
+
+// fbm3_batch that also returns the slope of the normalised sum with respect to in.x and in.z
+// (each octave's derivative times its amplitude and frequency). The heights are bit-identical
+// to fbm3_batch; divide the slopes by the terrain scale for d/dworldX and d/dworldZ.
+template<int Octaves>
+void fbm3d_batch(const FbmBatchInput& in, float* out, float* outDx, float* outDz, size_t n, int octaves = Octaves) {
+    const size_t BLOCK = 256;
+    float sx[BLOCK], sy[BLOCK], sz[BLOCK], noise[BLOCK], noiseDx[BLOCK], noiseDz[BLOCK];
+    float height[BLOCK], slopeX[BLOCK], slopeZ[BLOCK], amplitude[BLOCK], maxValue[BLOCK], octaveFreq[BLOCK];
+    double lacunarityPower[BLOCK];
+
+    for (size_t begin = 0; begin < n; begin += BLOCK) {
+        size_t count = std::min(BLOCK, n - begin);
+        for (size_t i = 0; i < count; i++) {
+            height[i] = 0.0f;
+            slopeX[i] = 0.0f;
+            slopeZ[i] = 0.0f;
+            amplitude[i] = 1.0f;
+            maxValue[i] = 0.0f;
+            lacunarityPower[i] = 1.0;
+        }
+
+        for (int o = 0; o < (Octaves > 0 ? Octaves : octaves); o++) {
+            for (size_t i = 0; i < count; i++) {
+                float currentFreq = (float)(in.frequency[begin + i] * lacunarityPower[i]);
+                sx[i] = in.x[begin + i] * currentFreq;
+                sy[i] = in.y * currentFreq;
+                sz[i] = in.z[begin + i] * currentFreq;
+                octaveFreq[i] = currentFreq;
+                lacunarityPower[i] *= in.lacunarity[begin + i];
+            }
+            perlin3d_batch(sx, sy, sz, noise, noiseDx, noiseDz, count);
+            for (size_t i = 0; i < count; i++) {
+                height[i] += noise[i] * amplitude[i];
+                slopeX[i] += noiseDx[i] * (amplitude[i] * octaveFreq[i]);
+                slopeZ[i] += noiseDz[i] * (amplitude[i] * octaveFreq[i]);
+                maxValue[i] += amplitude[i];
+                amplitude[i] *= in.persistence[begin + i];
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            out[begin + i] = height[i] / maxValue[i];
+            outDx[begin + i] = slopeX[i] / maxValue[i];
+            outDz[begin + i] = slopeZ[i] / maxValue[i];
+        }
+    }
+}
+
+void fbm3d_batch(const FbmBatchInput& in, int octaves, float* out, float* outDx, float* outDz, size_t n) {
+    switch (octaves) {
+    case 1: fbm3d_batch<1>(in, out, outDx, outDz, n); break;
+    case 2: fbm3d_batch<2>(in, out, outDx, outDz, n); break;
+    case 3: fbm3d_batch<3>(in, out, outDx, outDz, n); break;
+    case 4: fbm3d_batch<4>(in, out, outDx, outDz, n); break;
+    case 5: fbm3d_batch<5>(in, out, outDx, outDz, n); break;
+    case 6: fbm3d_batch<6>(in, out, outDx, outDz, n); break;
+    case 7: fbm3d_batch<7>(in, out, outDx, outDz, n); break;
+    case 8: fbm3d_batch<8>(in, out, outDx, outDz, n); break;
+    default: fbm3d_batch<0>(in, out, outDx, outDz, n, octaves); break;
+    }
+}
+
+// Prints samples/second for glm::perlin and every backend this CPU supports, plus the
+// largest difference from glm::perlin
+void benchmarkPerlinBatch(size_t sampleCount = 1 << 20) {
+    std::vector<float> x(sampleCount), y(sampleCount), z(sampleCount), out(sampleCount), reference(sampleCount);
+    for (size_t i = 0; i < sampleCount; i++) {
+        x[i] = (float)(i % 1024) * 0.0731f - 37.0f;
+        y[i] = 4.2f + (float)(i % 7) * 0.5f;
+        z[i] = (float)(i / 1024) * 0.0593f - 11.0f;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < sampleCount; i++)
+        reference[i] = glm::perlin(glm::vec3(x[i], y[i], z[i]));
+    double glmSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Perlin batch benchmark, " << sampleCount << " samples" << std::endl;
+    std::cout << "  glm::perlin: " << sampleCount / glmSeconds * 1e-6 << " Msamples/s" << std::endl;
+
+    PerlinBackend best = activePerlinBackend();
+    for (int b = PERLIN_SCALAR; b <= best; b++) {
+        Perlin3BatchFunction function = perlin3BatchFunction((PerlinBackend)b);
+        start = std::chrono::high_resolution_clock::now();
+        function(x.data(), y.data(), z.data(), out.data(), sampleCount);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        float maxError = 0.0f;
+        for (size_t i = 0; i < sampleCount; i++)
+            maxError = std::max(maxError, std::fabs(out[i] - reference[i]));
+        std::cout << "  " << perlinBackendName((PerlinBackend)b) << ": " << sampleCount / seconds * 1e-6
+            << " Msamples/s (" << glmSeconds / seconds << "x), max difference " << maxError << std::endl;
+    }
+}
+
+// Checks the analytic derivatives against finite differences of the same float kernel (a five
+// point stencil with a 1/128 step; float rounding of the samples limits it to ~1e-4), for single
+// octaves and for the 6 octave fBm, whose reference differentiates every octave at the
+// coordinates fbm3_batch samples and sums them. Then times what a height plus normal costs: the
+// plain fBm, the derivative fBm, and the plain fBm at the sample and its four neighbours.
+void benchmarkPerlinDerivatives(size_t sampleCount = 1 << 18) {
+    const int octaves = 6;
+    const float scale = 50.0f, seed = 42.0f;
+    std::vector<float> x(sampleCount), y(sampleCount), z(sampleCount);
+    std::vector<float> frequency(sampleCount), lacunarity(sampleCount), persistence(sampleCount);
+    for (size_t i = 0; i < sampleCount; i++) {
+        x[i] = ((float)(i % 512) * 0.731f - 187.0f) / scale;
+        y[i] = seed * 0.5f;
+        z[i] = ((float)(i / 512) * 0.593f - 71.0f) / scale;
+        frequency[i] = 0.8f + (float)(i % 5) * 0.1f;
+        lacunarity[i] = 2.0f + (float)(i % 3) * 0.1f;
+        persistence[i] = 0.5f;
+    }
+    FbmBatchInput input = { x.data(), z.data(), frequency.data(), lacunarity.data(), persistence.data(), seed * 0.5f };
+    std::vector<float> value(sampleCount), dx(sampleCount), dz(sampleCount), plain(sampleCount);
+
+    const float h = 1.0f / 128.0f;
+    auto noise = [](float px, float py, float pz) {
+        return (double)perlin3Kernel(PerlinLaneScalar(px), PerlinLaneScalar(py), PerlinLaneScalar(pz)).v;
+    };
+    auto differenceX = [&](float px, float py, float pz) {
+        return (8.0 * (noise(px + h, py, pz) - noise(px - h, py, pz)) - (noise(px + 2.0f * h, py, pz) - noise(px - 2.0f * h, py, pz)))
+            / (12.0 * h);
+    };
+    auto differenceZ = [&](float px, float py, float pz) {
+        return (8.0 * (noise(px, py, pz + h) - noise(px, py, pz - h)) - (noise(px, py, pz + 2.0f * h) - noise(px, py, pz - 2.0f * h)))
+            / (12.0 * h);
+    };
+
+    std::cout << "Perlin derivative check, " << sampleCount << " samples, " << perlinBackendName(activePerlinBackend()) << std::endl;
+    for (int pass = 0; pass < 2; pass++) {
+        bool fbm = pass == 1;
+        if (fbm) {
+            fbm3d_batch(input, octaves, value.data(), dx.data(), dz.data(), sampleCount);
+            fbm3_batch(input, octaves, plain.data(), sampleCount);
+        }
+        else {
+            perlin3d_batch(x.data(), y.data(), z.data(), value.data(), dx.data(), dz.data(), sampleCount);
+            perlin3_batch(x.data(), y.data(), z.data(), plain.data(), sampleCount);
+        }
+
+        double maxError = 0.0, sumSquaredError = 0.0, sumSquaredSlope = 0.0;
+        size_t valueMismatches = 0;
+        for (size_t i = 0; i < sampleCount; i++) {
+            if (value[i] != plain[i]) valueMismatches++;
+            double fdx = 0.0, fdz = 0.0;
+            if (fbm) {
+                double amplitude = 1.0, maxValue = 0.0, lacunarityPower = 1.0;
+                for (int o = 0; o < octaves; o++) {
+                    float currentFreq = (float)(frequency[i] * lacunarityPower);
+                    float px = x[i] * currentFreq, py = input.y * currentFreq, pz = z[i] * currentFreq;
+                    fdx += differenceX(px, py, pz) * amplitude * currentFreq;
+                    fdz += differenceZ(px, py, pz) * amplitude * currentFreq;
+                    maxValue += amplitude;
+                    amplitude *= persistence[i];
+                    lacunarityPower *= lacunarity[i];
+                }
+                fdx /= maxValue;
+                fdz /= maxValue;
+            }
+            else {
+                fdx = differenceX(x[i], y[i], z[i]);
+                fdz = differenceZ(x[i], y[i], z[i]);
+            }
+            double ex = dx[i] - fdx, ez = dz[i] - fdz;
+            maxError = std::max(maxError, std::max(std::fabs(ex), std::fabs(ez)));
+            sumSquaredError += ex * ex + ez * ez;
+            sumSquaredSlope += fdx * fdx + fdz * fdz;
+        }
+        std::cout << "  " << (fbm ? "fBm, 6 octaves" : "perlin") << ": max slope error " << maxError << ", rms error "
+            << std::sqrt(sumSquaredError / (2.0 * sampleCount)) << " (rms slope " << std::sqrt(sumSquaredSlope / (2.0 * sampleCount))
+            << "), " << valueMismatches << " heights differ from the plain kernel" << std::endl;
+    }
+
+    // Neighbour inputs one world unit away, for the finite-difference normals
+    std::vector<float> shiftedX[2], shiftedZ[2];
+    for (int side = 0; side < 2; side++) {
+        shiftedX[side].resize(sampleCount);
+        shiftedZ[side].resize(sampleCount);
+        for (size_t i = 0; i < sampleCount; i++) {
+            shiftedX[side][i] = x[i] + (side ? 1.0f : -1.0f) / scale;
+            shiftedZ[side][i] = z[i] + (side ? 1.0f : -1.0f) / scale;
+        }
+    }
+    std::vector<float> neighbour(sampleCount);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    fbm3_batch(input, octaves, plain.data(), sampleCount);
+    double plainSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    fbm3d_batch(input, octaves, value.data(), dx.data(), dz.data(), sampleCount);
+    double analyticSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    fbm3_batch(input, octaves, plain.data(), sampleCount);
+    for (int side = 0; side < 2; side++) {
+        FbmBatchInput shifted = input;
+        shifted.x = shiftedX[side].data();
+        fbm3_batch(shifted, octaves, neighbour.data(), sampleCount);
+        for (size_t i = 0; i < sampleCount; i++) dx[i] = side ? (neighbour[i] - dx[i]) * 0.5f : neighbour[i];
+        shifted = input;
+        shifted.z = shiftedZ[side].data();
+        fbm3_batch(shifted, octaves, neighbour.data(), sampleCount);
+        for (size_t i = 0; i < sampleCount; i++) dz[i] = side ? (neighbour[i] - dz[i]) * 0.5f : neighbour[i];
+    }
+    double differenceSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "  fBm height only: " << sampleCount / plainSeconds * 1e-6 << " Msamples/s" << std::endl;
+    std::cout << "  fBm height + analytic slope: " << sampleCount / analyticSeconds * 1e-6 << " Msamples/s ("
+        << analyticSeconds / plainSeconds << "x the height alone)" << std::endl;
+    std::cout << "  fBm height + central differences: " << sampleCount / differenceSeconds * 1e-6 << " Msamples/s ("
+        << differenceSeconds / analyticSeconds << "x slower than analytic)" << std::endl;
+}
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef PROGRESSIVE_TERRAIN_H
+#define PROGRESSIVE_TERRAIN_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include "terrain_pipeline.h"
+
+// Coarse-to-fine terrain generation for interactive edits. Every request is generated at 1/8,
+// 1/4, 1/2 and full resolution on a background thread; each level is a Heightfield over the same
+// world area with a wider grid spacing, so the renderer can swap in whatever finished last. A new
+// request cancels the levels still running for the old one within one band of rows.
+//
+// The full level goes through a TerrainPipeline that lives on the worker, so an edit that only
+// touches late stages (falloff, smoothing, erosion, hydrology, scattering) skips the previews and
+// reuses the cached noise. Hydrology and scattering only run on the full level.
+
+// generateHeightfield sampled at every `step`-th vertex: a ((width - 1) / step + 1)^2 grid with
+// spacing `step`. Heights follow the full-resolution falloff (an island mask is rasterised at the
+// level's resolution); smoothing runs only when step is 1, where the result is bit-identical to
+// generateHeightfield. Rows are generated in bands and cancelled() is checked between them;
+// returns false when it fired.
+bool generateHeightfieldLevel(const TerrainRequest& request, int step, Heightfield& out,
+    const std::function<bool()>& cancelled, ThreadPool& pool = globalThreadPool()) {
+    const int bandRows = 64;
+    int width = (request.width - 1) / step + 1;
+    int height = (request.height - 1) / step + 1;
+    out = Heightfield(width, height);
+    out.setSpacing((float)step);
+    std::vector<float>& heights = out.heightPlane();
+    std::vector<uint8_t>& biomes = out.biomePlane();
+    std::vector<float> coastDistance = islandDistanceField(request.island, request.width, request.height, step, pool);
+
+    for (int bandBegin = 0; bandBegin < height; bandBegin += bandRows) {
+        if (cancelled()) return false;
+        int rows = std::min(bandRows, height - bandBegin);
+        size_t offset = (size_t)bandBegin * width;
+        sampleTerrainBlock(out.worldX(0), out.worldZ(bandBegin), width, rows, request.scale, request.seed, request.octaves,
+            *request.biomeTable, false, heights.data() + offset, biomes.data() + offset, pool, (float)step);
+        for (int z = bandBegin; z < bandBegin + rows; z++)
+            for (int x = 0; x < width; x++)
+                heights[(size_t)z * width + x] *= coastDistance.empty()
+                    ? calculateFalloff(x * step, z * step, request.width, request.height, request.falloff.edgeHeight, request.falloff.border)
+                    : islandFalloff(coastDistance[(size_t)z * width + x], request.falloff);
+    }
+    if (step == 1) {
+        if (cancelled()) return false;
+        smoothHeightPlane(heights, width, height, request.smoothing, pool);
+    }
+    return true;
+}
+
+class ProgressiveTerrainGenerator
+{
+public:
+    static const int LEVEL_COUNT = 4;
+
+    ProgressiveTerrainGenerator()
+    {
+        worker = std::thread([this] { workerLoop(); });
+    }
+
+    ~ProgressiveTerrainGenerator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        worker.join();
+    }
+
+    ProgressiveTerrainGenerator(const ProgressiveTerrainGenerator&) = delete;
+    ProgressiveTerrainGenerator& operator=(const ProgressiveTerrainGenerator&) = delete;
+
+    // Starts over with new parameters; anything still running for older requests is abandoned
+    void request(const TerrainRequest& terrainRequest)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = terrainRequest;
+            hasPending = true;
+            generation++;
+            ready = false;
+        }
+        condition.notify_all();
+    }
+
+    // Abandons the current request without starting another
+    void cancel()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hasPending = false;
+        generation++;
+        ready = false;
+    }
+
+    // On the render thread: takes the level finished since the last call, if any; levels only
+    // ever get finer until the next request. step is 8, 4, 2 or 1. hydrologyTexels and scatter
+    // get the HydrologyMaps texels and the instances of the full level; they are left empty for
+    // previews or with those stages off.
+    bool poll(Heightfield& heightfield, int& step, std::vector<uint32_t>& hydrologyTexels, ScatterInstances& scatter)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ready) return false;
+        heightfield = std::move(completed);
+        hydrologyTexels = std::move(completedHydrology);
+        scatter = std::move(completedScatter);
+        step = completedStep;
+        ready = false;
+        return true;
+    }
+
+    // False once the full-resolution level of the latest request has been produced
+    bool refining() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hasPending || running;
+    }
+
+    // Seconds the level took when it last finished, coarsest first
+    double levelSeconds(int level) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return levelTimes[level];
+    }
+
+    // The full-resolution pipeline's counters as of its last run
+    TerrainStageStats stageStats(TerrainStage stage) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stageStatistics[stage];
+    }
+
+    size_t pipelineBytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pipelineMemory;
+    }
+
+    HydrologyStats hydrologyStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hydrologyStatistics;
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;) {
+            TerrainRequest job;
+            uint64_t jobGeneration;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || hasPending; });
+                if (stopping) return;
+                job = pending;
+                jobGeneration = generation;
+                hasPending = false;
+                running = true;
+            }
+
+            auto cancelled = [&] {
+                std::lock_guard<std::mutex> lock(mutex);
+                return stopping || generation != jobGeneration;
+            };
+            // Previews are only worth it when the noise has to be sampled again
+            int firstLevel = pipeline.isCached(job, STAGE_FBM) ? LEVEL_COUNT - 1 : 0;
+            for (int level = firstLevel; level < LEVEL_COUNT; level++) {
+                int step = 1 << (LEVEL_COUNT - 1 - level);
+                auto start = std::chrono::high_resolution_clock::now();
+                Heightfield result;
+                std::vector<uint32_t> hydrology;
+                ScatterInstances scatter;
+                if (step == 1) {
+                    bool finished = pipeline.run(job, cancelled);
+                    publishPipelineStats();
+                    if (!finished) break;
+                    result = pipeline.heightfield();
+                    hydrology = pipeline.hydrology().texels;
+                    scatter = pipeline.scatter();
+                }
+                else if (!generateHeightfieldLevel(job, step, result, cancelled)) {
+                    break;
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping || generation != jobGeneration) break;
+                levelTimes[level] = seconds;
+                completed = std::move(result);
+                completedHydrology = std::move(hydrology);
+                completedScatter = std::move(scatter);
+                completedStep = step;
+                ready = true;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+    }
+
+    void publishPipelineStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int stage = 0; stage < TERRAIN_STAGE_COUNT; stage++)
+            stageStatistics[stage] = pipeline.stats((TerrainStage)stage);
+        pipelineMemory = pipeline.memoryBytes();
+        hydrologyStatistics = pipeline.hydrology().stats;
+    }
+
+    TerrainPipeline pipeline;   // Worker thread only
+
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    TerrainRequest pending;
+    bool hasPending = false;
+    bool running = false;
+    uint64_t generation = 0;
+    Heightfield completed;
+    std::vector<uint32_t> completedHydrology;
+    ScatterInstances completedScatter;
+    int completedStep = 0;
+    bool ready = false;
+    bool stopping = false;
+    double levelTimes[LEVEL_COUNT] = {};
+    TerrainStageStats stageStatistics[TERRAIN_STAGE_COUNT];
+    size_t pipelineMemory = 0;
+    HydrologyStats hydrologyStatistics;
+    std::thread worker;
+};
+
+#endif
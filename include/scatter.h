@@ -0,0 +1,355 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include "thread_pool.h"
+#include "biome_table.h"
+#include "erosion.h"
+
+// Poisson-disk scattering of trees, bushes and rocks over a row-major height plane, for the
+// instanced renderer in vegetation_renderer.h.
+//
+// Every kind is its own blue-noise point set with a minimum distance between points, generated
+// with Bridson's dart throwing in square chunks. Chunks run in four phases by the parity of
+// their coordinates, the same colouring erosion.h uses: chunks of one phase never touch, so they
+// run in parallel, and each only has to keep its distance from the points of neighbours that
+// finished in an earlier phase. Every chunk draws from its own stream seeded by (seed, kind,
+// chunk), so the points depend on the seed only, never on the thread count.
+//
+// The full point set is then thinned by the density of the biome under each point (biomePlane(),
+// one BiomeType per vertex), the slope, the sea and, with hydrology on, rivers and lakes.
+// Dropping points from a Poisson-disk set keeps the minimum distance, so sparse biomes stay
+// blue noise rather than clumping.
+//
+// Chunks double as the renderer's culling cells. Their instances are packed to 8 bytes each and
+// stored back to back, chunk by chunk and kind by kind, so the whole set is one upload and every
+// (chunk, kind) pair is one instanced draw over a contiguous range.
+
+enum ScatterKind {
+    SCATTER_TREES,
+    SCATTER_BUSHES,
+    SCATTER_ROCKS,
+    SCATTER_KIND_COUNT
+};
+
+const char* scatterKindName(ScatterKind kind) {
+    static const char* names[] = { "Trees", "Bushes", "Rocks" };
+    return names[kind];
+}
+
+// minDistance, biomeDensity and maxSlope decide where instances go; the rest is read by the
+// renderer every frame and can change without scattering again
+struct ScatterLayer {
+    float minDistance;          // Between two instances of this kind, in vertices
+    float biomeDensity[4];      // Share of the Poisson-disk points kept, per BiomeType
+    float maxSlope;             // Rise over run; steeper ground stays bare
+    float minScale, maxScale;
+    float drawDistance;         // World units; the renderer fades instances out towards it
+};
+
+struct ScatterSettings {
+    bool enabled = false;
+    uint32_t seed = 1;
+    int chunkSize = 128;        // Vertices per side of a sampling and culling chunk
+    float seaLevel = -10.0f;    // Set from the scene; nothing grows below it
+    float shoreMargin = 1.0f;   // Nor this close above it
+    ScatterLayer layers[SCATTER_KIND_COUNT];
+
+    ScatterSettings()
+    {
+        //                          distance  plains hills mountains desert  slope  scale        draw distance
+        layers[SCATTER_TREES] =  { 5.0f, { 0.35f, 0.8f, 0.2f, 0.1f }, 0.8f, 0.7f, 1.3f, 700.0f };
+        layers[SCATTER_BUSHES] = { 2.5f, { 0.5f, 0.4f, 0.2f, 0.15f }, 1.0f, 0.6f, 1.4f, 300.0f };
+        layers[SCATTER_ROCKS] =  { 4.0f, { 0.05f, 0.15f, 0.4f, 0.5f }, 3.0f, 0.5f, 2.0f, 400.0f };
+    }
+};
+
+// 8 bytes. Position is relative to the chunk corner, so it needs no more than 16 bits per axis
+// whatever the terrain size; the height is not stored at all, the renderer samples it from the
+// height texture.
+struct ScatterInstance {
+    uint16_t x, z;              // 0-65535 across the chunk
+    uint8_t rotation;           // 0-255 for a full turn about the vertical
+    uint8_t scale;              // 0-255 between the layer's minScale and maxScale
+    uint8_t tint;               // Colour variation
+    uint8_t biome;              // BiomeType under the instance
+};
+
+struct ScatterChunk {
+    int x0, z0;                 // Corner vertex
+    float minHeight, maxHeight; // Terrain under the chunk, for culling
+    uint32_t first[SCATTER_KIND_COUNT];     // Into ScatterInstances::instances
+    uint32_t count[SCATTER_KIND_COUNT];
+};
+
+struct ScatterStats {
+    double sampleMilliseconds = 0.0;    // Poisson-disk sets
+    double packMilliseconds = 0.0;      // Thinning and packing
+    uint64_t candidates = 0;            // Darts thrown
+    uint64_t samples = 0;               // Poisson-disk points before thinning
+    uint64_t instances[SCATTER_KIND_COUNT] = {};
+};
+
+struct ScatterInstances {
+    int chunkSize = 0;          // Vertices
+    int chunksX = 0, chunksZ = 0;
+    std::vector<ScatterChunk> chunks;       // Row-major
+    std::vector<ScatterInstance> instances;
+    ScatterStats stats;
+
+    bool empty() const { return instances.empty(); }
+    size_t memoryBytes() const
+    {
+        return chunks.capacity() * sizeof(ScatterChunk) + instances.capacity() * sizeof(ScatterInstance);
+    }
+};
+
+namespace scatter_detail {
+
+    struct Point {
+        float x, z;
+    };
+
+    // Bridson's algorithm over [x0, x1) x [z0, z1), keeping `radius` from every point already
+    // in `neighbours` (points of adjacent chunks). Appends to `out`; returns the darts thrown.
+    inline uint64_t sampleChunk(float x0, float z0, float x1, float z1, float radius,
+        const std::vector<const std::vector<Point>*>& neighbours, ErosionRandom& random, std::vector<Point>& out)
+    {
+        const int attempts = 16;
+        const float distance = radius * 1.001f;
+        Point ring[attempts];
+        for (int attempt = 0; attempt < attempts; attempt++)
+            ring[attempt] = { std::cos(6.28318531f * attempt / attempts), std::sin(6.28318531f * attempt / attempts) };
+        // Cells of radius / sqrt(2) hold at most one point each; a conflict is within 2 cells
+        const float cell = radius / std::sqrt(2.0f), inverseCell = 1.0f / cell;
+        const float gridX0 = x0 - radius - cell, gridZ0 = z0 - radius - cell;
+        const int columns = (int)std::ceil((x1 - x0 + 2.0f * radius) * inverseCell) + 3;
+        const int rows = (int)std::ceil((z1 - z0 + 2.0f * radius) * inverseCell) + 3;
+        // The grid holds the points themselves; empty cells are far away rather than flagged
+        const Point empty = { 1e30f, 1e30f };
+        std::vector<Point> grid((size_t)columns * rows, empty);
+        std::vector<Point> points;
+
+        auto cellIndex = [&](const Point& p) {
+            return (size_t)((p.z - gridZ0) * inverseCell) * columns + (size_t)((p.x - gridX0) * inverseCell);
+        };
+        auto insert = [&](const Point& p) {
+            grid[cellIndex(p)] = p;
+            points.push_back(p);
+        };
+        // The outer ring of cells starts at least 2 cells from p, so only the 5x5 block less its
+        // corners can hold a conflict. The border padding keeps the block inside the grid.
+        auto fits = [&](const Point& p) {
+            if (p.x < x0 || p.z < z0 || p.x >= x1 || p.z >= z1) return false;
+            const Point* centre = &grid[cellIndex(p)];
+            float nearest = 1e30f;
+            for (int dz = -2; dz <= 2; dz++) {
+                const Point* row = centre + dz * columns;
+                int reach = (dz == -2 || dz == 2) ? 1 : 2;
+                for (int dx = -reach; dx <= reach; dx++) {
+                    float ox = row[dx].x - p.x, oz = row[dx].z - p.z;
+                    nearest = std::min(nearest, ox * ox + oz * oz);
+                }
+            }
+            return nearest >= radius * radius;
+        };
+
+        for (const std::vector<Point>* chunk : neighbours)
+            for (const Point& p : *chunk)
+                if (p.x >= x0 - radius && p.z >= z0 - radius && p.x < x1 + radius && p.z < z1 + radius) insert(p);
+        size_t ownBegin = points.size();
+
+        uint64_t darts = 0;
+        std::vector<int> active;
+        // A few random seeds; the neighbours' points can leave pockets a single seed won't reach
+        for (int seedDart = 0; seedDart < 8; seedDart++) {
+            Point p = { x0 + random.nextFloat() * (x1 - x0), z0 + random.nextFloat() * (z1 - z0) };
+            darts++;
+            if (!fits(p)) continue;
+            active.push_back((int)points.size());
+            insert(p);
+        }
+        while (!active.empty()) {
+            size_t slot = (size_t)(random.next() % active.size());
+            Point centre = points[active[slot]];
+            // Candidates just outside the radius, evenly spaced around it from a random start
+            float angle = random.nextFloat() * 6.28318531f;
+            float cosStart = std::cos(angle) * distance, sinStart = std::sin(angle) * distance;
+            bool placed = false;
+            for (int attempt = 0; attempt < attempts; attempt++) {
+                Point p = { centre.x + cosStart * ring[attempt].x - sinStart * ring[attempt].z,
+                    centre.z + sinStart * ring[attempt].x + cosStart * ring[attempt].z };
+                darts++;
+                if (!fits(p)) continue;
+                active.push_back((int)points.size());
+                insert(p);
+                placed = true;
+                break;
+            }
+            if (!placed) {
+                active[slot] = active.back();
+                active.pop_back();
+            }
+        }
+        out.insert(out.end(), points.begin() + ownBegin, points.end());
+        return darts;
+    }
+
+    // Bilinear height and the gradient's magnitude at (x, z), clamped to the plane
+    inline void heightAndSlope(const std::vector<float>& heights, int width, int height, float x, float z,
+        float& outHeight, float& outSlope)
+    {
+        int cellX = std::min((int)x, width - 2), cellZ = std::min((int)z, height - 2);
+        float u = x - cellX, v = z - cellZ;
+        const float* p = &heights[(size_t)cellZ * width + cellX];
+        float nw = p[0], ne = p[1], sw = p[width], se = p[width + 1];
+        float gradientX = (ne - nw) * (1.0f - v) + (se - sw) * v;
+        float gradientZ = (sw - nw) * (1.0f - u) + (se - ne) * u;
+        outHeight = nw * (1.0f - u) * (1.0f - v) + ne * u * (1.0f - v) + sw * (1.0f - u) * v + se * u * v;
+        outSlope = std::sqrt(gradientX * gradientX + gradientZ * gradientZ);
+    }
+}
+
+// Scatters every layer over the plane. hydrologyTexels (HydrologyMaps::texels) may be empty;
+// otherwise nothing is placed on its rivers and lakes.
+void scatterInstances(const std::vector<float>& heights, const std::vector<uint8_t>& biomes,
+    const std::vector<uint32_t>& hydrologyTexels, int width, int height, const ScatterSettings& settings,
+    ScatterInstances& result, ThreadPool& pool = globalThreadPool()) {
+    using namespace scatter_detail;
+    typedef std::chrono::high_resolution_clock Clock;
+    auto milliseconds = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    result = ScatterInstances();
+    if (width < 2 || height < 2) return;
+    // Only direct neighbours can conflict when a chunk is at least one radius wide
+    float largestRadius = 0.0f;
+    for (const ScatterLayer& layer : settings.layers) largestRadius = std::max(largestRadius, layer.minDistance);
+    int chunkSize = std::max(settings.chunkSize, (int)std::ceil(largestRadius) + 1);
+    int chunksX = (width - 2) / chunkSize + 1, chunksZ = (height - 2) / chunkSize + 1;
+    result.chunkSize = chunkSize;
+    result.chunksX = chunksX;
+    result.chunksZ = chunksZ;
+    ScatterStats& stats = result.stats;
+
+    // Full Poisson-disk sets, per kind and chunk
+    auto start = Clock::now();
+    size_t chunkCount = (size_t)chunksX * chunksZ;
+    std::vector<std::vector<Point>> samples(chunkCount * SCATTER_KIND_COUNT);
+    std::vector<uint64_t> chunkDarts(chunkCount, 0);
+    for (int phase = 0; phase < 4; phase++) {
+        int phaseX = phase & 1, phaseZ = phase >> 1;
+        int columns = (chunksX - phaseX + 1) / 2;
+        int rows = (chunksZ - phaseZ + 1) / 2;
+        if (columns <= 0 || rows <= 0) continue;
+        pool.parallelFor(columns * rows, 1, [&](int begin, int end) {
+            std::vector<const std::vector<Point>*> neighbours;
+            for (int task = begin; task < end; task++) {
+                int chunkX = (task % columns) * 2 + phaseX;
+                int chunkZ = (task / columns) * 2 + phaseZ;
+                size_t chunk = (size_t)chunkZ * chunksX + chunkX;
+                float x0 = (float)(chunkX * chunkSize), z0 = (float)(chunkZ * chunkSize);
+                // The last vertex belongs to the last chunk
+                float x1 = std::min(x0 + chunkSize, (float)(width - 1) + 1e-3f);
+                float z1 = std::min(z0 + chunkSize, (float)(height - 1) + 1e-3f);
+                for (int kind = 0; kind < SCATTER_KIND_COUNT; kind++) {
+                    const ScatterLayer& layer = settings.layers[kind];
+                    if (layer.minDistance <= 0.0f) continue;
+                    neighbours.clear();
+                    for (int dz = -1; dz <= 1; dz++)
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int nx = chunkX + dx, nz = chunkZ + dz;
+                            if ((dx || dz) && nx >= 0 && nz >= 0 && nx < chunksX && nz < chunksZ)
+                                neighbours.push_back(&samples[((size_t)nz * chunksX + nx) * SCATTER_KIND_COUNT + kind]);
+                        }
+                    ErosionRandom random(((uint64_t)settings.seed << 32) ^ (chunk * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)kind << 24));
+                    chunkDarts[chunk] += sampleChunk(x0, z0, x1, z1, layer.minDistance, neighbours, random,
+                        samples[chunk * SCATTER_KIND_COUNT + kind]);
+                }
+            }
+        });
+    }
+    for (uint64_t darts : chunkDarts) stats.candidates += darts;
+    for (const std::vector<Point>& points : samples) stats.samples += points.size();
+    stats.sampleMilliseconds = milliseconds(start);
+
+    // Thin in place, then pack every chunk into its slice of one array
+    start = Clock::now();
+    result.chunks.resize(chunkCount);
+    pool.parallelFor((int)chunkCount, 1, [&](int begin, int end) {
+        for (int chunk = begin; chunk < end; chunk++) {
+            ScatterChunk& out = result.chunks[chunk];
+            out.x0 = (chunk % chunksX) * chunkSize;
+            out.z0 = (chunk / chunksX) * chunkSize;
+            out.minHeight = 1e30f;
+            out.maxHeight = -1e30f;
+            for (int z = out.z0; z <= std::min(out.z0 + chunkSize, height - 1); z++)
+                for (int x = out.x0; x <= std::min(out.x0 + chunkSize, width - 1); x++) {
+                    out.minHeight = std::min(out.minHeight, heights[(size_t)z * width + x]);
+                    out.maxHeight = std::max(out.maxHeight, heights[(size_t)z * width + x]);
+                }
+
+            for (int kind = 0; kind < SCATTER_KIND_COUNT; kind++) {
+                const ScatterLayer& layer = settings.layers[kind];
+                std::vector<Point>& points = samples[(size_t)chunk * SCATTER_KIND_COUNT + kind];
+                ErosionRandom random(((uint64_t)settings.seed << 32) ^ ((uint64_t)chunk * 0xd1b54a32d192ed03ull) ^ ((uint64_t)kind << 24) ^ 1);
+                size_t kept = 0;
+                for (const Point& p : points) {
+                    int vertexX = std::min((int)(p.x + 0.5f), width - 1), vertexZ = std::min((int)(p.z + 0.5f), height - 1);
+                    size_t vertex = (size_t)vertexZ * width + vertexX;
+                    uint8_t biome = biomes[vertex];
+                    float keep = layer.biomeDensity[std::min<int>(biome, 3)];
+                    if (random.nextFloat() >= keep) continue;
+                    float pointHeight, slope;
+                    heightAndSlope(heights, width, height, p.x, p.z, pointHeight, slope);
+                    if (pointHeight < settings.seaLevel + settings.shoreMargin || slope > layer.maxSlope) continue;
+                    if (!hydrologyTexels.empty() && (hydrologyTexels[vertex] & 0x00ffff00u)) continue;
+                    points[kept++] = p;
+                }
+                points.resize(kept);
+            }
+        }
+    });
+
+    uint32_t total = 0;
+    for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        for (int kind = 0; kind < SCATTER_KIND_COUNT; kind++) {
+            uint32_t count = (uint32_t)samples[chunk * SCATTER_KIND_COUNT + kind].size();
+            result.chunks[chunk].first[kind] = total;
+            result.chunks[chunk].count[kind] = count;
+            stats.instances[kind] += count;
+            total += count;
+        }
+    result.instances.resize(total);
+    pool.parallelFor((int)chunkCount, 4, [&](int begin, int end) {
+        for (int chunk = begin; chunk < end; chunk++) {
+            const ScatterChunk& bounds = result.chunks[chunk];
+            float toUnit = 65535.0f / chunkSize;
+            for (int kind = 0; kind < SCATTER_KIND_COUNT; kind++) {
+                std::vector<Point>& points = samples[(size_t)chunk * SCATTER_KIND_COUNT + kind];
+                ScatterInstance* out = &result.instances[bounds.first[kind]];
+                ErosionRandom random(((uint64_t)settings.seed << 32) ^ ((uint64_t)chunk * 0x94d049bb133111ebull) ^ ((uint64_t)kind << 24) ^ 2);
+                for (const Point& p : points) {
+                    uint64_t bits = random.next();
+                    int vertexX = std::min((int)(p.x + 0.5f), width - 1), vertexZ = std::min((int)(p.z + 0.5f), height - 1);
+                    out->x = (uint16_t)std::min(65535.0f, (p.x - bounds.x0) * toUnit + 0.5f);
+                    out->z = (uint16_t)std::min(65535.0f, (p.z - bounds.z0) * toUnit + 0.5f);
+                    out->rotation = (uint8_t)bits;
+                    out->scale = (uint8_t)(bits >> 8);
+                    out->tint = (uint8_t)(bits >> 16);
+                    out->biome = biomes[(size_t)vertexZ * width + vertexX];
+                    out++;
+                }
+                std::vector<Point>().swap(points);
+            }
+        }
+    });
+    stats.packMilliseconds = milliseconds(start);
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef SEA_TRIM_H
+#define SEA_TRIM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "heightfield.h"
+#include "sea_waves.h"
+
+// Sea-level-aware trimming of the terrain and sea meshes. The sea is opaque and only moves
+// vertically, between seaLevel + seaWaveMinHeight and seaLevel + seaWaveMaxHeight (plus what the
+// ripples add), so while the camera is above the highest wave:
+//  - terrain inside the sea plane that never rises above the lowest trough cannot be seen;
+//  - sea over terrain that stays above the highest crest cannot be seen either.
+// The CDLOD quadtree already has the height range of every node. The vertex buffer terrain and
+// the sea plane order their indices tile by tile with per-tile bounds, and draw whichever tiles
+// survive with one glMultiDrawElements. Tiles are classified again only when the terrain, the
+// sea level or the wave amplitude change.
+
+struct SeaTrimSettings {
+    bool enabled = true;
+    float rippleMargin = 2.0f;      // Added to both wave bounds while ripples are on; they have no hard bound
+};
+
+// Where the sea surface can be: the rest plane's xz rectangle and the height range of the waves
+struct SeaBand {
+    bool enabled = false;
+    glm::vec2 areaMin = glm::vec2(0.0f), areaMax = glm::vec2(0.0f);
+    float low = 0.0f, high = 0.0f;
+
+    static SeaBand fromWaves(const glm::vec2& areaMin, const glm::vec2& areaMax, float seaLevel, const SeaWaveParams& params,
+        float margin)
+    {
+        SeaBand band;
+        band.enabled = true;
+        band.areaMin = areaMin;
+        band.areaMax = areaMax;
+        band.low = seaLevel + seaWaveMinHeight(params) - margin;
+        band.high = seaLevel + seaWaveMaxHeight(params) + margin;
+        return band;
+    }
+
+    // True when terrain inside this box is always under the water, seen from cameraHeight
+    bool hides(const glm::vec3& boxMin, const glm::vec3& boxMax, float cameraHeight) const
+    {
+        return enabled && cameraHeight > high && boxMax.y < low && boxMin.x >= areaMin.x && boxMax.x <= areaMax.x
+            && boxMin.z >= areaMin.y && boxMax.z <= areaMax.y;
+    }
+
+    bool operator==(const SeaBand& other) const
+    {
+        return enabled == other.enabled && areaMin == other.areaMin && areaMax == other.areaMax && low == other.low
+            && high == other.high;
+    }
+    bool operator!=(const SeaBand& other) const { return !(*this == other); }
+};
+
+// Row-major grid indices, six per quad as Heightfield::meshIndices and the sea plane emit them,
+// regrouped so each tileSize x tileSize block of quads is one contiguous range. select() keeps
+// any subset of tiles; neighbouring kept tiles merge into one range of the multi-draw.
+class TiledIndexRanges
+{
+public:
+    // Reorders indices in place
+    void build(std::vector<unsigned int>& indices, int cellsX, int cellsZ, int tileSize)
+    {
+        tile = tileSize;
+        tilesX = (cellsX + tileSize - 1) / tileSize;
+        tilesZ = (cellsZ + tileSize - 1) / tileSize;
+        std::vector<unsigned int> tiled(indices.size());
+        first.assign((size_t)tilesX * tilesZ + 1, 0);
+        size_t out = 0;
+        for (int tz = 0; tz < tilesZ; tz++)
+            for (int tx = 0; tx < tilesX; tx++) {
+                first[(size_t)tz * tilesX + tx] = out;
+                int x0 = tx * tileSize, x1 = std::min(x0 + tileSize, cellsX);
+                for (int z = tz * tileSize; z < std::min((tz + 1) * tileSize, cellsZ); z++) {
+                    const unsigned int* row = &indices[((size_t)z * cellsX + x0) * 6];
+                    std::copy(row, row + (size_t)(x1 - x0) * 6, &tiled[out]);
+                    out += (size_t)(x1 - x0) * 6;
+                }
+            }
+        first.back() = out;
+        indices.swap(tiled);
+        select([](int) { return true; });
+    }
+
+    int tileCount() const { return tilesX * tilesZ; }
+    int tileCountX() const { return tilesX; }
+    int tileSize() const { return tile; }
+
+    // Keeps the tiles for which keep(tile) is true
+    template<typename KeepFunction>
+    void select(const KeepFunction& keep)
+    {
+        counts.clear();
+        offsets.clear();
+        drawn = 0;
+        size_t rangeEnd = 0;
+        for (int t = 0; t < tileCount(); t++) {
+            if (!keep(t)) continue;
+            size_t begin = first[t], end = first[t + 1];
+            if (!counts.empty() && rangeEnd == begin) counts.back() += (GLsizei)(end - begin);
+            else {
+                counts.push_back((GLsizei)(end - begin));
+                offsets.push_back((const void*)(begin * sizeof(unsigned int)));
+            }
+            rangeEnd = end;
+            drawn += (int)((end - begin) / 3);
+        }
+    }
+
+    // With the VAO holding the reordered element buffer bound
+    void draw() const
+    {
+        if (!counts.empty())
+            glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)counts.size());
+    }
+
+    int triangleCount() const { return first.empty() ? 0 : (int)(first.back() / 3); }
+    int drawnTriangles() const { return drawn; }
+    int rangeCount() const { return (int)counts.size(); }
+
+private:
+    int tile = 1, tilesX = 0, tilesZ = 0;
+    std::vector<size_t> first;      // Index offset of each tile, plus the total at the end
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    int drawn = 0;
+};
+
+// The sea plane's element buffer in tiles, leaving out the tiles that are under land everywhere.
+// Classified against the full-resolution heights: where a coarse LOD node sags below the crest
+// the land now shows instead of sea poking through it.
+class SeaPlaneTiles
+{
+public:
+    static const int TILE_SIZE = 16;
+
+    // Regroups the plane's indices and rewrites the element buffer bound to planeVAO (every VAO
+    // sharing that buffer draws the new order). origin is the world xz of vertex 0.
+    void build(GLuint planeVAO, std::vector<GLuint>& indices, int cellsX, int cellsZ, const glm::vec2& planeOrigin, float cellSize)
+    {
+        ranges.build(indices, cellsX, cellsZ, TILE_SIZE);
+        columns = cellsX;
+        rows = cellsZ;
+        origin = planeOrigin;
+        spacing = cellSize;
+        hiddenTiles = 0;
+        classified = false;
+
+        glBindVertexArray(planeVAO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
+        glBindVertexArray(0);
+    }
+
+    // Hides the tiles where the terrain is above band.high at every point; with no terrain or the
+    // band disabled every tile is drawn. Does nothing unless the terrain revision or band changed.
+    void classify(const Heightfield* terrain, unsigned int terrainRevision, const SeaBand& band)
+    {
+        bool active = terrain && band.enabled && terrain->width() > 1 && terrain->height() > 1;
+        if (classified && active == wasActive && (!active || (terrainRevision == revision && band == lastBand))) return;
+        classified = true;
+        wasActive = active;
+        revision = terrainRevision;
+        lastBand = band;
+
+        std::vector<char> hidden(ranges.tileCount(), 0);
+        hiddenTiles = 0;
+        if (active)
+            for (int t = 0; t < ranges.tileCount(); t++) {
+                hidden[t] = underLand(*terrain, t, band.high);
+                hiddenTiles += hidden[t];
+            }
+        ranges.select([&](int t) { return !hidden[t]; });
+    }
+
+    void draw() const { ranges.draw(); }
+
+    int tileCount() const { return ranges.tileCount(); }
+    int hiddenTileCount() const { return hiddenTiles; }
+    int triangleCount() const { return ranges.triangleCount(); }
+    int drawnTriangles() const { return ranges.drawnTriangles(); }
+
+private:
+    // The terrain is bilinear between its vertices, so the lowest vertex around the tile bounds it
+    bool underLand(const Heightfield& terrain, int t, float crest) const
+    {
+        int tx = t % ranges.tileCountX(), tz = t / ranges.tileCountX();
+        float x0 = origin.x + tx * TILE_SIZE * spacing, x1 = origin.x + std::min((tx + 1) * TILE_SIZE, columns) * spacing;
+        float z0 = origin.y + tz * TILE_SIZE * spacing, z1 = origin.y + std::min((tz + 1) * TILE_SIZE, rows) * spacing;
+        float step = terrain.spacing();
+        int vx0 = (int)std::floor((x0 - terrain.worldX(0)) / step), vx1 = (int)std::ceil((x1 - terrain.worldX(0)) / step);
+        int vz0 = (int)std::floor((z0 - terrain.worldZ(0)) / step), vz1 = (int)std::ceil((z1 - terrain.worldZ(0)) / step);
+        if (vx0 < 0 || vz0 < 0 || vx1 > terrain.width() - 1 || vz1 > terrain.height() - 1) return false;
+        for (int z = vz0; z <= vz1; z++)
+            for (int x = vx0; x <= vx1; x++)
+                if (terrain.heightAt(x, z) <= crest) return false;
+        return true;
+    }
+
+    TiledIndexRanges ranges;
+    int columns = 0, rows = 0;
+    glm::vec2 origin = glm::vec2(0.0f);
+    float spacing = 1.0f;
+    int hiddenTiles = 0;
+
+    bool classified = false, wasActive = false;
+    unsigned int revision = 0;
+    SeaBand lastBand;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SEA_WAVES_H
+#define SEA_WAVES_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+// CPU mirror of the wave sum in seashadernogs.vs. Keep the two in sync: the transform
+// feedback validation compares them vertex by vertex.
+
+struct SeaWaveParams {
+    float frequency;
+    float amplitude;
+    float speed;
+};
+
+struct SeaWaveSample {
+    float height; // Displacement added to the rest height
+    float dHx;    // d(height)/dx
+    float dHz;    // d(height)/dz
+};
+
+// One term of the sum: amplitude * exp(sin(kx * x + kz * z + omega * t))
+struct SeaWaveTerm {
+    float amplitudeScale;
+    float kx, kz;
+    float omega;
+};
+
+// The seven terms used by the shader, with wave numbers resolved for the given parameters
+void getSeaWaveTerms(const SeaWaveParams& p, SeaWaveTerm terms[7]) {
+    terms[0] = { 1.0f, 0.3f, p.frequency + 0.1f, 1.0f }; // A1 ignores wave_speed in the shader
+    terms[1] = { 0.8f, p.frequency + 0.15f, 0.0f, p.speed };
+    terms[2] = { 0.9f, 0.0f, p.frequency + 0.2f, p.speed };
+    terms[3] = { 0.6f, p.frequency + 0.05f, 0.0f, p.speed };
+    terms[4] = { 0.7f, p.frequency + 0.08f, p.frequency + 0.08f, p.speed * 1.2f };
+    terms[5] = { 0.5f, p.frequency + 0.12f, -(p.frequency + 0.12f), p.speed * 0.8f };
+    terms[6] = { 0.4f, 0.5f * (p.frequency + 0.18f), 0.5f * (p.frequency + 0.18f), p.speed * 1.5f };
+}
+
+SeaWaveSample evaluateSeaWaves(float x, float z, float time, const SeaWaveParams& params) {
+    SeaWaveTerm terms[7];
+    getSeaWaveTerms(params, terms);
+
+    SeaWaveSample sample = { 0.0f, 0.0f, 0.0f };
+    for (const SeaWaveTerm& t : terms) {
+        float phase = t.kx * x + t.kz * z + t.omega * time;
+        float a = params.amplitude * t.amplitudeScale;
+        float e = std::exp(std::sin(phase));
+        float slope = a * e * std::cos(phase);
+        sample.height += a * e;
+        sample.dHx += slope * t.kx;
+        sample.dHz += slope * t.kz;
+    }
+    return sample;
+}
+
+glm::vec3 seaWaveNormal(const SeaWaveSample& sample) {
+    return glm::normalize(glm::vec3(-sample.dHx, 1.0f, -sample.dHz));
+}
+
+// Bounds of the displacement over all x, z, t (exp(sin) lies in [1/e, e])
+float seaWaveMaxHeight(const SeaWaveParams& params) {
+    return params.amplitude * 4.9f * 2.7182818f;
+}
+float seaWaveMinHeight(const SeaWaveParams& params) {
+    return params.amplitude * 4.9f / 2.7182818f;
+}
+// Average over x, z and t: the mean of exp(sin(a)) over a period is I0(1)
+float seaWaveMeanHeight(const SeaWaveParams& params) {
+    return params.amplitude * 4.9f * 1.2660659f;
+}
+
+struct SeaWaveError {
+    float maxPositionError = 0.0f;
+    float maxNormalError = 0.0f; // Largest component difference of the unit normals
+    size_t worstVertex = 0;
+};
+
+// Compare captured (position, normal) pairs against the CPU evaluator.
+// `restPositions` are the undisplaced vertices; both arrays are read with the given float strides.
+SeaWaveError compareSeaWaves(const float* captured, size_t capturedStride, const float* restPositions, size_t restStride,
+    size_t vertexCount, float time, const SeaWaveParams& params) {
+    SeaWaveError error;
+    for (size_t i = 0; i < vertexCount; i++) {
+        const float* rest = restPositions + i * restStride;
+        const float* gpu = captured + i * capturedStride;
+
+        SeaWaveSample sample = evaluateSeaWaves(rest[0], rest[2], time, params);
+        glm::vec3 position(rest[0], rest[1] + sample.height, rest[2]);
+        glm::vec3 normal = seaWaveNormal(sample);
+
+        glm::vec3 dp = glm::abs(position - glm::vec3(gpu[0], gpu[1], gpu[2]));
+        glm::vec3 dn = glm::abs(normal - glm::vec3(gpu[3], gpu[4], gpu[5]));
+        float positionError = std::max({ dp.x, dp.y, dp.z });
+        float normalError = std::max({ dn.x, dn.y, dn.z });
+
+        if (positionError > error.maxPositionError) {
+            error.maxPositionError = positionError;
+            error.worstVertex = i;
+        }
+        error.maxNormalError = std::max(error.maxNormalError, normalError);
+    }
+    return error;
+}
+
+#endif
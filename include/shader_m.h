@@ -8,14 +8,16 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
     unsigned int ID;
 
-    // Constructor now accepts an optional geometry shader path
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    // Constructor now accepts an optional geometry shader path and preprocessor defines
+    // (e.g. "#define WAVE_MATH_TIER 2\n") for building shader permutations
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "")
     {
         std::string vertexCode, fragmentCode, geometryCode;
         std::ifstream vShaderFile, fShaderFile, gShaderFile;
@@ -44,7 +46,10 @@ public:
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
                 geometryCode = gShaderStream.str();
+                geometryCode = injectDefines(resolveIncludes(geometryCode, geometryPath), defines);
             }
+            vertexCode = injectDefines(resolveIncludes(vertexCode, vertexPath), defines);
+            fragmentCode = injectDefines(resolveIncludes(fragmentCode, fragmentPath), defines);
         }
         catch (std::ifstream::failure& e)
         {
@@ -88,15 +93,137 @@ public:
             glDeleteShader(geometry);
     }
 
+    // Vertex-only program whose outputs are captured with transform feedback (interleaved)
+    Shader(const char* vertexPath, const std::vector<const char*>& feedbackVaryings, const std::string& defines = "")
+    {
+        std::string vertexCode;
+        std::ifstream vShaderFile;
+        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            vShaderFile.open(vertexPath);
+            std::stringstream vShaderStream;
+            vShaderStream << vShaderFile.rdbuf();
+            vShaderFile.close();
+            vertexCode = injectDefines(resolveIncludes(vShaderStream.str(), vertexPath), defines);
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        }
+
+        const char* vShaderCode = vertexCode.c_str();
+        unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+
+        ID = glCreateProgram();
+        glAttachShader(ID, vertex);
+        // Varyings must be declared before linking
+        glTransformFeedbackVaryings(ID, (GLsizei)feedbackVaryings.size(), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+
+        glDeleteShader(vertex);
+    }
+
+    // Single-stage program, for compute shaders (stage = GL_COMPUTE_SHADER). Check linked()
+    // where the stage may be unsupported.
+    Shader(GLenum stage, const char* path, const std::string& defines = "")
+    {
+        std::string code;
+        std::ifstream shaderFile;
+        shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            shaderFile.open(path);
+            std::stringstream shaderStream;
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
+            code = injectDefines(resolveIncludes(shaderStream.str(), path), defines);
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        }
+
+        const char* shaderCode = code.c_str();
+        unsigned int shader = glCreateShader(stage);
+        glShaderSource(shader, 1, &shaderCode, NULL);
+        glCompileShader(shader);
+        checkCompileErrors(shader, "COMPUTE");
+
+        ID = glCreateProgram();
+        glAttachShader(ID, shader);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+
+        glDeleteShader(shader);
+    }
+
+    bool linked() const
+    {
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+
     void use() const { glUseProgram(ID); }
 
     void setBool(const std::string& name, bool value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); }
     void setInt(const std::string& name, int value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), value); }
     void setFloat(const std::string& name, float value) const { glUniform1f(glGetUniformLocation(ID, name.c_str()), value); }
+    void setVec2(const std::string& name, const glm::vec2& value) const { glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
     void setVec3(const std::string& name, const glm::vec3& value) const { glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
     void setMat4(const std::string& name, const glm::mat4& mat) const { glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]); }
 
 private:
+    // Defines have to follow the #version line
+    static std::string injectDefines(const std::string& code, const std::string& defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
+
+    // Expand `#include "file"` lines (paths relative to the including shader) so the
+    // wave functions can be shared between programs
+    static std::string resolveIncludes(const std::string& code, const std::string& path)
+    {
+        std::string directory;
+        size_t slash = path.find_last_of("/\\");
+        if (slash != std::string::npos)
+            directory = path.substr(0, slash + 1);
+
+        std::stringstream input(code), output;
+        std::string line;
+        while (std::getline(input, line))
+        {
+            size_t open = line.find('"');
+            size_t close = line.rfind('"');
+            if (line.compare(0, 8, "#include") == 0 && open != std::string::npos && close > open)
+            {
+                std::string includePath = directory + line.substr(open + 1, close - open - 1);
+                std::ifstream includeFile;
+                includeFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+                includeFile.open(includePath);
+                std::stringstream includeStream;
+                includeStream << includeFile.rdbuf();
+                output << resolveIncludes(includeStream.str(), includePath) << "\n";
+            }
+            else
+            {
+                output << line << "\n";
+            }
+        }
+        return output.str();
+    }
+
     void checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
@@ -0,0 +1,263 @@
+#ifndef SHORE_MAP_H
+#define SHORE_MAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <shader_m.h>
+#include "heightfield.h"
+#include "island_mask.h"
+#include "thread_pool.h"
+
+// Coastal data for the sea shader, so foam and shallow-water tint need one texture fetch instead
+// of reconstructing scene depth per pixel. One RGBA16F texel per sea vertex:
+//   r  depth below the reference water level (negative on land); the shader turns it back into
+//      the terrain height and measures depth from the displaced surface
+//   g  distance to the nearest land in world units, capped at `range`
+//   ba unit direction towards that land (the negated gradient of g), 0 where g is capped
+// The map covers the sea plane; the distances see land up to `range` beyond it. Land is what
+// rises above the water level passed in, which main.cpp sets to the mean of the wave surface, so
+// the coast sits halfway up the swash rather than at the bottom of every trough.
+//
+// Depths are stored against the water level of the last full build, so a new level (sea level
+// or wave amplitude) only recomputes distances around texels whose land/sea state flipped. A terrain edit recomputes the edited rectangle plus `range` around it.
+// Both re-upload only that rectangle. Distances come from the exact transform in island_mask.h
+// over the rectangle grown by another `range`, which is all the land that can be within range
+// of it, so partial updates match a full build texel for texel.
+
+struct ShoreMapSettings {
+    bool enabled = true;
+    float range = 24.0f;            // World units; distances beyond are all the same open sea
+    float foamWidth = 3.0f;         // Surf band from the coast, world units
+    float shallowDepth = 6.0f;      // Depth over which the shallow colour fades into the sea colour
+    glm::vec3 shallowColor = glm::vec3(0.25f, 0.75f, 0.7f);
+};
+
+struct ShoreMapStats {
+    double milliseconds = 0.0;      // Last build or update
+    int texelsUpdated = 0;          // By the last build or update
+    int fullBuilds = 0;
+    int partialUpdates = 0;
+};
+
+class ShoreMap
+{
+public:
+    ShoreMap() {}
+    ~ShoreMap() { release(); }
+    ShoreMap(const ShoreMap&) = delete;
+    ShoreMap& operator=(const ShoreMap&) = delete;
+
+    bool ready() const { return texture != 0; }
+    size_t gpuBytes() const { return texture ? (size_t)w * h * 8 : 0; }
+    const ShoreMapStats& getStats() const { return stats; }
+    const std::vector<float>& texelData() const { return texels; }
+
+    // Samples the terrain over [areaMin, areaMax] every texelSize world units and computes and
+    // uploads every texel; needs the GL context current
+    void build(const Heightfield& terrain, float waterLevel, const glm::vec2& areaMin, const glm::vec2& areaMax, float texelSize,
+        float range, ThreadPool& pool = globalThreadPool())
+    {
+        if (terrain.width() < 2 || terrain.height() < 2) {
+            release();
+            return;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        origin = areaMin;
+        spacing = texelSize;
+        maxDistance = range;
+        w = (int)std::floor((areaMax.x - areaMin.x) / texelSize + 0.5f) + 1;
+        h = (int)std::floor((areaMax.y - areaMin.y) / texelSize + 0.5f) + 1;
+        apron = (int)std::ceil(range / texelSize) + 1;
+        paddedWidth = w + 2 * apron;
+        paddedHeight = h + 2 * apron;
+        referenceLevel = currentLevel = waterLevel;
+        heights.assign((size_t)paddedWidth * paddedHeight, 0.0f);
+        texels.assign((size_t)w * h * 4, 0.0f);
+        sampleHeights(terrain, 0, 0, paddedWidth - 1, paddedHeight - 1, pool);
+        recompute(0, 0, w - 1, h - 1, pool);
+
+        if (!texture) glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, texels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        stats.fullBuilds++;
+        stats.texelsUpdated = w * h;
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // After the terrain changed inside the world rectangle [worldMin, worldMax]
+    void updateTerrain(const Heightfield& terrain, const glm::vec2& worldMin, const glm::vec2& worldMax,
+        ThreadPool& pool = globalThreadPool())
+    {
+        if (!ready()) return;
+        auto start = std::chrono::high_resolution_clock::now();
+        // Texels read the terrain bilinearly, so they see one terrain cell past the edit
+        float reach = terrain.spacing();
+        int px0 = std::max(0, (int)std::floor((worldMin.x - reach - origin.x) / spacing) + apron);
+        int pz0 = std::max(0, (int)std::floor((worldMin.y - reach - origin.y) / spacing) + apron);
+        int px1 = std::min(paddedWidth - 1, (int)std::ceil((worldMax.x + reach - origin.x) / spacing) + apron);
+        int pz1 = std::min(paddedHeight - 1, (int)std::ceil((worldMax.y + reach - origin.y) / spacing) + apron);
+        if (px0 > px1 || pz0 > pz1) return;
+        sampleHeights(terrain, px0, pz0, px1, pz1, pool);
+        int texelCount = update(px0 - apron, pz0 - apron, px1 - apron, pz1 - apron, pool);
+        finishUpdate(start, texelCount);
+    }
+
+    // Recomputes distances only around texels that changed between land and sea
+    void updateWaterLevel(float waterLevel, ThreadPool& pool = globalThreadPool())
+    {
+        if (!ready() || waterLevel == currentLevel) return;
+        auto start = std::chrono::high_resolution_clock::now();
+        int x0 = paddedWidth, z0 = paddedHeight, x1 = -1, z1 = -1;
+        for (int z = 0; z < paddedHeight; z++)
+            for (int x = 0; x < paddedWidth; x++) {
+                float height = heights[(size_t)z * paddedWidth + x];
+                if ((height > currentLevel) != (height > waterLevel)) {
+                    x0 = std::min(x0, x);
+                    x1 = std::max(x1, x);
+                    z0 = std::min(z0, z);
+                    z1 = std::max(z1, z);
+                }
+            }
+        currentLevel = waterLevel;
+        int texelCount = x1 < 0 ? 0 : update(x0 - apron, z0 - apron, x1 - apron, z1 - apron, pool);
+        finishUpdate(start, texelCount);
+    }
+
+    // Binds to `unit`, or turns the coastal shading off when there is no map
+    void bind(const Shader& shader, int unit, const ShoreMapSettings& settings) const
+    {
+        shader.setBool("u_shoreEnabled", texture != 0 && settings.enabled);
+        if (!texture || !settings.enabled) return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("u_shoreMap", unit);
+        shader.setVec2("u_shoreOrigin", origin);
+        shader.setVec2("u_shoreSize", glm::vec2((float)w, (float)h));
+        shader.setFloat("u_shoreSpacing", spacing);
+        shader.setFloat("u_shoreReferenceLevel", referenceLevel);
+        shader.setFloat("u_foamWidth", settings.foamWidth);
+        shader.setFloat("u_shallowDepth", settings.shallowDepth);
+        shader.setVec3("u_shallowColor", settings.shallowColor);
+    }
+
+    void release()
+    {
+        if (texture) glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+private:
+    // Padded texels [x0, x1] x [z0, z1], bilinear and clamped to the terrain's edge
+    void sampleHeights(const Heightfield& terrain, int x0, int z0, int x1, int z1, ThreadPool& pool)
+    {
+        float step = terrain.spacing();
+        float maxX = (float)(terrain.width() - 1), maxZ = (float)(terrain.height() - 1);
+        pool.parallelFor(z1 - z0 + 1, 16, [&](int rowBegin, int rowEnd) {
+            for (int z = z0 + rowBegin; z < z0 + rowEnd; z++) {
+                float fz = glm::clamp((origin.y + (z - apron) * spacing - terrain.worldZ(0)) / step, 0.0f, maxZ);
+                int vz = std::min((int)fz, terrain.height() - 2);
+                float tz = fz - vz;
+                for (int x = x0; x <= x1; x++) {
+                    float fx = glm::clamp((origin.x + (x - apron) * spacing - terrain.worldX(0)) / step, 0.0f, maxX);
+                    int vx = std::min((int)fx, terrain.width() - 2);
+                    float tx = fx - vx;
+                    float top = glm::mix(terrain.heightAt(vx, vz), terrain.heightAt(vx + 1, vz), tx);
+                    float bottom = glm::mix(terrain.heightAt(vx, vz + 1), terrain.heightAt(vx + 1, vz + 1), tx);
+                    heights[(size_t)z * paddedWidth + x] = glm::mix(top, bottom, tz);
+                }
+            }
+        });
+    }
+
+    // Texels within range of the changed texels [x0, x1] x [z0, z1] (map coordinates, may lie in
+    // the apron), plus one for the gradient; returns how many were updated
+    int update(int x0, int z0, int x1, int z1, ThreadPool& pool)
+    {
+        x0 = std::max(0, x0 - apron);
+        z0 = std::max(0, z0 - apron);
+        x1 = std::min(w - 1, x1 + apron);
+        z1 = std::min(h - 1, z1 + apron);
+        if (x0 > x1 || z0 > z1) return 0;
+        recompute(x0, z0, x1, z1, pool);
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x0, z0, x1 - x0 + 1, z1 - z0 + 1, GL_RGBA, GL_FLOAT, &texels[((size_t)z0 * w + x0) * 4]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return (x1 - x0 + 1) * (z1 - z0 + 1);
+    }
+
+    // Texels [x0, x1] x [z0, z1] from the heights; the distance transform runs over the
+    // rectangle grown by the apron, clamped to the padded grid
+    void recompute(int x0, int z0, int x1, int z1, ThreadPool& pool)
+    {
+        using island_detail::EDT_INFINITY;
+        int wx0 = std::max(0, x0), wz0 = std::max(0, z0);
+        int wx1 = std::min(paddedWidth - 1, x1 + 2 * apron), wz1 = std::min(paddedHeight - 1, z1 + 2 * apron);
+        int windowWidth = wx1 - wx0 + 1, windowHeight = wz1 - wz0 + 1;
+        std::vector<float> distance((size_t)windowWidth * windowHeight);
+        pool.parallelFor(windowHeight, 32, [&](int zBegin, int zEnd) {
+            for (int z = zBegin; z < zEnd; z++)
+                for (int x = 0; x < windowWidth; x++)
+                    distance[(size_t)z * windowWidth + x] =
+                        heights[(size_t)(wz0 + z) * paddedWidth + wx0 + x] > currentLevel ? 0.0f : EDT_INFINITY;
+        });
+        island_detail::distanceTransform2D(distance, windowWidth, windowHeight, pool);
+        float cap = maxDistance;
+        for (float& d : distance) d = std::min(std::sqrt(d) * spacing, cap);
+
+        pool.parallelFor(z1 - z0 + 1, 16, [&](int rowBegin, int rowEnd) {
+            // Window coordinates of map texel (x, z) are (x + apron - wx0, z + apron - wz0)
+            auto at = [&](int x, int z) {
+                int wx = glm::clamp(x + apron - wx0, 0, windowWidth - 1), wz = glm::clamp(z + apron - wz0, 0, windowHeight - 1);
+                return distance[(size_t)wz * windowWidth + wx];
+            };
+            for (int z = z0 + rowBegin; z < z0 + rowEnd; z++)
+                for (int x = x0; x <= x1; x++) {
+                    glm::vec2 gradient(at(x + 1, z) - at(x - 1, z), at(x, z + 1) - at(x, z - 1));
+                    float length = glm::length(gradient);
+                    glm::vec2 direction = length > 1e-6f ? -gradient / length : glm::vec2(0.0f);
+                    float* texel = &texels[((size_t)z * w + x) * 4];
+                    texel[0] = referenceLevel - heights[(size_t)(z + apron) * paddedWidth + x + apron];
+                    texel[1] = at(x, z);
+                    texel[2] = direction.x;
+                    texel[3] = direction.y;
+                }
+        });
+    }
+
+    void finishUpdate(std::chrono::high_resolution_clock::time_point start, int texelCount)
+    {
+        stats.partialUpdates++;
+        stats.texelsUpdated = texelCount;
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    GLuint texture = 0;
+    int w = 0, h = 0;
+    glm::vec2 origin = glm::vec2(0.0f);     // World x/z of texel (0, 0)
+    float spacing = 1.0f;
+    float maxDistance = 0.0f;
+    int apron = 0;                          // Texels of terrain kept around the map
+    int paddedWidth = 0, paddedHeight = 0;
+    std::vector<float> heights;             // Padded grid
+    std::vector<float> texels;              // Map grid, 4 floats each
+    float referenceLevel = 0.0f;            // Water level the depths are stored for
+    float currentLevel = 0.0f;              // Water level the distances are for
+    ShoreMapStats stats;
+};
+
+#endif
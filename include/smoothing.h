@@ -0,0 +1,423 @@
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include "thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SMOOTHING_SSE2 1
+#endif
+
+// Smoothing for contiguous height planes (row-major, width * height floats).
+//
+//   SMOOTH_BOX_EXACT  the original 3x3 box from smoothHeights(), same summation order, so the
+//                     result is bit-identical; interior cells skip the bounds checks
+//   SMOOTH_BOX        separable box of `radius`. One pass uses running sums; N passes are
+//                     collapsed into one wider separable kernel (including the clipped borders)
+//   SMOOTH_GAUSSIAN   separable Gaussian, N passes collapse to sigma * sqrt(N)
+//   SMOOTH_BILATERAL  Gaussian weighted by height difference, keeps ridges and coastlines sharp
+//
+// Near the edges every kernel only uses the cells inside the plane and renormalises, like
+// the original box did.
+
+enum SmoothingKernel {
+    SMOOTH_BOX_EXACT,
+    SMOOTH_BOX,
+    SMOOTH_GAUSSIAN,
+    SMOOTH_BILATERAL
+};
+
+struct SmoothingSettings {
+    SmoothingKernel kernel = SMOOTH_BOX_EXACT;
+    int passes = 3;            // Defaults reproduce generateTerrain's three box passes
+    int radius = 1;            // SMOOTH_BOX
+    float sigma = 1.0f;        // SMOOTH_GAUSSIAN / SMOOTH_BILATERAL, in cells
+    float rangeSigma = 4.0f;   // SMOOTH_BILATERAL, in height units
+};
+
+const char* smoothingKernelName(SmoothingKernel kernel) {
+    static const char* names[] = { "Box (exact)", "Box", "Gaussian", "Bilateral" };
+    return names[kernel];
+}
+
+// Symmetric 1D kernel plus the renormalised weights of the `radius` cells next to an edge.
+// border[x * (2 * radius + 1) + radius + d] is the weight of x + d for output x < radius;
+// the far edge uses the mirrored table.
+struct SmoothingKernel1D {
+    int radius = 0;
+    std::vector<float> interior;
+    std::vector<float> border;
+};
+
+// N passes of the clipped box of radius r in one kernel of radius N * r. The border tables
+// come from running the clipped passes on unit impulses, so edges match the iterated filter.
+SmoothingKernel1D makeBoxKernel(int r, int passes) {
+    SmoothingKernel1D kernel;
+    int R = r * passes;
+    int taps = 2 * R + 1;
+    kernel.radius = R;
+
+    int lineLength = 4 * R + 1;
+    std::vector<double> line(lineLength), next(lineLength);
+    std::vector<double> response((size_t)lineLength * lineLength);
+    for (int j = 0; j < lineLength; j++) {
+        std::fill(line.begin(), line.end(), 0.0);
+        line[j] = 1.0;
+        for (int p = 0; p < passes; p++) {
+            for (int x = 0; x < lineLength; x++) {
+                int begin = std::max(0, x - r), end = std::min(lineLength - 1, x + r);
+                double sum = 0.0;
+                for (int i = begin; i <= end; i++) sum += line[i];
+                next[x] = sum / (end - begin + 1);
+            }
+            line.swap(next);
+        }
+        for (int x = 0; x < lineLength; x++)
+            response[(size_t)j * lineLength + x] = line[x];
+    }
+
+    kernel.interior.resize(taps);
+    for (int d = -R; d <= R; d++)
+        kernel.interior[d + R] = (float)response[(size_t)(2 * R + d) * lineLength + 2 * R];
+    kernel.border.assign((size_t)R * taps, 0.0f);
+    for (int x = 0; x < R; x++)
+        for (int d = -x; d <= R; d++)
+            kernel.border[(size_t)x * taps + d + R] = (float)response[(size_t)(x + d) * lineLength + x];
+    return kernel;
+}
+
+// Truncated at 3 sigma, or at maxRadius for planes too small for that
+SmoothingKernel1D makeGaussianKernel(float sigma, int maxRadius) {
+    SmoothingKernel1D kernel;
+    int R = std::max(1, std::min(maxRadius, (int)std::ceil(3.0f * sigma)));
+    int taps = 2 * R + 1;
+    kernel.radius = R;
+
+    std::vector<double> weights(taps);
+    for (int d = -R; d <= R; d++)
+        weights[d + R] = std::exp(-(double)d * d / (2.0 * sigma * sigma));
+
+    kernel.interior.resize(taps);
+    kernel.border.assign((size_t)R * taps, 0.0f);
+    for (int x = 0; x <= R; x++) {
+        double total = 0.0;
+        for (int d = -std::min(x, R); d <= R; d++) total += weights[d + R];
+        for (int d = -std::min(x, R); d <= R; d++) {
+            float w = (float)(weights[d + R] / total);
+            if (x == R) kernel.interior[d + R] = w;
+            else kernel.border[(size_t)x * taps + d + R] = w;
+        }
+    }
+    return kernel;
+}
+
+const int SMOOTHING_ROWS_PER_TASK = 16;
+const int SMOOTHING_TILE_WIDTH = 512; // Columns per tile in the vertical pass (2 KB per row)
+
+// out[i] = sum over k of weights[k] * rows[k][i], for i in [begin, end). Accumulates in
+// registers 8 outputs at a time instead of re-reading out for every tap.
+void weightedRowSum(const float* const* rows, const float* weights, int count, float* out, int begin, int end) {
+    int i = begin;
+#ifdef SMOOTHING_SSE2
+    for (; i + 8 <= end; i += 8) {
+        __m128 a = _mm_setzero_ps(), b = _mm_setzero_ps();
+        for (int k = 0; k < count; k++) {
+            __m128 w = _mm_set1_ps(weights[k]);
+            a = _mm_add_ps(a, _mm_mul_ps(w, _mm_loadu_ps(rows[k] + i)));
+            b = _mm_add_ps(b, _mm_mul_ps(w, _mm_loadu_ps(rows[k] + i + 4)));
+        }
+        _mm_storeu_ps(out + i, a);
+        _mm_storeu_ps(out + i + 4, b);
+    }
+#endif
+    for (; i < end; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < count; k++)
+            sum += weights[k] * rows[k][i];
+        out[i] = sum;
+    }
+}
+
+// Horizontal pass of a collapsed kernel; the line must be longer than 2 * radius
+void smoothRowsKernel(const float* in, float* out, int width, int height, const SmoothingKernel1D& kernel, ThreadPool& pool) {
+    int R = kernel.radius, taps = 2 * R + 1;
+    pool.parallelFor(height, SMOOTHING_ROWS_PER_TASK, [&](int zBegin, int zEnd) {
+        std::vector<const float*> rows(taps);
+        for (int z = zBegin; z < zEnd; z++) {
+            const float* src = in + (size_t)z * width;
+            float* dst = out + (size_t)z * width;
+            for (int x = 0; x < R; x++) {
+                const float* w = &kernel.border[(size_t)x * taps + R];
+                float left = 0.0f, right = 0.0f;
+                for (int d = -x; d <= R; d++) {
+                    left += w[d] * src[x + d];
+                    right += w[d] * src[width - 1 - x - d];
+                }
+                dst[x] = left;
+                dst[width - 1 - x] = right;
+            }
+            // Tap k of output x reads src[x - R + k]: shifted copies of the row
+            for (int k = 0; k < taps; k++)
+                rows[k] = src + k - R;
+            weightedRowSum(rows.data(), kernel.interior.data(), taps, dst, R, width - R);
+        }
+    });
+}
+
+// Vertical pass of a collapsed kernel, walking column tiles so the 2 * radius + 1 source
+// rows of a tile stay in cache while consecutive output rows reuse them
+void smoothColumnsKernel(const float* in, float* out, int width, int height, const SmoothingKernel1D& kernel, ThreadPool& pool) {
+    int R = kernel.radius, taps = 2 * R + 1;
+    pool.parallelFor(height, SMOOTHING_ROWS_PER_TASK, [&](int zBegin, int zEnd) {
+        std::vector<const float*> rows(taps);
+        std::vector<float> weights(taps);
+        for (int x0 = 0; x0 < width; x0 += SMOOTHING_TILE_WIDTH) {
+            int x1 = std::min(width, x0 + SMOOTHING_TILE_WIDTH);
+            for (int z = zBegin; z < zEnd; z++) {
+                // Rows outside the plane are skipped; the far edge uses the mirrored border table
+                int count = 0;
+                for (int d = -R; d <= R; d++) {
+                    if (z + d < 0 || z + d >= height)
+                        continue;
+                    float w;
+                    if (z < R) w = kernel.border[(size_t)z * taps + R + d];
+                    else if (z >= height - R) w = kernel.border[(size_t)(height - 1 - z) * taps + R - d];
+                    else w = kernel.interior[R + d];
+                    rows[count] = in + (size_t)(z + d) * width;
+                    weights[count++] = w;
+                }
+                weightedRowSum(rows.data(), weights.data(), count, out + (size_t)z * width, x0, x1);
+            }
+        }
+    });
+}
+
+// Clipped box of radius r with sliding sums (double, so long rows don't drift)
+void smoothRowsRunningBox(const float* in, float* out, int width, int height, int r, ThreadPool& pool) {
+    pool.parallelFor(height, SMOOTHING_ROWS_PER_TASK, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            const float* src = in + (size_t)z * width;
+            float* dst = out + (size_t)z * width;
+            double sum = 0.0;
+            for (int x = 0; x < std::min(r, width); x++) sum += src[x];
+            for (int x = 0; x < width; x++) {
+                if (x + r < width) sum += src[x + r];
+                if (x - r - 1 >= 0) sum -= src[x - r - 1];
+                int count = std::min(width - 1, x + r) - std::max(0, x - r) + 1;
+                dst[x] = (float)(sum / count);
+            }
+        }
+    });
+}
+
+void smoothColumnsRunningBox(const float* in, float* out, int width, int height, int r, ThreadPool& pool) {
+    // One running sum per column of the tile, advanced a row at a time
+    int tiles = (width + SMOOTHING_TILE_WIDTH - 1) / SMOOTHING_TILE_WIDTH;
+    pool.parallelFor(tiles, 1, [&](int tileBegin, int tileEnd) {
+        std::vector<double> sums(SMOOTHING_TILE_WIDTH);
+        for (int tile = tileBegin; tile < tileEnd; tile++) {
+            int x0 = tile * SMOOTHING_TILE_WIDTH, x1 = std::min(width, x0 + SMOOTHING_TILE_WIDTH);
+            std::fill(sums.begin(), sums.end(), 0.0);
+            for (int z = 0; z < std::min(r, height); z++)
+                for (int x = x0; x < x1; x++) sums[x - x0] += in[(size_t)z * width + x];
+
+            for (int z = 0; z < height; z++) {
+                const float* add = z + r < height ? in + (size_t)(z + r) * width : nullptr;
+                const float* remove = z - r - 1 >= 0 ? in + (size_t)(z - r - 1) * width : nullptr;
+                double count = std::min(height - 1, z + r) - std::max(0, z - r) + 1;
+                float* dst = out + (size_t)z * width;
+                for (int x = x0; x < x1; x++) {
+                    double& sum = sums[x - x0];
+                    if (add) sum += add[x];
+                    if (remove) sum -= remove[x];
+                    dst[x] = (float)(sum / count);
+                }
+            }
+        }
+    });
+}
+
+// smoothHeights() on a plane: identical arithmetic, interior cells without bounds checks
+void smoothBoxExactPass(const float* in, float* out, int width, int height, ThreadPool& pool) {
+    pool.parallelFor(height, SMOOTHING_ROWS_PER_TASK, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            bool borderRow = z == 0 || z == height - 1;
+            for (int x = 0; x < width; x++) {
+                if (borderRow || x == 0 || x == width - 1) {
+                    float sum = 0.0f;
+                    int count = 0;
+                    for (int dz = -1; dz <= 1; dz++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int nx = x + dx;
+                            int nz = z + dz;
+                            if (nx >= 0 && nx < width && nz >= 0 && nz < height) {
+                                sum += in[(size_t)nz * width + nx];
+                                count++;
+                            }
+                        }
+                    }
+                    out[(size_t)z * width + x] = sum / count;
+                    continue;
+                }
+
+                // Interior run: same left-to-right summation as the checked loop
+                const float* up = in + (size_t)(z - 1) * width;
+                const float* mid = up + width;
+                const float* down = mid + width;
+                float* dst = out + (size_t)z * width;
+                for (; x < width - 1; x++) {
+                    float sum = 0.0f;
+                    sum += up[x - 1]; sum += up[x]; sum += up[x + 1];
+                    sum += mid[x - 1]; sum += mid[x]; sum += mid[x + 1];
+                    sum += down[x - 1]; sum += down[x]; sum += down[x + 1];
+                    dst[x] = sum / 9.0f;
+                }
+                x--; // The last column goes through the checked path
+            }
+        }
+    });
+}
+
+void smoothBilateralPass(const float* in, float* out, int width, int height, float sigma, float rangeSigma, ThreadPool& pool) {
+    int R = std::max(1, (int)std::ceil(2.0f * sigma));
+    std::vector<float> spatial(2 * R + 1);
+    for (int d = -R; d <= R; d++)
+        spatial[d + R] = std::exp(-(float)(d * d) / (2.0f * sigma * sigma));
+    float rangeScale = -1.0f / (2.0f * rangeSigma * rangeSigma);
+
+    pool.parallelFor(height, SMOOTHING_ROWS_PER_TASK, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            int dzBegin = -std::min(R, z), dzEnd = std::min(R, height - 1 - z);
+            for (int x = 0; x < width; x++) {
+                int dxBegin = -std::min(R, x), dxEnd = std::min(R, width - 1 - x);
+                float center = in[(size_t)z * width + x];
+                float sum = 0.0f, total = 0.0f;
+                for (int dz = dzBegin; dz <= dzEnd; dz++) {
+                    const float* row = in + (size_t)(z + dz) * width + x;
+                    float wz = spatial[dz + R];
+                    for (int dx = dxBegin; dx <= dxEnd; dx++) {
+                        float diff = row[dx] - center;
+                        float w = wz * spatial[dx + R] * std::exp(diff * diff * rangeScale);
+                        sum += w * row[dx];
+                        total += w;
+                    }
+                }
+                out[(size_t)z * width + x] = sum / total;
+            }
+        }
+    });
+}
+
+// How far (in cells) a smoothed value can be influenced by its neighbours. Blocks generated
+// with this much extra border on each side give seam-free results after cropping.
+int smoothingApron(const SmoothingSettings& settings) {
+    int passes = std::max(0, settings.passes);
+    switch (settings.kernel) {
+    case SMOOTH_BOX: return std::max(1, settings.radius) * passes;
+    case SMOOTH_GAUSSIAN: return passes > 0 ? (int)std::ceil(3.0f * settings.sigma * std::sqrt((float)passes)) : 0;
+    case SMOOTH_BILATERAL: return std::max(1, (int)std::ceil(2.0f * settings.sigma)) * passes;
+    default: return passes;
+    }
+}
+
+// Smooths `heights` (width * height, row-major) in place
+void smoothHeightPlane(std::vector<float>& heights, int width, int height, const SmoothingSettings& settings,
+    ThreadPool& pool = globalThreadPool()) {
+    if (width <= 0 || height <= 0 || settings.passes <= 0)
+        return;
+    std::vector<float> scratch(heights.size());
+
+    switch (settings.kernel) {
+    case SMOOTH_BOX_EXACT:
+        for (int pass = 0; pass < settings.passes; pass++) {
+            smoothBoxExactPass(heights.data(), scratch.data(), width, height, pool);
+            heights.swap(scratch);
+        }
+        break;
+
+    case SMOOTH_BOX: {
+        int r = std::max(1, settings.radius);
+        int R = r * settings.passes;
+        if (settings.passes == 1 || width <= 2 * R || height <= 2 * R) {
+            // Running sums cost the same for any radius; iterate if the plane is too small to collapse
+            for (int pass = 0; pass < settings.passes; pass++) {
+                smoothRowsRunningBox(heights.data(), scratch.data(), width, height, r, pool);
+                smoothColumnsRunningBox(scratch.data(), heights.data(), width, height, r, pool);
+            }
+        }
+        else {
+            SmoothingKernel1D kernel = makeBoxKernel(r, settings.passes);
+            smoothRowsKernel(heights.data(), scratch.data(), width, height, kernel, pool);
+            smoothColumnsKernel(scratch.data(), heights.data(), width, height, kernel, pool);
+        }
+        break;
+    }
+
+    case SMOOTH_GAUSSIAN: {
+        int maxRadius = (std::min(width, height) - 1) / 2;
+        if (maxRadius < 1)
+            break;
+        SmoothingKernel1D kernel = makeGaussianKernel(settings.sigma * std::sqrt((float)settings.passes), maxRadius);
+        smoothRowsKernel(heights.data(), scratch.data(), width, height, kernel, pool);
+        smoothColumnsKernel(scratch.data(), heights.data(), width, height, kernel, pool);
+        break;
+    }
+
+    case SMOOTH_BILATERAL:
+        for (int pass = 0; pass < settings.passes; pass++) {
+            smoothBilateralPass(heights.data(), scratch.data(), width, height, settings.sigma, settings.rangeSigma, pool);
+            heights.swap(scratch);
+        }
+        break;
+    }
+}
+
+// Times every kernel on a width x height plane and prints the largest difference from the
+// exact box, which is what generateTerrain uses. `legacy` is smoothHeights() on the
+// interleaved vertex layout, timed for comparison when given.
+void runSmoothingReport(void (*legacy)(std::vector<float>&, int, int, int) = nullptr, int width = 2048, int height = 2048, int passes = 3) {
+    std::vector<float> source((size_t)width * height);
+    for (int z = 0; z < height; z++)
+        for (int x = 0; x < width; x++) {
+            unsigned int hash = (unsigned int)(x * 73856093) ^ (unsigned int)(z * 19349663);
+            hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+            source[(size_t)z * width + x] = 40.0f * std::sin(x * 0.01f) * std::cos(z * 0.013f) + (float)(hash & 1023) / 256.0f;
+        }
+
+    std::cout << "Smoothing report, " << width << "x" << height << ", " << passes << " passes, "
+        << globalThreadPool().size() << " threads" << std::endl;
+    if (legacy) {
+        std::vector<float> vertices(source.size() * 3);
+        for (size_t i = 0; i < source.size(); i++) vertices[i * 3 + 1] = source[i];
+        auto start = std::chrono::high_resolution_clock::now();
+        legacy(vertices, width, height, passes);
+        std::cout << "  smoothHeights (xyz, serial): "
+            << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() << " ms" << std::endl;
+    }
+    std::vector<float> reference;
+    for (int k = SMOOTH_BOX_EXACT; k <= SMOOTH_BILATERAL; k++) {
+        SmoothingSettings settings;
+        settings.kernel = (SmoothingKernel)k;
+        settings.passes = passes;
+        std::vector<float> plane = source;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        smoothHeightPlane(plane, width, height, settings);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if (k == SMOOTH_BOX_EXACT)
+            reference = plane;
+        float maxDifference = 0.0f;
+        for (size_t i = 0; i < plane.size(); i++)
+            maxDifference = std::max(maxDifference, std::fabs(plane[i] - reference[i]));
+        std::cout << "  " << smoothingKernelName(settings.kernel) << ": " << ms << " ms, max difference from exact box "
+            << maxDifference << std::endl;
+    }
+}
+
+#endif
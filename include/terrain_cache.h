@@ -0,0 +1,440 @@
+#ifndef TERRAIN_CACHE_H
+#define TERRAIN_CACHE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "biome_table.h"
+#include "smoothing.h"
+#include "tile_codec.h"
+
+// On-disk cache of generated terrain tiles. Every tile is its own fixed-size file, laid out so
+// it can be memory-mapped and its sections handed straight to memcpy/glBufferData:
+//
+//   TerrainTileHeader (64 bytes)
+//   heights   float[side * side]       offset heightOffset
+//   biomes    uint8[side * side]       offset biomeOffset
+//   vertices  float[side * side * 3]   offset vertexOffset (world-space xyz)
+//
+// Sections start on TILE_SECTION_ALIGN boundaries. Tiles live in a directory named after the
+// hash of every generation parameter, and the header repeats the hash, so changing the seed or
+// the biome table never reads stale terrain. Files are written to a temporary name and renamed,
+// so readers only ever see complete tiles.
+//
+// A cache created with maxError >= 0 stores compressed tiles instead (tile_codec.h): the header
+// is followed by the height and biome streams and vertices are rebuilt on load. That trades the
+// direct upload for a fraction of the disk space.
+
+const uint32_t TILE_MAGIC = 0x43544757; // "WGTC"
+const uint32_t TILE_FORMAT_VERSION = 1;
+const size_t TILE_SECTION_ALIGN = 64;
+
+struct TerrainTileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t parameterHash;
+    int32_t chunkX, chunkZ;
+    uint32_t side;          // Vertices per tile side
+    uint32_t encoding;      // TileEncoding
+    uint64_t heightOffset, biomeOffset, vertexOffset;
+    uint64_t fileSize;
+};
+static_assert(sizeof(TerrainTileHeader) == 64, "tile header must stay 64 bytes");
+
+enum TileEncoding {
+    TILE_ENCODING_RAW,          // heights, biomes, vertices
+    TILE_ENCODING_COMPRESSED    // Codec streams at heightOffset and biomeOffset, no vertices
+};
+
+struct TerrainTileLayout {
+    size_t heightOffset, biomeOffset, vertexOffset, fileSize;
+};
+
+TerrainTileLayout terrainTileLayout(uint32_t side) {
+    auto align = [](size_t offset) { return (offset + TILE_SECTION_ALIGN - 1) / TILE_SECTION_ALIGN * TILE_SECTION_ALIGN; };
+    size_t count = (size_t)side * side;
+    TerrainTileLayout layout;
+    layout.heightOffset = align(sizeof(TerrainTileHeader));
+    layout.biomeOffset = align(layout.heightOffset + count * sizeof(float));
+    layout.vertexOffset = align(layout.biomeOffset + count);
+    layout.fileSize = align(layout.vertexOffset + count * 3 * sizeof(float));
+    return layout;
+}
+
+// FNV-1a over raw bytes; the parameters are hashed field by field so struct padding never leaks in
+struct ParameterHasher {
+    uint64_t value = 14695981039346656037ull;
+
+    void bytes(const void* data, size_t size)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            value ^= p[i];
+            value *= 1099511628211ull;
+        }
+    }
+    template<typename T>
+    void add(const T& field) { bytes(&field, sizeof(T)); }
+};
+
+void hashBiomeParameters(ParameterHasher& hasher, const BiomeParameters& params) {
+    hasher.add(params.heightScale);
+    hasher.add(params.frequency);
+    hasher.add(params.persistence);
+    hasher.add(params.lacunarity);
+}
+
+// Everything that changes a generated tile
+uint64_t terrainParameterHash(int chunkSize, float scale, float seed, int octaves, const SmoothingSettings& smoothing,
+    const BiomeTable& biomeTable) {
+    ParameterHasher hasher;
+    hasher.add(TILE_FORMAT_VERSION);
+    hasher.add(chunkSize);
+    hasher.add(scale);
+    hasher.add(seed);
+    hasher.add(octaves);
+    hasher.add((int)smoothing.kernel);
+    hasher.add(smoothing.passes);
+    hasher.add(smoothing.radius);
+    hasher.add(smoothing.sigma);
+    hasher.add(smoothing.rangeSigma);
+    for (const BiomeDefinition& biome : biomeTable.biomes) {
+        hasher.add((int)biome.type);
+        hasher.add(biome.classifyBelow);
+        hasher.add(biome.start);
+        hasher.add(biome.peak);
+        hasher.add(biome.end);
+        hashBiomeParameters(hasher, biome.params);
+    }
+    hashBiomeParameters(hasher, biomeTable.fallback);
+    return hasher.value;
+}
+
+// Read-only view of a whole file; pages are only faulted in when touched
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            close();
+            return false;
+        }
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size = (size_t)info.st_size;
+        view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);    // The mapping keeps the file alive
+        if (view == MAP_FAILED) view = nullptr;
+#endif
+        if (!view) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view) munmap(view, size);
+#endif
+        view = nullptr;
+        size = 0;
+    }
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(view); }
+    size_t bytes() const { return size; }
+
+private:
+    void* view = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// A validated tile file; the section pointers stay valid while the tile is alive
+struct MappedTerrainTile {
+    MappedFile file;
+    TerrainTileHeader header = {};
+    const float* heights = nullptr;
+    const uint8_t* biomes = nullptr;
+    const float* vertices = nullptr;    // Null for compressed tiles
+
+    std::vector<float> decodedHeights;  // Backing for heights/biomes of compressed tiles
+    std::vector<uint8_t> decodedBiomes;
+};
+
+struct TerrainCacheStats {
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+    std::atomic<uint64_t> rejected{ 0 };    // Present but wrong version, hash or size
+    std::atomic<uint64_t> written{ 0 };
+    std::atomic<uint64_t> writeFailures{ 0 };
+};
+
+// Tiles for one parameter hash. load() is safe from any thread; store() queues the tile for
+// the writer thread and returns immediately. maxError < 0 keeps raw tiles, otherwise tiles are
+// compressed with that error bound (0 is lossless).
+class TerrainTileCache
+{
+public:
+    TerrainTileCache(const std::string& rootDirectory, uint64_t parameterHash, uint32_t tileSide, float maxError = -1.0f)
+        : side(tileSide), layout(terrainTileLayout(tileSide)), compressionError(maxError)
+    {
+        // Raw, lossless and lossy tiles of the same terrain live in separate directories
+        ParameterHasher hasher;
+        hasher.value = parameterHash;
+        hasher.add(maxError < 0.0f ? -1.0f : maxError);
+        hash = hasher.value;
+        encoding = maxError < 0.0f ? TILE_ENCODING_RAW : TILE_ENCODING_COMPRESSED;
+
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+        directory = (std::filesystem::path(rootDirectory) / name).string();
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        writer = std::thread([this] { writerLoop(); });
+    }
+
+    ~TerrainTileCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            stopping = true;
+        }
+        writeCondition.notify_all();
+        writer.join();  // Pending writes are finished first
+    }
+
+    TerrainTileCache(const TerrainTileCache&) = delete;
+    TerrainTileCache& operator=(const TerrainTileCache&) = delete;
+
+    uint64_t parameterHash() const { return hash; }
+
+    std::unique_ptr<MappedTerrainTile> load(int chunkX, int chunkZ)
+    {
+        std::unique_ptr<MappedTerrainTile> tile(new MappedTerrainTile());
+        if (!tile->file.open(tilePath(chunkX, chunkZ))) {
+            stats.misses++;
+            return nullptr;
+        }
+        const TerrainTileHeader* header = reinterpret_cast<const TerrainTileHeader*>(tile->file.data());
+        bool valid = tile->file.bytes() >= sizeof(TerrainTileHeader) && header->magic == TILE_MAGIC
+            && header->version == TILE_FORMAT_VERSION && header->parameterHash == hash && header->side == side
+            && header->chunkX == chunkX && header->chunkZ == chunkZ && header->encoding == encoding
+            && header->fileSize == tile->file.bytes();
+        if (valid) tile->header = *header;
+        if (valid && encoding == TILE_ENCODING_RAW) {
+            valid = header->fileSize == layout.fileSize;
+            tile->heights = reinterpret_cast<const float*>(tile->file.data() + layout.heightOffset);
+            tile->biomes = tile->file.data() + layout.biomeOffset;
+            tile->vertices = reinterpret_cast<const float*>(tile->file.data() + layout.vertexOffset);
+        }
+        else if (valid) {
+            size_t count = (size_t)side * side;
+            tile->decodedHeights.resize(count);
+            tile->decodedBiomes.resize(count);
+            valid = header->heightOffset <= header->biomeOffset && header->biomeOffset <= header->fileSize
+                && decodeHeightTile(tile->file.data() + header->heightOffset, header->biomeOffset - header->heightOffset,
+                    tile->decodedHeights.data())
+                && decodeBiomeTile(tile->file.data() + header->biomeOffset, header->fileSize - header->biomeOffset,
+                    tile->decodedBiomes.data());
+            tile->heights = tile->decodedHeights.data();
+            tile->biomes = tile->decodedBiomes.data();
+            tile->file.close();     // Everything needed was decoded
+        }
+        if (!valid) {
+            stats.rejected++;
+            return nullptr;
+        }
+        stats.hits++;
+        return tile;
+    }
+
+    // Serialises the tile on the calling thread and hands the bytes to the writer
+    void store(int chunkX, int chunkZ, const float* heights, const uint8_t* biomes, const float* vertices)
+    {
+        size_t count = (size_t)side * side;
+        std::vector<uint8_t> image;
+        TerrainTileHeader header = {};
+        header.magic = TILE_MAGIC;
+        header.version = TILE_FORMAT_VERSION;
+        header.parameterHash = hash;
+        header.chunkX = chunkX;
+        header.chunkZ = chunkZ;
+        header.side = side;
+        header.encoding = encoding;
+        if (encoding == TILE_ENCODING_RAW) {
+            image.assign(layout.fileSize, 0);
+            header.heightOffset = layout.heightOffset;
+            header.biomeOffset = layout.biomeOffset;
+            header.vertexOffset = layout.vertexOffset;
+            header.fileSize = layout.fileSize;
+            memcpy(image.data() + layout.heightOffset, heights, count * sizeof(float));
+            memcpy(image.data() + layout.biomeOffset, biomes, count);
+            memcpy(image.data() + layout.vertexOffset, vertices, count * 3 * sizeof(float));
+        }
+        else {
+            std::vector<uint8_t> heightStream = encodeHeightTile(heights, side, side, compressionError);
+            std::vector<uint8_t> biomeStream = encodeBiomeTile(biomes, side, side);
+            header.heightOffset = sizeof(TerrainTileHeader);
+            // Codec streams expect 4-byte alignment
+            header.biomeOffset = (header.heightOffset + heightStream.size() + 3) & ~(uint64_t)3;
+            header.vertexOffset = 0;
+            header.fileSize = header.biomeOffset + biomeStream.size();
+            image.assign(header.fileSize, 0);
+            memcpy(image.data() + header.heightOffset, heightStream.data(), heightStream.size());
+            memcpy(image.data() + header.biomeOffset, biomeStream.data(), biomeStream.size());
+        }
+        memcpy(image.data(), &header, sizeof(header));
+
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            pendingWrites.push_back({ tilePath(chunkX, chunkZ), std::move(image) });
+        }
+        writeCondition.notify_one();
+    }
+
+    // Blocks until every queued tile is on disk
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(writeMutex);
+        idleCondition.wait(lock, [this] { return pendingWrites.empty() && !writing; });
+    }
+
+    TerrainCacheStats stats;
+
+private:
+    struct PendingWrite {
+        std::string path;
+        std::vector<uint8_t> image;
+    };
+
+    std::string tilePath(int chunkX, int chunkZ) const
+    {
+        return directory + "/" + std::to_string(chunkX) + "_" + std::to_string(chunkZ) + ".tile";
+    }
+
+    void writerLoop()
+    {
+        for (;;) {
+            PendingWrite job;
+            {
+                std::unique_lock<std::mutex> lock(writeMutex);
+                writeCondition.wait(lock, [this] { return stopping || !pendingWrites.empty(); });
+                if (pendingWrites.empty()) return;  // Only reached when stopping
+                job = std::move(pendingWrites.front());
+                pendingWrites.pop_front();
+                writing = true;
+            }
+
+            if (writeAtomically(job.path, job.image)) stats.written++;
+            else stats.writeFailures++;
+
+            {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                writing = false;
+            }
+            idleCondition.notify_all();
+        }
+    }
+
+    static bool writeAtomically(const std::string& path, const std::vector<uint8_t>& image)
+    {
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(reinterpret_cast<const char*>(image.data()), (std::streamsize)image.size());
+            if (!out) return false;
+        }
+#ifdef _WIN32
+        // std::rename refuses to replace an existing file on Windows
+        if (!MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+            DeleteFileA(temporary.c_str());
+            return false;
+        }
+#else
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    uint64_t hash;
+    uint32_t side;
+    TerrainTileLayout layout;
+    float compressionError;
+    uint32_t encoding;
+    std::string directory;
+
+    std::mutex writeMutex;
+    std::condition_variable writeCondition, idleCondition;
+    std::deque<PendingWrite> pendingWrites;
+    bool writing = false;
+    bool stopping = false;
+    std::thread writer;
+};
+
+#endif
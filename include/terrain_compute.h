@@ -0,0 +1,194 @@
+#ifndef TERRAIN_COMPUTE_H
+#define TERRAIN_COMPUTE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <shader_m.h>
+#include "biome_table.h"
+#include "noise.h"
+#include "heightfield.h"
+#include "terrain_gpu.h"
+
+// generateHeightfield on the GPU: terraingen.cs evaluates the biome noise, blended parameters,
+// fBm and falloff for every vertex in one dispatch, then runs the box smoothing passes
+// ping-ponging between two R32F images, leaving the result in a HeightmapTexture that the
+// renderer samples directly. The Perlin noise is a line-by-line port of glm::perlin, so heights
+// match the CPU to float rounding (99.9% of vertices within ~0.005). The exceptions are the
+// steep one-LUT-entry ramps between biome bands, where an ulp of biome noise moves the blended
+// frequency; a few vertices per million there differ by up to a few tenths.
+//
+// Needs a GL 4.3 context (compute shaders, image load/store, SSBOs); supported() is false
+// otherwise and the caller keeps using generateHeightfield. Only the box kernels are ported:
+// canGenerate() is false for Gaussian and bilateral smoothing.
+class TerrainComputeGenerator
+{
+public:
+    TerrainComputeGenerator() {}
+    ~TerrainComputeGenerator() { release(); }
+    TerrainComputeGenerator(const TerrainComputeGenerator&) = delete;
+    TerrainComputeGenerator& operator=(const TerrainComputeGenerator&) = delete;
+
+    static bool contextSupportsCompute() { return GLAD_GL_VERSION_4_3 != 0; }
+
+    // Compiles the passes; false (and the generator stays unusable) without compute support.
+    // Shader paths are relative to the working directory like every other program.
+    bool init()
+    {
+        if (initialised) return supported();
+        initialised = true;
+        if (!contextSupportsCompute()) return false;
+        generatePass.reset(new Shader(GL_COMPUTE_SHADER, "terraingen.cs", "#define TERRAIN_PASS 0\n"));
+        smoothPass.reset(new Shader(GL_COMPUTE_SHADER, "terraingen.cs", "#define TERRAIN_PASS 1\n"));
+        if (!generatePass->linked() || !smoothPass->linked()) {
+            release();
+            return false;
+        }
+        glGenBuffers(1, &lutBuffer);
+        return true;
+    }
+
+    bool supported() const { return generatePass != nullptr; }
+
+    bool canGenerate(const SmoothingSettings& smoothing) const
+    {
+        return supported() && (smoothing.kernel == SMOOTH_BOX_EXACT || smoothing.kernel == SMOOTH_BOX);
+    }
+
+    // Fills `target` (reallocated as R32F) with generateHeightfield(width, height, ...), or the
+    // TerrainPipeline result for a non-default falloff
+    void generate(int width, int height, float scale, float seed, int octaves, const SmoothingSettings& smoothing,
+        const FalloffSettings& falloff, const BiomeTable& biomeTable, HeightmapTexture& target)
+    {
+        glm::vec2 origin(-(width / 2.0f), -(height / 2.0f));
+        int passes = smoothing.passes;
+        // Same clamp as smoothHeightPlane, so both generators smooth identically
+        int radius = smoothing.kernel == SMOOTH_BOX ? std::max(1, smoothing.radius) : 1;
+
+        // The last smoothing pass has to land in the target
+        target.allocate(width, height, origin);
+        ensureScratch(width, height);
+        GLuint images[2] = { target.id(), scratchHeights };
+        int current = passes % 2;
+
+        uploadBiomeTable(biomeTable);
+        generatePass->use();
+        generatePass->setVec2("u_origin", origin);
+        glUniform2i(glGetUniformLocation(generatePass->ID, "u_size"), width, height);
+        generatePass->setFloat("u_scale", scale);
+        generatePass->setFloat("u_seed", seed);
+        generatePass->setInt("u_octaves", octaves);
+        generatePass->setBool("u_applyFalloff", true);
+        generatePass->setInt("u_falloffBorder", falloff.border);
+        generatePass->setFloat("u_falloffEdge", falloff.edgeHeight);
+        const std::vector<BiomeTable::Band>& bands = biomeTable.compiledBands();
+        int bandCount = std::min((int)bands.size(), 16);
+        std::vector<float> bandBelow(16, 1.0f);
+        std::vector<int> bandType(16, 0);
+        for (int i = 0; i < bandCount; i++) {
+            bandBelow[i] = bands[i].below;
+            bandType[i] = bands[i].type;
+        }
+        generatePass->setInt("u_bandCount", bandCount);
+        glUniform1fv(glGetUniformLocation(generatePass->ID, "u_bandBelow"), 16, bandBelow.data());
+        glUniform1iv(glGetUniformLocation(generatePass->ID, "u_bandType"), 16, bandType.data());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lutBuffer);
+        glBindImageTexture(0, images[current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glBindImageTexture(1, biomeTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+        dispatch(width, height);
+
+        smoothPass->use();
+        glUniform2i(glGetUniformLocation(smoothPass->ID, "u_size"), width, height);
+        smoothPass->setInt("u_radius", radius);
+        for (int pass = 0; pass < passes; pass++) {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            glBindImageTexture(1, images[current], 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(0, images[1 - current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            dispatch(width, height);
+            current = 1 - current;
+        }
+
+        glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    }
+
+    // Copies the last result back into a Heightfield (heights and biomes), for the CPU-side
+    // consumers: LOD bounds, edits, the vertex buffer path
+    Heightfield download(const HeightmapTexture& heights) const
+    {
+        Heightfield heightfield(heights.width(), heights.height());
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, heights.id());
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, heightfield.heightPlane().data());
+        glBindTexture(GL_TEXTURE_2D, biomeTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, heightfield.biomePlane().data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        return heightfield;
+    }
+
+    void release()
+    {
+        if (generatePass) glDeleteProgram(generatePass->ID);
+        if (smoothPass) glDeleteProgram(smoothPass->ID);
+        generatePass.reset();
+        smoothPass.reset();
+        if (lutBuffer) glDeleteBuffers(1, &lutBuffer);
+        releaseScratch();
+        lutBuffer = 0;
+    }
+
+private:
+    void dispatch(int width, int height)
+    {
+        glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    }
+
+    // Re-uploaded only when the table was recompiled
+    void uploadBiomeTable(const BiomeTable& biomeTable)
+    {
+        if (biomeTable.getVersion() == lutVersion && lutTable == &biomeTable) return;
+        const std::vector<BiomeParameters>& lut = biomeTable.compiledLut();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, lutBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, lut.size() * sizeof(BiomeParameters), lut.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        lutVersion = biomeTable.getVersion();
+        lutTable = &biomeTable;
+    }
+
+    void ensureScratch(int width, int height)
+    {
+        if (scratchHeights && scratchWidth == width && scratchHeight == height) return;
+        releaseScratch();
+        scratchWidth = width;
+        scratchHeight = height;
+        glGenTextures(1, &scratchHeights);
+        glBindTexture(GL_TEXTURE_2D, scratchHeights);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, width, height);
+        glGenTextures(1, &biomeTexture);
+        glBindTexture(GL_TEXTURE_2D, biomeTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void releaseScratch()
+    {
+        if (scratchHeights) glDeleteTextures(1, &scratchHeights);
+        if (biomeTexture) glDeleteTextures(1, &biomeTexture);
+        scratchHeights = biomeTexture = 0;
+    }
+
+    bool initialised = false;
+    std::unique_ptr<Shader> generatePass, smoothPass;
+    GLuint lutBuffer = 0;
+    GLuint scratchHeights = 0, biomeTexture = 0;
+    int scratchWidth = 0, scratchHeight = 0;
+    uint32_t lutVersion = 0;
+    const BiomeTable* lutTable = nullptr;
+};
+
+#endif
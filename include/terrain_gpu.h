@@ -0,0 +1,393 @@
+#ifndef TERRAIN_GPU_H
+#define TERRAIN_GPU_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <shader_m.h>
+#include "heightfield.h"
+#include "sea_trim.h"
+
+// GPU copies of a Heightfield. HeightmapTexture holds one height per sample (2 or 4 bytes) and
+// is displaced in the vertex shader; VertexBufferTerrain is the classic vertex and index buffer
+// (12 bytes of xyz and 4 of packed normal per vertex plus ~24 bytes of indices), kept for
+// comparison. Both re-upload only the dirty rectangle after an edit.
+
+class HeightmapTexture
+{
+public:
+    enum Format {
+        HEIGHTMAP_R16,  // Normalised 16-bit over the height range: height = r * scale + offset
+        HEIGHTMAP_R32F
+    };
+
+    HeightmapTexture() {}
+    ~HeightmapTexture() { release(); }
+    HeightmapTexture(const HeightmapTexture&) = delete;
+    HeightmapTexture& operator=(const HeightmapTexture&) = delete;
+
+    GLuint id() const { return texture; }
+    Format format() const { return storage; }
+    int width() const { return w; }
+    int height() const { return h; }
+    size_t gpuBytes() const { return (size_t)w * h * (storage == HEIGHTMAP_R16 ? 2 : 4); }
+
+    void upload(const Heightfield& heightfield, Format format)
+    {
+        release();
+        w = heightfield.width();
+        h = heightfield.height();
+        storage = format;
+        origin = glm::vec2(heightfield.worldX(0), heightfield.worldZ(0));
+        spacing = heightfield.spacing();
+
+        std::vector<float> heights = heightfield.decodeHeights();
+        if (format == HEIGHTMAP_R16) {
+            auto range = std::minmax_element(heights.begin(), heights.end());
+            heightOffset = *range.first;
+            heightScale = std::max(*range.second - *range.first, 1e-6f);
+        }
+        else {
+            heightOffset = 0.0f;
+            heightScale = 1.0f;
+        }
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (format == HEIGHTMAP_R16) {
+            std::vector<uint16_t> texels = encodeR16(heights.data(), heights.size());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, w, h, 0, GL_RED, GL_UNSIGNED_SHORT, texels.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, heights.data());
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Uninitialised R32F storage of a width x height heightfield, for GPU writers (see
+    // terrain_compute.h)
+    void allocate(int width, int height, const glm::vec2& worldOrigin)
+    {
+        release();
+        w = width;
+        h = height;
+        storage = HEIGHTMAP_R32F;
+        origin = worldOrigin;
+        spacing = 1.0f;
+        heightOffset = 0.0f;
+        heightScale = 1.0f;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Re-upload vertices [x, x + width) x [z, z + height) after the heightfield was edited. An
+    // R16 texture whose range no longer covers the edit is re-quantised in full.
+    void updateRegion(const Heightfield& heightfield, int x, int z, int width, int height)
+    {
+        x = std::max(x, 0);
+        z = std::max(z, 0);
+        width = std::min(width, w - x);
+        height = std::min(height, h - z);
+        if (!texture || width <= 0 || height <= 0) return;
+
+        std::vector<float> region((size_t)width * height);
+        for (int row = 0; row < height; row++)
+            for (int column = 0; column < width; column++)
+                region[(size_t)row * width + column] = heightfield.heightAt(x + column, z + row);
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (storage == HEIGHTMAP_R16) {
+            auto range = std::minmax_element(region.begin(), region.end());
+            if (*range.first < heightOffset || *range.second > heightOffset + heightScale) {
+                glBindTexture(GL_TEXTURE_2D, 0);
+                upload(heightfield, storage);
+                return;
+            }
+            std::vector<uint16_t> texels = encodeR16(region.data(), region.size());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, z, width, height, GL_RED, GL_UNSIGNED_SHORT, texels.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, z, width, height, GL_RED, GL_FLOAT, region.data());
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Binds to `unit` and sets the sampling uniforms shared by the displacement shaders
+    void bind(const Shader& shader, int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("u_heightmap", unit);
+        shader.setFloat("u_heightScale", heightScale);
+        shader.setFloat("u_heightOffset", heightOffset);
+        shader.setVec2("u_terrainOrigin", origin);
+        shader.setVec2("u_terrainSize", glm::vec2((float)w, (float)h));
+        shader.setFloat("u_gridSpacing", spacing);
+    }
+
+    void release()
+    {
+        if (texture) glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+private:
+    std::vector<uint16_t> encodeR16(const float* heights, size_t count) const
+    {
+        std::vector<uint16_t> texels(count);
+        float inverse = 65535.0f / heightScale;
+        for (size_t i = 0; i < count; i++)
+            texels[i] = (uint16_t)std::min(65535.0f, std::max(0.0f, (heights[i] - heightOffset) * inverse + 0.5f));
+        return texels;
+    }
+
+    GLuint texture = 0;
+    int w = 0, h = 0;
+    Format storage = HEIGHTMAP_R32F;
+    float heightScale = 1.0f, heightOffset = 0.0f;
+    glm::vec2 origin = glm::vec2(0.0f);
+    float spacing = 1.0f;
+};
+
+// Rivers and lakes from hydrology.h, one RGBA8 texel per heightfield vertex (see HydrologyMaps
+// for the channels). noiseshader.fs tints the terrain with it while u_hydrologyEnabled is set.
+class HydrologyTexture
+{
+public:
+    HydrologyTexture() {}
+    ~HydrologyTexture() { release(); }
+    HydrologyTexture(const HydrologyTexture&) = delete;
+    HydrologyTexture& operator=(const HydrologyTexture&) = delete;
+
+    bool ready() const { return texture != 0; }
+    size_t gpuBytes() const { return texture ? (size_t)w * h * 4 : 0; }
+
+    // Empty texels (a preview, or hydrology off) release the texture
+    void upload(const std::vector<uint32_t>& texels, const Heightfield& heightfield)
+    {
+        release();
+        if (texels.empty() || texels.size() != heightfield.vertexCount()) return;
+        w = heightfield.width();
+        h = heightfield.height();
+        origin = glm::vec2(heightfield.worldX(0), heightfield.worldZ(0));
+        spacing = heightfield.spacing();
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Binds to `unit`, or turns the tint off when there is nothing to show
+    void bind(const Shader& shader, int unit) const
+    {
+        shader.setBool("u_hydrologyEnabled", texture != 0);
+        if (!texture) return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("u_hydrologyMap", unit);
+        shader.setVec2("u_hydrologyOrigin", origin);
+        shader.setVec2("u_hydrologySize", glm::vec2((float)w, (float)h));
+        shader.setFloat("u_hydrologySpacing", spacing);
+    }
+
+    void release()
+    {
+        if (texture) glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+private:
+    GLuint texture = 0;
+    int w = 0, h = 0;
+    glm::vec2 origin = glm::vec2(0.0f);
+    float spacing = 1.0f;
+};
+
+// The full-resolution mesh as interleaved xyz plus a second buffer of packed normals (the
+// generator's when the heightfield kept them, central differences otherwise), drawn with
+// noiseshader.vs. Indices are grouped in TILE_SIZE^2 quad tiles with the highest vertex of
+// each, so tiles under the sea are skipped.
+class VertexBufferTerrain
+{
+public:
+    static const int TILE_SIZE = 32;
+
+    VertexBufferTerrain() {}
+    ~VertexBufferTerrain() { release(); }
+    VertexBufferTerrain(const VertexBufferTerrain&) = delete;
+    VertexBufferTerrain& operator=(const VertexBufferTerrain&) = delete;
+
+    bool ready() const { return VAO != 0; }
+    size_t gpuBytes() const
+    {
+        return VAO ? (size_t)w * h * (3 * sizeof(float) + sizeof(uint32_t)) + (size_t)ranges.triangleCount() * 3 * sizeof(unsigned int) : 0;
+    }
+    int triangleCount() const { return ranges.triangleCount(); }
+    int trimmedTriangles() const { return ranges.triangleCount() - ranges.drawnTriangles(); }
+
+    void upload(const Heightfield& heightfield)
+    {
+        release();
+        w = heightfield.width();
+        h = heightfield.height();
+        origin = glm::vec2(heightfield.worldX(0), heightfield.worldZ(0));
+        spacing = heightfield.spacing();
+        const std::vector<float>& vertices = heightfield.meshVertices();
+        std::vector<unsigned int> indices = heightfield.meshIndices();
+        std::vector<uint32_t> normals = heightfield.normalPlane();
+        if (normals.size() != heightfield.vertexCount()) {
+            normals.resize(heightfield.vertexCount());
+            globalThreadPool().parallelFor(h, 64, [&](int zBegin, int zEnd) {
+                for (int z = zBegin; z < zEnd; z++)
+                    for (int x = 0; x < w; x++)
+                        normals[(size_t)z * w + x] = gridNormal(heightfield, x, z);
+            });
+        }
+        ranges.build(indices, w - 1, h - 1, TILE_SIZE);
+        tileTops.assign(ranges.tileCount(), 0.0f);
+        updateTileTops(heightfield, 0, 0, w, h);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &NBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, NBO);
+        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(uint32_t), normals.data(), GL_DYNAMIC_DRAW);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(uint32_t), (void*)0);
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        heightfield.releaseMesh();
+    }
+
+    // Rewrites the rows of the dirty rectangle; each row is one glBufferSubData of xyz and, one
+    // vertex wider on every side, one of normals
+    void updateRegion(const Heightfield& heightfield, int x, int z, int width, int height)
+    {
+        int nx0 = std::max(x - 1, 0), nz0 = std::max(z - 1, 0);
+        int nx1 = std::min(x + width + 1, w), nz1 = std::min(z + height + 1, h);
+        x = std::max(x, 0);
+        z = std::max(z, 0);
+        width = std::min(width, w - x);
+        height = std::min(height, h - z);
+        if (!VBO || width <= 0 || height <= 0) return;
+
+        std::vector<float> row((size_t)width * 3);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        for (int r = z; r < z + height; r++) {
+            for (int column = 0; column < width; column++) {
+                row[column * 3] = heightfield.worldX(x + column);
+                row[column * 3 + 1] = heightfield.heightAt(x + column, r);
+                row[column * 3 + 2] = heightfield.worldZ(r);
+            }
+            glBufferSubData(GL_ARRAY_BUFFER, ((size_t)r * w + x) * 3 * sizeof(float), row.size() * sizeof(float), row.data());
+        }
+        std::vector<uint32_t> normalRow(nx1 - nx0);
+        glBindBuffer(GL_ARRAY_BUFFER, NBO);
+        for (int r = nz0; r < nz1; r++) {
+            for (int column = nx0; column < nx1; column++) normalRow[column - nx0] = gridNormal(heightfield, column, r);
+            glBufferSubData(GL_ARRAY_BUFFER, ((size_t)r * w + nx0) * sizeof(uint32_t), normalRow.size() * sizeof(uint32_t), normalRow.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        updateTileTops(heightfield, x, z, width, height);
+    }
+
+    // Every tile the sea does not hide from cameraHeight (band disabled: all of them)
+    void draw(const SeaBand& band, float cameraHeight)
+    {
+        if (!VAO) return;
+        bool hiding = band.enabled && cameraHeight > band.high;
+        if (tilesDirty || hiding != wasHiding || (hiding && band != lastBand)) {
+            ranges.select([&](int t) {
+                int tx = t % ranges.tileCountX(), tz = t / ranges.tileCountX();
+                glm::vec3 boxMin(origin.x + tx * TILE_SIZE * spacing, -1e30f, origin.y + tz * TILE_SIZE * spacing);
+                glm::vec3 boxMax(origin.x + std::min((tx + 1) * TILE_SIZE, w - 1) * spacing, tileTops[t],
+                    origin.y + std::min((tz + 1) * TILE_SIZE, h - 1) * spacing);
+                return !(hiding && band.hides(boxMin, boxMax, cameraHeight));
+            });
+            tilesDirty = false;
+            wasHiding = hiding;
+            lastBand = band;
+        }
+        glBindVertexArray(VAO);
+        ranges.draw();
+        glBindVertexArray(0);
+    }
+
+    void release()
+    {
+        if (VAO) glDeleteVertexArrays(1, &VAO);
+        if (VBO) glDeleteBuffers(1, &VBO);
+        if (NBO) glDeleteBuffers(1, &NBO);
+        if (EBO) glDeleteBuffers(1, &EBO);
+        VAO = VBO = NBO = EBO = 0;
+    }
+
+private:
+    uint32_t gridNormal(const Heightfield& heightfield, int x, int z) const
+    {
+        auto heightAt = [&](int vx, int vz) { return heightfield.heightAt(vx, vz); };
+        return packedGridNormal(heightAt, x, z, w, h, spacing);
+    }
+
+    // Highest vertex of the tiles touching vertices [x, x + width) x [z, z + height); tiles share
+    // their edge vertices with the next tile
+    void updateTileTops(const Heightfield& heightfield, int x, int z, int width, int height)
+    {
+        int tilesX = ranges.tileCountX(), tilesZ = ranges.tileCount() / std::max(tilesX, 1);
+        int tx0 = std::max(0, (x - 1) / TILE_SIZE), tx1 = std::min(tilesX - 1, (x + width - 1) / TILE_SIZE);
+        int tz0 = std::max(0, (z - 1) / TILE_SIZE), tz1 = std::min(tilesZ - 1, (z + height - 1) / TILE_SIZE);
+        for (int tz = tz0; tz <= tz1; tz++)
+            for (int tx = tx0; tx <= tx1; tx++) {
+                float top = -1e30f;
+                for (int vz = tz * TILE_SIZE; vz <= std::min((tz + 1) * TILE_SIZE, h - 1); vz++)
+                    for (int vx = tx * TILE_SIZE; vx <= std::min((tx + 1) * TILE_SIZE, w - 1); vx++)
+                        top = std::max(top, heightfield.heightAt(vx, vz));
+                tileTops[(size_t)tz * tilesX + tx] = top;
+            }
+        tilesDirty = true;
+    }
+
+    GLuint VAO = 0, VBO = 0, NBO = 0, EBO = 0;
+    int w = 0, h = 0;
+    glm::vec2 origin = glm::vec2(0.0f);
+    float spacing = 1.0f;
+
+    TiledIndexRanges ranges;
+    std::vector<float> tileTops;
+    bool tilesDirty = true, wasHiding = false;
+    SeaBand lastBand;
+};
+
+#endif
@@ -0,0 +1,460 @@
+#ifndef TERRAIN_PIPELINE_H
+#define TERRAIN_PIPELINE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <glm/glm.hpp>
+#include "noise.h"
+#include "erosion.h"
+#include "island_mask.h"
+#include "hydrology.h"
+#include "scatter.h"
+
+// generateHeightfield split into an explicit stage graph, each stage keeping its last output
+// keyed by a hash of everything it was computed from:
+//
+//   biome noise -> biome params -> fBm heights -> falloff -> smoothing -> erosion -> hydrology -> normals
+//                       |                            |                                            |
+//                       |          island mask ------+                                            |
+//                       +----------------------- biomes -------------------------------------> mesh -> scatter
+//
+// A stage's key chains its parent's key with its own inputs, so editing a late stage (the
+// smoothing passes, the erosion settings) reuses every stage above it and only recomputes what
+// is downstream. With erosion and hydrology off the result is bit-identical to
+// generateHeightfield.
+//
+// The fBm stage gets its slopes from the same evaluation (fbm3d_batch). With smoothing, erosion
+// and hydrology off, the normals are built from them away from biome transitions; elsewhere, or
+// once the surface has been reshaped, they are central differences of the final heights.
+//
+// Every cached output is kept, which costs ~62 bytes per vertex (62 MB at 1025^2), plus 12 with
+// hydrology on and 8 per scattered instance.
+
+struct TerrainRequest {
+    int width = 1025;               // Full-resolution vertices
+    int height = 1025;
+    float scale = 50.0f;
+    float seed = 1.0f;
+    int octaves = 4;
+    FalloffSettings falloff;
+    IslandMaskSettings island;      // Coastline the falloff follows
+    SmoothingSettings smoothing;    // Applied at full resolution only
+    ErosionSettings erosion;        // Same
+    HydrologySettings hydrology;    // Same; seaLevel only counts when enabled
+    ScatterSettings scatter;        // Same
+    std::shared_ptr<const BiomeTable> biomeTable;
+};
+
+enum TerrainStage {
+    STAGE_BIOME_NOISE,
+    STAGE_BIOME_PARAMS,
+    STAGE_FBM,
+    STAGE_ISLAND_MASK,
+    STAGE_FALLOFF,
+    STAGE_SMOOTHING,
+    STAGE_EROSION,
+    STAGE_HYDROLOGY,
+    STAGE_NORMALS,
+    STAGE_MESH,
+    STAGE_SCATTER,
+    TERRAIN_STAGE_COUNT
+};
+
+const char* terrainStageName(TerrainStage stage) {
+    static const char* names[] = { "Biome noise", "Biome params", "fBm heights", "Island mask", "Falloff", "Smoothing", "Erosion", "Hydrology",
+        "Normals", "Mesh", "Scatter" };
+    return names[stage];
+}
+
+struct TerrainStageStats {
+    double milliseconds = 0.0;  // Last time the stage actually ran
+    uint64_t hits = 0;          // Runs that reused the cached output
+    uint64_t misses = 0;
+    size_t bytes = 0;           // Held by the cached output
+};
+
+// FNV-1a over the raw bytes of stage inputs
+class StageKey
+{
+public:
+    explicit StageKey(uint64_t parent = 1469598103934665603ull) : hash(parent) {}
+
+    template <typename T>
+    StageKey& add(const T& value)
+    {
+        return addBytes(&value, sizeof(T));
+    }
+
+    StageKey& addBytes(const void* data, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return *this;
+    }
+
+    uint64_t value() const { return hash; }
+
+private:
+    uint64_t hash;
+};
+
+class TerrainPipeline
+{
+public:
+    // Brings every stage up to date for the request, reusing the ones whose inputs did not
+    // change. cancelled() is checked between stages and between row bands of the noise stages;
+    // returns false when it fired, leaving the interrupted stage uncached.
+    bool run(const TerrainRequest& request, const std::function<bool()>& cancelled, ThreadPool& pool = globalThreadPool())
+    {
+        uint64_t keys[TERRAIN_STAGE_COUNT];
+        stageKeys(request, keys);
+        for (int stage = 0; stage < TERRAIN_STAGE_COUNT; stage++) {
+            if (cached[stage] && cachedKeys[stage] == keys[stage]) {
+                statistics[stage].hits++;
+                continue;
+            }
+            if (cancelled()) return false;
+            cached[stage] = false;
+            auto start = std::chrono::high_resolution_clock::now();
+            if (!runStage((TerrainStage)stage, request, cancelled, pool)) return false;
+            statistics[stage].milliseconds = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count();
+            statistics[stage].misses++;
+            statistics[stage].bytes = stageBytes((TerrainStage)stage);
+            cachedKeys[stage] = keys[stage];
+            cached[stage] = true;
+        }
+        return true;
+    }
+
+    // True when run() would reuse `stage` (and so every stage above it) for this request
+    bool isCached(const TerrainRequest& request, TerrainStage stage) const
+    {
+        uint64_t keys[TERRAIN_STAGE_COUNT];
+        stageKeys(request, keys);
+        return cached[stage] && cachedKeys[stage] == keys[stage];
+    }
+
+    // Outputs of the last successful run()
+    const Heightfield& heightfield() const { return mesh; }
+    const std::vector<uint32_t>& normals() const { return normalPlane; } // packTerrainNormal, row-major
+    const std::vector<float>& coastDistance() const { return islandDistance; } // Empty for ISLAND_RECTANGLE
+    const HydrologyMaps& hydrology() const { return hydrologyMaps; } // Empty with hydrology off
+    const ScatterInstances& scatter() const { return scatterOutput; } // Empty with scattering off
+
+    const TerrainStageStats& stats(TerrainStage stage) const { return statistics[stage]; }
+
+    size_t memoryBytes() const
+    {
+        size_t total = 0;
+        for (int stage = 0; stage < TERRAIN_STAGE_COUNT; stage++) total += stageBytes((TerrainStage)stage);
+        return total;
+    }
+
+    // Drops every cached output (the statistics are kept)
+    void clear()
+    {
+        std::fill(std::begin(cached), std::end(cached), false);
+        std::vector<float>().swap(biomeNoise);
+        std::vector<BiomeParameters>().swap(biomeParams);
+        std::vector<uint8_t>().swap(biomes);
+        std::vector<float>().swap(fbmHeights);
+        std::vector<float>().swap(fbmSlopeX);
+        std::vector<float>().swap(fbmSlopeZ);
+        std::vector<float>().swap(islandDistance);
+        std::vector<float>().swap(falloffHeights);
+        std::vector<float>().swap(smoothedHeights);
+        std::vector<float>().swap(erodedHeights);
+        std::vector<float>().swap(hydrologyHeights);
+        hydrologyMaps = HydrologyMaps();
+        std::vector<uint32_t>().swap(normalPlane);
+        mesh = Heightfield();
+        scatterOutput = ScatterInstances();
+    }
+
+private:
+    static void stageKeys(const TerrainRequest& request, uint64_t* keys)
+    {
+        keys[STAGE_BIOME_NOISE] = StageKey().add(request.width).add(request.height).add(request.scale).add(request.seed).value();
+
+        // Hashed by content: the request holds a copy of the table, so pointers and versions
+        // don't say whether it changed
+        const BiomeTable& table = *request.biomeTable;
+        const std::vector<BiomeParameters>& lut = table.compiledLut();
+        StageKey params(keys[STAGE_BIOME_NOISE]);
+        params.addBytes(lut.data(), lut.size() * sizeof(BiomeParameters));
+        for (const BiomeTable::Band& band : table.compiledBands()) params.add(band.below).add(band.type);
+        keys[STAGE_BIOME_PARAMS] = params.value();
+
+        keys[STAGE_FBM] = StageKey(keys[STAGE_BIOME_PARAMS]).add(request.octaves).value();
+        // The mask only depends on the grid and the shape, not on the noise
+        const IslandMaskSettings& island = request.island;
+        StageKey mask;
+        mask.add(request.width).add(request.height).add(island.shape);
+        if (island.shape == ISLAND_POLYGON) mask.addBytes(island.polygon.data(), island.polygon.size() * sizeof(glm::vec2));
+        if (island.shape == ISLAND_NOISE) mask.add(island.noiseScale).add(island.threshold).add(island.radialBias).add(island.noiseSeed);
+        if (island.shape == ISLAND_PAINTED) mask.add(island.painted.get()).add(island.paintedRevision);
+        keys[STAGE_ISLAND_MASK] = mask.value();
+
+        keys[STAGE_FALLOFF] = StageKey(keys[STAGE_FBM]).add(keys[STAGE_ISLAND_MASK]).add(request.falloff.border)
+            .add(request.falloff.edgeHeight).value();
+        const SmoothingSettings& smoothing = request.smoothing;
+        keys[STAGE_SMOOTHING] = StageKey(keys[STAGE_FALLOFF]).add(smoothing.kernel).add(smoothing.passes).add(smoothing.radius)
+            .add(smoothing.sigma).add(smoothing.rangeSigma).value();
+        const ErosionSettings& erosion = request.erosion;
+        StageKey eroded(keys[STAGE_SMOOTHING]);
+        eroded.add(erosion.hydraulic).add(erosion.thermal);
+        if (erosion.hydraulic) {
+            eroded.add(erosion.dropletsPerVertex).add(erosion.rounds).add(erosion.maxLifetime).add(erosion.radius).add(erosion.inertia)
+                .add(erosion.sedimentCapacity).add(erosion.minCapacity).add(erosion.erodeSpeed).add(erosion.depositSpeed)
+                .add(erosion.evaporateSpeed).add(erosion.gravity).add(erosion.seed);
+        }
+        if (erosion.thermal) eroded.add(erosion.thermalIterations).add(erosion.talus).add(erosion.thermalRate);
+        keys[STAGE_EROSION] = eroded.value();
+        const HydrologySettings& hydrology = request.hydrology;
+        StageKey drained(keys[STAGE_EROSION]);
+        drained.add(hydrology.enabled);
+        if (hydrology.enabled) {
+            drained.add(hydrology.routing).add(hydrology.seaLevel).add(hydrology.epsilon).add(hydrology.riverThreshold)
+                .add(hydrology.carveDepth).add(hydrology.minLakeDepth).add(hydrology.carveRivers).add(hydrology.fillLakes);
+        }
+        keys[STAGE_HYDROLOGY] = drained.value();
+        keys[STAGE_NORMALS] = keys[STAGE_HYDROLOGY];
+        keys[STAGE_MESH] = keys[STAGE_HYDROLOGY];
+        // Scale and draw distance only matter to the renderer
+        const ScatterSettings& scatter = request.scatter;
+        StageKey scattered(keys[STAGE_MESH]);
+        scattered.add(scatter.enabled);
+        if (scatter.enabled) {
+            scattered.add(scatter.seed).add(scatter.chunkSize).add(scatter.seaLevel).add(scatter.shoreMargin);
+            for (const ScatterLayer& layer : scatter.layers)
+                scattered.add(layer.minDistance).add(layer.biomeDensity).add(layer.maxSlope);
+        }
+        keys[STAGE_SCATTER] = scattered.value();
+    }
+
+    bool runStage(TerrainStage stage, const TerrainRequest& request, const std::function<bool()>& cancelled, ThreadPool& pool)
+    {
+        int width = request.width, height = request.height;
+        size_t count = (size_t)width * height;
+        switch (stage) {
+        case STAGE_BIOME_NOISE:
+            biomeNoise.resize(count);
+            return forEachBand(height, cancelled, pool, [&](int zBegin, int zEnd) {
+                std::vector<float> xs(width), ys(width, request.seed * 0.1f), zs(width);
+                for (int x = 0; x < width; x++) xs[x] = gridWorld(x, width) / (request.scale * 4.0f);
+                for (int z = zBegin; z < zEnd; z++) {
+                    std::fill(zs.begin(), zs.end(), gridWorld(z, height) / (request.scale * 4.0f));
+                    float* out = &biomeNoise[(size_t)z * width];
+                    perlin3_batch(xs.data(), ys.data(), zs.data(), out, width);
+                    for (int x = 0; x < width; x++) out[x] = (out[x] + 1.0f) * 0.5f;
+                }
+            });
+
+        case STAGE_BIOME_PARAMS:
+            biomeParams.resize(count);
+            biomes.resize(count);
+            pool.parallelFor((int)height, 64, [&](int zBegin, int zEnd) {
+                for (size_t i = (size_t)zBegin * width; i < (size_t)zEnd * width; i++) {
+                    biomeParams[i] = request.biomeTable->evaluate(biomeNoise[i]);
+                    biomes[i] = (uint8_t)request.biomeTable->classify(biomeNoise[i]);
+                }
+            });
+            return true;
+
+        case STAGE_FBM:
+            // The slopes come out of the same evaluation (fbm3d_batch), per world unit; the
+            // normals stage uses them when nothing after the falloff reshapes the surface
+            fbmHeights.resize(count);
+            fbmSlopeX.resize(count);
+            fbmSlopeZ.resize(count);
+            return forEachBand(height, cancelled, pool, [&](int zBegin, int zEnd) {
+                std::vector<float> xs(width), zs(width), frequency(width), lacunarity(width), persistence(width);
+                for (int x = 0; x < width; x++) xs[x] = gridWorld(x, width) / request.scale;
+                for (int z = zBegin; z < zEnd; z++) {
+                    std::fill(zs.begin(), zs.end(), gridWorld(z, height) / request.scale);
+                    const BiomeParameters* params = &biomeParams[(size_t)z * width];
+                    for (int x = 0; x < width; x++) {
+                        frequency[x] = params[x].frequency;
+                        lacunarity[x] = params[x].lacunarity;
+                        persistence[x] = params[x].persistence;
+                    }
+                    size_t row = (size_t)z * width;
+                    float* out = &fbmHeights[row];
+                    FbmBatchInput fbmInput = { xs.data(), zs.data(), frequency.data(), lacunarity.data(), persistence.data(), request.seed * 0.5f };
+                    fbm3d_batch(fbmInput, request.octaves, out, &fbmSlopeX[row], &fbmSlopeZ[row], width);
+                    for (int x = 0; x < width; x++) {
+                        out[x] = out[x] * params[x].heightScale;
+                        fbmSlopeX[row + x] *= params[x].heightScale / request.scale;
+                        fbmSlopeZ[row + x] *= params[x].heightScale / request.scale;
+                    }
+                }
+            });
+
+        case STAGE_ISLAND_MASK:
+            islandDistance = islandDistanceField(request.island, width, height, 1, pool);
+            return true;
+
+        case STAGE_FALLOFF:
+            falloffHeights.resize(count);
+            pool.parallelFor(height, 64, [&](int zBegin, int zEnd) {
+                for (int z = zBegin; z < zEnd; z++)
+                    for (int x = 0; x < width; x++) {
+                        size_t i = (size_t)z * width + x;
+                        falloffHeights[i] = fbmHeights[i] * falloffAt(request, x, z);
+                    }
+            });
+            return true;
+
+        case STAGE_SMOOTHING:
+            smoothedHeights = falloffHeights;
+            smoothHeightPlane(smoothedHeights, width, height, request.smoothing, pool);
+            return true;
+
+        case STAGE_EROSION:
+            erodedHeights = smoothedHeights;
+            return !erodeHeightPlane(erodedHeights, width, height, request.erosion, pool, cancelled).cancelled;
+
+        case STAGE_HYDROLOGY:
+            hydrologyHeights = erodedHeights;
+            hydrologyMaps = HydrologyMaps();
+            if (request.hydrology.enabled) applyHydrology(hydrologyHeights, width, height, request.hydrology, hydrologyMaps, pool);
+            return true;
+
+        case STAGE_NORMALS:
+            // Central differences, one-sided at the border, over 1 unit spacing. While the surface
+            // is still fBm * falloff, vertices whose neighbours share their biome parameters
+            // use the fBm's own slopes instead (product rule, with the falloff ramp differenced
+            // on the grid). Where the parameters change, the noise is stretched by a varying
+            // frequency, which the slopes don't include, so those keep the differences.
+            normalPlane.resize(count);
+            pool.parallelFor(height, 64, [&](int zBegin, int zEnd) {
+                bool analytic = request.smoothing.passes <= 0 && !request.erosion.hydraulic && !request.erosion.thermal
+                    && !request.hydrology.enabled;
+                auto heightAt = [&](int x, int z) { return hydrologyHeights[(size_t)z * width + x]; };
+                std::vector<float> above(width), falloff(width), below(width);
+                for (int z = zBegin; z < zEnd; z++) {
+                    int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, height - 1);
+                    if (analytic)
+                        for (int x = 0; x < width; x++) {
+                            above[x] = falloffAt(request, x, z0);
+                            falloff[x] = falloffAt(request, x, z);
+                            below[x] = falloffAt(request, x, z1);
+                        }
+                    for (int x = 0; x < width; x++) {
+                        size_t i = (size_t)z * width + x;
+                        int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, width - 1);
+                        if (!analytic || !uniformBiome(x0, z0, x1, z1, width, biomeParams[i])) {
+                            normalPlane[i] = packedGridNormal(heightAt, x, z, width, height, 1.0f);
+                            continue;
+                        }
+                        float falloffDx = x1 > x0 ? (falloff[x1] - falloff[x0]) / (x1 - x0) : 0.0f;
+                        float falloffDz = z1 > z0 ? (below[x] - above[x]) / (z1 - z0) : 0.0f;
+                        float dx = fbmSlopeX[i] * falloff[x] + fbmHeights[i] * falloffDx;
+                        float dz = fbmSlopeZ[i] * falloff[x] + fbmHeights[i] * falloffDz;
+                        float inverseLength = 1.0f / std::sqrt(dx * dx + 1.0f + dz * dz);
+                        normalPlane[i] = packTerrainNormal(glm::vec3(-dx, 1.0f, -dz) * inverseLength);
+                    }
+                }
+            });
+            return true;
+
+        case STAGE_MESH:
+            mesh = Heightfield(width, height);
+            mesh.heightPlane() = hydrologyHeights;
+            mesh.biomePlane() = biomes;
+            mesh.normalPlane() = normalPlane;
+            return true;
+
+        case STAGE_SCATTER:
+            scatterOutput = ScatterInstances();
+            if (request.scatter.enabled)
+                scatterInstances(hydrologyHeights, biomes, hydrologyMaps.texels, width, height, request.scatter, scatterOutput, pool);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    // Falloff factor of vertex (x, z): the island mask's when there is one, the rectangle's otherwise
+    float falloffAt(const TerrainRequest& request, int x, int z) const
+    {
+        return islandDistance.empty()
+            ? calculateFalloff(x, z, request.width, request.height, request.falloff.edgeHeight, request.falloff.border)
+            : islandFalloff(islandDistance[(size_t)z * request.width + x], request.falloff);
+    }
+
+    // True when every vertex of [x0, x1] x [z0, z1] has the parameters `centre`
+    bool uniformBiome(int x0, int z0, int x1, int z1, int width, const BiomeParameters& centre) const
+    {
+        for (int z = z0; z <= z1; z++)
+            for (int x = x0; x <= x1; x++)
+                if (std::memcmp(&biomeParams[(size_t)z * width + x], &centre, sizeof(BiomeParameters))) return false;
+        return true;
+    }
+
+    // Heightfield::worldX of a spacing-1 grid, without building one
+    static float gridWorld(int i, int size) { return (float)i - size / 2.0f; }
+
+    // rows(zBegin, zEnd) over bands of 64 rows on the pool, checking cancelled() between bands
+    template <typename RowFunction>
+    static bool forEachBand(int height, const std::function<bool()>& cancelled, ThreadPool& pool, const RowFunction& rows)
+    {
+        const int bandRows = 64;
+        for (int bandBegin = 0; bandBegin < height; bandBegin += bandRows) {
+            if (cancelled()) return false;
+            int bandEnd = std::min(bandBegin + bandRows, height);
+            pool.parallelFor(bandEnd - bandBegin, 8, [&](int begin, int end) { rows(bandBegin + begin, bandBegin + end); });
+        }
+        return true;
+    }
+
+    size_t stageBytes(TerrainStage stage) const
+    {
+        switch (stage) {
+        case STAGE_BIOME_NOISE: return biomeNoise.capacity() * sizeof(float);
+        case STAGE_BIOME_PARAMS: return biomeParams.capacity() * sizeof(BiomeParameters) + biomes.capacity();
+        case STAGE_FBM: return (fbmHeights.capacity() + fbmSlopeX.capacity() + fbmSlopeZ.capacity()) * sizeof(float);
+        case STAGE_ISLAND_MASK: return islandDistance.capacity() * sizeof(float);
+        case STAGE_FALLOFF: return falloffHeights.capacity() * sizeof(float);
+        case STAGE_SMOOTHING: return smoothedHeights.capacity() * sizeof(float);
+        case STAGE_EROSION: return erodedHeights.capacity() * sizeof(float);
+        case STAGE_HYDROLOGY: return hydrologyHeights.capacity() * sizeof(float) + hydrologyMaps.memoryBytes();
+        case STAGE_NORMALS: return normalPlane.capacity() * sizeof(uint32_t);
+        case STAGE_MESH: return mesh.memoryBytes();
+        case STAGE_SCATTER: return scatterOutput.memoryBytes();
+        default: return 0;
+        }
+    }
+
+    bool cached[TERRAIN_STAGE_COUNT] = {};
+    uint64_t cachedKeys[TERRAIN_STAGE_COUNT] = {};
+    TerrainStageStats statistics[TERRAIN_STAGE_COUNT];
+
+    std::vector<float> biomeNoise;
+    std::vector<BiomeParameters> biomeParams;
+    std::vector<uint8_t> biomes;
+    std::vector<float> fbmHeights;
+    std::vector<float> fbmSlopeX, fbmSlopeZ;   // d/dworldX, d/dworldZ of fbmHeights
+    std::vector<float> islandDistance;
+    std::vector<float> falloffHeights;
+    std::vector<float> smoothedHeights;
+    std::vector<float> erodedHeights;
+    std::vector<float> hydrologyHeights;
+    HydrologyMaps hydrologyMaps;
+    std::vector<uint32_t> normalPlane;
+    Heightfield mesh;
+    ScatterInstances scatterOutput;
+};
+
+#endif
@@ -0,0 +1,468 @@
+#ifndef TERRAIN_STREAMING_H
+#define TERRAIN_STREAMING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "noise.h"
+#include "terrain_cache.h"
+
+// Infinite terrain: the world is cut into square chunks that worker threads generate around
+// the camera (nearest and most in front first). Finished chunks are uploaded under a per-frame
+// byte budget and kept in an LRU cache bounded by a memory budget.
+//
+// Noise is sampled in world coordinates and there is no falloff, so neighbouring chunks agree
+// on their shared border vertices. Smoothing runs on the chunk plus an apron of
+// smoothingApron() cells and is cropped afterwards, which keeps the borders identical too.
+//
+// With a cache directory set, workers first try the tile cache (terrain_cache.h): a hit maps
+// the tile file and its vertex section is uploaded as is, a miss generates the chunk and queues
+// it for writing.
+
+struct TerrainStreamSettings {
+    int chunkSize = 64;                 // Cells per chunk side ((chunkSize + 1)^2 vertices)
+    int viewRadius = 6;                 // In chunks
+    size_t memoryBudget = 256u << 20;   // CPU + GPU bytes held by cached chunks
+    size_t uploadBudget = 1u << 20;     // Vertex bytes uploaded per frame (at least one chunk)
+    int workerCount = 0;                // 0: hardware threads - 1 (at least 1)
+
+    // Generation parameters; changing any of them needs clear()
+    float scale = 50.0f;
+    float seed = 1.0f;
+    int octaves = 4;
+    SmoothingSettings smoothing;
+    std::string cacheDirectory = "terrain_cache";   // Empty disables the disk cache
+    float cacheMaxError = -1.0f;    // < 0 raw mappable tiles, 0 lossless compressed, > 0 bounded-error compressed
+};
+
+struct TerrainStreamStats {
+    int cachedChunks = 0;
+    int uploadedChunks = 0;
+    int queuedChunks = 0;
+    int generatingChunks = 0;
+    int uploadsLastFrame = 0;
+    int drawnChunks = 0;
+    size_t cpuBytes = 0;
+    size_t gpuBytes = 0;
+    uint64_t generatedTotal = 0;
+    uint64_t evictedTotal = 0;
+    uint64_t cacheHits = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t cacheWrites = 0;
+};
+
+struct TerrainChunk {
+    int chunkX = 0, chunkZ = 0;
+    std::vector<float> heights;     // (chunkSize + 1)^2, row-major
+    std::vector<uint8_t> biomes;
+    std::vector<float> vertices;    // World-space xyz, freed after upload
+    std::unique_ptr<MappedTerrainTile> mapped;  // Replaces vertices for chunks read from the disk cache
+    GLuint VAO = 0, VBO = 0;
+    uint64_t lastUsedFrame = 0;
+
+    size_t cpuBytes() const
+    {
+        return heights.capacity() * sizeof(float) + biomes.capacity() + vertices.capacity() * sizeof(float)
+            + (mapped ? mapped->file.bytes() : 0);
+    }
+    const float* vertexData() const { return mapped ? mapped->vertices : vertices.data(); }
+    size_t vertexBytes() const { return mapped ? heights.size() * 3 * sizeof(float) : vertices.size() * sizeof(float); }
+    size_t gpuBytes() const { return VBO ? heights.size() * 3 * sizeof(float) : 0; }
+};
+
+// Heights, biomes and world-space vertices of one chunk
+TerrainChunk generateTerrainChunk(int chunkX, int chunkZ, const TerrainStreamSettings& settings, const BiomeTable& biomeTable,
+    ThreadPool& pool) {
+    TerrainChunk chunk;
+    chunk.chunkX = chunkX;
+    chunk.chunkZ = chunkZ;
+
+    int apron = smoothingApron(settings.smoothing);
+    int side = settings.chunkSize + 1;
+    int blockSide = side + 2 * apron;
+    int originX = chunkX * settings.chunkSize, originZ = chunkZ * settings.chunkSize;
+
+    std::vector<float> block((size_t)blockSide * blockSide);
+    std::vector<uint8_t> blockBiomes(block.size());
+    sampleTerrainBlock((float)(originX - apron), (float)(originZ - apron), blockSide, blockSide, settings.scale, settings.seed,
+        settings.octaves, biomeTable, false, block.data(), blockBiomes.data(), pool);
+    smoothHeightPlane(block, blockSide, blockSide, settings.smoothing, pool);
+
+    chunk.heights.resize((size_t)side * side);
+    chunk.biomes.resize((size_t)side * side);
+    chunk.vertices.resize((size_t)side * side * 3);
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            size_t source = (size_t)(z + apron) * blockSide + x + apron;
+            size_t index = (size_t)z * side + x;
+            chunk.heights[index] = block[source];
+            chunk.biomes[index] = blockBiomes[source];
+            chunk.vertices[index * 3] = (float)(originX + x);
+            chunk.vertices[index * 3 + 1] = block[source];
+            chunk.vertices[index * 3 + 2] = (float)(originZ + z);
+        }
+    }
+    return chunk;
+}
+
+TerrainChunk loadTerrainChunk(std::unique_ptr<MappedTerrainTile> tile) {
+    TerrainChunk chunk;
+    chunk.chunkX = tile->header.chunkX;
+    chunk.chunkZ = tile->header.chunkZ;
+    int side = (int)tile->header.side;
+    size_t count = (size_t)side * side;
+    chunk.heights.assign(tile->heights, tile->heights + count);
+    chunk.biomes.assign(tile->biomes, tile->biomes + count);
+    if (tile->vertices) {
+        chunk.mapped = std::move(tile);
+        return chunk;
+    }
+
+    // Compressed tiles carry no vertices
+    chunk.vertices.resize(count * 3);
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            size_t index = (size_t)z * side + x;
+            chunk.vertices[index * 3] = (float)(chunk.chunkX * (side - 1) + x);
+            chunk.vertices[index * 3 + 1] = chunk.heights[index];
+            chunk.vertices[index * 3 + 2] = (float)(chunk.chunkZ * (side - 1) + z);
+        }
+    }
+    return chunk;
+}
+
+class TerrainStreamer
+{
+public:
+    // The worker threads start with the first update(), so a streamer that is never enabled costs nothing
+    explicit TerrainStreamer(const TerrainStreamSettings& streamSettings)
+        : settings(streamSettings), serialPool(1)
+    {
+    }
+
+    ~TerrainStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+        clear();
+    }
+
+    TerrainStreamer(const TerrainStreamer&) = delete;
+    TerrainStreamer& operator=(const TerrainStreamer&) = delete;
+
+    // Budgets and view radius can change at any time; generation parameters need clear()
+    TerrainStreamSettings settings;
+
+    // Drop every cached chunk (GL objects included) and any queued or running work.
+    // Needs the GL context current.
+    void clear()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.clear();
+            completed.clear();
+            inFlight.clear();
+            generation++;
+            // Generation parameters are copied under the lock so workers never see a half-written struct
+            jobSettings = settings;
+            jobBiomes = std::make_shared<const BiomeTable>(activeBiomeTable());
+            jobCache.reset();
+            if (!settings.cacheDirectory.empty()) {
+                uint64_t hash = terrainParameterHash(settings.chunkSize, settings.scale, settings.seed, settings.octaves,
+                    settings.smoothing, *jobBiomes);
+                jobCache = std::make_shared<TerrainTileCache>(settings.cacheDirectory, hash, settings.chunkSize + 1, settings.cacheMaxError);
+            }
+        }
+        for (auto& entry : chunks)
+            releaseGL(entry.second);
+        chunks.clear();
+    }
+
+    // Once per frame, on the GL thread: reprioritise the wanted chunks, collect finished ones,
+    // upload within the budget and evict down to the memory budget
+    void update(const glm::vec3& cameraPos, const glm::vec3& cameraFront)
+    {
+        frame++;
+        if (!initialised) {
+            clear();
+            int workerCount = settings.workerCount > 0 ? settings.workerCount : (int)std::thread::hardware_concurrency() - 1;
+            for (int i = 0; i < std::max(1, workerCount); i++)
+                workers.emplace_back([this] { workerLoop(); });
+            initialised = true;
+        }
+        buildSharedIndices();
+
+        int cameraChunkX = (int)std::floor(cameraPos.x / settings.chunkSize);
+        int cameraChunkZ = (int)std::floor(cameraPos.z / settings.chunkSize);
+        glm::vec2 viewDir(cameraFront.x, cameraFront.z);
+        viewDir = glm::length(viewDir) > 1e-4f ? glm::normalize(viewDir) : glm::vec2(0.0f);
+
+        {
+            // Finished chunks are collected under the same lock the queue is rebuilt in, so a chunk
+            // that completes in between is never requested twice
+            std::lock_guard<std::mutex> lock(queueMutex);
+            for (TerrainChunk& chunk : completed) {
+                stats.generatedTotal++;
+                chunks[key(chunk.chunkX, chunk.chunkZ)] = std::move(chunk);
+            }
+            completed.clear();
+
+            // Missing chunks inside the radius, highest priority at the back
+            queue.clear();
+            int radius = settings.viewRadius;
+            for (int dz = -radius; dz <= radius; dz++) {
+                for (int dx = -radius; dx <= radius; dx++) {
+                    if (dx * dx + dz * dz > radius * radius) continue;
+                    int cx = cameraChunkX + dx, cz = cameraChunkZ + dz;
+                    auto found = chunks.find(key(cx, cz));
+                    if (found != chunks.end()) {
+                        found->second.lastUsedFrame = frame;
+                        continue;
+                    }
+                    if (inFlight.count(key(cx, cz))) continue;
+                    glm::vec2 toChunk((cx + 0.5f) * settings.chunkSize - cameraPos.x, (cz + 0.5f) * settings.chunkSize - cameraPos.z);
+                    float distance = glm::length(toChunk) / settings.chunkSize;
+                    float facing = distance > 1e-4f ? glm::dot(toChunk / (distance * settings.chunkSize), viewDir) : 1.0f;
+                    // Chunks behind the camera count as up to twice as far away
+                    queue.push_back({ cx, cz, distance * (1.5f - 0.5f * facing) });
+                }
+            }
+            std::sort(queue.begin(), queue.end(), [](const Request& a, const Request& b) { return a.priority > b.priority; });
+
+            stats.queuedChunks = (int)queue.size();
+            stats.generatingChunks = (int)inFlight.size();
+            if (jobCache) {
+                stats.cacheHits = jobCache->stats.hits;
+                stats.cacheMisses = jobCache->stats.misses + jobCache->stats.rejected;
+                stats.cacheWrites = jobCache->stats.written;
+            }
+        }
+        if (stats.queuedChunks > 0)
+            queueCondition.notify_all();
+
+        uploadWithinBudget(cameraPos);
+        evictToBudget();
+
+        stats.cachedChunks = (int)chunks.size();
+        stats.uploadedChunks = 0;
+        stats.cpuBytes = stats.gpuBytes = 0;
+        for (auto& entry : chunks) {
+            stats.uploadedChunks += entry.second.VAO != 0;
+            stats.cpuBytes += entry.second.cpuBytes();
+            stats.gpuBytes += entry.second.gpuBytes();
+        }
+    }
+
+    // Draws the uploaded chunks inside the view radius; the caller binds the shader
+    void draw(const glm::vec3& cameraPos)
+    {
+        stats.drawnChunks = 0;
+        float maxDistance = (settings.viewRadius + 1.0f) * settings.chunkSize;
+        for (auto& entry : chunks) {
+            const TerrainChunk& chunk = entry.second;
+            if (!chunk.VAO) continue;
+            glm::vec2 center((chunk.chunkX + 0.5f) * settings.chunkSize, (chunk.chunkZ + 0.5f) * settings.chunkSize);
+            if (glm::length(center - glm::vec2(cameraPos.x, cameraPos.z)) > maxDistance) continue;
+            glBindVertexArray(chunk.VAO);
+            glDrawElements(GL_TRIANGLES, (GLsizei)sharedIndexCount, GL_UNSIGNED_INT, 0);
+            stats.drawnChunks++;
+        }
+        glBindVertexArray(0);
+    }
+
+    // Height of the cached terrain at a world position, if its chunk is loaded
+    bool heightAt(float worldX, float worldZ, float& height) const
+    {
+        int cx = (int)std::floor(worldX / settings.chunkSize), cz = (int)std::floor(worldZ / settings.chunkSize);
+        auto found = chunks.find(key(cx, cz));
+        if (found == chunks.end()) return false;
+        int side = settings.chunkSize + 1;
+        int x = std::min(side - 1, std::max(0, (int)std::floor(worldX) - cx * settings.chunkSize));
+        int z = std::min(side - 1, std::max(0, (int)std::floor(worldZ) - cz * settings.chunkSize));
+        height = found->second.heights[(size_t)z * side + x];
+        return true;
+    }
+
+    const TerrainStreamStats& getStats() const { return stats; }
+
+private:
+    struct Request {
+        int chunkX, chunkZ;
+        float priority;   // Lower is sooner
+    };
+
+    static uint64_t key(int chunkX, int chunkZ) { return ((uint64_t)(uint32_t)chunkX << 32) | (uint32_t)chunkZ; }
+
+    void workerLoop()
+    {
+        for (;;) {
+            Request request;
+            uint64_t jobGeneration;
+            TerrainStreamSettings localSettings;
+            std::shared_ptr<const BiomeTable> biomeTable;
+            std::shared_ptr<TerrainTileCache> cache;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping) return;
+                request = queue.back();
+                queue.pop_back();
+                inFlight.insert({ key(request.chunkX, request.chunkZ), true });
+                jobGeneration = generation;
+                localSettings = jobSettings;
+                biomeTable = jobBiomes;
+                cache = jobCache;
+            }
+
+            TerrainChunk chunk;
+            std::unique_ptr<MappedTerrainTile> tile;
+            if (cache) tile = cache->load(request.chunkX, request.chunkZ);
+            if (tile) {
+                chunk = loadTerrainChunk(std::move(tile));
+            }
+            else {
+                chunk = generateTerrainChunk(request.chunkX, request.chunkZ, localSettings, *biomeTable, serialPool);
+                if (cache) cache->store(chunk.chunkX, chunk.chunkZ, chunk.heights.data(), chunk.biomes.data(), chunk.vertices.data());
+            }
+
+            std::lock_guard<std::mutex> lock(queueMutex);
+            // Results of a cleared generation are dropped
+            if (jobGeneration != generation) continue;
+            inFlight.erase(key(request.chunkX, request.chunkZ));
+            completed.push_back(std::move(chunk));
+        }
+    }
+
+    // Every chunk has the same grid, so they share one index buffer
+    void buildSharedIndices()
+    {
+        if (sharedEBO && sharedIndexChunkSize == settings.chunkSize) return;
+        int side = settings.chunkSize + 1;
+        std::vector<unsigned int> indices;
+        indices.reserve((size_t)settings.chunkSize * settings.chunkSize * 6);
+        for (int z = 0; z < settings.chunkSize; z++) {
+            for (int x = 0; x < settings.chunkSize; x++) {
+                unsigned int topLeft = z * side + x;
+                unsigned int topRight = topLeft + 1;
+                unsigned int bottomLeft = (z + 1) * side + x;
+                unsigned int bottomRight = bottomLeft + 1;
+                indices.insert(indices.end(), { topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight });
+            }
+        }
+        if (!sharedEBO) glGenBuffers(1, &sharedEBO);
+        // Element buffer bindings belong to a VAO, so bind one while uploading
+        GLuint scratchVAO;
+        glGenVertexArrays(1, &scratchVAO);
+        glBindVertexArray(scratchVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glDeleteVertexArrays(1, &scratchVAO);
+        sharedIndexCount = indices.size();
+        sharedIndexChunkSize = settings.chunkSize;
+    }
+
+    void uploadWithinBudget(const glm::vec3& cameraPos)
+    {
+        std::vector<TerrainChunk*> pending;
+        for (auto& entry : chunks)
+            if (!entry.second.VAO) pending.push_back(&entry.second);
+        glm::vec2 camera(cameraPos.x, cameraPos.z);
+        auto distance = [&](const TerrainChunk* c) {
+            return glm::length(glm::vec2((c->chunkX + 0.5f) * settings.chunkSize, (c->chunkZ + 0.5f) * settings.chunkSize) - camera);
+        };
+        std::sort(pending.begin(), pending.end(), [&](const TerrainChunk* a, const TerrainChunk* b) { return distance(a) < distance(b); });
+
+        size_t uploadedBytes = 0;
+        stats.uploadsLastFrame = 0;
+        for (TerrainChunk* chunk : pending) {
+            size_t bytes = chunk->vertexBytes();
+            if (stats.uploadsLastFrame > 0 && uploadedBytes + bytes > settings.uploadBudget) break;
+
+            glGenVertexArrays(1, &chunk->VAO);
+            glGenBuffers(1, &chunk->VBO);
+            glBindVertexArray(chunk->VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, chunk->VBO);
+            glBufferData(GL_ARRAY_BUFFER, bytes, chunk->vertexData(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedEBO);
+            glBindVertexArray(0);
+            std::vector<float>().swap(chunk->vertices);
+            chunk->mapped.reset();
+
+            uploadedBytes += bytes;
+            stats.uploadsLastFrame++;
+        }
+    }
+
+    // Least recently used first; chunks wanted this frame are never evicted
+    void evictToBudget()
+    {
+        size_t total = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> byAge;
+        for (auto& entry : chunks) {
+            total += entry.second.cpuBytes() + entry.second.gpuBytes();
+            if (entry.second.lastUsedFrame != frame)
+                byAge.push_back({ entry.second.lastUsedFrame, entry.first });
+        }
+        if (total <= settings.memoryBudget) return;
+
+        std::sort(byAge.begin(), byAge.end());
+        for (auto& old : byAge) {
+            if (total <= settings.memoryBudget) break;
+            TerrainChunk& chunk = chunks[old.second];
+            total -= chunk.cpuBytes() + chunk.gpuBytes();
+            releaseGL(chunk);
+            chunks.erase(old.second);
+            stats.evictedTotal++;
+        }
+    }
+
+    static void releaseGL(TerrainChunk& chunk)
+    {
+        if (chunk.VBO) glDeleteBuffers(1, &chunk.VBO);
+        if (chunk.VAO) glDeleteVertexArrays(1, &chunk.VAO);
+        chunk.VBO = chunk.VAO = 0;
+    }
+
+    std::unordered_map<uint64_t, TerrainChunk> chunks;   // Owned by the GL thread
+    TerrainStreamStats stats;
+    uint64_t frame = 0;
+    bool initialised = false;
+
+    GLuint sharedEBO = 0;
+    size_t sharedIndexCount = 0;
+    int sharedIndexChunkSize = 0;
+
+    // Shared with the workers, guarded by queueMutex
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::vector<Request> queue;
+    std::vector<TerrainChunk> completed;
+    std::unordered_map<uint64_t, bool> inFlight;
+    uint64_t generation = 0;
+    TerrainStreamSettings jobSettings;
+    std::shared_ptr<const BiomeTable> jobBiomes;
+    std::shared_ptr<TerrainTileCache> jobCache;
+    bool stopping = false;
+
+    ThreadPool serialPool;   // No threads: each chunk is generated on the worker that picked it
+    std::vector<std::thread> workers;
+};
+
+#endif
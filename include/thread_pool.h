@@ -0,0 +1,130 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed-size worker pool shared by the CPU simulation/generation code.
+// parallelFor() is the main entry point: the calling thread works on chunks too,
+// so it is safe to call from inside another pool task without deadlocking.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        // The caller always participates, so spawn one less worker
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that take part in a parallelFor (workers + caller)
+    unsigned int size() const { return (unsigned int)workers.size() + 1; }
+
+    // Queue a fire-and-forget job
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobs.push_back(std::move(job));
+        }
+        queueCondition.notify_one();
+    }
+
+    // Calls body(begin, end) for consecutive ranges of at most `grain` items covering [0, count)
+    // and blocks until every range has finished.
+    void parallelFor(int count, int grain, const std::function<void(int, int)>& body)
+    {
+        if (count <= 0) return;
+        grain = std::max(1, grain);
+        int chunkCount = (count + grain - 1) / grain;
+
+        if (chunkCount == 1 || workers.empty()) {
+            for (int begin = 0; begin < count; begin += grain)
+                body(begin, std::min(count, begin + grain));
+            return;
+        }
+
+        struct ForState {
+            std::atomic<int> nextChunk{ 0 };
+            std::atomic<int> finishedChunks{ 0 };
+            std::mutex doneMutex;
+            std::condition_variable doneCondition;
+        };
+        auto state = std::make_shared<ForState>();
+
+        // Helpers that start late simply find no chunk left; `state` keeps them valid
+        auto runChunks = [state, count, grain, chunkCount, &body]() {
+            int chunk;
+            while ((chunk = state->nextChunk.fetch_add(1)) < chunkCount) {
+                int begin = chunk * grain;
+                body(begin, std::min(count, begin + grain));
+                if (state->finishedChunks.fetch_add(1) + 1 == chunkCount) {
+                    std::lock_guard<std::mutex> lock(state->doneMutex);
+                    state->doneCondition.notify_all();
+                }
+            }
+        };
+
+        int helpers = std::min((int)workers.size(), chunkCount - 1);
+        for (int i = 0; i < helpers; i++)
+            submit(runChunks);
+        runChunks();
+
+        std::unique_lock<std::mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&] { return state->finishedChunks.load() == chunkCount; });
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+};
+
+// Process-wide pool used by the terrain and water code
+ThreadPool& globalThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif
@@ -0,0 +1,412 @@
+#ifndef TILE_CODEC_H
+#define TILE_CODEC_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include "noise.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TILE_CODEC_SSE2 1
+#endif
+
+// Compression for terrain tiles (any row-major plane of heights or biomes).
+//
+//   1. Values become 32-bit integers: the bit pattern of each float, remapped so integer order
+//      matches float order (lossless), or round((h - min) / step) (lossy, |error| <= maxError).
+//   2. 2D prediction: each value is predicted as left + up - upLeft, which is exact on planes
+//      and leaves small residuals on smooth terrain. Residuals are zigzag-coded to unsigned.
+//   3. Bit-packing: blocks of 128 residuals are stored with the smallest bit width that holds
+//      the largest one. Values are interleaved over four 32-bit lanes (value i in lane i % 4),
+//      so SSE2 unpacks four at a time with the same shifts in every lane.
+//
+// Decoding is unpack, a prefix sum along each row plus the row above, and the inverse value
+// mapping; all three run four lanes wide.
+
+const uint32_t TILE_CODEC_MAGIC = 0x31435448; // "HTC1"
+const int TILE_CODEC_BLOCK = 128;
+
+enum TileCodecMode {
+    TILE_CODEC_FLOAT_LOSSLESS,  // Exact float bits
+    TILE_CODEC_QUANTISED,       // value * step + offset
+    TILE_CODEC_BYTES            // uint8 planes (biomes)
+};
+
+struct TileCodecHeader {
+    uint32_t magic;
+    uint32_t mode;
+    int32_t width, height;
+    float offset, step;
+    uint32_t blockCount;
+    uint32_t payloadBytes;  // Packed words after the width table
+};
+static_assert(sizeof(TileCodecHeader) == 32, "codec header must stay 32 bytes");
+
+// Integer order equals float order; the mapping is its own inverse
+inline uint32_t orderedFloatBits(uint32_t bits) {
+    return bits ^ ((uint32_t)((int32_t)bits >> 31) & 0x7FFFFFFFu);
+}
+
+inline uint32_t zigzagEncode(uint32_t value) { return (value << 1) ^ (uint32_t)((int32_t)value >> 31); }
+inline uint32_t zigzagDecode(uint32_t value) { return (value >> 1) ^ (0u - (value & 1u)); }
+
+inline size_t tileCodecWidthTableBytes(uint32_t blockCount) { return (blockCount + 3) & ~3u; }
+
+// Predict, zigzag and bit-pack width * height integers. Arithmetic wraps, which the decoder
+// undoes exactly.
+std::vector<uint8_t> encodeTileValues(const uint32_t* values, int width, int height, TileCodecMode mode, float offset, float step) {
+    size_t count = (size_t)width * height;
+    uint32_t blockCount = (uint32_t)((count + TILE_CODEC_BLOCK - 1) / TILE_CODEC_BLOCK);
+    std::vector<uint32_t> residuals((size_t)blockCount * TILE_CODEC_BLOCK, 0);
+    for (int z = 0; z < height; z++) {
+        for (int x = 0; x < width; x++) {
+            size_t i = (size_t)z * width + x;
+            uint32_t left = x > 0 ? values[i - 1] : 0;
+            uint32_t up = z > 0 ? values[i - width] : 0;
+            uint32_t upLeft = x > 0 && z > 0 ? values[i - width - 1] : 0;
+            residuals[i] = zigzagEncode(values[i] - (left + up - upLeft));
+        }
+    }
+
+    std::vector<uint8_t> widths(tileCodecWidthTableBytes(blockCount), 0);
+    std::vector<uint32_t> packed;
+    for (uint32_t block = 0; block < blockCount; block++) {
+        const uint32_t* in = &residuals[(size_t)block * TILE_CODEC_BLOCK];
+        uint32_t any = 0;
+        for (int i = 0; i < TILE_CODEC_BLOCK; i++) any |= in[i];
+        int bits = 0;
+        while (bits < 32 && (any >> bits) != 0) bits++;
+        widths[block] = (uint8_t)bits;
+
+        size_t base = packed.size();
+        packed.resize(base + (size_t)bits * 4, 0);
+        for (int i = 0; i < TILE_CODEC_BLOCK && bits > 0; i++) {
+            int lane = i & 3, position = (i >> 2) * bits;
+            int word = position >> 5, shift = position & 31;
+            packed[base + word * 4 + lane] |= in[i] << shift;
+            if (shift + bits > 32)
+                packed[base + (word + 1) * 4 + lane] |= in[i] >> (32 - shift);
+        }
+    }
+
+    TileCodecHeader header = { TILE_CODEC_MAGIC, (uint32_t)mode, width, height, offset, step, blockCount,
+        (uint32_t)(packed.size() * sizeof(uint32_t)) };
+    std::vector<uint8_t> out(sizeof(header) + widths.size() + packed.size() * sizeof(uint32_t));
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + sizeof(header), widths.data(), widths.size());
+    if (!packed.empty())
+        memcpy(out.data() + sizeof(header) + widths.size(), packed.data(), packed.size() * sizeof(uint32_t));
+    return out;
+}
+
+// maxError 0 is lossless; otherwise every decoded height is within maxError. Falls back to
+// lossless when the error bound is too fine to quantise the range in 32 bits.
+std::vector<uint8_t> encodeHeightTile(const float* heights, int width, int height, float maxError = 0.0f) {
+    size_t count = (size_t)width * height;
+    std::vector<uint32_t> values(count);
+    if (maxError > 0.0f && count > 0) {
+        auto range = std::minmax_element(heights, heights + count);
+        float offset = *range.first;
+        // A little under 2 * maxError leaves room for float rounding in the decoder
+        float step = maxError * 1.998f;
+        bool fits = (*range.second - offset) / step < 2147483647.0f;
+        for (size_t i = 0; fits && i < count; i++) {
+            values[i] = (uint32_t)std::lround((heights[i] - offset) / step);
+            fits = std::fabs((float)(int32_t)values[i] * step + offset - heights[i]) <= maxError;
+        }
+        if (fits)
+            return encodeTileValues(values.data(), width, height, TILE_CODEC_QUANTISED, offset, step);
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t bits;
+        memcpy(&bits, &heights[i], sizeof(bits));
+        values[i] = orderedFloatBits(bits);
+    }
+    return encodeTileValues(values.data(), width, height, TILE_CODEC_FLOAT_LOSSLESS, 0.0f, 0.0f);
+}
+
+// Lossless for Heightfield::HEIGHT_UINT16 planes: decodes to quantised * scale + offset
+std::vector<uint8_t> encodeQuantisedTile(const uint16_t* quantised, int width, int height, float scale, float offset) {
+    std::vector<uint32_t> values(quantised, quantised + (size_t)width * height);
+    return encodeTileValues(values.data(), width, height, TILE_CODEC_QUANTISED, offset, scale);
+}
+
+std::vector<uint8_t> encodeBiomeTile(const uint8_t* biomes, int width, int height) {
+    std::vector<uint32_t> values(biomes, biomes + (size_t)width * height);
+    return encodeTileValues(values.data(), width, height, TILE_CODEC_BYTES, 0.0f, 1.0f);
+}
+
+bool readTileCodecHeader(const uint8_t* data, size_t size, TileCodecHeader& header) {
+    if (size < sizeof(TileCodecHeader)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != TILE_CODEC_MAGIC || header.width < 0 || header.height < 0 || header.mode > TILE_CODEC_BYTES)
+        return false;
+    size_t count = (size_t)header.width * header.height;
+    return header.blockCount == (count + TILE_CODEC_BLOCK - 1) / TILE_CODEC_BLOCK
+        && size >= sizeof(header) + tileCodecWidthTableBytes(header.blockCount) + header.payloadBytes;
+}
+
+// Unpack one block of zigzagged residuals; the bit width is a template argument so every
+// shift and mask is a constant
+template<int Bits>
+void unpackTileBlock(const uint32_t* packed, uint32_t* out) {
+#ifdef TILE_CODEC_SSE2
+    if (Bits == 0) {
+        memset(out, 0, TILE_CODEC_BLOCK * sizeof(uint32_t));
+        return;
+    }
+    const __m128i mask = _mm_set1_epi32(Bits == 32 ? -1 : (int)((1u << (Bits & 31)) - 1));
+    const __m128i* words = reinterpret_cast<const __m128i*>(packed);
+    for (int j = 0; j < TILE_CODEC_BLOCK / 4; j++) {
+        const int position = j * Bits, word = position >> 5, shift = position & 31;
+        __m128i value = _mm_srli_epi32(_mm_loadu_si128(words + word), shift);
+        if (shift + Bits > 32)
+            value = _mm_or_si128(value, _mm_slli_epi32(_mm_loadu_si128(words + word + 1), 32 - shift));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j * 4), _mm_and_si128(value, mask));
+    }
+#else
+    const uint32_t mask = Bits == 32 ? 0xFFFFFFFFu : (1u << (Bits & 31)) - 1;
+    for (int i = 0; i < TILE_CODEC_BLOCK; i++) {
+        if (Bits == 0) {
+            out[i] = 0;
+            continue;
+        }
+        int lane = i & 3, position = (i >> 2) * Bits;
+        int word = position >> 5, shift = position & 31;
+        uint32_t value = packed[word * 4 + lane] >> shift;
+        if (shift + Bits > 32)
+            value |= packed[(word + 1) * 4 + lane] << ((32 - shift) & 31);
+        out[i] = value & mask;
+    }
+#endif
+}
+
+typedef void (*UnpackTileBlockFunction)(const uint32_t*, uint32_t*);
+
+const UnpackTileBlockFunction unpackTileBlockTable[33] = {
+    unpackTileBlock<0>, unpackTileBlock<1>, unpackTileBlock<2>, unpackTileBlock<3>, unpackTileBlock<4>,
+    unpackTileBlock<5>, unpackTileBlock<6>, unpackTileBlock<7>, unpackTileBlock<8>, unpackTileBlock<9>,
+    unpackTileBlock<10>, unpackTileBlock<11>, unpackTileBlock<12>, unpackTileBlock<13>, unpackTileBlock<14>,
+    unpackTileBlock<15>, unpackTileBlock<16>, unpackTileBlock<17>, unpackTileBlock<18>, unpackTileBlock<19>,
+    unpackTileBlock<20>, unpackTileBlock<21>, unpackTileBlock<22>, unpackTileBlock<23>, unpackTileBlock<24>,
+    unpackTileBlock<25>, unpackTileBlock<26>, unpackTileBlock<27>, unpackTileBlock<28>, unpackTileBlock<29>,
+    unpackTileBlock<30>, unpackTileBlock<31>, unpackTileBlock<32>
+};
+
+// Residuals back to values, one row at a time: value = up + prefix sum of the row's residuals
+void reconstructTileRow(const uint32_t* residuals, const uint32_t* up, uint32_t* row, int width) {
+    int x = 0;
+    uint32_t carry = 0;
+#ifdef TILE_CODEC_SSE2
+    __m128i running = _mm_setzero_si128();
+    for (; x + 4 <= width; x += 4) {
+        __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(residuals + x));
+        __m128i r = _mm_xor_si128(_mm_srli_epi32(u, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(u, _mm_set1_epi32(1))));
+        r = _mm_add_epi32(r, _mm_slli_si128(r, 4));
+        r = _mm_add_epi32(r, _mm_slli_si128(r, 8));
+        r = _mm_add_epi32(r, running);
+        running = _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i above = up ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x)) : _mm_setzero_si128();
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), _mm_add_epi32(r, above));
+    }
+    carry = (uint32_t)_mm_cvtsi128_si32(running);
+#endif
+    for (; x < width; x++) {
+        carry += zigzagDecode(residuals[x]);
+        row[x] = carry + (up ? up[x] : 0);
+    }
+}
+
+// Inverse of the value mapping, for one row
+void tileValuesToFloats(const uint32_t* values, float* out, int count, TileCodecMode mode, float offset, float step) {
+    int i = 0;
+#ifdef TILE_CODEC_SSE2
+    if (mode == TILE_CODEC_FLOAT_LOSSLESS) {
+        const __m128i magnitude = _mm_set1_epi32(0x7FFFFFFF);
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+            v = _mm_xor_si128(v, _mm_and_si128(_mm_srai_epi32(v, 31), magnitude));
+            _mm_storeu_ps(out + i, _mm_castsi128_ps(v));
+        }
+    }
+    else {
+        const __m128 scale = _mm_set1_ps(step), bias = _mm_set1_ps(offset);
+        for (; i + 4 <= count; i += 4) {
+            __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(v, scale), bias));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (mode == TILE_CODEC_FLOAT_LOSSLESS) {
+            uint32_t bits = orderedFloatBits(values[i]);
+            memcpy(&out[i], &bits, sizeof(bits));
+        }
+        else {
+            out[i] = (float)(int32_t)values[i] * step + offset;
+        }
+    }
+}
+
+// Unpacks the stream and hands every reconstructed row to rowSink(z, values); false if the
+// stream is malformed. Scratch buffers are per thread, so decoding a tile does not allocate.
+template<typename RowSink>
+bool decodeTileRows(const uint8_t* data, size_t size, TileCodecHeader& header, RowSink rowSink) {
+    if (!readTileCodecHeader(data, size, header)) return false;
+    const uint8_t* widths = data + sizeof(header);
+    const uint8_t* payload = widths + tileCodecWidthTableBytes(header.blockCount);
+
+    // The width table is padded to 4 bytes, so the words are aligned whenever the stream is
+    const uint32_t* packed = reinterpret_cast<const uint32_t*>(payload);
+    thread_local std::vector<uint32_t> residuals, rows;
+    residuals.resize((size_t)header.blockCount * TILE_CODEC_BLOCK);
+    size_t word = 0;
+    for (uint32_t block = 0; block < header.blockCount; block++) {
+        if (widths[block] > 32 || (word + widths[block] * 4) * sizeof(uint32_t) > header.payloadBytes) return false;
+        unpackTileBlockTable[widths[block]](packed + word, residuals.data() + (size_t)block * TILE_CODEC_BLOCK);
+        word += widths[block] * 4;
+    }
+
+    // Two rows of values: the one being rebuilt and the one above it
+    rows.resize((size_t)header.width * 2);
+    for (int z = 0; z < header.height; z++) {
+        uint32_t* row = rows.data() + (size_t)(z & 1) * header.width;
+        const uint32_t* up = z > 0 ? rows.data() + (size_t)((z - 1) & 1) * header.width : nullptr;
+        reconstructTileRow(residuals.data() + (size_t)z * header.width, up, row, header.width);
+        rowSink(z, row);
+    }
+    return true;
+}
+
+// Any height mode to floats; out holds width * height values
+bool decodeHeightTile(const uint8_t* data, size_t size, float* out) {
+    TileCodecHeader header;
+    if (!readTileCodecHeader(data, size, header) || header.mode == TILE_CODEC_BYTES) return false;
+    return decodeTileRows(data, size, header, [&](int z, const uint32_t* row) {
+        tileValuesToFloats(row, out + (size_t)z * header.width, header.width, (TileCodecMode)header.mode, header.offset, header.step);
+    });
+}
+
+bool decodeBiomeTile(const uint8_t* data, size_t size, uint8_t* out) {
+    TileCodecHeader header;
+    if (!readTileCodecHeader(data, size, header) || header.mode != TILE_CODEC_BYTES) return false;
+    return decodeTileRows(data, size, header, [&](int z, const uint32_t* row) {
+        uint8_t* dst = out + (size_t)z * header.width;
+        for (int x = 0; x < header.width; x++)
+            dst[x] = (uint8_t)row[x];
+    });
+}
+
+// TerrainData in compressed form: heights and biomes only, the mesh is rebuilt on decompression
+struct CompressedTerrain {
+    int width = 0, height = 0;
+    std::vector<uint8_t> heights;
+    std::vector<uint8_t> biomes;
+
+    size_t bytes() const { return heights.size() + biomes.size(); }
+};
+
+CompressedTerrain compressTerrainData(const TerrainData& terrain, int width, int height, float maxError = 0.0f) {
+    CompressedTerrain compressed;
+    compressed.width = width;
+    compressed.height = height;
+    size_t count = (size_t)width * height;
+    std::vector<float> heights(count);
+    std::vector<uint8_t> biomes(count);
+    for (size_t i = 0; i < count; i++) {
+        heights[i] = terrain.vertices[i * 3 + 1];
+        biomes[i] = (uint8_t)terrain.biomeMap[i];
+    }
+    compressed.heights = encodeHeightTile(heights.data(), width, height, maxError);
+    compressed.biomes = encodeBiomeTile(biomes.data(), width, height);
+    return compressed;
+}
+
+bool decompressHeightfield(const CompressedTerrain& compressed, Heightfield& heightfield) {
+    heightfield = Heightfield(compressed.width, compressed.height);
+    return decodeHeightTile(compressed.heights.data(), compressed.heights.size(), heightfield.heightPlane().data())
+        && decodeBiomeTile(compressed.biomes.data(), compressed.biomes.size(), heightfield.biomePlane().data());
+}
+
+TerrainData decompressTerrainData(const CompressedTerrain& compressed, ThreadPool& pool = globalThreadPool()) {
+    Heightfield heightfield;
+    if (!decompressHeightfield(compressed, heightfield)) return TerrainData();
+    return toTerrainData(heightfield, pool);
+}
+
+// Compression ratio and decode throughput over the tiles of a generated terrain, against
+// reading the same raw tiles back from a file
+void runTileCodecReport(int size = 1025, int tileSide = 65) {
+    Heightfield terrain = generateHeightfield(size, size, 50.0f, 1.0f, 4);
+    const std::vector<float>& plane = terrain.heightPlane();
+
+    std::vector<std::vector<float>> tiles;
+    for (int tz = 0; tz + tileSide <= size; tz += tileSide - 1) {
+        for (int tx = 0; tx + tileSide <= size; tx += tileSide - 1) {
+            std::vector<float> tile((size_t)tileSide * tileSide);
+            for (int z = 0; z < tileSide; z++)
+                memcpy(&tile[(size_t)z * tileSide], &plane[(size_t)(tz + z) * size + tx], tileSide * sizeof(float));
+            tiles.push_back(tile);
+        }
+    }
+    size_t rawBytes = tiles.size() * tiles[0].size() * sizeof(float);
+    std::cout << "Tile codec report, " << tiles.size() << " tiles of " << tileSide << "x" << tileSide << " from a "
+        << size << "x" << size << " terrain" << std::endl;
+
+    // Raw tiles read back from a file (page cache, so the best case for uncompressed storage)
+    {
+        const char* path = "tile_codec_report.tmp";
+        {
+            std::ofstream out(path, std::ios::binary);
+            for (const std::vector<float>& tile : tiles)
+                out.write(reinterpret_cast<const char*>(tile.data()), tile.size() * sizeof(float));
+        }
+        std::vector<float> buffer(tiles[0].size());
+        auto start = std::chrono::high_resolution_clock::now();
+        std::ifstream in(path, std::ios::binary);
+        for (size_t t = 0; t < tiles.size(); t++)
+            in.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(float));
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        in.close();
+        std::remove(path);
+        std::cout << "  raw file read: " << rawBytes / seconds / 1e9 << " GB/s" << std::endl;
+    }
+
+    const float errors[] = { 0.0f, 0.001f, 0.01f, 0.05f };
+    for (float maxError : errors) {
+        std::vector<std::vector<uint8_t>> encoded;
+        size_t encodedBytes = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const std::vector<float>& tile : tiles) {
+            encoded.push_back(encodeHeightTile(tile.data(), tileSide, tileSide, maxError));
+            encodedBytes += encoded.back().size();
+        }
+        double encodeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::vector<float> decoded(tiles[0].size());
+        float worstError = 0.0f;
+        int repeats = 20;
+        start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            for (size_t t = 0; t < tiles.size(); t++) {
+                decodeHeightTile(encoded[t].data(), encoded[t].size(), decoded.data());
+                if (r == 0)
+                    for (size_t i = 0; i < decoded.size(); i++)
+                        worstError = std::max(worstError, std::fabs(decoded[i] - tiles[t][i]));
+            }
+        }
+        double decodeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+
+        std::cout << "  " << (maxError == 0.0f ? "lossless" : "max error " + std::to_string(maxError)) << ": ratio "
+            << (double)rawBytes / encodedBytes << ":1, encode " << rawBytes / encodeSeconds / 1e9 << " GB/s, decode "
+            << rawBytes / decodeSeconds / 1e9 << " GB/s, worst error " << worstError << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef TILED_PLANE_H
+#define TILED_PLANE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include "thread_pool.h"
+#include "heightfield.h"
+#include "smoothing.h"
+
+// Tiled storage for terrain planes: 64x64 tiles stored one after another, row-major inside a
+// tile. A 3x3 (or wider) neighbourhood then touches at most four tiles instead of rows a
+// whole plane width apart, and a tile plus its apron fits in L1/L2.
+// Edge tiles are padded to the full tile size; padding cells are never read or written.
+template<typename T>
+class TiledPlane
+{
+public:
+    static const int TILE_SHIFT = 6;
+    static const int TILE_SIZE = 1 << TILE_SHIFT;
+    static const int TILE_MASK = TILE_SIZE - 1;
+    static const int TILE_CELLS = TILE_SIZE * TILE_SIZE;
+
+    TiledPlane() {}
+
+    TiledPlane(int width, int height)
+        : w(width), h(height), tilesX((width + TILE_MASK) >> TILE_SHIFT), tilesZ((height + TILE_MASK) >> TILE_SHIFT)
+    {
+        cells.assign((size_t)tilesX * tilesZ * TILE_CELLS, T());
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int tileCountX() const { return tilesX; }
+    int tileCountZ() const { return tilesZ; }
+    int tileWidth(int tx) const { return std::min(TILE_SIZE, w - (tx << TILE_SHIFT)); }
+    int tileHeight(int tz) const { return std::min(TILE_SIZE, h - (tz << TILE_SHIFT)); }
+
+    size_t offset(int x, int z) const
+    {
+        size_t tile = (size_t)(z >> TILE_SHIFT) * tilesX + (x >> TILE_SHIFT);
+        return (tile << (2 * TILE_SHIFT)) + ((z & TILE_MASK) << TILE_SHIFT) + (x & TILE_MASK);
+    }
+
+    T& at(int x, int z) { return cells[offset(x, z)]; }
+    const T& at(int x, int z) const { return cells[offset(x, z)]; }
+
+    // TILE_SIZE * TILE_SIZE cells, row-major
+    T* tileData(int tx, int tz) { return &cells[((size_t)tz * tilesX + tx) * TILE_CELLS]; }
+    const T* tileData(int tx, int tz) const { return &cells[((size_t)tz * tilesX + tx) * TILE_CELLS]; }
+
+    static TiledPlane fromRowMajor(const T* source, int width, int height, ThreadPool& pool = globalThreadPool())
+    {
+        TiledPlane plane(width, height);
+        pool.parallelFor(plane.tilesZ, 1, [&](int tzBegin, int tzEnd) {
+            for (int tz = tzBegin; tz < tzEnd; tz++)
+                for (int tx = 0; tx < plane.tilesX; tx++) {
+                    T* tile = plane.tileData(tx, tz);
+                    int x0 = tx << TILE_SHIFT, z0 = tz << TILE_SHIFT;
+                    for (int z = 0; z < plane.tileHeight(tz); z++)
+                        std::copy_n(source + (size_t)(z0 + z) * width + x0, plane.tileWidth(tx), tile + (z << TILE_SHIFT));
+                }
+        });
+        return plane;
+    }
+
+    // Row-major copy for upload or for the row-major passes
+    void toRowMajor(T* destination, ThreadPool& pool = globalThreadPool()) const
+    {
+        pool.parallelFor(tilesZ, 1, [&](int tzBegin, int tzEnd) {
+            for (int tz = tzBegin; tz < tzEnd; tz++)
+                for (int tx = 0; tx < tilesX; tx++) {
+                    const T* tile = tileData(tx, tz);
+                    int x0 = tx << TILE_SHIFT, z0 = tz << TILE_SHIFT;
+                    for (int z = 0; z < tileHeight(tz); z++)
+                        std::copy_n(tile + (z << TILE_SHIFT), tileWidth(tx), destination + (size_t)(z0 + z) * w + x0);
+                }
+        });
+    }
+
+    // Copy tile (tx, tz) and `apron` cells around it into `out`, a row-major block of
+    // (TILE_SIZE + 2 * apron)^2 cells. Coordinates outside the plane are clamped to the edge.
+    void gatherTile(int tx, int tz, int apron, T* out) const
+    {
+        int stride = TILE_SIZE + 2 * apron;
+        int x0 = (tx << TILE_SHIFT) - apron, z0 = (tz << TILE_SHIFT) - apron;
+        for (int z = 0; z < stride; z++) {
+            int sz = std::min(std::max(z0 + z, 0), h - 1);
+            for (int x = 0; x < stride;) {
+                int sx = std::min(std::max(x0 + x, 0), w - 1);
+                // Copy the run that stays inside one source tile
+                int run = 1;
+                if (x0 + x >= 0 && x0 + x < w)
+                    run = std::min(stride - x, std::min(TILE_SIZE - (sx & TILE_MASK), w - sx));
+                const T* src = &cells[offset(sx, sz)];
+                std::copy_n(src, run, out + (size_t)z * stride + x);
+                x += run;
+            }
+        }
+    }
+
+    // Clamped access around one cell, hiding tile boundaries
+    class Neighbourhood
+    {
+    public:
+        Neighbourhood(const TiledPlane& plane, int x, int z) : plane(plane), x(x), z(z) {}
+        bool inside(int dx, int dz) const
+        {
+            return x + dx >= 0 && x + dx < plane.w && z + dz >= 0 && z + dz < plane.h;
+        }
+        const T& operator()(int dx, int dz) const
+        {
+            return plane.at(std::min(std::max(x + dx, 0), plane.w - 1), std::min(std::max(z + dz, 0), plane.h - 1));
+        }
+    private:
+        const TiledPlane& plane;
+        int x, z;
+    };
+
+    Neighbourhood neighbourhood(int x, int z) const { return Neighbourhood(*this, x, z); }
+
+    // Visits cells in storage order (tile by tile), skipping the padding of edge tiles
+    class iterator
+    {
+    public:
+        iterator(TiledPlane* plane, size_t index) : plane(plane), index(index) { skipPadding(); }
+        T& operator*() const { return plane->cells[index]; }
+        int x() const { return (int)((tile() % plane->tilesX) << TILE_SHIFT) + (int)(index & TILE_MASK); }
+        int z() const { return (int)((tile() / plane->tilesX) << TILE_SHIFT) + (int)((index >> TILE_SHIFT) & TILE_MASK); }
+        iterator& operator++() { index++; skipPadding(); return *this; }
+        bool operator==(const iterator& other) const { return index == other.index; }
+        bool operator!=(const iterator& other) const { return index != other.index; }
+    private:
+        size_t tile() const { return index >> (2 * TILE_SHIFT); }
+        void skipPadding()
+        {
+            while (index < plane->cells.size() && (x() >= plane->w || z() >= plane->h))
+                index++;
+        }
+        TiledPlane* plane;
+        size_t index;
+    };
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, cells.size()); }
+
+    size_t memoryBytes() const { return cells.capacity() * sizeof(T); }
+
+private:
+    int w = 0, h = 0;
+    int tilesX = 0, tilesZ = 0;
+    std::vector<T> cells;
+};
+
+// Height and biome planes of a Heightfield in tiled layout
+struct TiledHeightfield {
+    TiledPlane<float> heights;
+    TiledPlane<uint8_t> biomes;
+
+    static TiledHeightfield fromHeightfield(const Heightfield& heightfield, ThreadPool& pool = globalThreadPool())
+    {
+        TiledHeightfield tiled;
+        std::vector<float> decoded = heightfield.decodeHeights();
+        tiled.heights = TiledPlane<float>::fromRowMajor(decoded.data(), heightfield.width(), heightfield.height(), pool);
+        tiled.biomes = TiledPlane<uint8_t>::fromRowMajor(heightfield.biomePlane().data(), heightfield.width(), heightfield.height(), pool);
+        return tiled;
+    }
+
+    Heightfield toHeightfield(ThreadPool& pool = globalThreadPool()) const
+    {
+        Heightfield heightfield(heights.width(), heights.height());
+        heights.toRowMajor(heightfield.heightPlane().data(), pool);
+        biomes.toRowMajor(heightfield.biomePlane().data(), pool);
+        return heightfield;
+    }
+};
+
+// One pass of smoothHeights' 3x3 box on a tiled plane, bit-identical to SMOOTH_BOX_EXACT.
+// Tiles away from the plane edge run on a gathered block with a one cell apron.
+void smoothBoxExactTiled(const TiledPlane<float>& in, TiledPlane<float>& out, ThreadPool& pool = globalThreadPool()) {
+    const int S = TiledPlane<float>::TILE_SIZE, stride = S + 2;
+    int tilesX = in.tileCountX(), tilesZ = in.tileCountZ();
+    pool.parallelFor(tilesX * tilesZ, 4, [&](int begin, int end) {
+        std::vector<float> block((size_t)stride * stride);
+        for (int t = begin; t < end; t++) {
+            int tx = t % tilesX, tz = t / tilesX;
+            int x0 = tx * S, z0 = tz * S;
+            float* dst = out.tileData(tx, tz);
+            bool edgeTile = x0 == 0 || z0 == 0 || x0 + S >= in.width() || z0 + S >= in.height();
+
+            if (edgeTile) {
+                for (int lz = 0; lz < in.tileHeight(tz); lz++)
+                    for (int lx = 0; lx < in.tileWidth(tx); lx++) {
+                        TiledPlane<float>::Neighbourhood n = in.neighbourhood(x0 + lx, z0 + lz);
+                        float sum = 0.0f;
+                        int count = 0;
+                        for (int dz = -1; dz <= 1; dz++)
+                            for (int dx = -1; dx <= 1; dx++)
+                                if (n.inside(dx, dz)) {
+                                    sum += n(dx, dz);
+                                    count++;
+                                }
+                        dst[lz * S + lx] = sum / count;
+                    }
+                continue;
+            }
+
+            in.gatherTile(tx, tz, 1, block.data());
+            for (int lz = 0; lz < S; lz++) {
+                const float* up = &block[(size_t)lz * stride + 1];
+                const float* mid = up + stride;
+                const float* down = mid + stride;
+                for (int lx = 0; lx < S; lx++) {
+                    float sum = 0.0f;
+                    sum += up[lx - 1]; sum += up[lx]; sum += up[lx + 1];
+                    sum += mid[lx - 1]; sum += mid[lx]; sum += mid[lx + 1];
+                    sum += down[lx - 1]; sum += down[lx]; sum += down[lx + 1];
+                    dst[lz * S + lx] = sum / 9.0f;
+                }
+            }
+        }
+    });
+}
+
+// Central-difference normal with clamped neighbours, shared by both layouts
+glm::vec3 heightNormal(float left, float right, float down, float up) {
+    return glm::normalize(glm::vec3(left - right, 2.0f, down - up));
+}
+
+void computeNormalsTiled(const TiledPlane<float>& heights, TiledPlane<glm::vec3>& normals, ThreadPool& pool = globalThreadPool()) {
+    const int S = TiledPlane<float>::TILE_SIZE, stride = S + 2;
+    int tilesX = heights.tileCountX(), tilesZ = heights.tileCountZ();
+    pool.parallelFor(tilesX * tilesZ, 4, [&](int begin, int end) {
+        std::vector<float> block((size_t)stride * stride);
+        for (int t = begin; t < end; t++) {
+            int tx = t % tilesX, tz = t / tilesX;
+            heights.gatherTile(tx, tz, 1, block.data());
+            glm::vec3* dst = normals.tileData(tx, tz);
+            for (int lz = 0; lz < heights.tileHeight(tz); lz++) {
+                const float* row = &block[(size_t)(lz + 1) * stride + 1];
+                for (int lx = 0; lx < heights.tileWidth(tx); lx++)
+                    dst[lz * S + lx] = heightNormal(row[lx - 1], row[lx + 1], row[lx - stride], row[lx + stride]);
+            }
+        }
+    });
+}
+
+void computeNormalsRowMajor(const std::vector<float>& heights, int width, int height, std::vector<glm::vec3>& normals,
+    ThreadPool& pool = globalThreadPool()) {
+    normals.resize(heights.size());
+    pool.parallelFor(height, 16, [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            const float* row = &heights[(size_t)z * width];
+            const float* up = &heights[(size_t)std::max(z - 1, 0) * width];
+            const float* down = &heights[(size_t)std::min(z + 1, height - 1) * width];
+            glm::vec3* dst = &normals[(size_t)z * width];
+            dst[0] = heightNormal(row[0], row[std::min(1, width - 1)], up[0], down[0]);
+            for (int x = 1; x < width - 1; x++)
+                dst[x] = heightNormal(row[x - 1], row[x + 1], up[x], down[x]);
+            if (width > 1)
+                dst[width - 1] = heightNormal(row[width - 2], row[width - 1], up[width - 1], down[width - 1]);
+        }
+    });
+}
+
+// Times one smoothing pass and the normal pass in both layouts for each grid size and checks
+// that every output cell agrees. Both normal planes are held at once for the check, so the peak
+// is about 28 bytes per cell: 450 MB at 4096^2, 7.5 GB at 16384^2. Larger sizes are opt-in.
+void runTiledLayoutReport(const std::vector<int>& sizes = { 4096 }) {
+    typedef std::chrono::high_resolution_clock Clock;
+    auto ms = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+    std::cout << "Tiled layout report, " << globalThreadPool().size() << " threads" << std::endl;
+    for (int n : sizes) {
+        std::vector<float> source((size_t)n * n);
+        for (int z = 0; z < n; z++)
+            for (int x = 0; x < n; x++)
+                source[(size_t)z * n + x] = 40.0f * std::sin(x * 0.01f) * std::cos(z * 0.013f) + (float)((x * 7 + z * 13) & 15);
+
+        // Smoothing, row-major then tiled. Outputs are allocated inside the timed region in
+        // both layouts (smoothHeightPlane allocates its scratch plane).
+        SmoothingSettings box;
+        box.kernel = SMOOTH_BOX_EXACT;
+        box.passes = 1;
+        std::vector<float> smoothed = source;
+        Clock::time_point start = Clock::now();
+        smoothHeightPlane(smoothed, n, n, box);
+        double rowSmooth = ms(start);
+
+        start = Clock::now();
+        TiledPlane<float> tiled = TiledPlane<float>::fromRowMajor(source.data(), n, n);
+        double toTiled = ms(start);
+
+        start = Clock::now();
+        TiledPlane<float> tiledSmoothed(n, n);
+        smoothBoxExactTiled(tiled, tiledSmoothed);
+        double tiledSmooth = ms(start);
+
+        bool same = true;
+        for (auto it = tiledSmoothed.begin(); it != tiledSmoothed.end(); ++it)
+            same = same && *it == smoothed[(size_t)it.z() * n + it.x()];
+        start = Clock::now();
+        tiledSmoothed.toRowMajor(smoothed.data());
+        double toRowMajor = ms(start);
+        tiledSmoothed = TiledPlane<float>();
+        std::vector<float>().swap(smoothed);
+
+        // Normals, row-major then tiled
+        start = Clock::now();
+        std::vector<glm::vec3> normals;
+        computeNormalsRowMajor(source, n, n, normals);
+        double rowNormals = ms(start);
+        std::vector<float>().swap(source);
+
+        start = Clock::now();
+        TiledPlane<glm::vec3> tiledNormals(n, n);
+        computeNormalsTiled(tiled, tiledNormals);
+        double tiledNormalTime = ms(start);
+
+        for (auto it = tiledNormals.begin(); it != tiledNormals.end(); ++it)
+            same = same && *it == normals[(size_t)it.z() * n + it.x()];
+
+        std::cout << "  " << n << "x" << n << ": smoothing row-major " << rowSmooth << " ms, tiled " << tiledSmooth
+            << " ms; normals row-major " << rowNormals << " ms, tiled " << tiledNormalTime << " ms; conversion to tiled "
+            << toTiled << " ms, back " << toRowMajor << " ms" << (same ? "" : " (RESULTS DIFFER)") << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef VEGETATION_RENDERER_H
+#define VEGETATION_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <shader_m.h>
+#include "heightfield.h"
+#include "scatter.h"
+#include "terrain_gpu.h"
+#include "cdlod_terrain.h"
+
+// Draws ScatterInstances (scatter.h) with vegetation.vs / vegetation.fs. Each kind is one small
+// flat-shaded mesh. The instances live in one static buffer, uploaded once per scatter, and each
+// visible (chunk, kind) pair is a glDrawElementsInstanced over its slice of that buffer. Per frame
+// the CPU only tests chunk bounds against the frustum and each kind's draw distance. The shader
+// takes heights from the terrain's height texture, so edits and a rising sea need no re-upload.
+
+struct VegetationStats {
+    int chunksDrawn = 0;
+    int chunksCulled = 0;
+    int drawCalls = 0;
+    uint64_t instancesDrawn = 0;
+    size_t gpuBytes = 0;
+};
+
+class VegetationRenderer
+{
+public:
+    VegetationRenderer() {}
+    ~VegetationRenderer() { release(); }
+    VegetationRenderer(const VegetationRenderer&) = delete;
+    VegetationRenderer& operator=(const VegetationRenderer&) = delete;
+
+    bool ready() const { return !chunks.empty(); }
+    const VegetationStats& getStats() const { return stats; }
+    // Of the last upload
+    const ScatterStats& scatterStats() const { return uploadedStats; }
+    uint64_t instanceCount() const { return uploadedInstances; }
+
+    // Replaces the instances; an empty scatter (a preview, or scattering off) draws nothing. The
+    // buffer only grows, so re-scattering at a similar density reuses its storage.
+    void upload(const ScatterInstances& scatter, const Heightfield& heightfield)
+    {
+        chunks.clear();
+        uploadedStats = scatter.stats;
+        uploadedInstances = scatter.instances.size();
+        if (scatter.empty()) return;
+        if (!meshVAO) buildMeshes();
+
+        origin = glm::vec2(heightfield.worldX(0), heightfield.worldZ(0));
+        spacing = heightfield.spacing();
+        chunkWorldSize = scatter.chunkSize * spacing;
+        chunks = scatter.chunks;
+
+        size_t bytes = scatter.instances.size() * sizeof(ScatterInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (bytes > instanceCapacity) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, scatter.instances.data(), GL_STATIC_DRAW);
+            instanceCapacity = bytes;
+        }
+        else {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, scatter.instances.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        visible.reserve(chunks.size());
+        stats.gpuBytes = instanceCapacity + meshBytes;
+    }
+
+    // Draws everything within each kind's draw distance. heights is the terrain's height texture
+    // (CdlodTerrain::heights()); view, projection and the light uniforms are set by the caller.
+    void draw(const Shader& shader, const HeightmapTexture& heights, const ScatterSettings& settings,
+        const glm::mat4& viewProjection, const glm::vec3& cameraPos, float seaLevel)
+    {
+        stats.chunksDrawn = stats.chunksCulled = stats.drawCalls = 0;
+        stats.instancesDrawn = 0;
+        if (!ready() || !heights.id()) return;
+
+        // Chunks in the frustum, with their boxes raised by the tallest instance
+        float tallest = 0.0f;
+        for (int kind = 0; kind < SCATTER_KIND_COUNT; kind++)
+            tallest = std::max(tallest, meshes[kind].height * settings.layers[kind].maxScale);
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        visible.clear();
+        for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+            glm::vec3 boxMin, boxMax;
+            chunkBox(chunks[chunk], tallest, boxMin, boxMax);
+            if (frustum.intersectsBox(boxMin, boxMax)) visible.push_back((uint32_t)chunk);
+            else stats.chunksCulled++;
+        }
+
+        shader.use();
+        heights.bind(shader, 3);
+        shader.setVec3("u_cameraPos", cameraPos);
+        shader.setFloat("seaLevel", seaLevel);
+        shader.setFloat("u_shoreMargin", settings.shoreMargin);
+        shader.setFloat("u_chunkSize", chunkWorldSize);
+        glBindVertexArray(meshVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int kind = 0; kind < SCATTER_KIND_COUNT; kind++) {
+            const ScatterLayer& layer = settings.layers[kind];
+            shader.setVec2("u_scaleRange", glm::vec2(layer.minScale, layer.maxScale));
+            shader.setFloat("u_drawDistance", layer.drawDistance);
+            for (uint32_t chunk : visible) {
+                const ScatterChunk& bounds = chunks[chunk];
+                uint32_t count = bounds.count[kind];
+                if (!count) continue;
+                glm::vec3 boxMin, boxMax;
+                chunkBox(bounds, meshes[kind].height * layer.maxScale, boxMin, boxMax);
+                glm::vec3 closest = glm::clamp(cameraPos, boxMin, boxMax);
+                if (glm::dot(closest - cameraPos, closest - cameraPos) > layer.drawDistance * layer.drawDistance) continue;
+
+                // Point the per-instance attributes at this chunk's slice
+                size_t offset = (size_t)bounds.first[kind] * sizeof(ScatterInstance);
+                glVertexAttribPointer(3, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(ScatterInstance), (void*)offset);
+                glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ScatterInstance), (void*)(offset + 4));
+                shader.setVec2("u_chunkOrigin", origin + glm::vec2((float)bounds.x0, (float)bounds.z0) * spacing);
+                glDrawElementsInstanced(GL_TRIANGLES, meshes[kind].indexCount, GL_UNSIGNED_INT,
+                    (void*)(meshes[kind].firstIndex * sizeof(unsigned int)), (GLsizei)count);
+                stats.drawCalls++;
+                stats.instancesDrawn += count;
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        stats.chunksDrawn = (int)visible.size();
+    }
+
+    // Drops the instances; the meshes stay for the next upload
+    void clear()
+    {
+        chunks.clear();
+        uploadedInstances = 0;
+        uploadedStats = ScatterStats();
+    }
+
+    void release()
+    {
+        if (meshVAO) glDeleteVertexArrays(1, &meshVAO);
+        GLuint buffers[] = { meshVBO, meshEBO, instanceVBO };
+        for (GLuint buffer : buffers)
+            if (buffer) glDeleteBuffers(1, &buffer);
+        meshVAO = meshVBO = meshEBO = instanceVBO = 0;
+        instanceCapacity = meshBytes = 0;
+        stats.gpuBytes = 0;
+        clear();
+    }
+
+private:
+    struct Mesh {
+        GLsizei firstIndex = 0, indexCount = 0;
+        float height = 0.0f;    // Top of the mesh at scale 1
+    };
+
+    // Position, normal, colour
+    struct MeshBuilder {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+
+        void triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& colour)
+        {
+            glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+            for (const glm::vec3& corner : { a, b, c }) {
+                indices.push_back((unsigned int)(vertices.size() / 9));
+                vertices.insert(vertices.end(), { corner.x, corner.y, corner.z, normal.x, normal.y, normal.z,
+                    colour.x, colour.y, colour.z });
+            }
+        }
+
+        // A closed cone (or prism when the top radius is non-zero) around the y axis
+        void frustumOfCone(float bottom, float top, float bottomRadius, float topRadius, int sides, const glm::vec3& colour)
+        {
+            for (int side = 0; side < sides; side++) {
+                float a0 = 6.28318531f * side / sides, a1 = 6.28318531f * (side + 1) / sides;
+                glm::vec3 b0(std::cos(a0) * bottomRadius, bottom, std::sin(a0) * bottomRadius);
+                glm::vec3 b1(std::cos(a1) * bottomRadius, bottom, std::sin(a1) * bottomRadius);
+                glm::vec3 t0(std::cos(a0) * topRadius, top, std::sin(a0) * topRadius);
+                glm::vec3 t1(std::cos(a1) * topRadius, top, std::sin(a1) * topRadius);
+                triangle(b0, t0, b1, colour);
+                if (topRadius > 0.0f) triangle(b1, t0, t1, colour);
+                triangle(glm::vec3(0.0f, bottom, 0.0f), b0, b1, colour);
+            }
+        }
+
+        // Octahedron split once into 32 faces, pushed out to `radii` with a per-vertex bump
+        void blob(const glm::vec3& radii, float lift, float roughness, uint32_t seed, const glm::vec3& colour)
+        {
+            const glm::vec3 axes[6] = { { 1, 0, 0 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 }, { 0, -1, 0 } };
+            auto shape = [&](glm::vec3 direction) {
+                direction = glm::normalize(direction);
+                uint32_t hash = seed;
+                for (float component : { direction.x, direction.y, direction.z })
+                    hash = (hash ^ (uint32_t)(int)std::floor(component * 1000.0f + 0.5f)) * 16777619u;
+                float bump = 1.0f + roughness * ((float)(hash >> 8 & 0xff) / 255.0f - 0.5f);
+                return direction * radii * bump + glm::vec3(0.0f, lift, 0.0f);
+            };
+            for (int pole = 4; pole <= 5; pole++)
+                for (int side = 0; side < 4; side++) {
+                    glm::vec3 p = axes[pole], a = axes[side], b = axes[(side + 1) % 4];
+                    if (pole == 5) std::swap(a, b);
+                    glm::vec3 pa = (p + a) * 0.5f, ab = (a + b) * 0.5f, bp = (b + p) * 0.5f;
+                    triangle(shape(p), shape(bp), shape(pa), colour);
+                    triangle(shape(pa), shape(ab), shape(a), colour);
+                    triangle(shape(pa), shape(bp), shape(ab), colour);
+                    triangle(shape(bp), shape(b), shape(ab), colour);
+                }
+        }
+    };
+
+    void buildMeshes()
+    {
+        MeshBuilder builder;
+        auto finish = [&](ScatterKind kind, size_t firstIndex) {
+            meshes[kind].firstIndex = (GLsizei)firstIndex;
+            meshes[kind].indexCount = (GLsizei)(builder.indices.size() - firstIndex);
+            meshes[kind].height = 0.0f;
+            for (size_t i = firstIndex; i < builder.indices.size(); i++)
+                meshes[kind].height = std::max(meshes[kind].height, builder.vertices[builder.indices[i] * 9 + 1]);
+        };
+
+        size_t first = builder.indices.size();
+        builder.frustumOfCone(-0.5f, 1.6f, 0.22f, 0.16f, 6, glm::vec3(0.35f, 0.24f, 0.14f));
+        builder.frustumOfCone(1.2f, 4.0f, 1.5f, 0.0f, 8, glm::vec3(0.13f, 0.36f, 0.12f));
+        builder.frustumOfCone(2.6f, 5.5f, 1.1f, 0.0f, 8, glm::vec3(0.16f, 0.42f, 0.14f));
+        finish(SCATTER_TREES, first);
+
+        first = builder.indices.size();
+        builder.blob(glm::vec3(1.0f, 0.7f, 1.0f), 0.35f, 0.3f, 7u, glm::vec3(0.24f, 0.42f, 0.16f));
+        finish(SCATTER_BUSHES, first);
+
+        first = builder.indices.size();
+        builder.blob(glm::vec3(0.9f, 0.55f, 0.8f), 0.15f, 0.5f, 31u, glm::vec3(0.45f, 0.43f, 0.4f));
+        finish(SCATTER_ROCKS, first);
+
+        glGenVertexArrays(1, &meshVAO);
+        glGenBuffers(1, &meshVBO);
+        glGenBuffers(1, &meshEBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(meshVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        glBufferData(GL_ARRAY_BUFFER, builder.vertices.size() * sizeof(float), builder.vertices.data(), GL_STATIC_DRAW);
+        for (int attribute = 0; attribute < 3; attribute++) {
+            glVertexAttribPointer(attribute, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(attribute * 3 * sizeof(float)));
+            glEnableVertexAttribArray(attribute);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, builder.indices.size() * sizeof(unsigned int), builder.indices.data(), GL_STATIC_DRAW);
+        // Per-instance position and variation; draw() points them at one chunk at a time
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(3, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(ScatterInstance), (void*)0);
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ScatterInstance), (void*)4);
+        glEnableVertexAttribArray(3);
+        glEnableVertexAttribArray(4);
+        glVertexAttribDivisor(3, 1);
+        glVertexAttribDivisor(4, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        meshBytes = builder.vertices.size() * sizeof(float) + builder.indices.size() * sizeof(unsigned int);
+    }
+
+    void chunkBox(const ScatterChunk& chunk, float instanceHeight, glm::vec3& boxMin, glm::vec3& boxMax) const
+    {
+        glm::vec2 corner = origin + glm::vec2((float)chunk.x0, (float)chunk.z0) * spacing;
+        boxMin = glm::vec3(corner.x, chunk.minHeight, corner.y);
+        boxMax = glm::vec3(corner.x + chunkWorldSize, chunk.maxHeight + instanceHeight, corner.y + chunkWorldSize);
+    }
+
+    Mesh meshes[SCATTER_KIND_COUNT];
+    std::vector<ScatterChunk> chunks;
+    std::vector<uint32_t> visible;      // Scratch for draw(), reserved on upload
+    glm::vec2 origin = glm::vec2(0.0f);
+    float spacing = 1.0f;
+    float chunkWorldSize = 0.0f;
+    ScatterStats uploadedStats;
+    uint64_t uploadedInstances = 0;
+    VegetationStats stats;
+
+    GLuint meshVAO = 0, meshVBO = 0, meshEBO = 0, instanceVBO = 0;
+    size_t instanceCapacity = 0;
+    size_t meshBytes = 0;
+};
+
+#endif
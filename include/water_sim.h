@@ -0,0 +1,255 @@
+#ifndef WATER_SIM_H
+#define WATER_SIM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WATER_SIM_SSE2 1
+#endif
+
+// Interactive ripple layer: a 2D wave equation on a square grid that sits on top of the
+// analytic sea waves. The grid is split into tiles; only tiles that carry energy (and their
+// direct neighbours) are stepped, so calm water costs nothing.
+class WaterSimulation
+{
+public:
+    static const int TILE_SIZE = 32;
+    static_assert(TILE_SIZE % 4 == 0, "stepTile's SSE2 loop covers whole rows of a tile");
+
+    float waveSpeed = 12.0f;        // Propagation speed in world units per second
+    float damping = 0.996f;         // Per-step energy loss
+    float fixedTimeStep = 1.0f / 120.0f;
+    int maxStepsPerFrame = 8;       // Prevents a slow frame from snowballing
+    float sleepThreshold = 0.0005f; // Tiles below this amplitude go to sleep
+
+    // gridSize must be a multiple of TILE_SIZE; the grid covers [origin, origin + extent] in xz
+    WaterSimulation(int gridSize, glm::vec2 origin, float extent)
+        : size(gridSize), origin(origin), extent(extent), stride(gridSize + 2)
+    {
+        tilesPerSide = size / TILE_SIZE;
+        cellSize = extent / size;
+        // One cell of zero padding all around keeps the stencil branch-free
+        current.assign(stride * stride, 0.0f);
+        previous.assign(stride * stride, 0.0f);
+        tileAwake.assign(tilesPerSide * tilesPerSide, 0);
+        tileQuietSteps.assign(tilesPerSide * tilesPerSide, 0);
+        clearDirty();
+    }
+
+    // Push the surface down around a world-space point with a smooth cosine bump
+    void disturb(float worldX, float worldZ, float radius, float strength)
+    {
+        float cx = (worldX - origin.x) / cellSize;
+        float cz = (worldZ - origin.y) / cellSize;
+        float r = std::max(radius / cellSize, 1.0f);
+
+        int x0 = std::max(0, (int)std::floor(cx - r)), x1 = std::min(size - 1, (int)std::ceil(cx + r));
+        int z0 = std::max(0, (int)std::floor(cz - r)), z1 = std::min(size - 1, (int)std::ceil(cz + r));
+        if (x0 > x1 || z0 > z1) return;
+
+        for (int z = z0; z <= z1; z++) {
+            for (int x = x0; x <= x1; x++) {
+                float d = std::sqrt((x - cx) * (x - cx) + (z - cz) * (z - cz)) / r;
+                if (d >= 1.0f) continue;
+                current[index(x, z)] -= strength * 0.5f * (1.0f + std::cos(d * 3.14159265f));
+            }
+        }
+
+        for (int tz = z0 / TILE_SIZE; tz <= z1 / TILE_SIZE; tz++)
+            for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++)
+                wakeTile(tx, tz);
+        markDirty(x0, z0, x1, z1);
+    }
+
+    // Advance by the frame delta in fixed steps. Returns the number of steps taken.
+    int update(float frameDelta)
+    {
+        accumulator += frameDelta;
+        int steps = 0;
+        while (accumulator >= fixedTimeStep && steps < maxStepsPerFrame) {
+            step();
+            accumulator -= fixedTimeStep;
+            steps++;
+        }
+        // Drop the backlog instead of trying to catch up on the next frame
+        if (steps == maxStepsPerFrame) accumulator = 0.0f;
+        return steps;
+    }
+
+    void step()
+    {
+        // Courant number for the 2D scheme, clamped below the stability limit of 0.5
+        float courant = waveSpeed * fixedTimeStep / cellSize;
+        float k = std::min(courant * courant, 0.49f);
+
+        // Step every awake tile plus its neighbours so waves can travel into sleeping water
+        stepList.clear();
+        for (int tz = 0; tz < tilesPerSide; tz++) {
+            for (int tx = 0; tx < tilesPerSide; tx++) {
+                bool near = false;
+                for (int dz = -1; dz <= 1 && !near; dz++)
+                    for (int dx = -1; dx <= 1 && !near; dx++)
+                        near = isAwake(tx + dx, tz + dz);
+                if (near) stepList.push_back(tz * tilesPerSide + tx);
+            }
+        }
+        if (stepList.empty()) return;
+
+        std::vector<unsigned char> nextAwake(tileAwake.size(), 0);
+        globalThreadPool().parallelFor((int)stepList.size(), 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int tile = stepList[i];
+                nextAwake[tile] = stepTile(tile % tilesPerSide, tile / tilesPerSide, k) ? 1 : 0;
+            }
+        });
+
+        // The new heights were written over `previous`, so swapping makes them current
+        std::swap(current, previous);
+
+        for (int tile : stepList) {
+            int tx = tile % tilesPerSide, tz = tile / tilesPerSide;
+            markDirty(tx * TILE_SIZE, tz * TILE_SIZE, tx * TILE_SIZE + TILE_SIZE - 1, tz * TILE_SIZE + TILE_SIZE - 1);
+            if (nextAwake[tile]) {
+                tileAwake[tile] = 1;
+                tileQuietSteps[tile] = 0;
+            }
+            else if (++tileQuietSteps[tile] > 16) {
+                sleepTile(tx, tz);
+            }
+        }
+    }
+
+    // R32F texture the sea vertex shader samples; call once after creating the GL context
+    void createTexture()
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        markDirty(0, 0, size - 1, size - 1);
+        uploadTexture();
+    }
+
+    // Upload only the rectangle touched since the last upload
+    void uploadTexture()
+    {
+        if (dirtyX1 < dirtyX0) return;
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, dirtyX0, dirtyZ0, dirtyX1 - dirtyX0 + 1, dirtyZ1 - dirtyZ0 + 1,
+            GL_RED, GL_FLOAT, &current[index(dirtyX0, dirtyZ0)]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        clearDirty();
+    }
+
+    int awakeTileCount() const
+    {
+        return (int)std::count(tileAwake.begin(), tileAwake.end(), (unsigned char)1);
+    }
+    int tileCount() const { return tilesPerSide * tilesPerSide; }
+
+    GLuint texture = 0;
+    int size;
+    glm::vec2 origin;
+    float extent;
+
+private:
+    int index(int x, int z) const { return (z + 1) * stride + (x + 1); }
+
+    bool isAwake(int tx, int tz) const
+    {
+        if (tx < 0 || tz < 0 || tx >= tilesPerSide || tz >= tilesPerSide) return false;
+        return tileAwake[tz * tilesPerSide + tx] != 0;
+    }
+
+    void wakeTile(int tx, int tz)
+    {
+        tileAwake[tz * tilesPerSide + tx] = 1;
+        tileQuietSteps[tz * tilesPerSide + tx] = 0;
+    }
+
+    // Flatten the tile completely so neighbours read exact zeros from it
+    void sleepTile(int tx, int tz)
+    {
+        for (int z = tz * TILE_SIZE; z < (tz + 1) * TILE_SIZE; z++) {
+            std::fill_n(&current[index(tx * TILE_SIZE, z)], TILE_SIZE, 0.0f);
+            std::fill_n(&previous[index(tx * TILE_SIZE, z)], TILE_SIZE, 0.0f);
+        }
+        tileAwake[tz * tilesPerSide + tx] = 0;
+        tileQuietSteps[tz * tilesPerSide + tx] = 0;
+    }
+
+    // Verlet step of the wave equation for one tile, writing the new heights into `previous`.
+    // Returns true if the tile still carries visible motion.
+    bool stepTile(int tx, int tz, float k)
+    {
+        float peak = 0.0f;
+        for (int z = tz * TILE_SIZE; z < (tz + 1) * TILE_SIZE; z++) {
+            const float* c = &current[index(tx * TILE_SIZE, z)];
+            float* p = &previous[index(tx * TILE_SIZE, z)];
+#ifdef WATER_SIM_SSE2
+            const __m128 vk = _mm_set1_ps(k);
+            const __m128 vFour = _mm_set1_ps(4.0f);
+            const __m128 vTwo = _mm_set1_ps(2.0f);
+            const __m128 vDamping = _mm_set1_ps(damping);
+            const __m128 vAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            __m128 vPeak = _mm_setzero_ps();
+            for (int x = 0; x < TILE_SIZE; x += 4) {
+                __m128 centre = _mm_loadu_ps(c + x);
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(c + x - 1), _mm_loadu_ps(c + x + 1)),
+                    _mm_add_ps(_mm_loadu_ps(c + x - stride), _mm_loadu_ps(c + x + stride)));
+                __m128 laplacian = _mm_sub_ps(sum, _mm_mul_ps(vFour, centre));
+                __m128 next = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(vTwo, centre), _mm_loadu_ps(p + x)), _mm_mul_ps(vk, laplacian));
+                next = _mm_mul_ps(next, vDamping);
+                _mm_storeu_ps(p + x, next);
+                vPeak = _mm_max_ps(vPeak, _mm_and_ps(next, vAbsMask));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, vPeak);
+            peak = std::max({ peak, lanes[0], lanes[1], lanes[2], lanes[3] });
+#else
+            for (int x = 0; x < TILE_SIZE; x++) {
+                float laplacian = c[x - 1] + c[x + 1] + c[x - stride] + c[x + stride] - 4.0f * c[x];
+                float next = (2.0f * c[x] - p[x] + k * laplacian) * damping;
+                p[x] = next;
+                peak = std::max(peak, std::fabs(next));
+            }
+#endif
+        }
+        return peak > sleepThreshold;
+    }
+
+    void markDirty(int x0, int z0, int x1, int z1)
+    {
+        dirtyX0 = std::min(dirtyX0, x0); dirtyZ0 = std::min(dirtyZ0, z0);
+        dirtyX1 = std::max(dirtyX1, x1); dirtyZ1 = std::max(dirtyZ1, z1);
+    }
+    void clearDirty() { dirtyX0 = dirtyZ0 = size; dirtyX1 = dirtyZ1 = -1; }
+
+    int stride;
+    int tilesPerSide;
+    float cellSize;
+    float accumulator = 0.0f;
+
+    std::vector<float> current;   // Heights at t
+    std::vector<float> previous;  // Heights at t - dt, overwritten with t + dt during a step
+    std::vector<unsigned char> tileAwake;
+    std::vector<int> tileQuietSteps;
+    std::vector<int> stepList;
+
+    int dirtyX0, dirtyZ0, dirtyX1, dirtyZ1;
+};
+
+#endif